@@ -0,0 +1,110 @@
+// Canvas overlay benchmark: draws the top bars and the main eval graph into a counting canvas
+// for a sweep of resolutions, smoothing windows and replay lengths.
+//
+//   bench_canvas [frames per case] [output.json]
+//
+// Reports ns/frame, draw calls/frame and the smoothing precompute cost as JSON on stdout
+// (and in output.json when given).
+#include "pch.h"
+#include "overlayrender.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    int framesPerCase = argc > 1 ? std::atoi(argv[1]) : 600;
+    framesPerCase = ClampInt(framesPerCase, 1, 100000);
+    const char* outPath = argc > 2 ? argv[2] : nullptr;
+
+    const CanvasPoint resolutions[] = { CanvasPoint(1280, 720), CanvasPoint(1920, 1080), CanvasPoint(2560, 1440), CanvasPoint(3840, 2160) };
+    const int smoothingWindows[] = { 0, 15, 60, 300 };
+    const int replayLengths[] = { 30 * 60 * 2, 30 * 60 * 5, 30 * 60 * 20 };
+
+    // Rendering at ~144 Hz against a 30 fps replay advances about 0.2 frames per render
+    const double positionStep = 30.0 / 144.0;
+
+    TopBarsElement topBars;
+    MainEvalDisplayElement mainEval;
+
+    std::string json = "{\"frames_per_case\":" + std::to_string(framesPerCase) + ",\"cases\":[";
+    bool first = true;
+
+    for (int numFrames : replayLengths)
+    {
+        std::vector<double> series = MakeSyntheticEvalSeries(numFrames);
+
+        for (int smoothing : smoothingWindows)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            const std::vector<float> smoothed = ComputeSmoothedSeries(series, smoothing);
+            auto t1 = std::chrono::steady_clock::now();
+            long long precomputeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+
+            for (const CanvasPoint& res : resolutions)
+            {
+                CountingCanvasTarget target;
+
+                RenderContext ctx;
+                ctx.canvas = &target;
+                ctx.evalSeries = &smoothed;
+                ctx.cfg.showTopBars = true;
+                ctx.cfg.showMainEval = true;
+                ctx.cfg.showMainBackground = true;
+                ctx.cfg.smoothingWindow = smoothing;
+
+                double position = 0.0;
+                double last = (double)(smoothed.size() - 1);
+
+                auto start = std::chrono::steady_clock::now();
+                for (int f = 0; f < framesPerCase; ++f)
+                {
+                    ctx.layout = ComputeLayout(res);
+                    ctx.playbackPosition = position;
+                    ctx.presentEval01 = InterpolatedEvalAt(smoothed, position);
+
+                    topBars.Render(ctx);
+                    mainEval.Render(ctx);
+
+                    position += positionStep;
+                    if (position > last) position = 0.0;
+                }
+                auto end = std::chrono::steady_clock::now();
+
+                long long totalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+                char line[320];
+                snprintf(line, sizeof(line),
+                    "%s{\"width\":%d,\"height\":%d,\"smoothing\":%d,\"replay_frames\":%d,"
+                    "\"ns_per_frame\":%.1f,\"draw_calls_per_frame\":%.1f,\"canvas_calls_per_frame\":%.1f,"
+                    "\"precompute_ns\":%lld,\"checksum\":%lld}",
+                    first ? "" : ",", res.X, res.Y, smoothing, numFrames,
+                    (double)totalNs / framesPerCase,
+                    (double)target.DrawCalls() / framesPerCase,
+                    (double)target.TotalCalls() / framesPerCase,
+                    precomputeNs, target.checksum);
+                json += line;
+                first = false;
+            }
+        }
+    }
+
+    json += "]}";
+
+    printf("%s\n", json.c_str());
+    if (outPath)
+    {
+        FILE* out = fopen(outPath, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "bench_canvas: could not write %s\n", outPath);
+            return 1;
+        }
+        fwrite(json.data(), 1, json.size(), out);
+        fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Row stream decoder benchmark: decodes a synthetic stream fed in pipe-sized chunks into a
+// RowStreamBuffer, for several widths, and parses the same data written as CSV, which is the
+// text round trip the stream replaces.
+//
+//   bench_rowstream [rows] [output.json]
+//
+// Reports ms, MB/s and rows/s per case as JSON on stdout (and in output.json when given).
+#include "pch.h"
+#include "csvparser.h"
+#include "overlayrender.h"
+#include "rowstream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    int rows = argc > 1 ? std::atoi(argv[1]) : 30 * 60 * 20;
+    rows = ClampInt(rows, 1, 10000000);
+    const char* outPath = argc > 2 ? argv[2] : nullptr;
+
+    const int columnCounts[] = { 3, 8, 32 };
+    const size_t chunkSizes[] = { 512, 4096, 65536 };
+    const int rowsPerFrame = 256;
+
+    std::string json = "{\"rows\":" + std::to_string(rows) + ",\"cases\":[";
+    bool first = true;
+    bool allOk = true;
+
+    for (int columns : columnCounts)
+    {
+        std::vector<double> base = MakeSyntheticEvalSeries(rows);
+        std::vector<float> data((size_t)rows * columns);
+        for (int r = 0; r < rows; ++r)
+            for (int c = 0; c < columns; ++c)
+                data[(size_t)r * columns + c] = (float)(c % 2 ? 1.0 - base[r] : base[r]);
+
+        std::string stream;
+        AppendRowStreamHeader(stream, columns, rows);
+        for (int r = 0; r < rows; r += rowsPerFrame)
+            AppendRowStreamRows(stream, data.data() + (size_t)r * columns, (std::min)(rowsPerFrame, rows - r), columns);
+        AppendRowStreamEnd(stream, rows);
+
+        for (size_t chunk : chunkSizes)
+        {
+            RowStreamBuffer buffer;
+            std::vector<std::vector<double>> decoded;
+            int width = 0;
+            RowStreamDecoder decoder(
+                [&](int cols, int) { width = cols; },
+                [&](const float* r, int n) { buffer.Push(r, n, width); });
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t pos = 0; pos < stream.size(); pos += chunk)
+                decoder.Feed(std::string_view(stream).substr(pos, chunk));
+            buffer.Drain(decoded);
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            double seconds = (std::max)(ns, 1LL) / 1e9;
+
+            bool ok = decoder.Finished() && decoded.size() == (size_t)columns && decoded[0].size() == (size_t)rows;
+            allOk = allOk && ok;
+
+            char line[320];
+            snprintf(line, sizeof(line),
+                "%s{\"format\":\"rowstream\",\"columns\":%d,\"chunk_bytes\":%zu,\"bytes\":%zu,\"ms\":%.3f,"
+                "\"mb_per_s\":%.1f,\"rows_per_s\":%.0f,\"ok\":%s}",
+                first ? "" : ",", columns, chunk, stream.size(), ns / 1e6,
+                stream.size() / 1e6 / seconds, rows / seconds, ok ? "true" : "false");
+            json += line;
+            first = false;
+        }
+
+        // the text round trip this replaces: applet writes a CSV, plugin reads and parses it
+        auto csvPath = std::filesystem::temp_directory_path() / "bench_rowstream.csv";
+        {
+            std::ofstream out(csvPath, std::ios::binary | std::ios::trunc);
+            for (int c = 0; c < columns; ++c)
+                out << (c ? "," : "") << "c" << c;
+            out << "\n";
+            for (int r = 0; r < rows; ++r)
+            {
+                for (int c = 0; c < columns; ++c)
+                    out << (c ? "," : "") << data[(size_t)r * columns + c];
+                out << "\n";
+            }
+        }
+        std::error_code ec;
+        auto csvBytes = std::filesystem::file_size(csvPath, ec);
+
+        auto start = std::chrono::steady_clock::now();
+        auto parsed = csvparser(csvPath);
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        double seconds = (std::max)(ns, 1LL) / 1e9;
+        std::filesystem::remove(csvPath, ec);
+
+        bool ok = parsed.size() == (size_t)columns && parsed[0].size() == (size_t)rows;
+        allOk = allOk && ok;
+
+        char line[320];
+        snprintf(line, sizeof(line),
+            ",{\"format\":\"csv\",\"columns\":%d,\"bytes\":%llu,\"ms\":%.3f,"
+            "\"mb_per_s\":%.1f,\"rows_per_s\":%.0f,\"ok\":%s}",
+            columns, (unsigned long long)csvBytes, ns / 1e6,
+            csvBytes / 1e6 / seconds, rows / seconds, ok ? "true" : "false");
+        json += line;
+    }
+
+    json += "]}";
+
+    printf("%s\n", json.c_str());
+    if (outPath)
+    {
+        FILE* out = fopen(outPath, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "bench_rowstream: could not write %s\n", outPath);
+            return 1;
+        }
+        fwrite(json.data(), 1, json.size(), out);
+        fclose(out);
+    }
+    return allOk ? 0 : 1;
+}
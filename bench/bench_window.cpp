@@ -0,0 +1,139 @@
+// Window benchmark: renders the window's two eval graphs in a backend-less ImGui context over
+// synthetic datasets of several replay lengths.
+//
+//   bench_window [frames per case] [output.json]
+//
+// Reports ns/frame, draw-list vertices and indices per frame and ImGui allocations per frame
+// as JSON on stdout (and in output.json when given). The settings page needs the BakkesMod
+// SDK's cvars, so it is not part of this benchmark.
+#include "pch.h"
+#include "evalgraph.h"
+#include "overlayrender.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// ImGui allocations made while a case runs
+struct ImGuiAllocCounters
+{
+    long long allocs = 0;
+    long long frees = 0;
+    long long bytes = 0;
+};
+
+static ImGuiAllocCounters allocCounters;
+
+static void* CountingImGuiAlloc(size_t size, void*)
+{
+    ++allocCounters.allocs;
+    allocCounters.bytes += (long long)size;
+    return malloc(size);
+}
+
+static void CountingImGuiFree(void* ptr, void*)
+{
+    if (ptr) ++allocCounters.frees;
+    free(ptr);
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? std::atoi(argv[1]) : 300;
+    frames = ClampInt(frames, 1, 100000);
+    const char* outPath = argc > 2 ? argv[2] : nullptr;
+
+    const int replayLengths[] = { 30 * 60 * 2, 30 * 60 * 5, 30 * 60 * 20 };
+
+    ImGui::SetAllocatorFunctions(CountingImGuiAlloc, CountingImGuiFree);
+    ImGui::CreateContext();
+    {
+        ImGuiIO& io = ImGui::GetIO();
+        io.IniFilename = nullptr;
+        io.LogFilename = nullptr;
+        io.DisplaySize = ImVec2(1920.0f, 1080.0f);
+        io.DeltaTime = 1.0f / 144.0f;
+
+        unsigned char* pixels = nullptr;
+        int texW = 0, texH = 0;
+        io.Fonts->GetTexDataAsRGBA32(&pixels, &texW, &texH); // no renderer, only needs to be built
+    }
+
+    std::string json = "{\"frames_per_case\":" + std::to_string(frames) + ",\"cases\":[";
+    bool first = true;
+
+    for (int numFrames : replayLengths)
+    {
+        std::vector<double> evalSeries = MakeSyntheticEvalSeries(numFrames);
+        std::vector<double> immSeries(evalSeries.size());
+        for (size_t i = 0; i < evalSeries.size(); ++i)
+            immSeries[i] = evalSeries[i] * evalSeries[i];
+
+        long long vtxTotal = 0;
+        long long idxTotal = 0;
+        allocCounters = ImGuiAllocCounters{};
+
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f)
+        {
+            int currentframe = (f * 7) % numFrames;
+
+            ImGui::NewFrame();
+            ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+            ImGui::SetNextWindowSize(ImVec2(1920.0f, 1080.0f));
+            ImGui::Begin("neuRLcar bench", nullptr, ImGuiWindowFlags_NoSavedSettings);
+
+            ImGui::Text("eval of current frame, 0 blue is winning, 1 orange is winning: %.4f", evalSeries[currentframe]);
+            RenderEvalGraph("##eval_graph", evalSeries, currentframe);
+            ImGui::Text("probability <3seconds (90 frames) until a goal: %.4f", immSeries[currentframe]);
+            RenderEvalGraph("##imm_graph", immSeries, currentframe, IM_COL32(255, 255, 255, 255), IM_COL32(0, 0, 0, 255));
+
+            ImGui::End();
+            ImGui::Render();
+
+            ImDrawData* drawData = ImGui::GetDrawData();
+            if (drawData)
+            {
+                vtxTotal += drawData->TotalVtxCount;
+                idxTotal += drawData->TotalIdxCount;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        long long totalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        char line[256];
+        snprintf(line, sizeof(line),
+            "%s{\"replay_frames\":%d,\"ns_per_frame\":%.1f,"
+            "\"vertices_per_frame\":%.1f,\"indices_per_frame\":%.1f,"
+            "\"allocs_per_frame\":%.2f,\"alloc_bytes_per_frame\":%.1f}",
+            first ? "" : ",", numFrames,
+            (double)totalNs / frames,
+            (double)vtxTotal / frames,
+            (double)idxTotal / frames,
+            (double)allocCounters.allocs / frames,
+            (double)allocCounters.bytes / frames);
+        json += line;
+        first = false;
+    }
+
+    json += "]}";
+
+    ImGui::DestroyContext();
+
+    printf("%s\n", json.c_str());
+    if (outPath)
+    {
+        FILE* out = fopen(outPath, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "bench_window: could not write %s\n", outPath);
+            return 1;
+        }
+        fwrite(json.data(), 1, json.size(), out);
+        fclose(out);
+    }
+    return 0;
+}
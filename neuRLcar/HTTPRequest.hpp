@@ -1213,7 +1213,7 @@ namespace http
                     // Empty line indicates the end of the header section (RFC 7230, 2.1. Client/Server Messaging)
                     const auto endIterator = std::search(responseData.cbegin(), responseData.cend(),
                                                          headerEnd.cbegin(), headerEnd.cend());
-                    if (endIterator == responseData.cend()) break; // two consecutive CRLFs not found
+                    if (endIterator == responseData.cend()) continue; // two consecutive CRLFs not found yet
 
                     const auto headerBeginIterator = responseData.cbegin();
                     const auto headerEndIterator = endIterator + 2;
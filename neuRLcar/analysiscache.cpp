@@ -0,0 +1,491 @@
+#include "pch.h"
+#include "analysiscache.h"
+#include "mappedfile.h"
+#include "modelmanifest.h"
+#include "rowstream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+static constexpr size_t kHashSliceBytes = 1u << 20;
+static constexpr auto kFingerprintTtl = std::chrono::seconds(5);
+
+static uint64_t Rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+// both plugin targets are little-endian
+static uint64_t Read64(const unsigned char* p)
+{
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t Read32(const unsigned char* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input)
+{
+	acc += input * kPrime2;
+	return Rotl(acc, 31) * kPrime1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t v)
+{
+	acc ^= Round(0, v);
+	return acc * kPrime1 + kPrime4;
+}
+
+ContentHasher::ContentHasher()
+	: v_{ kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1 }
+{
+}
+
+void ContentHasher::Update(const void* data, size_t size)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	total_ += size;
+
+	if (buffered_ + size < sizeof(buffer_))
+	{
+		if (size)
+			std::memcpy(buffer_ + buffered_, p, size);
+		buffered_ += size;
+		return;
+	}
+
+	if (buffered_)
+	{
+		size_t fill = sizeof(buffer_) - buffered_;
+		std::memcpy(buffer_ + buffered_, p, fill);
+		for (int i = 0; i < 4; ++i)
+			v_[i] = Round(v_[i], Read64(buffer_ + i * 8));
+		p += fill;
+		size -= fill;
+		buffered_ = 0;
+	}
+
+	const unsigned char* end = p + size;
+	while (end - p >= 32)
+	{
+		v_[0] = Round(v_[0], Read64(p));
+		v_[1] = Round(v_[1], Read64(p + 8));
+		v_[2] = Round(v_[2], Read64(p + 16));
+		v_[3] = Round(v_[3], Read64(p + 24));
+		p += 32;
+	}
+
+	buffered_ = (size_t)(end - p);
+	if (buffered_)
+		std::memcpy(buffer_, p, buffered_);
+}
+
+uint64_t ContentHasher::Digest() const
+{
+	uint64_t h;
+	if (total_ >= 32)
+	{
+		h = Rotl(v_[0], 1) + Rotl(v_[1], 7) + Rotl(v_[2], 12) + Rotl(v_[3], 18);
+		for (uint64_t v : v_)
+			h = MergeRound(h, v);
+	}
+	else
+	{
+		h = kPrime5;
+	}
+	h += total_;
+
+	const unsigned char* p = buffer_;
+	const unsigned char* end = buffer_ + buffered_;
+	for (; end - p >= 8; p += 8)
+		h = Rotl(h ^ Round(0, Read64(p)), 27) * kPrime1 + kPrime4;
+	if (end - p >= 4)
+	{
+		h = Rotl(h ^ (Read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = Rotl(h ^ (*p * kPrime5), 11) * kPrime1;
+
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+	return h;
+}
+
+static std::string Hex64(uint64_t v)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+	return buf;
+}
+
+static bool ParseHex64(const std::string& text, uint64_t& v)
+{
+	if (text.empty() || text.size() > 16)
+		return false;
+	try
+	{
+		size_t used = 0;
+		v = std::stoull(text, &used, 16);
+		return used == text.size();
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+std::string AnalysisCacheKey::ToString() const
+{
+	return Hex64(replayHash) + "-" + Hex64(modelFingerprint);
+}
+
+bool AnalysisCacheKey::Parse(const std::string& text, AnalysisCacheKey& key)
+{
+	size_t dash = text.find('-');
+	if (dash == std::string::npos)
+		return false;
+	AnalysisCacheKey parsed;
+	if (!ParseHex64(text.substr(0, dash), parsed.replayHash) || !ParseHex64(text.substr(dash + 1), parsed.modelFingerprint))
+		return false;
+	key = parsed;
+	return key.Valid();
+}
+
+std::filesystem::path AnalysisKeyPathFor(const std::filesystem::path& csvPath)
+{
+	std::filesystem::path path = csvPath;
+	path.replace_extension(".key");
+	return path;
+}
+
+std::filesystem::path PartialAnalysisPathFor(const std::filesystem::path& csvPath)
+{
+	std::filesystem::path path = csvPath;
+	path.replace_extension(".partial.csv");
+	return path;
+}
+
+std::filesystem::path ExistingAnalysisFile(const std::filesystem::path& csvPath)
+{
+	std::error_code ec;
+	auto rowStreamPath = RowStreamPathFor(csvPath);
+	if (std::filesystem::exists(rowStreamPath, ec))
+		return rowStreamPath;
+	if (std::filesystem::exists(csvPath, ec))
+		return csvPath;
+	return {};
+}
+
+bool CopyAnalysisFiles(const std::filesystem::path& fromCsv, const std::filesystem::path& toCsv, std::string& error)
+{
+	std::filesystem::path from = ExistingAnalysisFile(fromCsv);
+	if (from.empty())
+	{
+		error = "no analysis at " + fromCsv.string();
+		return false;
+	}
+
+	const bool binary = from.extension() == ".nrlb";
+	std::filesystem::path to = binary ? RowStreamPathFor(toCsv) : toCsv;
+	std::error_code ec;
+	// the other format would otherwise shadow (or be shadowed by) the copy
+	std::filesystem::remove(binary ? toCsv : RowStreamPathFor(toCsv), ec);
+	std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec);
+	if (ec)
+	{
+		error = ec.message();
+		return false;
+	}
+	return true;
+}
+
+static bool ReadKeyFile(const std::filesystem::path& csvPath, AnalysisCacheKey& key)
+{
+	std::ifstream in(AnalysisKeyPathFor(csvPath));
+	std::string text;
+	return in >> text && AnalysisCacheKey::Parse(text, key);
+}
+
+void AnalysisCache::Load(const std::filesystem::path& stateFile)
+{
+	std::map<std::string, ReplayEntry> replays;
+	std::ifstream in(stateFile);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string hash, path;
+		ReplayEntry entry;
+		if (std::getline(fields, hash, '\t') && fields >> entry.size >> entry.mtime && fields.get() == '\t' &&
+			std::getline(fields, path) && ParseHex64(hash, entry.hash))
+			replays[path] = entry;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	stateFile_ = stateFile;
+	replays_ = std::move(replays);
+	dirty_ = false;
+}
+
+void AnalysisCache::SaveIfDirty()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!dirty_ || stateFile_.empty())
+		return;
+
+	// dropped entries for replays that were deleted keep the file from growing forever
+	std::filesystem::path tmpPath = stateFile_;
+	tmpPath += ".tmp";
+	{
+		std::ofstream out(tmpPath, std::ios::trunc);
+		std::error_code ec;
+		for (const auto& [path, entry] : replays_)
+			if (std::filesystem::exists(std::filesystem::path(path), ec))
+				out << Hex64(entry.hash) << '\t' << entry.size << '\t' << entry.mtime << '\t' << path << '\n';
+		if (!out)
+			return;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, stateFile_, ec);
+	if (!ec)
+		dirty_ = false;
+}
+
+bool AnalysisCache::ReplayHash(const std::filesystem::path& replay, uint64_t& hash, std::string& error,
+	const std::atomic<bool>* cancel)
+{
+	std::error_code ec;
+	uint64_t size = std::filesystem::file_size(replay, ec);
+	if (ec)
+	{
+		error = replay.string() + ": " + ec.message();
+		return false;
+	}
+	long long mtime = std::filesystem::last_write_time(replay, ec).time_since_epoch().count();
+	const std::string key = replay.string();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = replays_.find(key);
+		if (it != replays_.end() && it->second.size == size && it->second.mtime == mtime)
+		{
+			hash = it->second.hash;
+			return true;
+		}
+	}
+
+	auto file = MapFileReadOnly(replay, error);
+	if (!file)
+		return false;
+
+	ContentHasher hasher;
+	for (size_t offset = 0; offset < file->Size(); offset += kHashSliceBytes)
+	{
+		if (cancel && cancel->load())
+		{
+			error = "cancelled while hashing " + replay.string();
+			return false;
+		}
+		hasher.Update(file->Data() + offset, (std::min)(kHashSliceBytes, file->Size() - offset));
+	}
+	hash = hasher.Digest();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	replays_[key] = ReplayEntry{ (uint64_t)file->Size(), mtime, hash };
+	dirty_ = true;
+	return true;
+}
+
+uint64_t AnalysisCache::ModelFingerprint(const std::filesystem::path& modelDir)
+{
+	const std::string key = modelDir.string();
+	const auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = fingerprints_.find(key);
+		if (it != fingerprints_.end() && now - it->second.computedAt < kFingerprintTtl)
+			return it->second.value;
+	}
+
+	std::vector<std::string> files;
+	std::error_code ec;
+
+	// a model.cfg version stands for the whole install, so a large runtime folder isn't walked;
+	// the applet's size and mtime still catch an exe swapped without bumping it
+	ModelManifest manifest;
+	std::string manifestError;
+	bool declared = false;
+	if (LoadModelManifest(ModelManifestPath(modelDir), modelDir.filename().string(), manifest, manifestError))
+	{
+		std::error_code sizeEc, timeEc;
+		const auto applet = modelDir / manifest.applet;
+		uint64_t size = std::filesystem::file_size(applet, sizeEc);
+		long long mtime = std::filesystem::last_write_time(applet, timeEc).time_since_epoch().count();
+		declared = !sizeEc && !timeEc;
+		if (declared)
+			files.push_back(std::string("model.cfg") + '\0' + manifest.version + '\0' + manifest.applet + '\0' +
+				std::to_string(size) + '\0' + std::to_string(mtime));
+	}
+
+	auto it = declared ? std::filesystem::recursive_directory_iterator() :
+		std::filesystem::recursive_directory_iterator(modelDir, std::filesystem::directory_options::skip_permission_denied, ec);
+	for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+	{
+		std::error_code entryEc;
+		if (it->is_directory(entryEc))
+		{
+			if (it.depth() == 0 && it->path().filename() == "demoanalysis")
+				it.disable_recursion_pending();
+			continue;
+		}
+
+		uint64_t size = it->file_size(entryEc);
+		long long mtime = it->last_write_time(entryEc).time_since_epoch().count();
+		std::string relative = it->path().lexically_relative(modelDir).generic_string();
+		files.push_back(relative + '\0' + std::to_string(size) + '\0' + std::to_string(mtime));
+	}
+
+	// directory order is unspecified
+	std::sort(files.begin(), files.end());
+	uint64_t value = 0;
+	if (!files.empty())
+	{
+		ContentHasher hasher;
+		for (const std::string& file : files)
+			hasher.Update(file.data(), file.size() + 1);
+		value = hasher.Digest();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	fingerprints_[key] = Fingerprint{ value, now };
+	return value;
+}
+
+bool AnalysisCache::KeyFor(const std::filesystem::path& replay, const std::filesystem::path& modelDir,
+	AnalysisCacheKey& key, std::string& error, const std::atomic<bool>* cancel)
+{
+	AnalysisCacheKey computed;
+	if (!ReplayHash(replay, computed.replayHash, error, cancel))
+		return false;
+	computed.modelFingerprint = ModelFingerprint(modelDir);
+	if (!computed.Valid())
+	{
+		error = "no model install in " + modelDir.string();
+		return false;
+	}
+	key = computed;
+	return true;
+}
+
+AnalysisFreshness AnalysisCache::Check(const std::filesystem::path& csvPath, const AnalysisCacheKey& key)
+{
+	if (ExistingAnalysisFile(csvPath).empty())
+		return AnalysisFreshness::Missing;
+	AnalysisCacheKey recorded;
+	return ReadKeyFile(csvPath, recorded) && recorded == key ? AnalysisFreshness::Fresh : AnalysisFreshness::Stale;
+}
+
+AnalysisFreshness AnalysisCache::CheckModel(const std::filesystem::path& csvPath, uint64_t modelFingerprint)
+{
+	if (ExistingAnalysisFile(csvPath).empty())
+		return AnalysisFreshness::Missing;
+	AnalysisCacheKey recorded;
+	return ReadKeyFile(csvPath, recorded) && recorded.modelFingerprint == modelFingerprint ? AnalysisFreshness::Fresh : AnalysisFreshness::Stale;
+}
+
+void AnalysisCache::Record(const std::filesystem::path& csvPath, const AnalysisCacheKey& key)
+{
+	{
+		std::ofstream out(AnalysisKeyPathFor(csvPath), std::ios::trunc);
+		out << key.ToString() << '\n';
+		if (!out)
+		{
+			LOG("neuRLcar: could not write {}", AnalysisKeyPathFor(csvPath).string());
+			return;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	byKey_[key.ToString()] = csvPath;
+}
+
+void AnalysisCache::Forget(const std::filesystem::path& csvPath)
+{
+	std::error_code ec;
+	std::filesystem::remove(AnalysisKeyPathFor(csvPath), ec);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto it = byKey_.begin(); it != byKey_.end();)
+		it = it->second == csvPath ? byKey_.erase(it) : std::next(it);
+}
+
+void AnalysisCache::IndexDirectory(const std::filesystem::path& analysisDir)
+{
+	const std::string dirKey = analysisDir.string();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (indexedDirs_.count(dirKey))
+			return;
+	}
+
+	std::map<std::string, std::filesystem::path> found;
+	std::error_code ec;
+	for (auto it = std::filesystem::directory_iterator(analysisDir, ec);
+		!ec && it != std::filesystem::directory_iterator();
+		it.increment(ec))
+	{
+		if (it->path().extension() != ".key")
+			continue;
+		std::filesystem::path csvPath = it->path();
+		csvPath.replace_extension(".csv");
+		AnalysisCacheKey key;
+		if (ReadKeyFile(csvPath, key))
+			found[key.ToString()] = csvPath;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	indexedDirs_.insert(dirKey);
+	// entries recorded while scanning are newer than what was read
+	for (auto& [key, path] : found)
+		byKey_.emplace(key, std::move(path));
+}
+
+bool AnalysisCache::FindByKey(const std::filesystem::path& analysisDir, const AnalysisCacheKey& key, std::filesystem::path& csvPath)
+{
+	IndexDirectory(analysisDir);
+
+	std::filesystem::path candidate;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = byKey_.find(key.ToString());
+		if (it == byKey_.end())
+			return false;
+		candidate = it->second;
+	}
+
+	// the index can lag behind deletions and re-analyses done outside the plugin
+	if (candidate.parent_path() != analysisDir || Check(candidate, key) != AnalysisFreshness::Fresh)
+		return false;
+	csvPath = candidate;
+	return true;
+}
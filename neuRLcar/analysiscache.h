@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+// 64-bit streaming content hash (XXH64, seed 0); fed in slices so large files never need a copy
+class ContentHasher
+{
+public:
+	ContentHasher();
+
+	void Update(const void* data, size_t size);
+	uint64_t Digest() const;
+
+private:
+	uint64_t v_[4];
+	unsigned char buffer_[32];
+	size_t buffered_ = 0;
+	uint64_t total_ = 0;
+};
+
+// What an analysis was computed from: the replay's contents and the model install that ran.
+// Kept in a "<id>.key" sidecar next to each analysis, so analyses from an older model, or of
+// a replay file that has since changed, are recognised as stale instead of being reused.
+struct AnalysisCacheKey
+{
+	uint64_t replayHash = 0;
+	uint64_t modelFingerprint = 0;
+
+	bool Valid() const { return replayHash != 0 && modelFingerprint != 0; }
+	bool operator==(const AnalysisCacheKey& other) const
+	{
+		return replayHash == other.replayHash && modelFingerprint == other.modelFingerprint;
+	}
+	bool operator!=(const AnalysisCacheKey& other) const { return !(*this == other); }
+
+	// "<replay hash hex>-<model fingerprint hex>"
+	std::string ToString() const;
+	static bool Parse(const std::string& text, AnalysisCacheKey& key);
+};
+
+enum class AnalysisFreshness
+{
+	Missing,   // no analysis file
+	Stale,     // computed by another model install or from other replay contents, or of unknown origin
+	Fresh,
+};
+
+// Replay hashes (cached by path, size and mtime), model fingerprints and the key -> analysis
+// index used to share one analysis between copies of the same replay. Thread safe; hashing and
+// directory walks happen outside the lock.
+class AnalysisCache
+{
+public:
+	// Replay hashes persist across sessions as "<hash>\t<size>\t<mtime>\t<path>" lines
+	void Load(const std::filesystem::path& stateFile);
+	void SaveIfDirty();
+
+	// Content hash of a replay, re-read only when its size or mtime changed. cancel is checked
+	// between 1 MiB slices, so a large replay on a slow disk doesn't hold up a shutdown.
+	bool ReplayHash(const std::filesystem::path& replay, uint64_t& hash, std::string& error,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// Hash of the relative path, size and mtime of every file in the model folder (the applet and
+	// its _internal tree; analyses excluded), or of the model.cfg version and the applet when the
+	// folder has a valid manifest. Recomputed at most every few seconds per folder.
+	uint64_t ModelFingerprint(const std::filesystem::path& modelDir);
+
+	bool KeyFor(const std::filesystem::path& replay, const std::filesystem::path& modelDir,
+		AnalysisCacheKey& key, std::string& error, const std::atomic<bool>* cancel = nullptr);
+
+	// csvPath is the analysis' base name; the .nrlb next to it counts as the same analysis
+	AnalysisFreshness Check(const std::filesystem::path& csvPath, const AnalysisCacheKey& key);
+	// Cheap check for scans: only the model half of the key is compared
+	AnalysisFreshness CheckModel(const std::filesystem::path& csvPath, uint64_t modelFingerprint);
+
+	// Writes the sidecar for a finished analysis and indexes it
+	void Record(const std::filesystem::path& csvPath, const AnalysisCacheKey& key);
+	// Drops the sidecar along with a deleted analysis
+	void Forget(const std::filesystem::path& csvPath);
+
+	// Another analysis in the same folder computed from the same key, e.g. a renamed copy of the replay
+	bool FindByKey(const std::filesystem::path& analysisDir, const AnalysisCacheKey& key, std::filesystem::path& csvPath);
+
+private:
+	struct ReplayEntry
+	{
+		uint64_t size = 0;
+		long long mtime = 0;
+		uint64_t hash = 0;
+	};
+
+	struct Fingerprint
+	{
+		uint64_t value = 0;
+		std::chrono::steady_clock::time_point computedAt{};
+	};
+
+	void IndexDirectory(const std::filesystem::path& analysisDir);
+
+	std::mutex mutex_;
+	std::filesystem::path stateFile_;
+	std::map<std::string, ReplayEntry> replays_;
+	bool dirty_ = false;
+	std::map<std::string, Fingerprint> fingerprints_;
+	std::set<std::string> indexedDirs_;
+	std::map<std::string, std::filesystem::path> byKey_;   // key -> csv path
+};
+
+// <id>.csv -> <id>.key
+std::filesystem::path AnalysisKeyPathFor(const std::filesystem::path& csvPath);
+
+// <id>.csv -> <id>.partial.csv, where the applet writes until it has finished
+std::filesystem::path PartialAnalysisPathFor(const std::filesystem::path& csvPath);
+
+// The .nrlb or .csv holding the analysis, empty if neither exists
+std::filesystem::path ExistingAnalysisFile(const std::filesystem::path& csvPath);
+
+// Copies the analysis behind fromCsv (either format) to toCsv's name, replacing what was there
+bool CopyAnalysisFiles(const std::filesystem::path& fromCsv, const std::filesystem::path& toCsv, std::string& error);
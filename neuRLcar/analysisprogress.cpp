@@ -0,0 +1,238 @@
+#include "pch.h"
+#include "analysisprogress.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static constexpr size_t kHistoryPerModel = 32;
+
+void AnalysisProgressTracker::Begin(const std::string& key, const std::string& model, int expectedFrames)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Running& run = running_[key];
+	run = Running{};
+	run.model = model;
+	run.expectedFrames = expectedFrames;
+	run.startedAt = Clock::now();
+}
+
+void AnalysisProgressTracker::Update(const std::string& key, int framesDone, int framesTotal)
+{
+	if (framesTotal <= 0 || framesDone < 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = running_.find(key);
+	if (it == running_.end())
+		return;
+
+	Running& run = it->second;
+	run.framesDone = (std::min)(framesDone, framesTotal);
+	run.framesTotal = framesTotal;
+	if (run.firstReportFrames < 0)
+	{
+		// the first report includes the applet's startup, so rates are measured from here
+		run.firstReportAt = Clock::now();
+		run.firstReportFrames = run.framesDone;
+	}
+}
+
+void AnalysisProgressTracker::End(const std::string& key, bool ok)
+{
+	std::string model;
+	Sample sample;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = running_.find(key);
+		if (it == running_.end())
+			return;
+
+		const Running& run = it->second;
+		model = run.model;
+		sample.frames = run.framesTotal > 0 ? run.framesTotal : run.expectedFrames;
+		sample.seconds = std::chrono::duration<double>(Clock::now() - run.startedAt).count();
+		running_.erase(it);
+	}
+
+	if (!ok)
+		return;
+
+	AddSample(model, sample);
+
+	std::filesystem::path file;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		file = historyFile_;
+	}
+	if (!file.empty())
+		std::ofstream(file, std::ios::app) << model << '\t' << sample.frames << '\t' << sample.seconds << '\n';
+}
+
+AnalysisProgress AnalysisProgressTracker::Snapshot(const std::string& key) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return SnapshotLocked(key);
+}
+
+void AnalysisProgressTracker::SetViewed(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	viewedKey_ = key;
+}
+
+AnalysisProgress AnalysisProgressTracker::SnapshotViewed() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return SnapshotLocked(viewedKey_);
+}
+
+AnalysisProgress AnalysisProgressTracker::SnapshotLocked(const std::string& key) const
+{
+	AnalysisProgress progress;
+
+	auto it = running_.find(key);
+	if (it == running_.end())
+		return progress;
+
+	const Running& run = it->second;
+	const auto now = Clock::now();
+	progress.active = true;
+	progress.elapsedSeconds = std::chrono::duration<double>(now - run.startedAt).count();
+
+	if (run.firstReportFrames >= 0)
+	{
+		progress.reported = true;
+		progress.framesDone = run.framesDone;
+		progress.framesTotal = run.framesTotal;
+		progress.fraction = (double)run.framesDone / run.framesTotal;
+
+		int framesSinceFirst = run.framesDone - run.firstReportFrames;
+		double secondsSinceFirst = std::chrono::duration<double>(now - run.firstReportAt).count();
+		if (framesSinceFirst > 0)
+			progress.etaSeconds = (run.framesTotal - run.framesDone) * (secondsSinceFirst / framesSinceFirst);
+		else if (run.framesDone > 0)
+			progress.etaSeconds = (run.framesTotal - run.framesDone) * (progress.elapsedSeconds / run.framesDone);
+		return progress;
+	}
+
+	// nothing reported yet: go by how long this model usually takes
+	progress.framesTotal = run.expectedFrames;
+	double predicted = PredictLocked(run.model, run.expectedFrames);
+	if (predicted > 0.0)
+	{
+		progress.fraction = (std::min)(progress.elapsedSeconds / predicted, 0.99);
+		progress.etaSeconds = (std::max)(predicted - progress.elapsedSeconds, 0.0);
+	}
+	return progress;
+}
+
+double AnalysisProgressTracker::PredictSeconds(const std::string& model, int numFrames) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return PredictLocked(model, numFrames);
+}
+
+// Least-squares fit of seconds = startup + perFrame * frames over the model's recent runs;
+// falls back to the median run when the length is unknown or the runs can't be fitted
+double AnalysisProgressTracker::PredictLocked(const std::string& model, int numFrames) const
+{
+	auto it = history_.find(model);
+	if (it == history_.end() || it->second.empty())
+		return -1.0;
+	const auto& samples = it->second;
+
+	if (numFrames > 0)
+	{
+		double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+		for (const Sample& s : samples)
+		{
+			if (s.frames <= 0) continue;
+			n += 1; sx += s.frames; sy += s.seconds; sxx += (double)s.frames * s.frames; sxy += s.frames * s.seconds;
+		}
+
+		double denom = n * sxx - sx * sx;
+		if (n >= 2 && denom > 0.0)
+		{
+			double perFrame = (n * sxy - sx * sy) / denom;
+			double startup = (sy - perFrame * sx) / n;
+			if (perFrame > 0.0)
+				return (std::max)(startup, 0.0) + perFrame * numFrames;
+		}
+		if (n >= 1 && sx > 0.0)
+			return sy / sx * numFrames;
+	}
+
+	std::vector<double> seconds;
+	for (const Sample& s : samples)
+		seconds.push_back(s.seconds);
+	std::nth_element(seconds.begin(), seconds.begin() + seconds.size() / 2, seconds.end());
+	return seconds[seconds.size() / 2];
+}
+
+void AnalysisProgressTracker::AddSample(const std::string& model, Sample sample)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto& samples = history_[model];
+	samples.push_back(sample);
+	while (samples.size() > kHistoryPerModel)
+		samples.pop_front();
+}
+
+void AnalysisProgressTracker::LoadHistory(const std::filesystem::path& file)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		historyFile_ = file;
+		history_.clear();
+	}
+
+	std::ifstream in(file);
+	std::string line;
+	size_t lines = 0;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		std::string model;
+		Sample sample;
+		if (std::getline(fields, model, '\t') && fields >> sample.frames >> sample.seconds && sample.seconds > 0.0)
+			AddSample(model, sample);
+		++lines;
+	}
+
+	// the file is append-only; rewrite it once it is mostly samples that fell out of the window
+	size_t kept = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& [model, samples] : history_)
+			kept += samples.size();
+	}
+	if (lines > 4 * (std::max)(kept, kHistoryPerModel))
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::ofstream out(file, std::ios::trunc);
+		for (auto& [model, samples] : history_)
+			for (const Sample& s : samples)
+				out << model << '\t' << s.frames << '\t' << s.seconds << '\n';
+	}
+}
+
+bool ParseProgressLine(std::string_view line, int& framesDone, int& framesTotal)
+{
+	static constexpr std::string_view verb = "PROGRESS\t";
+	if (line.substr(0, verb.size()) != verb)
+		return false;
+
+	std::istringstream fields{ std::string(line.substr(verb.size())) };
+	return static_cast<bool>(fields >> framesDone >> framesTotal);
+}
+
+std::string FormatDuration(double seconds)
+{
+	long long total = (long long)(seconds + 0.5);
+	if (total < 0) total = 0;
+	long long h = total / 3600, m = (total / 60) % 60, s = total % 60;
+	return h > 0 ? std::format("{}:{:02}:{:02}", h, m, s) : std::format("{}:{:02}", m, s);
+}
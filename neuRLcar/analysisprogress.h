@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Called from process reader threads as the applet reports progress
+using AnalysisProgressFn = std::function<void(int framesDone, int framesTotal)>;
+
+// Snapshot of one analysis for the overlay/window
+struct AnalysisProgress
+{
+	bool active = false;
+	bool reported = false;        // a PROGRESS line arrived; otherwise fraction/eta are predictions
+	int framesDone = 0;
+	int framesTotal = 0;
+	double fraction = 0.0;        // [0,1]
+	double elapsedSeconds = 0.0;
+	double etaSeconds = -1.0;     // < 0 while unknown
+};
+
+// Tracks running analyses and predicts how long they take. Applets report progress on stdout as
+//   PROGRESS <frames done> <frames total>
+// (tab separated; resident servers put the request id after the verb, like their other replies).
+// Until the first line arrives, the ETA comes from the model's history of analysis time against
+// replay length. Updates come from reader threads and snapshots from the renderers; both only
+// take a short lock.
+class AnalysisProgressTracker
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// expectedFrames is the replay length if known, 0 otherwise
+	void Begin(const std::string& key, const std::string& model, int expectedFrames);
+	void Update(const std::string& key, int framesDone, int framesTotal);
+	void End(const std::string& key, bool ok);   // successful runs go into the model's history
+
+	AnalysisProgress Snapshot(const std::string& key) const;
+
+	// The job for the replay being viewed, so the render thread doesn't need the session context
+	void SetViewed(const std::string& key);
+	AnalysisProgress SnapshotViewed() const;
+
+	// Predicted wall time in seconds for numFrames (0 = unknown length); < 0 without history
+	double PredictSeconds(const std::string& model, int numFrames) const;
+
+	// History is kept as "<model>\t<frames>\t<seconds>" lines and appended as runs finish
+	void LoadHistory(const std::filesystem::path& file);
+
+private:
+	struct Running
+	{
+		std::string model;
+		int expectedFrames = 0;
+		int framesDone = 0;
+		int framesTotal = 0;
+		Clock::time_point startedAt{};
+		Clock::time_point firstReportAt{};
+		int firstReportFrames = -1;
+	};
+
+	struct Sample
+	{
+		int frames = 0;
+		double seconds = 0.0;
+	};
+
+	void AddSample(const std::string& model, Sample sample);
+	double PredictLocked(const std::string& model, int numFrames) const;
+	AnalysisProgress SnapshotLocked(const std::string& key) const;
+
+	mutable std::mutex mutex_;
+	std::map<std::string, Running> running_;
+	std::map<std::string, std::deque<Sample>> history_;
+	std::filesystem::path historyFile_;
+	std::string viewedKey_;
+};
+
+// Parses a one-shot applet's "PROGRESS\t<done>\t<total>" line
+bool ParseProgressLine(std::string_view line, int& framesDone, int& framesTotal);
+
+// "1:05", "12:40", "1:02:03"
+std::string FormatDuration(double seconds);
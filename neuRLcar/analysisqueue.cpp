@@ -0,0 +1,254 @@
+#include "pch.h"
+#include "analysisqueue.h"
+
+#include <algorithm>
+
+static constexpr int kMaxWorkers = 16;
+
+const char* ToString(AnalysisOutcome outcome)
+{
+	switch (outcome)
+	{
+	case AnalysisOutcome::Succeeded: return "succeeded";
+	case AnalysisOutcome::Failed:    return "failed";
+	case AnalysisOutcome::TimedOut:  return "timed out";
+	case AnalysisOutcome::Cancelled: return "cancelled";
+	}
+	return "?";
+}
+
+AnalysisQueue::AnalysisQueue(RunFn run, DoneFn done, SpawnFn spawn)
+	: run_(std::move(run)), done_(std::move(done)), spawn_(std::move(spawn))
+{
+}
+
+AnalysisQueue::~AnalysisQueue()
+{
+	Shutdown();
+}
+
+bool AnalysisQueue::Enqueue(AnalysisJob job, bool front)
+{
+	const std::string key = job.Key();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (shutdown_ || running_.count(key))
+			return false;
+
+		auto it = std::find_if(queue_.begin(), queue_.end(), [&](const AnalysisJob& j) { return j.Key() == key; });
+		if (it != queue_.end())
+		{
+			if (!front)
+				return false;
+			queue_.erase(it);
+		}
+
+		if (front)
+			queue_.push_front(std::move(job));
+		else
+			queue_.push_back(std::move(job));
+
+		SpawnWorkersLocked();
+	}
+	return true;
+}
+
+// Workers are started lazily, one per queued job up to the concurrency level
+void AnalysisQueue::SpawnWorkersLocked()
+{
+	while (!shutdown_ && liveWorkers_ < concurrency_ && liveWorkers_ < (int)(queue_.size() + running_.size()))
+	{
+		++liveWorkers_;
+		spawn_([this] { WorkerLoop(); });
+	}
+}
+
+bool AnalysisQueue::Promote(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = std::find_if(queue_.begin(), queue_.end(), [&](const AnalysisJob& j) { return j.Key() == key; });
+	if (it == queue_.end())
+		return false;
+
+	AnalysisJob job = std::move(*it);
+	queue_.erase(it);
+	queue_.push_front(std::move(job));
+	return true;
+}
+
+void AnalysisQueue::SetConcurrency(int workers)
+{
+	workers = std::clamp(workers, 1, kMaxWorkers);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		concurrency_ = workers;
+		SpawnWorkersLocked();
+	}
+}
+
+int AnalysisQueue::Concurrency() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return concurrency_;
+}
+
+size_t AnalysisQueue::Queued() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return queue_.size();
+}
+
+size_t AnalysisQueue::Running() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return running_.size();
+}
+
+bool AnalysisQueue::Contains(const std::string& key) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (running_.count(key))
+		return true;
+	return std::any_of(queue_.begin(), queue_.end(), [&](const AnalysisJob& j) { return j.Key() == key; });
+}
+
+bool AnalysisQueue::Cancel(const std::string& key)
+{
+	AnalysisJob dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto running = running_.find(key);
+		if (running != running_.end())
+		{
+			running->second->store(true);
+			return true;
+		}
+
+		auto it = std::find_if(queue_.begin(), queue_.end(), [&](const AnalysisJob& j) { return j.Key() == key; });
+		if (it == queue_.end())
+			return false;
+		dropped = std::move(*it);
+		queue_.erase(it);
+	}
+
+	NotifyDropped({ dropped });
+	return true;
+}
+
+void AnalysisQueue::CancelAll()
+{
+	std::vector<AnalysisJob> dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		dropped = DropQueuedLocked();
+	}
+	NotifyDropped(dropped);
+}
+
+std::vector<AnalysisJob> AnalysisQueue::DropQueuedLocked()
+{
+	std::vector<AnalysisJob> dropped(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+	queue_.clear();
+	for (auto& [key, cancel] : running_)
+		cancel->store(true);
+	return dropped;
+}
+
+void AnalysisQueue::NotifyDropped(const std::vector<AnalysisJob>& jobs)
+{
+	if (!done_)
+		return;
+	for (const auto& job : jobs)
+		done_(job, AnalysisOutcome::Cancelled);
+}
+
+bool AnalysisQueue::Shutdown(std::chrono::milliseconds grace)
+{
+	std::vector<AnalysisJob> dropped;
+	bool finished = true;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (!shutdown_)
+		{
+			shutdown_ = true;
+			dropped = DropQueuedLocked();
+		}
+
+		// running jobs see their cancel flag and kill their applets; wait for that
+		auto allExited = [this] { return liveWorkers_ == 0; };
+		if (grace.count() < 0)
+			cv_.wait(lock, allExited);
+		else
+			finished = cv_.wait_for(lock, grace, allExited);
+	}
+
+	NotifyDropped(dropped);
+	return finished;
+}
+
+void AnalysisQueue::Abandon()
+{
+	// a done_ already under way still gets to finish
+	std::unique_lock<std::mutex> lock(mutex_);
+	abandoned_ = true;
+	cv_.wait(lock, [this] { return reporting_ == 0; });
+}
+
+void AnalysisQueue::WorkerLoop()
+{
+	while (true)
+	{
+		AnalysisJob job;
+		std::shared_ptr<std::atomic<bool>> cancel;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			// an idle worker gives its thread back; so does one above a lowered concurrency level
+			if (shutdown_ || queue_.empty() || liveWorkers_ > concurrency_)
+			{
+				--liveWorkers_;
+				cv_.notify_all();
+				return;
+			}
+
+			job = std::move(queue_.front());
+			queue_.pop_front();
+			cancel = std::make_shared<std::atomic<bool>>(false);
+			running_[job.Key()] = cancel;
+		}
+
+		AnalysisOutcome outcome = AnalysisOutcome::Failed;
+		try
+		{
+			if (run_)
+				outcome = run_(job, *cancel);
+		}
+		catch (const std::exception& e)
+		{
+			LOG("neuRLcar: analysis of {} threw: {}", job.Key(), e.what());
+		}
+		catch (...)
+		{
+			LOG("neuRLcar: analysis of {} threw", job.Key());
+		}
+		if (cancel->load() && outcome != AnalysisOutcome::Succeeded)
+			outcome = AnalysisOutcome::Cancelled;
+
+		// no longer running by the time done_ reports it, so a rejected duplicate can't mistake
+		// it for a job that is still live
+		bool report = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_.erase(job.Key());
+			report = done_ && !abandoned_;
+			if (report)
+				++reporting_;
+		}
+		if (report)
+		{
+			done_(job, outcome);
+			std::lock_guard<std::mutex> lock(mutex_);
+			--reporting_;
+			cv_.notify_all();
+		}
+	}
+}
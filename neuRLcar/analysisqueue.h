@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "launchpolicy.h"
+#include "modelmanifest.h"
+
+// How the applet hands its results to the plugin
+enum class AnalysisTransport
+{
+	Csv,            // applet writes demoanalysis/<replayId>.csv
+	RowStream,      // binary rows over stdout (rowstream.h), saved as <replayId>.nrlb
+	SharedMemory,   // shared segment (sharedresults.h), saved as <replayId>.nrlb
+};
+
+// One replay to run through one model's applet
+struct AnalysisJob
+{
+	std::string replayId;                 // replay file stem / replay GUID
+	std::string model;
+	std::filesystem::path replayPath;
+	std::filesystem::path analysisPath;   // demoanalysis/<replayId>.csv
+	std::filesystem::path exePath;
+	int numFrames = 0;                    // replay length if known; for ETA prediction and buffer sizing
+	double replayFps = 0.0;               // replay record rate if known
+	std::chrono::milliseconds timeout{ -1 }; // applet wall-time limit, negative for none
+	AnalysisTransport transport = AnalysisTransport::Csv;
+	LaunchPolicy launch;                  // priority, affinity, memory and concurrency caps
+	int segments = 1;                     // applet processes one replay may be split across (--frames)
+	int segmentOverlapFrames = 0;         // how early each later segment starts, to warm up
+	bool canServe = true;                 // the applet supports --serve (model.cfg)
+	ColumnProjection columns;             // streamed rows are projected onto the overlay's columns
+	double rowRate = 0.0;                 // rows per second of replay if model.cfg declares it
+	std::string remoteUrl;                // analyzed by this server instead (remoteanalysis.h) if set
+
+	std::string Key() const { return model + "/" + replayId; }
+};
+
+enum class AnalysisOutcome
+{
+	Succeeded,
+	Failed,
+	TimedOut,
+	Cancelled,    // by the user, or dropped/killed on shutdown
+};
+
+const char* ToString(AnalysisOutcome outcome);
+
+// Job queue drained by up to `concurrency` worker loops. The loops run wherever spawn puts
+// them (blocking tasks on the plugin's thread pool) and end once the queue is empty. Jobs are
+// de-duplicated by model/replay; the replay being viewed can be pushed (or moved) to the front.
+class AnalysisQueue
+{
+public:
+	// run gets the job's cancel flag and should kill the applet once it is set
+	using RunFn = std::function<AnalysisOutcome(const AnalysisJob& job, const std::atomic<bool>& cancel)>;
+	// Called exactly once per accepted job, including jobs dropped from the queue, on the worker
+	// thread (or the cancelling thread for queued jobs). The job is no longer Contains()ed by then.
+	using DoneFn = std::function<void(const AnalysisJob& job, AnalysisOutcome outcome)>;
+	// Starts one worker loop on some long-lived thread; the loop blocks while applets run
+	using SpawnFn = std::function<void(std::function<void()> loop)>;
+
+	AnalysisQueue(RunFn run, DoneFn done, SpawnFn spawn);
+	~AnalysisQueue();
+
+	AnalysisQueue(const AnalysisQueue&) = delete;
+	AnalysisQueue& operator=(const AnalysisQueue&) = delete;
+
+	// Returns false if the job is already running (or queued and front == false)
+	bool Enqueue(AnalysisJob job, bool front = false);
+	bool Promote(const std::string& key);   // move a queued job to the front
+
+	void SetConcurrency(int workers);
+	int Concurrency() const;
+
+	size_t Queued() const;
+	size_t Running() const;
+	bool Contains(const std::string& key) const;
+
+	// Removes a queued job or sets a running job's cancel flag; false if the key is unknown
+	bool Cancel(const std::string& key);
+	void CancelAll();
+
+	// Cancels everything and waits up to grace for the workers; false if some are still busy.
+	// Call it again to keep waiting: the queue must not be destroyed while a worker runs.
+	bool Shutdown(std::chrono::milliseconds grace = std::chrono::milliseconds(-1));
+	// After a Shutdown() that gave up: waits for a done_ call in progress, then stops calling it
+	// for the workers still running, so the queue can be leaked by an owner that is going away
+	void Abandon();
+
+private:
+	void WorkerLoop();
+	void SpawnWorkersLocked();
+	std::vector<AnalysisJob> DropQueuedLocked();
+	void NotifyDropped(const std::vector<AnalysisJob>& jobs);
+
+	RunFn run_;
+	DoneFn done_;
+	SpawnFn spawn_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<AnalysisJob> queue_;
+	std::map<std::string, std::shared_ptr<std::atomic<bool>>> running_;   // key -> cancel flag
+	int concurrency_ = 1;
+	int liveWorkers_ = 0;
+	int reporting_ = 0;                      // done_ calls in progress
+	bool shutdown_ = false;
+	bool abandoned_ = false;
+};
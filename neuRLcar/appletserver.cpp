@@ -0,0 +1,370 @@
+#include "pch.h"
+#include "appletserver.h"
+
+#include <algorithm>
+#include <vector>
+
+static constexpr auto kHealthCheckAfterIdle = std::chrono::seconds(30);
+static constexpr auto kPingTimeout = std::chrono::seconds(5);
+static constexpr auto kJanitorPeriod = std::chrono::seconds(5);
+
+AppletServerClient::AppletServerClient(std::filesystem::path exePath, std::string model, ProcessLimits limits)
+	: exePath_(std::move(exePath)), model_(std::move(model)), limits_(limits),
+	healthCheckAfterIdle_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(kHealthCheckAfterIdle).count()),
+	pingTimeout_(std::chrono::duration_cast<std::chrono::milliseconds>(kPingTimeout).count())
+{
+}
+
+AppletServerClient::~AppletServerClient()
+{
+	Stop();
+}
+
+bool AppletServerClient::EnsureStarted(std::string& error)
+{
+	std::lock_guard<std::mutex> lock(processMutex_);
+	if (process_ && process_->Running())
+		return true;
+
+	process_.reset(); // reaps a crashed server
+	stdoutLines_ = LineSplitter{};
+	stderrTail_.clear();
+
+	ProcessLaunch launch;
+	launch.exePath = exePath_.string();
+	launch.args = { "--serve" };
+	launch.workingDir = exePath_.parent_path().string();
+	launch.pipeStdin = true;
+	launch.limits = limits_;
+	launch.onStdout = [this](std::string_view chunk) {
+		stdoutLines_.Feed(chunk, [this](std::string_view line) { OnStdoutLine(line); });
+	};
+	launch.onStderr = [this](std::string_view chunk) {
+		stderrTail_.append(chunk);
+		if (stderrTail_.size() > 8192)
+			stderrTail_.erase(0, stderrTail_.size() - 8192);
+	};
+
+	process_ = SpawnProcess(launch, error);
+	if (!process_)
+		return false;
+
+	LOG("neuRLcar: started resident applet for '{}' (pid {})", model_, process_->Pid());
+	startedAt_ = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> stateLock(mutex_);
+	lastActivity_ = std::chrono::steady_clock::now();
+	return true;
+}
+
+AnalysisOutcome AppletServerClient::Request(const std::string& verb, const std::string& args,
+	std::chrono::milliseconds timeout, std::string& error, AnalysisProgressFn onProgress,
+	const std::atomic<bool>* cancel)
+{
+	auto pending = std::make_shared<Pending>();
+	pending->onProgress = std::move(onProgress);
+	unsigned long long id = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		id = nextId_++;
+		pending_[id] = pending;
+	}
+
+	std::string line = verb + "\t" + std::to_string(id);
+	if (!args.empty())
+		line += "\t" + args;
+	line += "\n";
+
+	bool written = false;
+	{
+		std::lock_guard<std::mutex> lock(processMutex_);
+		written = process_ && process_->WriteStdin(line);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!written)
+	{
+		pending_.erase(id);
+		error = "applet server is not accepting requests";
+		return AnalysisOutcome::Failed;
+	}
+
+	// wake up periodically so a server that died without answering fails the request
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	auto ready = [&] { return pending->done; };
+	while (!cv_.wait_for(lock, std::chrono::milliseconds(250), ready))
+	{
+		if (cancel && cancel->load())
+		{
+			pending_.erase(id);
+			error = verb + " cancelled";
+			return AnalysisOutcome::Cancelled;
+		}
+		if (timeout.count() >= 0 && std::chrono::steady_clock::now() >= deadline)
+		{
+			pending_.erase(id);
+			error = verb + " timed out";
+			return AnalysisOutcome::TimedOut;
+		}
+
+		lock.unlock();
+		bool alive = Running();
+		lock.lock();
+		if (!alive && !pending->done)
+		{
+			pending->done = true;
+			pending->ok = false;
+			pending->message = "applet server exited";
+		}
+	}
+
+	pending_.erase(id);
+	lastActivity_ = std::chrono::steady_clock::now();
+	if (!pending->ok)
+		error = pending->message;
+	return pending->ok ? AnalysisOutcome::Succeeded : AnalysisOutcome::Failed;
+}
+
+AnalysisOutcome AppletServerClient::Analyze(const std::string& replayPath, const std::string& analysisPath,
+	std::chrono::milliseconds timeout, std::string& error, AnalysisProgressFn onProgress,
+	const std::atomic<bool>* cancel)
+{
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		if (!EnsureStarted(error))
+			return AnalysisOutcome::Failed;
+
+		const std::chrono::steady_clock::duration healthCheckAfterIdle(healthCheckAfterIdle_.load());
+		if (IdleFor() > healthCheckAfterIdle && !Ping(std::chrono::milliseconds(pingTimeout_.load())))
+		{
+			LOG("neuRLcar: resident applet for '{}' failed its health check, restarting", model_);
+			Stop();
+			continue;
+		}
+
+		AnalysisOutcome outcome = Request("ANALYZE", replayPath + "\t" + analysisPath, timeout, error, onProgress, cancel);
+		if (outcome == AnalysisOutcome::Succeeded)
+			return outcome;
+
+		if (outcome == AnalysisOutcome::TimedOut || outcome == AnalysisOutcome::Cancelled)
+		{
+			Stop(std::chrono::milliseconds(0));
+			return outcome;
+		}
+
+		// a crash fails the request; an ERROR reply (bad replay) is the job's problem
+		if (Running())
+			return outcome;
+
+		LOG("neuRLcar: resident applet for '{}' exited mid-request ({}), restarting", model_, error);
+		Stop();
+	}
+	return AnalysisOutcome::Failed;
+}
+
+bool AppletServerClient::Ping(std::chrono::milliseconds timeout)
+{
+	std::string error;
+	return Request("PING", "", timeout, error) == AnalysisOutcome::Succeeded;
+}
+
+void AppletServerClient::SetHealthCheck(std::chrono::steady_clock::duration idle, std::chrono::milliseconds pingTimeout)
+{
+	healthCheckAfterIdle_ = idle.count();
+	pingTimeout_ = pingTimeout.count();
+}
+
+bool AppletServerClient::Running()
+{
+	std::lock_guard<std::mutex> lock(processMutex_);
+	return process_ && process_->Running();
+}
+
+std::chrono::steady_clock::duration AppletServerClient::IdleFor()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!pending_.empty())
+		return std::chrono::steady_clock::duration::zero();
+	return std::chrono::steady_clock::now() - lastActivity_;
+}
+
+void AppletServerClient::Stop(std::chrono::milliseconds grace)
+{
+	// held until the server is gone: a restart in between would have its requests failed below,
+	// and its reader threads would share stdoutLines_ with the old ones
+	std::lock_guard<std::mutex> processLock(processMutex_);
+	std::unique_ptr<ChildProcess> process = std::move(process_);
+	const std::chrono::steady_clock::time_point startedAt = startedAt_;
+	if (!process)
+		return;
+
+	// ask nicely, then kill
+	if (grace.count() > 0)
+	{
+		process->WriteStdin("QUIT\n");
+		process->CloseStdin();
+	}
+	if (grace.count() <= 0 || !process->Wait(grace))
+		process->Kill();
+	process->Wait(kWaitForever);
+
+	FailAllPending("applet server stopped");
+
+	ProcessUsage usage = process->Usage();
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+	appletUsageStats().Record(model_, usage, wallSeconds);
+	LOG("neuRLcar: stopped resident applet for '{}' ({:.1f} s CPU in {:.0f} s, peak RSS {} MB)",
+		model_, usage.cpuSeconds, wallSeconds, usage.peakRssBytes >> 20);
+}
+
+// Reader thread
+void AppletServerClient::OnStdoutLine(std::string_view line)
+{
+	std::vector<std::string_view> fields;
+	size_t start = 0;
+	while (start <= line.size())
+	{
+		size_t tab = line.find('\t', start);
+		if (tab == std::string_view::npos) tab = line.size();
+		fields.push_back(line.substr(start, tab - start));
+		start = tab + 1;
+	}
+
+	if (fields.size() < 2)
+		return;
+
+	const std::string_view verb = fields[0];
+	if (verb != "DONE" && verb != "ERROR" && verb != "PONG" && verb != "PROGRESS")
+		return;
+
+	unsigned long long id = 0;
+	try { id = std::stoull(std::string(fields[1])); }
+	catch (...) { return; }
+
+	if (verb == "PROGRESS")
+	{
+		if (fields.size() < 4)
+			return;
+
+		int done = 0, total = 0;
+		try { done = std::stoi(std::string(fields[2])); total = std::stoi(std::string(fields[3])); }
+		catch (...) { return; }
+
+		AnalysisProgressFn onProgress;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			auto it = pending_.find(id);
+			if (it == pending_.end())
+				return;
+			onProgress = it->second->onProgress;
+		}
+		if (onProgress)
+			onProgress(done, total);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto it = pending_.find(id);
+	if (it == pending_.end())
+		return;
+
+	it->second->done = true;
+	it->second->ok = verb != "ERROR";
+	if (verb == "ERROR" && fields.size() > 2)
+		it->second->message = std::string(fields[2]);
+	cv_.notify_all();
+}
+
+void AppletServerClient::FailAllPending(const std::string& message)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& [id, p] : pending_)
+	{
+		p->done = true;
+		p->ok = false;
+		p->message = message;
+	}
+	cv_.notify_all();
+}
+
+AppletServerPool::~AppletServerPool()
+{
+	StopAll();
+}
+
+std::shared_ptr<AppletServerClient> AppletServerPool::Get(const std::string& model, const std::filesystem::path& exePath,
+	const ProcessLimits& limits)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto& client = clients_[model];
+	if (!client || client->ExePath() != exePath || client->Limits() != limits)
+		client = std::make_shared<AppletServerClient>(exePath, model, limits);
+
+	if (!janitor_.joinable())
+	{
+		stopping_ = false;
+		janitor_ = std::thread(&AppletServerPool::JanitorLoop, this);
+	}
+	return client;
+}
+
+void AppletServerPool::SetIdleLimit(std::chrono::steady_clock::duration idleLimit)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		idleLimit_ = idleLimit;
+	}
+	cv_.notify_all(); // the janitor's period may have shortened
+}
+
+// Stopping a server can take a couple of seconds, so idle shutdown runs on its own thread
+void AppletServerPool::JanitorLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stopping_)
+	{
+		const std::chrono::steady_clock::duration period = (std::min)(
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(kJanitorPeriod),
+			(std::max)(idleLimit_, std::chrono::steady_clock::duration(std::chrono::milliseconds(10))));
+		cv_.wait_for(lock, period);
+		if (stopping_)
+			break;
+
+		std::vector<std::shared_ptr<AppletServerClient>> clients;
+		for (auto& [model, client] : clients_)
+			clients.push_back(client);
+		auto idleLimit = idleLimit_;
+
+		lock.unlock();
+		for (auto& client : clients)
+			if (client->Running() && client->IdleFor() > idleLimit)
+				client->Stop();
+		lock.lock();
+	}
+}
+
+void AppletServerPool::StopAll(std::chrono::milliseconds grace)
+{
+	std::map<std::string, std::shared_ptr<AppletServerClient>> clients;
+	std::thread janitor;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+		clients.swap(clients_);
+		janitor.swap(janitor_);
+	}
+	cv_.notify_all();
+	if (janitor.joinable())
+		janitor.join();
+
+	for (auto& [model, client] : clients)
+		client->Stop(grace);
+}
+
+size_t AppletServerPool::RunningCount()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t n = 0;
+	for (auto& [model, client] : clients_)
+		if (client->Running()) ++n;
+	return n;
+}
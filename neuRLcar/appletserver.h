@@ -0,0 +1,114 @@
+#pragma once
+
+#include "analysisprogress.h"
+#include "analysisqueue.h"
+#include "processrunner.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Client for an applet kept alive between analyses (`<model>_applet.exe --serve`), so the
+// Python runtime and model weights are loaded once instead of per replay.
+//
+// Line protocol over the child's stdin/stdout, fields separated by tabs:
+//   plugin -> applet   ANALYZE <id> <replay path> <analysis path>
+//                      PING <id>
+//                      QUIT
+//   applet -> plugin   DONE <id>
+//                      ERROR <id> <message>
+//                      PONG <id>
+//                      PROGRESS <id> <frames done> <frames total>   (optional, while analyzing)
+// Any other stdout line is ignored. Requests may be answered in any order.
+class AppletServerClient
+{
+public:
+	AppletServerClient(std::filesystem::path exePath, std::string model, ProcessLimits limits = {});
+	~AppletServerClient();
+
+	AppletServerClient(const AppletServerClient&) = delete;
+	AppletServerClient& operator=(const AppletServerClient&) = delete;
+
+	// Blocking; call from a worker thread. Starts the server if needed, health-checks it
+	// after an idle period and restarts it once if it died mid-request. A timed out or
+	// cancelled request kills the server, since it would still be busy with that replay.
+	AnalysisOutcome Analyze(const std::string& replayPath, const std::string& analysisPath,
+		std::chrono::milliseconds timeout, std::string& error, AnalysisProgressFn onProgress = {},
+		const std::atomic<bool>* cancel = nullptr);
+
+	bool Ping(std::chrono::milliseconds timeout);
+	// A server idle for longer than `idle` is pinged before its next request, and restarted if
+	// it doesn't answer within pingTimeout (defaults: 30 s, 5 s)
+	void SetHealthCheck(std::chrono::steady_clock::duration idle, std::chrono::milliseconds pingTimeout);
+	bool Running();   // waits for a Stop in progress
+	std::chrono::steady_clock::duration IdleFor();
+	void Stop(std::chrono::milliseconds grace = std::chrono::seconds(2));   // QUIT, then kill after grace
+
+	const std::string& Model() const { return model_; }
+	const std::filesystem::path& ExePath() const { return exePath_; }
+	const ProcessLimits& Limits() const { return limits_; }
+
+private:
+	struct Pending
+	{
+		bool done = false;
+		bool ok = false;
+		std::string message;
+		AnalysisProgressFn onProgress;
+	};
+
+	bool EnsureStarted(std::string& error);
+	AnalysisOutcome Request(const std::string& verb, const std::string& args, std::chrono::milliseconds timeout,
+		std::string& error, AnalysisProgressFn onProgress = {}, const std::atomic<bool>* cancel = nullptr);
+	void OnStdoutLine(std::string_view line);
+	void FailAllPending(const std::string& message);
+
+	std::filesystem::path exePath_;
+	std::string model_;
+	ProcessLimits limits_;
+	std::atomic<std::chrono::steady_clock::rep> healthCheckAfterIdle_;
+	std::atomic<std::chrono::milliseconds::rep> pingTimeout_;
+
+	std::mutex processMutex_;              // serializes start/stop; held for the whole of a Stop
+	std::unique_ptr<ChildProcess> process_;
+	std::chrono::steady_clock::time_point startedAt_{};
+	LineSplitter stdoutLines_;             // reader thread only
+	std::string stderrTail_;               // reader thread only
+
+	std::mutex mutex_;                     // guards everything below
+	std::condition_variable cv_;
+	std::map<unsigned long long, std::shared_ptr<Pending>> pending_;
+	unsigned long long nextId_ = 1;
+	std::chrono::steady_clock::time_point lastActivity_{};
+};
+
+// One resident server per model; servers idle for longer than the idle limit are shut down
+class AppletServerPool
+{
+public:
+	~AppletServerPool();
+
+	// A server started with other limits is replaced, like one for another exe
+	std::shared_ptr<AppletServerClient> Get(const std::string& model, const std::filesystem::path& exePath,
+		const ProcessLimits& limits = {});
+	// Servers are checked every 5 s, or more often for an idle limit below that
+	void SetIdleLimit(std::chrono::steady_clock::duration idleLimit);
+	void StopAll(std::chrono::milliseconds grace = std::chrono::seconds(2));
+	size_t RunningCount();
+
+private:
+	void JanitorLoop();
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::map<std::string, std::shared_ptr<AppletServerClient>> clients_;
+	std::chrono::steady_clock::duration idleLimit_ = std::chrono::minutes(5);
+	std::thread janitor_;
+	bool stopping_ = false;
+};
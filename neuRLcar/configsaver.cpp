@@ -0,0 +1,46 @@
+#include "pch.h"
+#include "configsaver.h"
+
+ConfigSaver::ConfigSaver(WriteFn write, Clock clock) : write_(std::move(write)), clock_(std::move(clock))
+{
+}
+
+void ConfigSaver::MarkDirty()
+{
+	const std::int64_t now = clock_();
+	++requests_;
+	lastChangeNs_ = now;
+	// (a batch start that races with a write only makes the next write come early)
+	if (!dirty_.load())
+		firstChangeNs_ = now;
+	dirty_ = true;
+}
+
+bool ConfigSaver::Poll()
+{
+	if (!dirty_.load())
+		return false;
+
+	const std::int64_t now = clock_();
+	if (now - lastChangeNs_.load() < quietNs_ && now - firstChangeNs_.load() < maxDelayNs_)
+		return false;
+
+	Write();
+	return true;
+}
+
+bool ConfigSaver::Flush()
+{
+	if (!dirty_.load())
+		return false;
+	Write();
+	return true;
+}
+
+void ConfigSaver::Write()
+{
+	// cleared first, so a change made while writing is saved by the next write
+	dirty_ = false;
+	++writes_;
+	write_();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "tickscheduler.h"
+
+// Coalesces config saves. Settings changes only mark the config dirty; one write runs once no
+// change has come in for the quiet period, or after maxDelay while changes keep coming (a slider
+// being dragged), or on Flush. `writeconfig` rewrites the whole config file and has to run on
+// the game thread, so Poll and Flush belong there; MarkDirty may be called from any thread.
+class ConfigSaver
+{
+public:
+	using WriteFn = std::function<void()>;
+	using Clock = TickScheduler::Clock;
+
+	struct Stats
+	{
+		uint64_t requests = 0;    // MarkDirty calls
+		uint64_t writes = 0;
+
+		uint64_t Avoided() const { return requests > writes ? requests - writes : 0; }
+	};
+
+	explicit ConfigSaver(WriteFn write, Clock clock = TickScheduler::SteadyClockNs);
+
+	void SetQuietPeriod(std::chrono::milliseconds quiet) { quietNs_ = std::chrono::nanoseconds(quiet).count(); }
+	void SetMaxDelay(std::chrono::milliseconds maxDelay) { maxDelayNs_ = std::chrono::nanoseconds(maxDelay).count(); }
+
+	void MarkDirty();
+	bool Dirty() const { return dirty_.load(); }
+
+	// Writes if due; true if it wrote
+	bool Poll();
+	// Writes now if anything is pending (unload)
+	bool Flush();
+
+	Stats GetStats() const { return Stats{ requests_.load(), writes_.load() }; }
+
+private:
+	void Write();
+
+	WriteFn write_;
+	Clock clock_;
+	std::int64_t quietNs_ = 2'000'000'000;
+	std::int64_t maxDelayNs_ = 10'000'000'000;
+
+	std::atomic<bool> dirty_{ false };
+	std::atomic<std::int64_t> firstChangeNs_{ 0 };   // of the pending batch
+	std::atomic<std::int64_t> lastChangeNs_{ 0 };
+	std::atomic<uint64_t> requests_{ 0 };
+	std::atomic<uint64_t> writes_{ 0 };
+};
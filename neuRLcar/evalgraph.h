@@ -0,0 +1,15 @@
+#pragma once
+// The window's eval graphs, drawn with ImGui alone so the window benchmark can build them
+// without the BakkesMod SDK.
+#include "IMGUI/imgui.h"
+
+#include <vector>
+
+// 301 frames centred on currentframe, filled lowFillColor below the eval and highFillColor
+// above it; frames outside the series are greyed out
+void RenderEvalGraph(
+    const char* id,
+    const std::vector<double>& evaluation,
+    int currentframe,
+    ImU32 lowFillColor = IM_COL32(255, 165, 0, 255),
+    ImU32 highFillColor = IM_COL32(0, 0, 255, 255));
@@ -0,0 +1,276 @@
+#include "pch.h"
+#include "filewatcher.h"
+
+#include <algorithm>
+
+static constexpr auto kIdleWait = std::chrono::milliseconds(2000);
+static constexpr auto kSettleWait = std::chrono::milliseconds(250);
+
+static std::string WatchKey(const std::filesystem::path& dir)
+{
+	return dir.lexically_normal().string();
+}
+
+FileWatchService::~FileWatchService()
+{
+	Stop();
+}
+
+bool FileWatchService::Start(std::string& error)
+{
+	if (thread_.joinable())
+		return true;
+
+	auto backend = CreateDirectoryWatchBackend(error);
+	return backend && Start(std::move(backend));
+}
+
+bool FileWatchService::Start(std::unique_ptr<DirectoryWatchBackend> backend)
+{
+	if (thread_.joinable())
+		return true;
+
+	backend_ = std::move(backend);
+	stopping_ = false;
+	thread_ = std::thread([this]() { Run(); });
+	return true;
+}
+
+void FileWatchService::Stop()
+{
+	if (!thread_.joinable())
+		return;
+	stopping_ = true;
+	backend_->Wake();
+	thread_.join();
+	backend_.reset();
+	watches_.clear();
+	candidates_.clear();
+}
+
+void FileWatchService::Watch(const std::filesystem::path& dir, std::vector<std::string> extensions,
+	std::chrono::milliseconds settleTime, SettledFn onSettled)
+{
+	auto entry = std::make_unique<WatchEntry>();
+	entry->dir = dir;
+	entry->extensions = std::move(extensions);
+	entry->settleTime = settleTime;
+	entry->onSettled = std::move(onSettled);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.emplace_back(WatchKey(dir), std::move(entry));
+	}
+	if (backend_)
+		backend_->Wake();
+}
+
+void FileWatchService::WatchChanges(const std::filesystem::path& dir, std::chrono::milliseconds settleTime, ChangedFn onChanged)
+{
+	auto entry = std::make_unique<WatchEntry>();
+	entry->dir = dir;
+	entry->settleTime = settleTime;
+	entry->onChanged = std::move(onChanged);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.emplace_back(WatchKey(dir), std::move(entry));
+	}
+	if (backend_)
+		backend_->Wake();
+}
+
+void FileWatchService::Unwatch(const std::filesystem::path& dir)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.emplace_back(WatchKey(dir), nullptr);
+	}
+	if (backend_)
+		backend_->Wake();
+}
+
+size_t FileWatchService::Watching() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return watching_;
+}
+
+void FileWatchService::Run()
+{
+	std::vector<std::filesystem::path> changed;
+	std::vector<std::filesystem::path> overflowed;
+	std::string error;
+	bool changesPending = false;
+	while (!stopping_)
+	{
+		ApplyPending();
+
+		changed.clear();
+		overflowed.clear();
+		if (!backend_->Wait(candidates_.empty() && !changesPending ? kIdleWait : kSettleWait, changed, overflowed, error))
+		{
+			LOG("neuRLcar: file watching stopped: {}", error);
+			break;
+		}
+		if (stopping_)
+			break;
+
+		const auto now = std::chrono::steady_clock::now();
+		for (const auto& dir : overflowed)
+			Overflowed(dir, now);
+		for (const auto& path : changed)
+			Note(path, now);
+		CheckCandidates(now);
+		changesPending = CheckChanges(now);
+	}
+}
+
+// Watching thread; (un)watch requests are queued so the backend is only touched here
+void FileWatchService::ApplyPending()
+{
+	std::vector<std::pair<std::string, std::unique_ptr<WatchEntry>>> pending;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending.swap(pending_);
+	}
+	if (pending.empty())
+		return;
+
+	for (auto& [key, entry] : pending)
+	{
+		auto existing = watches_.find(key);
+		if (existing != watches_.end())
+		{
+			if (existing->second.active)
+				backend_->Remove(existing->second.dir);
+			watches_.erase(existing);
+			for (auto it = candidates_.begin(); it != candidates_.end();)
+				it = it->second.watchKey == key ? candidates_.erase(it) : std::next(it);
+		}
+		if (!entry)
+			continue;
+
+		std::string error;
+		entry->active = backend_->Add(entry->dir, error);
+		if (!entry->active)
+			LOG("neuRLcar: not watching {}: {}", entry->dir.string(), error);
+		entry->since = std::filesystem::file_time_type::clock::now();
+		watches_.emplace(key, std::move(*entry));
+	}
+
+	size_t active = std::count_if(watches_.begin(), watches_.end(), [](const auto& w) { return w.second.active; });
+	std::lock_guard<std::mutex> lock(mutex_);
+	watching_ = active;
+}
+
+void FileWatchService::Note(const std::filesystem::path& path, std::chrono::steady_clock::time_point now)
+{
+	// a watched directory can also be an entry of another watch; that is an ordinary change there
+	auto watch = watches_.find(WatchKey(path.parent_path()));
+	if (watch == watches_.end())
+		return;
+	if (watch->second.onChanged)
+	{
+		watch->second.changed = true;
+		watch->second.lastChange = now;
+		return;
+	}
+
+	const auto& extensions = watch->second.extensions;
+	if (std::find(extensions.begin(), extensions.end(), path.extension().string()) == extensions.end())
+		return;
+
+	// a notification restarts the settle timer; the size/mtime check below catches silent growth
+	Candidate& candidate = candidates_[path];
+	candidate.watchKey = watch->first;
+	candidate.lastChange = now;
+}
+
+// The backend dropped events for this directory; for change watches that's just a change
+void FileWatchService::Overflowed(const std::filesystem::path& dir, std::chrono::steady_clock::time_point now)
+{
+	auto watch = watches_.find(WatchKey(dir));
+	if (watch == watches_.end())
+		return;
+
+	if (watch->second.onChanged)
+	{
+		watch->second.changed = true;
+		watch->second.lastChange = now;
+	}
+	else
+		Rescan(watch->first, now);
+}
+
+// The backend lost events for this directory: anything written since the watch started may be new
+void FileWatchService::Rescan(const std::string& watchKey, std::chrono::steady_clock::time_point now)
+{
+	const WatchEntry& watch = watches_.at(watchKey);
+	std::error_code ec;
+	for (auto it = std::filesystem::directory_iterator(watch.dir, ec);
+		!ec && it != std::filesystem::directory_iterator();
+		it.increment(ec))
+	{
+		std::error_code entryEc;
+		if (it->last_write_time(entryEc) >= watch.since && !entryEc)
+			Note(it->path(), now);
+	}
+}
+
+void FileWatchService::CheckCandidates(std::chrono::steady_clock::time_point now)
+{
+	for (auto it = candidates_.begin(); it != candidates_.end();)
+	{
+		const std::filesystem::path& path = it->first;
+		Candidate& candidate = it->second;
+
+		std::error_code ec;
+		uint64_t size = std::filesystem::file_size(path, ec);
+		auto mtime = ec ? std::filesystem::file_time_type{} : std::filesystem::last_write_time(path, ec);
+		if (ec)
+		{
+			// deleted or renamed away before it settled
+			it = candidates_.erase(it);
+			continue;
+		}
+
+		if (size != candidate.size || mtime != candidate.mtime)
+		{
+			candidate.size = size;
+			candidate.mtime = mtime;
+			candidate.lastChange = now;
+			++it;
+			continue;
+		}
+
+		const WatchEntry& watch = watches_.at(candidate.watchKey);
+		if (now - candidate.lastChange < watch.settleTime)
+		{
+			++it;
+			continue;
+		}
+
+		std::filesystem::path settled = path;
+		it = candidates_.erase(it);
+		if (watch.onSettled)
+			watch.onSettled(settled);
+	}
+}
+
+// Reports change watches that have been quiet for their settle time; true while any is still settling
+bool FileWatchService::CheckChanges(std::chrono::steady_clock::time_point now)
+{
+	bool pending = false;
+	for (auto& [key, watch] : watches_)
+	{
+		if (!watch.changed)
+			continue;
+		if (now - watch.lastChange < watch.settleTime)
+		{
+			pending = true;
+			continue;
+		}
+		watch.changed = false;
+		watch.onChanged();
+	}
+	return pending;
+}
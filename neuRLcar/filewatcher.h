@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Platform change notifications for a set of directories (filewatcher_win32.cpp uses
+// ReadDirectoryChangesW, filewatcher_posix.cpp inotify). Only Wake() may be called from
+// another thread; everything else runs on the watching thread.
+class DirectoryWatchBackend
+{
+public:
+	virtual ~DirectoryWatchBackend() = default;
+
+	virtual bool Add(const std::filesystem::path& dir, std::string& error) = 0;
+	virtual void Remove(const std::filesystem::path& dir) = 0;
+
+	// Blocks until something changes, Wake() is called or the timeout passes, and appends the
+	// paths (files or subdirectories) that were created, written, renamed or deleted to changed.
+	// Watched directories the platform dropped events for go to overflowed instead. False if the
+	// backend stopped working.
+	virtual bool Wait(std::chrono::milliseconds timeout, std::vector<std::filesystem::path>& changed,
+		std::vector<std::filesystem::path>& overflowed, std::string& error) = 0;
+	virtual void Wake() = 0;
+};
+
+std::unique_ptr<DirectoryWatchBackend> CreateDirectoryWatchBackend(std::string& error);
+
+// Reports files in watched directories once they stop changing: a file is settled when its
+// size and mtime stayed the same for the watch's settle time after the last notification,
+// so a replay is only picked up after the game has finished writing it. Change watches only
+// say that something in a directory changed. Callbacks run on the watching thread.
+class FileWatchService
+{
+public:
+	using SettledFn = std::function<void(const std::filesystem::path& file)>;
+	using ChangedFn = std::function<void()>;
+
+	FileWatchService() = default;
+	~FileWatchService();
+
+	FileWatchService(const FileWatchService&) = delete;
+	FileWatchService& operator=(const FileWatchService&) = delete;
+
+	bool Start(std::string& error);
+	// With a backend of the caller's, e.g. a scripted one in tests
+	bool Start(std::unique_ptr<DirectoryWatchBackend> backend);
+	void Stop();
+
+	// extensions like ".replay"; replaces an existing watch on the same directory
+	void Watch(const std::filesystem::path& dir, std::vector<std::string> extensions,
+		std::chrono::milliseconds settleTime, SettledFn onSettled);
+	// Any entry of dir added, written, renamed or deleted, reported once it has been quiet for
+	// settleTime; for caches that only need to know when to look again. Replaces a Watch().
+	void WatchChanges(const std::filesystem::path& dir, std::chrono::milliseconds settleTime, ChangedFn onChanged);
+	void Unwatch(const std::filesystem::path& dir);
+
+	size_t Watching() const;
+
+private:
+	struct WatchEntry
+	{
+		std::filesystem::path dir;
+		std::vector<std::string> extensions;
+		std::chrono::milliseconds settleTime{ 0 };
+		SettledFn onSettled;
+		ChangedFn onChanged;                       // set for change watches instead of onSettled
+		std::filesystem::file_time_type since{};   // a rescan after dropped events only picks up newer files
+		bool active = false;
+		bool changed = false;                      // change watch with a report pending
+		std::chrono::steady_clock::time_point lastChange{};
+	};
+
+	struct Candidate
+	{
+		std::string watchKey;
+		uint64_t size = UINT64_MAX;
+		std::filesystem::file_time_type mtime{};
+		std::chrono::steady_clock::time_point lastChange{};
+	};
+
+	void Run();
+	void ApplyPending();
+	void Note(const std::filesystem::path& path, std::chrono::steady_clock::time_point now);
+	void Overflowed(const std::filesystem::path& dir, std::chrono::steady_clock::time_point now);
+	void Rescan(const std::string& watchKey, std::chrono::steady_clock::time_point now);
+	void CheckCandidates(std::chrono::steady_clock::time_point now);
+	bool CheckChanges(std::chrono::steady_clock::time_point now);
+
+	std::unique_ptr<DirectoryWatchBackend> backend_;
+	std::thread thread_;
+	std::atomic<bool> stopping_{ false };
+
+	mutable std::mutex mutex_;
+	std::vector<std::pair<std::string, std::unique_ptr<WatchEntry>>> pending_;   // null entry = unwatch
+	size_t watching_ = 0;
+
+	// watching thread only
+	std::map<std::string, WatchEntry> watches_;
+	std::map<std::filesystem::path, Candidate> candidates_;
+};
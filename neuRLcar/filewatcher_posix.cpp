@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "filewatcher.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// inotify backend; an eventfd wakes poll() for Wake()
+class InotifyWatchBackend : public DirectoryWatchBackend
+{
+public:
+	InotifyWatchBackend(int inotifyFd, int wakeFd) : inotifyFd_(inotifyFd), wakeFd_(wakeFd) {}
+
+	~InotifyWatchBackend() override
+	{
+		close(inotifyFd_);
+		close(wakeFd_);
+	}
+
+	bool Add(const std::filesystem::path& dir, std::string& error) override
+	{
+		int wd = inotify_add_watch(inotifyFd_, dir.c_str(), IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+		if (wd < 0)
+		{
+			error = "inotify_add_watch " + dir.string() + ": " + std::strerror(errno);
+			return false;
+		}
+		dirs_[wd] = dir;
+		return true;
+	}
+
+	void Remove(const std::filesystem::path& dir) override
+	{
+		for (auto it = dirs_.begin(); it != dirs_.end(); ++it)
+		{
+			if (it->second == dir)
+			{
+				inotify_rm_watch(inotifyFd_, it->first);
+				dirs_.erase(it);
+				return;
+			}
+		}
+	}
+
+	bool Wait(std::chrono::milliseconds timeout, std::vector<std::filesystem::path>& changed,
+		std::vector<std::filesystem::path>& overflowed, std::string& error) override
+	{
+		pollfd fds[2] = { { inotifyFd_, POLLIN, 0 }, { wakeFd_, POLLIN, 0 } };
+		int ready = poll(fds, 2, (int)timeout.count());
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+				return true;
+			error = std::string("poll: ") + std::strerror(errno);
+			return false;
+		}
+
+		if (fds[1].revents & POLLIN)
+		{
+			uint64_t count;
+			(void)!read(wakeFd_, &count, sizeof(count));
+		}
+		if (!(fds[0].revents & POLLIN))
+			return true;
+
+		alignas(inotify_event) char buffer[16 * 1024];
+		for (;;)
+		{
+			ssize_t bytes = read(inotifyFd_, buffer, sizeof(buffer));
+			if (bytes <= 0)
+			{
+				if (bytes < 0 && errno != EAGAIN && errno != EINTR)
+				{
+					error = std::string("read inotify: ") + std::strerror(errno);
+					return false;
+				}
+				return true;
+			}
+
+			for (char* p = buffer; p < buffer + bytes;)
+			{
+				const auto* event = reinterpret_cast<const inotify_event*>(p);
+				p += sizeof(inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					for (const auto& [wd, dir] : dirs_)
+						overflowed.push_back(dir);
+					continue;
+				}
+
+				auto dir = dirs_.find(event->wd);
+				if (dir == dirs_.end())
+					continue;
+				if (event->mask & IN_IGNORED)
+				{
+					// the directory went away; the watch is gone with it
+					dirs_.erase(dir);
+					continue;
+				}
+				if (event->len > 0)
+					changed.push_back(dir->second / event->name);
+			}
+		}
+	}
+
+	void Wake() override
+	{
+		uint64_t one = 1;
+		(void)!write(wakeFd_, &one, sizeof(one));
+	}
+
+private:
+	int inotifyFd_;
+	int wakeFd_;
+	std::map<int, std::filesystem::path> dirs_;
+};
+
+std::unique_ptr<DirectoryWatchBackend> CreateDirectoryWatchBackend(std::string& error)
+{
+	int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		error = std::string("inotify_init1: ") + std::strerror(errno);
+		return nullptr;
+	}
+	int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeFd < 0)
+	{
+		error = std::string("eventfd: ") + std::strerror(errno);
+		close(inotifyFd);
+		return nullptr;
+	}
+	return std::make_unique<InotifyWatchBackend>(inotifyFd, wakeFd);
+}
+
+#endif // !_WIN32
@@ -0,0 +1,167 @@
+#include "pch.h"
+#include "filewatcher.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+// ReadDirectoryChangesW backend: one overlapped read per directory, all waited on together
+// with a wake event. WaitForMultipleObjects caps this at 63 directories, far more than needed.
+class Win32WatchBackend : public DirectoryWatchBackend
+{
+public:
+	explicit Win32WatchBackend(HANDLE wake) : wake_(wake) {}
+
+	~Win32WatchBackend() override
+	{
+		while (!dirs_.empty())
+			Remove(dirs_.back()->path);
+		CloseHandle(wake_);
+	}
+
+	bool Add(const std::filesystem::path& dir, std::string& error) override
+	{
+		if (dirs_.size() + 1 >= MAXIMUM_WAIT_OBJECTS)
+		{
+			error = "too many watched directories";
+			return false;
+		}
+
+		HANDLE handle = CreateFileW(dir.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+			FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			error = "CreateFile " + dir.string() + " failed with error " + std::to_string(GetLastError());
+			return false;
+		}
+
+		auto watched = std::make_unique<Dir>();
+		watched->path = dir;
+		watched->handle = handle;
+		watched->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		if (!watched->overlapped.hEvent || !Arm(*watched))
+		{
+			error = "ReadDirectoryChangesW failed with error " + std::to_string(GetLastError());
+			if (watched->overlapped.hEvent)
+				CloseHandle(watched->overlapped.hEvent);
+			CloseHandle(handle);
+			return false;
+		}
+		dirs_.push_back(std::move(watched));
+		return true;
+	}
+
+	void Remove(const std::filesystem::path& dir) override
+	{
+		for (auto it = dirs_.begin(); it != dirs_.end(); ++it)
+		{
+			Dir& watched = **it;
+			if (watched.path != dir)
+				continue;
+
+			// the kernel owns the buffer until the cancelled read completes
+			DWORD bytes = 0;
+			CancelIoEx(watched.handle, &watched.overlapped);
+			GetOverlappedResult(watched.handle, &watched.overlapped, &bytes, TRUE);
+			CloseHandle(watched.overlapped.hEvent);
+			CloseHandle(watched.handle);
+			dirs_.erase(it);
+			return;
+		}
+	}
+
+	bool Wait(std::chrono::milliseconds timeout, std::vector<std::filesystem::path>& changed,
+		std::vector<std::filesystem::path>& overflowed, std::string& error) override
+	{
+		HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+		handles[0] = wake_;
+		for (size_t i = 0; i < dirs_.size(); ++i)
+			handles[i + 1] = dirs_[i]->overlapped.hEvent;
+
+		DWORD result = WaitForMultipleObjects((DWORD)dirs_.size() + 1, handles, FALSE, (DWORD)timeout.count());
+		if (result == WAIT_TIMEOUT)
+			return true;
+		if (result == WAIT_FAILED)
+		{
+			error = "WaitForMultipleObjects failed with error " + std::to_string(GetLastError());
+			return false;
+		}
+
+		size_t index = result - WAIT_OBJECT_0;
+		if (index == 0)
+		{
+			ResetEvent(wake_);
+			return true;
+		}
+
+		Dir& watched = *dirs_[index - 1];
+		DWORD bytes = 0;
+		BOOL ok = GetOverlappedResult(watched.handle, &watched.overlapped, &bytes, FALSE);
+		ResetEvent(watched.overlapped.hEvent);
+
+		if (!ok || bytes == 0)
+		{
+			// buffer overflow (bytes == 0) or a transient failure: let the service rescan
+			overflowed.push_back(watched.path);
+		}
+		else
+		{
+			const BYTE* p = watched.buffer;
+			for (;;)
+			{
+				const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+				changed.push_back(watched.path / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+				if (info->NextEntryOffset == 0)
+					break;
+				p += info->NextEntryOffset;
+			}
+		}
+
+		if (!Arm(watched))
+		{
+			// the directory was deleted or its volume went away; drop it rather than spin
+			std::filesystem::path gone = watched.path;
+			LOG("neuRLcar: lost the watch on {} (error {})", gone.string(), GetLastError());
+			Remove(gone);
+		}
+		return true;
+	}
+
+	void Wake() override
+	{
+		SetEvent(wake_);
+	}
+
+private:
+	struct Dir
+	{
+		std::filesystem::path path;
+		HANDLE handle = INVALID_HANDLE_VALUE;
+		OVERLAPPED overlapped{};
+		alignas(DWORD) BYTE buffer[32 * 1024];
+	};
+
+	bool Arm(Dir& watched)
+	{
+		return ReadDirectoryChangesW(watched.handle, watched.buffer, sizeof(watched.buffer), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
+			nullptr, &watched.overlapped, nullptr) != FALSE;
+	}
+
+	HANDLE wake_;
+	std::vector<std::unique_ptr<Dir>> dirs_;
+};
+
+std::unique_ptr<DirectoryWatchBackend> CreateDirectoryWatchBackend(std::string& error)
+{
+	HANDLE wake = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	if (!wake)
+	{
+		error = "CreateEvent failed with error " + std::to_string(GetLastError());
+		return nullptr;
+	}
+	return std::make_unique<Win32WatchBackend>(wake);
+}
+
+#endif // _WIN32
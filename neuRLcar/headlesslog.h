@@ -0,0 +1,93 @@
+#pragma once
+// LOG/DEBUGLOG for the CMake benchmarks and tests, which build the plugin's portable modules
+// without the BakkesMod SDK (pch.h includes this when NEURLCAR_HEADLESS is defined).
+// Lines go to stderr instead of the console.
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#if __has_include(<format>)
+#include <format>
+#endif
+
+constexpr bool DEBUG_LOG = false;
+
+namespace headlesslog
+{
+#if defined(__cpp_lib_format)
+	template <typename... Args>
+	std::string Format(std::string_view fmt, Args&&... args)
+	{
+		return std::vformat(fmt, std::make_format_args(args...));
+	}
+#else
+	// Enough of std::format for the log lines: "{}", "{:.Nf}" and "{:0N}", with "{{"/"}}" escapes
+	inline void Append(std::ostringstream& out, std::string_view fmt)
+	{
+		for (size_t i = 0; i < fmt.size(); ++i)
+		{
+			out << fmt[i];
+			if ((fmt[i] == '{' || fmt[i] == '}') && i + 1 < fmt.size() && fmt[i + 1] == fmt[i])
+				++i;
+		}
+	}
+
+	template <typename T, typename... Rest>
+	void Append(std::ostringstream& out, std::string_view fmt, T&& value, Rest&&... rest)
+	{
+		size_t open = fmt.find('{');
+		while (open != std::string_view::npos && open + 1 < fmt.size() && fmt[open + 1] == '{')
+			open = fmt.find('{', open + 2);
+		size_t close = open == std::string_view::npos ? open : fmt.find('}', open);
+		if (close == std::string_view::npos)
+		{
+			Append(out, fmt);
+			return;
+		}
+		Append(out, fmt.substr(0, open));
+
+		std::string_view spec = fmt.substr(open + 1, close - open - 1);
+		std::ostringstream field;
+		if (spec.size() > 1 && spec[0] == ':')
+		{
+			spec.remove_prefix(1);
+			if (spec[0] == '.')
+			{
+				field.setf(std::ios::fixed);
+				field.precision(std::stoi(std::string(spec.substr(1))));
+			}
+			else if (spec[0] == '0')
+			{
+				field.fill('0');
+				field.width(std::stoi(std::string(spec.substr(1))));
+			}
+		}
+		field << value;
+		out << field.str();
+		Append(out, fmt.substr(close + 1), std::forward<Rest>(rest)...);
+	}
+
+	template <typename... Args>
+	std::string Format(std::string_view fmt, Args&&... args)
+	{
+		std::ostringstream out;
+		Append(out, fmt, std::forward<Args>(args)...);
+		return out.str();
+	}
+#endif
+}
+
+template <typename... Args>
+void LOG(std::string_view fmt, Args&&... args)
+{
+	std::string text = headlesslog::Format(fmt, std::forward<Args>(args)...);
+	std::fprintf(stderr, "%s\n", text.c_str());
+}
+
+template <typename... Args>
+void DEBUGLOG(std::string_view fmt, Args&&... args)
+{
+	if constexpr (DEBUG_LOG)
+		LOG(fmt, std::forward<Args>(args)...);
+}
@@ -0,0 +1,942 @@
+#include "pch.h"
+#include "httpclient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using HttpClock = std::chrono::steady_clock;
+
+// a response head or chunk line longer than this is treated as garbage
+static constexpr size_t kMaxLineBytes = 16 << 10;
+static constexpr size_t kMaxHeaderFields = 100;
+
+static std::string Lower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return text;
+}
+
+static std::string Trim(const std::string& text)
+{
+	const size_t begin = text.find_first_not_of(" \t");
+	if (begin == std::string::npos)
+		return {};
+	return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+std::string HttpResponse::Header(const std::string& lowerName) const
+{
+	for (const auto& [name, value] : headers)
+		if (name == lowerName)
+			return value;
+	return {};
+}
+
+bool ParseHttpUrl(const std::string& url, std::string& host, std::string& port, std::string& target, std::string& error)
+{
+	static const std::string scheme = "http://";
+	if (Lower(url.substr(0, scheme.size())) != scheme)
+	{
+		error = "not an http:// url: " + url;
+		return false;
+	}
+
+	const size_t authorityEnd = url.find_first_of("/?#", scheme.size());
+	std::string authority = url.substr(scheme.size(), authorityEnd == std::string::npos ? std::string::npos : authorityEnd - scheme.size());
+	target = authorityEnd == std::string::npos ? "/" : url.substr(authorityEnd);
+	target = target.substr(0, target.find('#'));
+	if (target.empty() || target[0] == '?')
+		target = "/" + target;
+
+	if (authority.find('@') != std::string::npos)
+	{
+		error = "credentials in the url are not supported: " + url;
+		return false;
+	}
+
+	// [v6 address]:port
+	size_t portColon = std::string::npos;
+	if (!authority.empty() && authority[0] == '[')
+	{
+		const size_t close = authority.find(']');
+		if (close == std::string::npos)
+		{
+			error = "bad address in " + url;
+			return false;
+		}
+		host = authority.substr(1, close - 1);
+		if (close + 1 < authority.size() && authority[close + 1] == ':')
+			portColon = close + 1;
+	}
+	else
+	{
+		portColon = authority.rfind(':');
+		host = authority.substr(0, portColon);
+	}
+	port = portColon == std::string::npos ? "80" : authority.substr(portColon + 1);
+
+	if (host.empty() || port.empty() || port.find_first_not_of("0123456789") != std::string::npos)
+	{
+		error = "bad host or port in " + url;
+		return false;
+	}
+	return true;
+}
+
+namespace
+{
+	// Incremental response parser; bytes may be split anywhere
+	class ResponseParser
+	{
+	public:
+		enum class Result { NeedMore, Done, Failed };
+
+		void Reset(bool headRequest, const HttpBodySink* sink)
+		{
+			*this = ResponseParser();
+			headRequest_ = headRequest;
+			sink_ = sink && *sink ? sink : nullptr;
+		}
+
+		Result Feed(const char* data, size_t size)
+		{
+			while (size > 0 && stage_ != Stage::Done && stage_ != Stage::Failed)
+			{
+				const size_t used = Step(data, size);
+				data += used;
+				size -= used;
+			}
+			return Status();
+		}
+
+		// The peer closed the connection; that completes a body that runs to the close
+		Result Closed()
+		{
+			if (stage_ == Stage::ToClose)
+				stage_ = Stage::Done;
+			else if (stage_ != Stage::Done)
+				Fail(stage_ == Stage::StatusLine && line_.empty() ? "connection closed before a response" : "connection closed mid-response");
+			return Status();
+		}
+
+		HttpResponse Take() { return std::move(response_); }
+		bool KeepAlive() const { return keepAlive_; }
+		// The head is in and the body goes to the sink: a failure from here on keeps the status
+		bool Streaming() const { return streaming_; }
+		const std::string& Error() const { return error_; }
+
+	private:
+		enum class Stage { StatusLine, Header, Length, ChunkSize, ChunkData, ChunkEnd, Trailer, ToClose, Done, Failed };
+
+		Result Status() const
+		{
+			return stage_ == Stage::Done ? Result::Done : stage_ == Stage::Failed ? Result::Failed : Result::NeedMore;
+		}
+
+		void Fail(std::string error)
+		{
+			error_ = std::move(error);
+			stage_ = Stage::Failed;
+		}
+
+		void Body(const char* data, size_t size)
+		{
+			if (!streaming_)
+				response_.body.append(data, size);
+			else if (!(*sink_)(data, size))
+				Fail("the body was refused");
+		}
+
+		// Consumes some of data; body bytes are passed on as they are, everything else line by line
+		size_t Step(const char* data, size_t size)
+		{
+			if (stage_ == Stage::Length || stage_ == Stage::ChunkData || stage_ == Stage::ToClose)
+			{
+				const size_t take = stage_ == Stage::ToClose ? size : (size_t)(std::min)((unsigned long long)size, remaining_);
+				Body(data, take);
+				if (stage_ != Stage::ToClose && stage_ != Stage::Failed)
+				{
+					remaining_ -= take;
+					if (remaining_ == 0)
+						stage_ = stage_ == Stage::Length ? Stage::Done : Stage::ChunkEnd;
+				}
+				return take;
+			}
+
+			const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+			const size_t take = newline ? (size_t)(newline - data) + 1 : size;
+			line_.append(data, take);
+			if (line_.size() > kMaxLineBytes)
+			{
+				Fail("response line too long");
+				return take;
+			}
+			if (newline)
+			{
+				std::string line = std::move(line_);
+				line_.clear();
+				line.pop_back();
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				Line(line);
+			}
+			return take;
+		}
+
+		void Line(const std::string& line)
+		{
+			switch (stage_)
+			{
+			case Stage::StatusLine:
+			{
+				// HTTP/1.x <code> <reason>
+				if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12)
+					return Fail("bad status line");
+				try { response_.status = std::stoi(line.substr(9, 3)); }
+				catch (...) { return Fail("bad status line"); }
+				response_.reason = line.size() > 13 ? line.substr(13) : "";
+				keepAlive_ = line[7] != '0';
+				stage_ = Stage::Header;
+				return;
+			}
+			case Stage::Header:
+				if (!line.empty())
+					return Field(line);
+				return EndOfHead();
+			case Stage::ChunkSize:
+			{
+				// size in hex, maybe followed by ;extensions
+				unsigned long long size = 0;
+				size_t digits = 0;
+				for (char c : line)
+				{
+					int value = std::isdigit((unsigned char)c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+					if (value < 0)
+						break;
+					if (++digits > 15)
+						return Fail("chunk too large");
+					size = size * 16 + value;
+				}
+				if (digits == 0)
+					return Fail("bad chunk size");
+				remaining_ = size;
+				stage_ = size == 0 ? Stage::Trailer : Stage::ChunkData;
+				return;
+			}
+			case Stage::ChunkEnd:
+				if (!line.empty())
+					return Fail("chunk longer than its size");
+				stage_ = Stage::ChunkSize;
+				return;
+			case Stage::Trailer:
+				if (line.empty())
+					stage_ = Stage::Done;
+				return;
+			default:
+				return;
+			}
+		}
+
+		void Field(const std::string& line)
+		{
+			const size_t colon = line.find(':');
+			if (colon == std::string::npos || response_.headers.size() >= kMaxHeaderFields)
+				return Fail("bad header field");
+			std::string name = Lower(Trim(line.substr(0, colon)));
+			std::string value = Trim(line.substr(colon + 1));
+
+			if (name == "content-length")
+			{
+				try { contentLength_ = std::stoll(value); }
+				catch (...) { return Fail("bad content-length"); }
+				if (contentLength_ < 0)
+					return Fail("bad content-length");
+			}
+			else if (name == "transfer-encoding")
+				chunked_ = Lower(value).find("chunked") != std::string::npos;
+			else if (name == "connection")
+			{
+				const std::string token = Lower(value);
+				if (token.find("close") != std::string::npos)
+					keepAlive_ = false;
+				else if (token.find("keep-alive") != std::string::npos)
+					keepAlive_ = true;
+			}
+			response_.headers.emplace_back(std::move(name), std::move(value));
+		}
+
+		void EndOfHead()
+		{
+			const int status = response_.status;
+			if (status >= 100 && status < 200)
+			{
+				// an interim response; the real one follows
+				Reset(headRequest_, sink_);
+				return;
+			}
+
+			// error bodies are small and worth reading
+			streaming_ = sink_ && status >= 200 && status < 300;
+
+			if (headRequest_ || status == 204 || status == 304)
+				stage_ = Stage::Done;
+			else if (chunked_)
+				stage_ = Stage::ChunkSize;
+			else if (contentLength_ >= 0)
+			{
+				remaining_ = (unsigned long long)contentLength_;
+				stage_ = remaining_ == 0 ? Stage::Done : Stage::Length;
+			}
+			else
+			{
+				keepAlive_ = false;
+				stage_ = Stage::ToClose;
+			}
+		}
+
+		Stage stage_ = Stage::StatusLine;
+		HttpResponse response_;
+		std::string line_;
+		std::string error_;
+		unsigned long long remaining_ = 0;
+		long long contentLength_ = -1;
+		bool chunked_ = false;
+		bool keepAlive_ = true;
+		bool headRequest_ = false;
+		const HttpBodySink* sink_ = nullptr;   // the pending request's onBody
+		bool streaming_ = false;
+	};
+}
+
+struct HttpClient::Pending
+{
+	uint64_t id = 0;
+	HttpRequest request;
+	DoneFn done;
+	bool inlineDone = false;          // Fetch: completed on the loop thread, not posted
+	std::string hostKey;              // host:port
+	std::string host;
+	std::string port;
+	std::string wire;                 // encoded request
+	HttpClock::time_point deadline;
+	bool retried = false;
+	bool completed = false;
+};
+
+struct HttpClient::Connection
+{
+	std::string hostKey;
+	TcpSocket socket;
+	std::vector<SocketAddress> addresses;   // tried in order while connecting
+	size_t addressIndex = 0;
+	bool connecting = true;
+	bool closed = false;
+	std::shared_ptr<Pending> pending;       // null while idle
+	size_t sent = 0;
+	bool reused = false;
+	bool gotBytes = false;
+	HttpClock::time_point idleSince{};
+	ResponseParser parser;
+};
+
+HttpClient::HttpClient(PostFn post) : post_(std::move(post))
+{
+}
+
+HttpClient::~HttpClient()
+{
+	Stop(std::chrono::milliseconds(-1));
+}
+
+bool HttpClient::Start(std::string& error)
+{
+	if (thread_.joinable())
+		return true;
+	if (!NetInit(error) || !MakeSocketPair(wakeReader_, wakeWriter_, error))
+		return false;
+	stopping_ = false;
+	thread_ = std::thread(&HttpClient::Loop, this);
+	return true;
+}
+
+bool HttpClient::Stop(std::chrono::milliseconds grace)
+{
+	stopping_ = true;
+	Wake();
+	if (thread_.joinable())
+		thread_.join();
+
+	// sent while the loop was winding down
+	std::deque<std::shared_ptr<Pending>> late;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		late.swap(submitted_);
+	}
+	for (auto& pending : late)
+		Complete(pending, HttpResponse{ 0, {}, {}, {}, "http client stopped" });
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto idle = [this]() { return outstanding_ == 0; };
+	if (grace.count() < 0)
+	{
+		idle_.wait(lock, idle);
+		return true;
+	}
+	return idle_.wait_for(lock, grace, idle);
+}
+
+void HttpClient::Post(const char* name, std::function<void()> fn, bool blocking)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++outstanding_;
+	}
+	post_(name, [this, fn = std::move(fn)]() {
+		fn();
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (--outstanding_ == 0)
+			idle_.notify_all();
+	}, blocking);
+}
+
+void HttpClient::Wake()
+{
+	// one byte is enough to wake the loop; it clears the flag before draining
+	if (!wakePending_.exchange(true) && wakeWriter_.Valid())
+	{
+		char byte = 1;
+		wakeWriter_.Send(&byte, 1);
+	}
+}
+
+uint64_t HttpClient::Send(HttpRequest request, DoneFn done)
+{
+	return Submit(std::move(request), std::move(done), false);
+}
+
+uint64_t HttpClient::Submit(HttpRequest request, DoneFn done, bool inlineDone)
+{
+	auto pending = std::make_shared<Pending>();
+	pending->done = std::move(done);
+	pending->inlineDone = inlineDone;
+	pending->deadline = request.timeout.count() < 0 ? HttpClock::time_point::max() : HttpClock::now() + request.timeout;
+
+	std::string target, error;
+	const bool valid = ParseHttpUrl(request.url, pending->host, pending->port, target, error);
+	if (valid)
+	{
+		pending->hostKey = pending->host + ":" + pending->port;
+		const std::string host = pending->host.find(':') != std::string::npos ? "[" + pending->host + "]" : pending->host;
+		std::string& wire = pending->wire;
+		wire = request.method + " " + target + " HTTP/1.1\r\n"
+			"Host: " + host + (pending->port == "80" ? "" : ":" + pending->port) + "\r\n";
+		for (const auto& [name, value] : request.headers)
+			wire += name + ": " + value + "\r\n";
+		if (!request.body.empty() || request.method == "POST" || request.method == "PUT")
+			wire += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+		wire += "\r\n";
+		wire += request.body;
+	}
+	pending->request = std::move(request);
+	pending->request.body.clear();   // only the wire copy is needed
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending->id = nextId_++;
+		++stats_.requests;
+		if (valid && !stopping_)
+			submitted_.push_back(pending);
+	}
+
+	if (!valid)
+		Complete(pending, HttpResponse{ 0, {}, {}, {}, error });
+	else if (stopping_)
+		Complete(pending, HttpResponse{ 0, {}, {}, {}, "http client stopped" });
+	else
+		Wake();
+	return pending->id;
+}
+
+void HttpClient::Cancel(uint64_t id)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cancelled_.push_back(id);
+	}
+	Wake();
+}
+
+HttpResponse HttpClient::Fetch(HttpRequest request, const std::atomic<bool>* cancel)
+{
+	struct Waiter
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool done = false;
+		HttpResponse response;
+	};
+	auto waiter = std::make_shared<Waiter>();
+	const uint64_t id = Submit(std::move(request), [waiter](HttpResponse response) {
+		std::lock_guard<std::mutex> lock(waiter->mutex);
+		waiter->response = std::move(response);
+		waiter->done = true;
+		waiter->cv.notify_all();
+		}, true);
+
+	std::unique_lock<std::mutex> lock(waiter->mutex);
+	bool cancelSent = false;
+	while (!waiter->done)
+	{
+		waiter->cv.wait_for(lock, std::chrono::milliseconds(100));
+		if (cancel && *cancel && !cancelSent)
+		{
+			cancelSent = true;
+			lock.unlock();
+			Cancel(id);
+			lock.lock();
+		}
+	}
+	return std::move(waiter->response);
+}
+
+HttpClient::Stats HttpClient::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+void HttpClient::Complete(std::shared_ptr<Pending> pending, HttpResponse response)
+{
+	if (pending->completed)
+		return;
+	pending->completed = true;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!response.Received() || !response.error.empty())
+			++stats_.failed;
+	}
+
+	if (pending->inlineDone)
+	{
+		pending->done(std::move(response));
+		return;
+	}
+	Post("http response", [done = std::move(pending->done), response = std::move(response)]() mutable {
+		done(std::move(response));
+		}, false);
+}
+
+void HttpClient::Loop()
+{
+	std::vector<SocketPoll> polls;
+	std::vector<Connection*> owners;
+	while (!stopping_)
+	{
+		TakeSubmitted();
+		StartRequests();
+		Expire();
+
+		// sleep until a socket is ready, something is submitted, or the next deadline
+		auto wakeAt = HttpClock::now() + std::chrono::seconds(1);
+		polls.assign(1, SocketPoll{ wakeReader_.Handle(), kSocketReadable });
+		owners.assign(1, nullptr);
+		for (auto& connection : connections_)
+		{
+			short events = kSocketReadable;
+			if (connection->connecting || (connection->pending && connection->sent < connection->pending->wire.size()))
+				events = connection->connecting ? kSocketWritable : kSocketReadable | kSocketWritable;
+			polls.push_back(SocketPoll{ connection->socket.Handle(), events });
+			owners.push_back(connection.get());
+			if (connection->pending)
+				wakeAt = (std::min)(wakeAt, connection->pending->deadline);
+			else
+				wakeAt = (std::min)(wakeAt, connection->idleSince + kIdleConnectionLimit);
+		}
+		for (auto& [hostKey, queue] : waiting_)
+			for (auto& pending : queue)
+				wakeAt = (std::min)(wakeAt, pending->deadline);
+
+		auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - HttpClock::now());
+		PollSockets(polls, (std::max)(timeout, std::chrono::milliseconds(0)) + std::chrono::milliseconds(1));
+
+		if (polls[0].ready)
+		{
+			wakePending_ = false;
+			char drain[64];
+			while (wakeReader_.Recv(drain, sizeof(drain)) > 0)
+			{
+			}
+		}
+
+		for (size_t i = 1; i < polls.size(); ++i)
+		{
+			Connection& connection = *owners[i];
+			const short ready = polls[i].ready;
+			if (connection.closed || ready == 0)
+				continue;
+
+			if (connection.connecting)
+			{
+				std::string error;
+				if (connection.socket.ConnectResult(error))
+				{
+					connection.connecting = false;
+					std::lock_guard<std::mutex> lock(mutex_);
+					++stats_.connectionsOpened;
+				}
+				else
+				{
+					// on to the host's next address, if it has one
+					connection.closed = true;
+					connection.socket.Close();
+					if (connection.addressIndex + 1 < connection.addresses.size())
+						OpenConnection(connection.hostKey, std::move(connection.addresses), connection.addressIndex + 1, std::move(connection.pending));
+					else
+					{
+						{
+							std::lock_guard<std::mutex> lock(mutex_);
+							dns_.erase(connection.hostKey);   // looked up again next time
+						}
+						Complete(std::move(connection.pending), HttpResponse{ 0, {}, {}, {}, error });
+					}
+					continue;
+				}
+			}
+
+			if (ready & kSocketWritable)
+				OnWritable(connection);
+			if (!connection.closed && (ready & (kSocketReadable | kSocketFailed)))
+				OnReadable(connection);
+		}
+
+		connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+			[](const std::unique_ptr<Connection>& connection) { return connection->closed; }), connections_.end());
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		stats_.openConnections = (int)connections_.size();
+		stats_.inFlight = (int)submitted_.size();
+		for (auto& [hostKey, queue] : waiting_)
+			stats_.inFlight += (int)queue.size();
+		for (auto& connection : connections_)
+			stats_.inFlight += connection->pending ? 1 : 0;
+	}
+
+	// stopping: everything still open fails
+	TakeSubmitted();
+	for (auto& [hostKey, queue] : waiting_)
+		for (auto& pending : queue)
+			Complete(pending, HttpResponse{ 0, {}, {}, {}, "http client stopped" });
+	waiting_.clear();
+	for (auto& connection : connections_)
+		if (connection->pending)
+			Abort(*connection, "http client stopped");
+	connections_.clear();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	stats_.openConnections = 0;
+	stats_.inFlight = 0;
+}
+
+void HttpClient::TakeSubmitted()
+{
+	std::deque<std::shared_ptr<Pending>> submitted;
+	std::vector<uint64_t> cancelled;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		submitted.swap(submitted_);
+		cancelled.swap(cancelled_);
+	}
+	for (auto& pending : submitted)
+		waiting_[pending->hostKey].push_back(std::move(pending));
+
+	for (uint64_t id : cancelled)
+	{
+		for (auto& [hostKey, queue] : waiting_)
+		{
+			auto found = std::find_if(queue.begin(), queue.end(), [id](const auto& pending) { return pending->id == id; });
+			if (found != queue.end())
+			{
+				Complete(*found, HttpResponse{ 0, {}, {}, {}, "cancelled" });
+				queue.erase(found);
+			}
+		}
+		// a request on the wire takes its connection with it
+		for (auto& connection : connections_)
+		{
+			if (connection->pending && connection->pending->id == id)
+				Abort(*connection, "cancelled");
+		}
+	}
+}
+
+void HttpClient::StartRequests()
+{
+	const auto now = HttpClock::now();
+	for (auto it = waiting_.begin(); it != waiting_.end();)
+	{
+		const std::string& hostKey = it->first;
+		auto& queue = it->second;
+
+		// kept-alive connections first
+		for (auto& connection : connections_)
+		{
+			if (queue.empty())
+				break;
+			if (connection->hostKey == hostKey && !connection->connecting && !connection->closed && !connection->pending)
+			{
+				Assign(*connection, queue.front());
+				queue.pop_front();
+			}
+		}
+
+		int open = 0;
+		for (auto& connection : connections_)
+			open += connection->hostKey == hostKey && !connection->closed ? 1 : 0;
+
+		if (!queue.empty() && open < kMaxConnectionsPerHost)
+		{
+			std::vector<SocketAddress> addresses;
+			std::string lookupError;
+			bool lookup = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				DnsEntry& entry = dns_[hostKey];
+				if (!entry.addresses.empty() && now < entry.expires)
+				{
+					addresses = entry.addresses;
+					++stats_.dnsCacheHits;
+				}
+				else if (!entry.error.empty())
+				{
+					// the requests that were waiting for this lookup fail; later ones look it up again
+					lookupError = entry.error;
+					entry.error.clear();
+				}
+				else if (!entry.resolving)
+				{
+					entry.resolving = true;
+					++stats_.dnsLookups;
+					lookup = true;
+				}
+			}
+
+			if (!lookupError.empty())
+			{
+				for (auto& pending : queue)
+					Complete(pending, HttpResponse{ 0, {}, {}, {}, lookupError });
+				queue.clear();
+			}
+			else if (lookup)
+				Lookup(hostKey, queue.front()->host, queue.front()->port);
+			else if (!addresses.empty())   // otherwise a lookup is under way
+			{
+				for (; !queue.empty() && open < kMaxConnectionsPerHost; ++open)
+				{
+					auto pending = std::move(queue.front());
+					queue.pop_front();
+					OpenConnection(hostKey, addresses, 0, std::move(pending));
+				}
+			}
+		}
+
+		it = queue.empty() ? waiting_.erase(it) : std::next(it);
+	}
+}
+
+void HttpClient::Lookup(const std::string& hostKey, const std::string& host, const std::string& port)
+{
+	// a lookup can take seconds, so not on the loop thread; Stop cancels it
+	Post("dns lookup", [this, hostKey, host, port]() {
+		std::vector<SocketAddress> found;
+		std::string error;
+		const bool ok = ResolveHost(host, port, found, error, &stopping_) && !found.empty();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			DnsEntry& entry = dns_[hostKey];
+			entry.resolving = false;
+			if (ok)
+			{
+				entry.addresses = std::move(found);
+				entry.expires = HttpClock::now() + kDnsCacheLifetime;
+			}
+			else
+				entry.error = error.empty() ? "no address for " + host : error;
+		}
+		Wake();
+		}, true);
+}
+
+void HttpClient::OpenConnection(const std::string& hostKey, std::vector<SocketAddress> addresses, size_t addressIndex, std::shared_ptr<Pending> pending)
+{
+	std::string error;
+	for (; addressIndex < addresses.size(); ++addressIndex)
+	{
+		TcpSocket socket = TcpSocket::Connect(addresses[addressIndex], error);
+		if (!socket.Valid())
+			continue;
+
+		auto connection = std::make_unique<Connection>();
+		connection->hostKey = hostKey;
+		connection->socket = std::move(socket);
+		connection->addresses = std::move(addresses);
+		connection->addressIndex = addressIndex;
+		Assign(*connection, std::move(pending));
+		connections_.push_back(std::move(connection));
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		dns_.erase(hostKey);
+	}
+	Complete(std::move(pending), HttpResponse{ 0, {}, {}, {}, error });
+}
+
+void HttpClient::Assign(Connection& connection, std::shared_ptr<Pending> pending)
+{
+	connection.reused = !connection.connecting;
+	if (connection.reused)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++stats_.connectionsReused;
+	}
+	connection.parser.Reset(pending->request.method == "HEAD", &pending->request.onBody);
+	connection.pending = std::move(pending);
+	connection.sent = 0;
+	connection.gotBytes = false;
+	if (!connection.connecting)
+		OnWritable(connection);
+}
+
+void HttpClient::OnWritable(Connection& connection)
+{
+	if (!connection.pending)
+		return;
+	const std::string& wire = connection.pending->wire;
+	while (connection.sent < wire.size())
+	{
+		const long long sent = connection.socket.Send(wire.data() + connection.sent, wire.size() - connection.sent);
+		if (sent == 0)
+			return;
+		if (sent < 0)
+			return FailConnection(connection, connection.socket.LastError());
+		connection.sent += (size_t)sent;
+	}
+}
+
+void HttpClient::OnReadable(Connection& connection)
+{
+	char buffer[16 << 10];
+	for (;;)
+	{
+		const long long received = connection.socket.Recv(buffer, sizeof(buffer));
+		if (received == 0)
+			return;
+		if (received < 0)
+		{
+			if (!connection.socket.Closed())
+				return FailConnection(connection, connection.socket.LastError());
+			if (!connection.pending)
+			{
+				// an idle connection the server let go
+				connection.closed = true;
+				return;
+			}
+			if (connection.parser.Closed() == ResponseParser::Result::Done)
+				return FinishResponse(connection);
+			return FailConnection(connection, connection.parser.Error());
+		}
+
+		if (!connection.pending)
+		{
+			// nothing was asked; whatever this is, the connection can't be trusted
+			connection.closed = true;
+			connection.socket.Close();
+			return;
+		}
+		connection.gotBytes = true;
+		const auto result = connection.parser.Feed(buffer, (size_t)received);
+		if (result == ResponseParser::Result::Failed)
+			return FailConnection(connection, connection.parser.Error());
+		if (result == ResponseParser::Result::Done)
+			return FinishResponse(connection);
+	}
+}
+
+void HttpClient::FinishResponse(Connection& connection)
+{
+	auto pending = std::move(connection.pending);
+	HttpResponse response = connection.parser.Take();
+
+	// the whole request must have gone out too, or the connection is in an unknown state
+	if (connection.parser.KeepAlive() && connection.sent == pending->wire.size() && !connection.socket.Closed())
+		connection.idleSince = HttpClock::now();
+	else
+	{
+		connection.closed = true;
+		connection.socket.Close();
+	}
+	Complete(std::move(pending), std::move(response));
+}
+
+void HttpClient::FailConnection(Connection& connection, const std::string& error)
+{
+	// a kept-alive connection can be closed by the server just as a request goes out; one fresh
+	// try, but only if nothing of a response arrived
+	if (connection.pending && connection.reused && !connection.gotBytes && !connection.pending->retried)
+	{
+		connection.closed = true;
+		connection.socket.Close();
+		connection.pending->retried = true;
+		waiting_[connection.pending->hostKey].push_front(std::move(connection.pending));
+		return;
+	}
+	Abort(connection, error.empty() ? "connection failed" : error);
+}
+
+// Closes the connection and fails its request. A body already streaming to the sink keeps its
+// head, so the caller can tell a cut-off stream from no response at all.
+void HttpClient::Abort(Connection& connection, const std::string& error)
+{
+	connection.closed = true;
+	connection.socket.Close();
+	auto pending = std::move(connection.pending);
+	if (!pending)
+		return;
+
+	HttpResponse response = connection.parser.Streaming() ? connection.parser.Take() : HttpResponse{};
+	response.error = error;
+	Complete(std::move(pending), std::move(response));
+}
+
+void HttpClient::Expire()
+{
+	const auto now = HttpClock::now();
+	for (auto& [hostKey, queue] : waiting_)
+	{
+		for (auto it = queue.begin(); it != queue.end();)
+		{
+			if (now >= (*it)->deadline)
+			{
+				Complete(*it, HttpResponse{ 0, {}, {}, {}, "timed out" });
+				it = queue.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	for (auto& connection : connections_)
+	{
+		if (connection->closed)
+			continue;
+		if (connection->pending && now >= connection->pending->deadline)
+			Abort(*connection, "timed out");
+		else if (!connection->pending && now - connection->idleSince >= kIdleConnectionLimit)
+		{
+			connection->closed = true;
+			connection->socket.Close();
+		}
+	}
+}
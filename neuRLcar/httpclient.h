@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "netsocket.h"
+
+// Asynchronous HTTP/1.1 client. One event-loop thread drives every request over non-blocking
+// sockets (netsocket.h) with PollSockets, so many polls and uploads can be in flight without a
+// thread each. Connections are kept alive and reused per host, and resolved addresses are
+// cached. Completion callbacks are posted to the plugin's thread pool.
+//
+// http:// only. Request bodies are sent with Content-Length; responses may use Content-Length,
+// chunked transfer coding or end at close. Either way the body is decoded as it arrives, so a
+// request with onBody streams it in constant memory instead of collecting it.
+
+using HttpHeaders = std::vector<std::pair<std::string, std::string>>;
+
+// Takes body bytes as they come off the socket, without chunk framing; false stops the transfer.
+// Runs on the client's loop thread, so it should only hand the bytes on (a file, a decoder).
+using HttpBodySink = std::function<bool(const char* data, size_t size)>;
+
+struct HttpRequest
+{
+	std::string method = "GET";
+	std::string url;                              // http://host[:port][/path][?query]
+	HttpHeaders headers;                          // Host and Content-Length are added
+	std::string body;
+	std::chrono::milliseconds timeout{ 30000 };   // whole exchange, queueing included
+	HttpBodySink onBody;                          // 2xx bodies go here instead of into body
+};
+
+struct HttpResponse
+{
+	int status = 0;               // 0 if no response arrived: see error
+	std::string reason;
+	HttpHeaders headers;          // names lower-cased
+	std::string body;             // empty if the request's onBody took it
+	std::string error;            // connection failure, timeout, cancel or malformed response.
+	                              // Set with a status too if a body cut short went to onBody.
+
+	bool Received() const { return status != 0; }
+	std::string Header(const std::string& lowerName) const;
+};
+
+// Splits an http:// url; false (with error set) if it isn't one
+bool ParseHttpUrl(const std::string& url, std::string& host, std::string& port, std::string& target, std::string& error);
+
+class HttpClient
+{
+public:
+	using DoneFn = std::function<void(HttpResponse response)>;
+	// Runs a task on the plugin's pool; blocking for DNS lookups, which can take a while
+	using PostFn = std::function<void(const char* name, std::function<void()> fn, bool blocking)>;
+
+	struct Stats
+	{
+		uint64_t requests = 0;
+		uint64_t failed = 0;               // no response or a cut-off stream: connection errors, timeouts, cancels
+		uint64_t connectionsOpened = 0;
+		uint64_t connectionsReused = 0;    // requests sent on a kept-alive connection
+		uint64_t dnsLookups = 0;
+		uint64_t dnsCacheHits = 0;
+		int openConnections = 0;
+		int inFlight = 0;
+	};
+
+	static constexpr int kMaxConnectionsPerHost = 6;
+	// below the stand-in's 30 s, so the server isn't the one closing idle connections
+	static constexpr std::chrono::seconds kIdleConnectionLimit{ 15 };
+	static constexpr std::chrono::minutes kDnsCacheLifetime{ 5 };
+
+	explicit HttpClient(PostFn post);
+	~HttpClient();
+
+	HttpClient(const HttpClient&) = delete;
+	HttpClient& operator=(const HttpClient&) = delete;
+
+	bool Start(std::string& error);
+
+	// Queues a request; done is posted to the pool exactly once, also for failures. Returns an
+	// id for Cancel. Any thread.
+	uint64_t Send(HttpRequest request, DoneFn done);
+	// done gets a response with error "cancelled" unless it already completed
+	void Cancel(uint64_t id);
+
+	// Send and wait, for threads that may block. cancel is checked while waiting.
+	HttpResponse Fetch(HttpRequest request, const std::atomic<bool>* cancel = nullptr);
+
+	Stats GetStats() const;
+
+	// Fails whatever is in flight, closes every connection and waits up to grace for lookups and
+	// callbacks still on the pool. False if some are; call it again to keep waiting.
+	bool Stop(std::chrono::milliseconds grace);
+
+private:
+	struct Pending;
+	struct Connection;
+	struct DnsEntry
+	{
+		std::vector<SocketAddress> addresses;
+		std::chrono::steady_clock::time_point expires{};
+		bool resolving = false;
+		std::string error;                 // last lookup failed
+	};
+
+	uint64_t Submit(HttpRequest request, DoneFn done, bool inlineDone);
+	void Loop();
+	void Wake();
+	void TakeSubmitted();
+	void StartRequests();
+	void Lookup(const std::string& hostKey, const std::string& host, const std::string& port);
+	void OpenConnection(const std::string& hostKey, std::vector<SocketAddress> addresses, size_t addressIndex, std::shared_ptr<Pending> pending);
+	void Assign(Connection& connection, std::shared_ptr<Pending> pending);
+	void OnReadable(Connection& connection);
+	void OnWritable(Connection& connection);
+	void FinishResponse(Connection& connection);
+	void FailConnection(Connection& connection, const std::string& error);
+	void Abort(Connection& connection, const std::string& error);
+	void Complete(std::shared_ptr<Pending> pending, HttpResponse response);
+	void Expire();
+	void Post(const char* name, std::function<void()> fn, bool blocking);
+
+	PostFn post_;
+	std::thread thread_;
+	TcpSocket wakeReader_;
+	TcpSocket wakeWriter_;
+	std::atomic<bool> stopping_{ false };
+	std::atomic<bool> wakePending_{ false };
+
+	// shared with Send/Cancel and lookups
+	mutable std::mutex mutex_;
+	std::condition_variable idle_;                          // outstanding_ reached 0
+	std::deque<std::shared_ptr<Pending>> submitted_;
+	std::vector<uint64_t> cancelled_;
+	std::map<std::string, DnsEntry> dns_;                   // host:port
+	uint64_t nextId_ = 1;
+	int outstanding_ = 0;                                   // lookups and callbacks on the pool
+	Stats stats_;
+
+	// event loop thread only
+	std::map<std::string, std::deque<std::shared_ptr<Pending>>> waiting_;   // host:port -> not yet sent
+	std::vector<std::unique_ptr<Connection>> connections_;
+};
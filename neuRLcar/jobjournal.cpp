@@ -0,0 +1,266 @@
+#include "pch.h"
+#include "jobjournal.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <sstream>
+
+static constexpr int kMaxInterruptedRuns = 2;
+static constexpr size_t kCompactAfterAppends = 2000;
+
+uint32_t Crc32(std::string_view data)
+{
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+
+	uint32_t crc = 0xFFFFFFFFu;
+	for (unsigned char b : data)
+		crc = table[(crc ^ b) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static std::vector<std::string> SplitTabs(const std::string& text)
+{
+	std::vector<std::string> fields;
+	std::istringstream in(text);
+	std::string field;
+	while (std::getline(in, field, '\t'))
+		fields.push_back(field);
+	return fields;
+}
+
+static std::string FormatRecord(const std::string& payload)
+{
+	char crc[10];
+	std::snprintf(crc, sizeof(crc), "%08x ", Crc32(payload));
+	return crc + payload + '\n';
+}
+
+// Tabs and newlines would break the record; no sane replay path has them
+static bool Recordable(const AnalysisJob& job)
+{
+	for (const std::string& field : { job.model, job.replayId, job.replayPath.string() })
+		if (field.find_first_of("\t\r\n") != std::string::npos)
+			return false;
+	return true;
+}
+
+JobJournal::~JobJournal()
+{
+	Close();
+}
+
+std::vector<JobJournal::Entry> JobJournal::Open(const std::filesystem::path& file)
+{
+	struct Replayed
+	{
+		Entry entry;
+		bool running = false;
+		size_t order = 0;
+	};
+	std::map<std::string, Replayed> jobs;
+	size_t order = 0, torn = 0;
+
+	{
+		std::ifstream in(file, std::ios::binary);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (line.size() < 10 || line[8] != ' ')
+			{
+				torn += !line.empty();
+				continue;
+			}
+			std::string payload = line.substr(9);
+			uint32_t crc = 0;
+			if (std::sscanf(line.c_str(), "%8x", &crc) != 1 || crc != Crc32(payload))
+			{
+				++torn;
+				continue;
+			}
+
+			auto fields = SplitTabs(payload);
+			if (fields.size() < 3 || fields[0].size() != 1)
+				continue;
+			const std::string key = fields[1] + "/" + fields[2];
+
+			switch (fields[0][0])
+			{
+			case 'Q':
+			{
+				if (fields.size() < 6)
+					break;
+				Replayed& job = jobs[key];
+				if (job.entry.model.empty())
+					job.order = order++;
+				job.entry.model = fields[1];
+				job.entry.replayId = fields[2];
+				job.entry.replayPath = fields[3];
+				job.entry.numFrames = std::atoi(fields[4].c_str());
+				job.entry.attempts = std::atoi(fields[5].c_str());
+				job.running = false;
+				break;
+			}
+			case 'R':
+			{
+				auto it = jobs.find(key);
+				if (it != jobs.end())
+					it->second.running = true;
+				break;
+			}
+			case 'F':
+			case 'X':
+				jobs.erase(key);
+				break;
+			}
+		}
+	}
+
+	if (torn)
+		LOG("neuRLcar: skipped {} damaged line(s) in {}", torn, file.string());
+
+	std::vector<Replayed> unfinished;
+	for (auto& [key, job] : jobs)
+	{
+		if (job.running && ++job.entry.attempts > kMaxInterruptedRuns)
+		{
+			LOG("neuRLcar: not resuming {}, it was interrupted {} times", key, job.entry.attempts);
+			continue;
+		}
+		unfinished.push_back(std::move(job));
+	}
+	std::sort(unfinished.begin(), unfinished.end(), [](const Replayed& a, const Replayed& b) { return a.order < b.order; });
+
+	std::vector<Entry> entries;
+	std::lock_guard<std::mutex> lock(mutex_);
+	file_ = file;
+	out_.close();
+	out_.open(file_, std::ios::binary | std::ios::app);
+	pending_.clear();
+	attempts_.clear();
+	nextOrder_ = 0;
+	appended_ = 0;
+	for (auto& job : unfinished)
+	{
+		attempts_[job.entry.Key()] = job.entry.attempts;
+		entries.push_back(std::move(job.entry));
+	}
+	return entries;
+}
+
+void JobJournal::Queued(const AnalysisJob& job)
+{
+	if (!Recordable(job))
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!out_.is_open())
+		return;
+	auto attempts = attempts_.find(job.Key());
+	std::string payload = "Q\t" + job.model + "\t" + job.replayId + "\t" + job.replayPath.string() + "\t" +
+		std::to_string(job.numFrames) + "\t" + std::to_string(attempts == attempts_.end() ? 0 : attempts->second);
+	auto [it, added] = pending_.try_emplace(job.Key());
+	if (added)
+		it->second.order = nextOrder_++;
+	it->second.payload = payload;
+	it->second.started.clear();
+	Append(payload);
+}
+
+void JobJournal::Running(const AnalysisJob& job)
+{
+	if (!Recordable(job))
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!out_.is_open())
+		return;
+	std::string payload = "R\t" + job.model + "\t" + job.replayId;
+	auto it = pending_.find(job.Key());
+	if (it != pending_.end())
+		it->second.started = payload;
+	Append(payload);
+}
+
+void JobJournal::Finished(const AnalysisJob& job, AnalysisOutcome outcome)
+{
+	if (!Recordable(job))
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!out_.is_open())
+		return;
+	pending_.erase(job.Key());
+	attempts_.erase(job.Key());
+	if (outcome == AnalysisOutcome::Succeeded)
+		Append("F\t" + job.model + "\t" + job.replayId);
+	else
+		Append("X\t" + job.model + "\t" + job.replayId + "\t" + ToString(outcome));
+
+	if (appended_ >= kCompactAfterAppends)
+		CompactLocked();
+}
+
+void JobJournal::Compact()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (out_.is_open())
+		CompactLocked();
+}
+
+void JobJournal::Close()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	out_.close();
+}
+
+void JobJournal::Append(const std::string& payload)
+{
+	out_ << FormatRecord(payload);
+	out_.flush();
+	++appended_;
+}
+
+// Written under a temporary name and renamed over the journal, so a crash leaves the old or the
+// new file, never a mix
+void JobJournal::CompactLocked()
+{
+	std::filesystem::path tmpPath = file_;
+	tmpPath += ".tmp";
+	{
+		std::vector<const Pending*> ordered;
+		for (const auto& [key, pending] : pending_)
+			ordered.push_back(&pending);
+		std::sort(ordered.begin(), ordered.end(), [](const Pending* a, const Pending* b) { return a->order < b->order; });
+
+		std::ofstream tmp(tmpPath, std::ios::binary | std::ios::trunc);
+		for (const Pending* pending : ordered)
+		{
+			tmp << FormatRecord(pending->payload);
+			if (!pending->started.empty())
+				tmp << FormatRecord(pending->started);
+		}
+		if (!tmp)
+			return;
+	}
+
+	out_.close();
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, file_, ec);
+	if (ec)
+		LOG("neuRLcar: could not compact {}: {}", file_.string(), ec.message());
+	out_.open(file_, std::ios::binary | std::ios::app);
+	appended_ = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "analysisqueue.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Append-only record of analysis jobs, so work queued or running when the game exits (or
+// crashes) is picked up again on the next load. One line per event:
+//   <crc32 hex> Q <model> <replay id> <replay path> <frames> <attempts>   queued
+//   <crc32 hex> R <model> <replay id>                                   started
+//   <crc32 hex> F <model> <replay id>                                   finished
+//   <crc32 hex> X <model> <replay id> <outcome>                         failed, timed out or cancelled
+// fields tab separated, the checksum covering everything after it. A line torn by a crash fails
+// its checksum and is skipped. Lines are flushed as they are written, which survives the process
+// dying but not the machine losing power.
+class JobJournal
+{
+public:
+	struct Entry
+	{
+		std::string model;
+		std::string replayId;
+		std::filesystem::path replayPath;
+		int numFrames = 0;
+		int attempts = 0;   // loads that found this job running, i.e. runs that never finished
+
+		std::string Key() const { return model + "/" + replayId; }
+	};
+
+	~JobJournal();
+
+	// Opens (creating) the journal and returns the jobs it left unfinished, oldest first. Jobs
+	// that were interrupted while running too often are dropped, in case they are what crashed.
+	std::vector<Entry> Open(const std::filesystem::path& file);
+
+	void Queued(const AnalysisJob& job);
+	void Running(const AnalysisJob& job);
+	void Finished(const AnalysisJob& job, AnalysisOutcome outcome);
+
+	// Rewrites the file with just the unfinished jobs, and the R record of those running; also
+	// happens as the file grows
+	void Compact();
+	// Later events are ignored, so jobs dropped by a shutdown stay unfinished
+	void Close();
+
+private:
+	void Append(const std::string& payload);
+	void CompactLocked();
+
+	std::mutex mutex_;
+	std::filesystem::path file_;
+	std::ofstream out_;
+	struct Pending
+	{
+		size_t order = 0;      // first queued, so compaction keeps the queue order
+		std::string payload;   // latest Q record
+		std::string started;   // R record once it runs, kept so the next Open counts the attempt
+	};
+	std::map<std::string, Pending> pending_;
+	std::map<std::string, int> attempts_;          // carried over from Open for resumed jobs
+	size_t nextOrder_ = 0;
+	size_t appended_ = 0;                          // since the last compaction
+};
+
+uint32_t Crc32(std::string_view data);
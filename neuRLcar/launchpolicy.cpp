@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "launchpolicy.h"
+
+#include <algorithm>
+#include <bitset>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+static constexpr auto kSlotPoll = std::chrono::milliseconds(100);
+
+static std::string Trim(const std::string& text)
+{
+	size_t begin = text.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+		return {};
+	size_t end = text.find_last_not_of(" \t\r");
+	return text.substr(begin, end - begin + 1);
+}
+
+bool ParseProcessPriority(const std::string& text, ProcessPriority& priority)
+{
+	if (text == "normal" || text == "0") priority = ProcessPriority::Normal;
+	else if (text == "below_normal" || text == "1") priority = ProcessPriority::BelowNormal;
+	else if (text == "idle" || text == "2") priority = ProcessPriority::Idle;
+	else return false;
+	return true;
+}
+
+const char* ToString(ProcessPriority priority)
+{
+	switch (priority)
+	{
+	case ProcessPriority::BelowNormal: return "below_normal";
+	case ProcessPriority::Idle: return "idle";
+	default: return "normal";
+	}
+}
+
+bool ParseAffinity(const std::string& text, uint64_t& mask)
+{
+	if (text == "auto")
+	{
+		mask = DefaultAppletAffinity();
+		return true;
+	}
+	if (text == "all" || text.empty())
+	{
+		mask = 0;
+		return true;
+	}
+	try
+	{
+		size_t used = 0;
+		uint64_t parsed = std::stoull(text, &used, 0);
+		if (used != text.size())
+			return false;
+		mask = parsed;
+		return true;
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+uint64_t DefaultAppletAffinity()
+{
+	uint64_t available = 0;
+#ifdef _WIN32
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+		available = processMask;
+#else
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		for (int cpu = 0; cpu < 64; ++cpu)
+			if (CPU_ISSET(cpu, &set))
+				available |= 1ull << cpu;
+#endif
+	if (std::bitset<64>(available).count() < 4)
+		return 0;
+
+	// drop the two lowest cores this process can use
+	uint64_t mask = available;
+	mask &= mask - 1;
+	mask &= mask - 1;
+	return mask;
+}
+
+void ApplyLaunchConfig(const std::filesystem::path& file, LaunchPolicy& policy)
+{
+	std::ifstream in(file);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		++lineNumber;
+		line = Trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		size_t eq = line.find('=');
+		std::string key = Trim(line.substr(0, eq));
+		std::string value = eq == std::string::npos ? "" : Trim(line.substr(eq + 1));
+
+		bool ok = true;
+		try
+		{
+			if (key == "priority") ok = ParseProcessPriority(value, policy.limits.priority);
+			else if (key == "affinity") ok = ParseAffinity(value, policy.limits.affinityMask);
+			else if (key == "max_concurrent") policy.maxConcurrent = (std::max)(0, std::stoi(value));
+			else if (key == "memory_mb") policy.limits.memoryLimitBytes = (uint64_t)(std::max)(0LL, std::stoll(value)) << 20;
+			else ok = false;
+		}
+		catch (...)
+		{
+			ok = false;
+		}
+
+		if (!ok)
+			LOG("neuRLcar: {}:{}: ignoring '{}'", file.string(), lineNumber, line);
+	}
+}
+
+bool AppletSlots::Acquire(const std::string& model, int maxConcurrent, const std::atomic<bool>* cancel)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (maxConcurrent > 0 && running_[model] >= maxConcurrent)
+	{
+		if (cancel && cancel->load())
+			return false;
+		freed_.wait_for(lock, kSlotPoll);
+	}
+	++running_[model];
+	return true;
+}
+
+void AppletSlots::Release(const std::string& model)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = running_.find(model);
+		if (it != running_.end() && --it->second <= 0)
+			running_.erase(it);
+	}
+	freed_.notify_all();
+}
+
+AppletSlots& appletSlots()
+{
+	static AppletSlots slots;
+	return slots;
+}
+
+AppletSlot::AppletSlot(const LaunchPolicy& policy, const std::atomic<bool>* cancel)
+	: model_(policy.model)
+{
+	acquired_ = appletSlots().Acquire(model_, policy.maxConcurrent, cancel);
+}
+
+AppletSlot::~AppletSlot()
+{
+	if (acquired_)
+		appletSlots().Release(model_);
+}
+
+void AppletUsageStats::Record(const std::string& model, const ProcessUsage& usage, double wallSeconds)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Totals& totals = totals_[model];
+	++totals.runs;
+	totals.cpuSeconds += usage.cpuSeconds;
+	totals.wallSeconds += wallSeconds;
+	totals.peakRssBytes = (std::max)(totals.peakRssBytes, usage.peakRssBytes);
+	totals.last = usage;
+}
+
+std::map<std::string, AppletUsageStats::Totals> AppletUsageStats::Snapshot() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return totals_;
+}
+
+AppletUsageStats& appletUsageStats()
+{
+	static AppletUsageStats stats;
+	return stats;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "processrunner.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+
+// How a model's applet is started. Defaults come from the neurlcar_applet_* cvars; a model can
+// override them in models/<model>/launch.cfg with key=value lines:
+//   priority=normal|below_normal|idle
+//   affinity=auto|all|0xff00      auto keeps the applet off the first two logical cores
+//   max_concurrent=1             applets of this model running at once, 0 = no cap
+//   memory_mb=4096               0 = no cap
+struct LaunchPolicy
+{
+	std::string model;           // concurrency caps are per model
+	ProcessLimits limits;
+	int maxConcurrent = 0;
+};
+
+bool ParseProcessPriority(const std::string& text, ProcessPriority& priority);
+const char* ToString(ProcessPriority priority);
+
+// "auto", "all" or a hex/decimal mask; false if unparseable
+bool ParseAffinity(const std::string& text, uint64_t& mask);
+
+// Every logical core this process may use except the first two, which the game's main and render
+// threads favour; all of them on machines with fewer than four
+uint64_t DefaultAppletAffinity();
+
+// Applies launch.cfg on top of policy; a missing file leaves it unchanged
+void ApplyLaunchConfig(const std::filesystem::path& file, LaunchPolicy& policy);
+
+// Caps how many applets of one model run at once, across one-shot launches and benchmarks
+class AppletSlots
+{
+public:
+	// Blocks until a slot frees up; false if cancel was set while waiting
+	bool Acquire(const std::string& model, int maxConcurrent, const std::atomic<bool>* cancel);
+	void Release(const std::string& model);
+
+private:
+	std::mutex mutex_;
+	std::condition_variable freed_;
+	std::map<std::string, int> running_;
+};
+
+AppletSlots& appletSlots();
+
+// Held for the lifetime of one applet process
+class AppletSlot
+{
+public:
+	AppletSlot(const LaunchPolicy& policy, const std::atomic<bool>* cancel);
+	~AppletSlot();
+
+	AppletSlot(const AppletSlot&) = delete;
+	AppletSlot& operator=(const AppletSlot&) = delete;
+
+	bool Acquired() const { return acquired_; }
+
+private:
+	std::string model_;
+	bool acquired_ = false;
+};
+
+// Measured CPU time and peak RSS of finished applets, per model
+class AppletUsageStats
+{
+public:
+	void Record(const std::string& model, const ProcessUsage& usage, double wallSeconds);
+
+	struct Totals
+	{
+		int runs = 0;
+		double cpuSeconds = 0.0;
+		double wallSeconds = 0.0;
+		uint64_t peakRssBytes = 0;       // largest seen
+		ProcessUsage last;
+	};
+
+	std::map<std::string, Totals> Snapshot() const;
+
+private:
+	mutable std::mutex mutex_;
+	std::map<std::string, Totals> totals_;
+};
+
+AppletUsageStats& appletUsageStats();
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Read-only memory mapping of a whole file (mappedfile_win32.cpp / mappedfile_posix.cpp)
+class MappedFile
+{
+public:
+	virtual ~MappedFile() = default;
+
+	virtual const unsigned char* Data() const = 0;
+	virtual size_t Size() const = 0;
+};
+
+// Empty files map to a null Data() with Size() 0
+std::unique_ptr<MappedFile> MapFileReadOnly(const std::filesystem::path& path, std::string& error);
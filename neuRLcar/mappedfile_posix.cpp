@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "mappedfile.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class PosixMappedFile : public MappedFile
+{
+public:
+	PosixMappedFile(void* data, size_t size) : data_(data), size_(size) {}
+
+	~PosixMappedFile() override
+	{
+		if (data_)
+			munmap(data_, size_);
+	}
+
+	const unsigned char* Data() const override { return static_cast<const unsigned char*>(data_); }
+	size_t Size() const override { return size_; }
+
+private:
+	void* data_;
+	size_t size_;
+};
+
+std::unique_ptr<MappedFile> MapFileReadOnly(const std::filesystem::path& path, std::string& error)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		error = "open " + path.string() + ": " + std::strerror(errno);
+		return nullptr;
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0)
+	{
+		error = "fstat " + path.string() + ": " + std::strerror(errno);
+		close(fd);
+		return nullptr;
+	}
+
+	void* data = nullptr;
+	if (st.st_size > 0)
+	{
+		data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			error = "mmap " + path.string() + ": " + std::strerror(errno);
+			close(fd);
+			return nullptr;
+		}
+		madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	return std::make_unique<PosixMappedFile>(data, (size_t)st.st_size);
+}
+
+#endif // !_WIN32
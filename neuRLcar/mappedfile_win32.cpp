@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "mappedfile.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+class Win32MappedFile : public MappedFile
+{
+public:
+	Win32MappedFile(HANDLE file, HANDLE mapping, const void* data, size_t size)
+		: file_(file), mapping_(mapping), data_(data), size_(size)
+	{
+	}
+
+	~Win32MappedFile() override
+	{
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(mapping_);
+		CloseHandle(file_);
+	}
+
+	const unsigned char* Data() const override { return static_cast<const unsigned char*>(data_); }
+	size_t Size() const override { return size_; }
+
+private:
+	HANDLE file_;
+	HANDLE mapping_;
+	const void* data_;
+	size_t size_;
+};
+
+std::unique_ptr<MappedFile> MapFileReadOnly(const std::filesystem::path& path, std::string& error)
+{
+	// FILE_SHARE_WRITE/DELETE: the game may still be writing or replacing the replay
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		error = "CreateFile " + path.string() + " failed with error " + std::to_string(GetLastError());
+		return nullptr;
+	}
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size))
+	{
+		error = "GetFileSizeEx failed with error " + std::to_string(GetLastError());
+		CloseHandle(file);
+		return nullptr;
+	}
+	if (size.QuadPart == 0)
+		return std::make_unique<Win32MappedFile>(file, nullptr, nullptr, 0);
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		error = "CreateFileMapping failed with error " + std::to_string(GetLastError());
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		error = "MapViewOfFile failed with error " + std::to_string(GetLastError());
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return nullptr;
+	}
+	return std::make_unique<Win32MappedFile>(file, mapping, data, (size_t)size.QuadPart);
+}
+
+#endif // _WIN32
@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "modelmanifest.h"
+#include "sharedresults.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+static std::string Trim(const std::string& text)
+{
+	size_t begin = text.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+		return {};
+	size_t end = text.find_last_not_of(" \t\r");
+	return text.substr(begin, end - begin + 1);
+}
+
+// A bare file or folder name; the manifest must not point outside the model folder
+static bool IsPlainName(const std::string& name)
+{
+	return !name.empty() && name != "." && name != ".." &&
+		name.find_first_of("/\\:") == std::string::npos;
+}
+
+static bool IsIdentifier(const std::string& text, const char* extra)
+{
+	return !text.empty() && std::all_of(text.begin(), text.end(), [extra](char c) {
+		return std::isalnum((unsigned char)c) || c == '_' || std::strchr(extra, c) != nullptr;
+		});
+}
+
+static bool ParseColumnType(const std::string& text, ColumnType& type)
+{
+	if (text == "float") type = ColumnType::Float;
+	else if (text == "probability") type = ColumnType::Probability;
+	else if (text == "int") type = ColumnType::Int;
+	else if (text == "bool") type = ColumnType::Bool;
+	else return false;
+	return true;
+}
+
+int ModelManifest::ColumnIndex(const std::string& name) const
+{
+	for (size_t i = 0; i < columns.size(); ++i)
+		if (columns[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+ModelManifest DefaultModelManifest(const std::string& model)
+{
+	ModelManifest manifest;
+	manifest.applet = model + "_applet.exe";
+	manifest.stream = manifest.shm = manifest.serve = manifest.frames = true;
+	return manifest;
+}
+
+bool LoadModelManifest(const std::filesystem::path& file, const std::string& model, ModelManifest& manifest, std::string& error)
+{
+	std::ifstream in(file);
+	if (!in)
+	{
+		error = "cannot read " + file.filename().string();
+		return false;
+	}
+
+	ModelManifest parsed;
+	parsed.applet = model + "_applet.exe";
+	parsed.csv = false;
+	bool transportsGiven = false;
+	std::set<std::string> names;
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line))
+	{
+		++lineNumber;
+		line = Trim(line.substr(0, line.find('#')));
+		if (line.empty())
+			continue;
+
+		size_t eq = line.find('=');
+		std::string key = Trim(line.substr(0, eq));
+		std::string value = eq == std::string::npos ? "" : Trim(line.substr(eq + 1));
+		auto fail = [&](const std::string& why) {
+			error = "line " + std::to_string(lineNumber) + ": " + why;
+			return false;
+		};
+
+		if (key == "version")
+		{
+			if (!IsIdentifier(value, ".-+"))
+				return fail("version must be letters, digits and . - + _");
+			parsed.version = value;
+		}
+		else if (key == "applet")
+		{
+			if (!IsPlainName(value))
+				return fail("applet must be a file name in the model folder");
+			parsed.applet = value;
+		}
+		else if (key == "runtime")
+		{
+			if (value == "none")
+				parsed.runtime.clear();
+			else if (!IsPlainName(value))
+				return fail("runtime must be a folder name in the model folder or none");
+			else
+				parsed.runtime = value;
+		}
+		else if (key == "frame_rate")
+		{
+			char* end = nullptr;
+			double rate = std::strtod(value.c_str(), &end);
+			if (value.empty() || *end != '\0' || !(rate >= 1.0 && rate <= 1000.0))
+				return fail("frame_rate must be a number between 1 and 1000");
+			parsed.frameRate = rate;
+		}
+		else if (key == "column")
+		{
+			std::istringstream words(value);
+			ManifestColumn column;
+			std::string type, rest;
+			words >> column.name >> type >> rest;
+			if (!IsIdentifier(column.name, "") || !rest.empty())
+				return fail("expected column=<name> <type>");
+			if (!ParseColumnType(type.empty() ? "float" : type, column.type))
+				return fail("unknown column type '" + type + "'");
+			if (!names.insert(column.name).second)
+				return fail("duplicate column '" + column.name + "'");
+			parsed.columns.push_back(column);
+		}
+		else if (key == "transports")
+		{
+			transportsGiven = true;
+			std::istringstream list(value);
+			std::string mode;
+			while (std::getline(list, mode, ','))
+			{
+				mode = Trim(mode);
+				if (mode == "csv") parsed.csv = true;
+				else if (mode == "stream") parsed.stream = true;
+				else if (mode == "shm") parsed.shm = true;
+				else if (mode == "serve") parsed.serve = true;
+				else if (mode == "frames") parsed.frames = true;
+				else return fail("unknown transport '" + mode + "'");
+			}
+		}
+	}
+
+	if (parsed.version.empty())
+	{
+		error = "no version";
+		return false;
+	}
+	if (parsed.columns.empty())
+	{
+		error = "no columns";
+		return false;
+	}
+	if (!transportsGiven)
+		parsed.csv = true;
+	if (!parsed.csv && !parsed.stream && !parsed.shm)
+	{
+		error = "no output transport (csv, stream or shm)";
+		return false;
+	}
+	if ((parsed.serve || parsed.frames) && !parsed.csv)
+	{
+		error = "serve and frames write CSVs and need csv";
+		return false;
+	}
+	if (parsed.shm && parsed.columns.size() > (size_t)kSharedResultsMaxColumns)
+	{
+		error = "shm carries at most " + std::to_string(kSharedResultsMaxColumns) + " columns";
+		return false;
+	}
+
+	manifest = std::move(parsed);
+	return true;
+}
+
+ColumnProjection ProjectionFor(const ModelManifest& manifest, const std::vector<std::string>& wanted)
+{
+	ColumnProjection projection;
+	for (const auto& name : wanted)
+	{
+		int index = name.empty() ? -1 : manifest.ColumnIndex(name);
+		if (!name.empty() && index < 0)
+			return {};
+		projection.source.push_back(index);
+	}
+	projection.sourceColumns = manifest.columns.size();
+	return projection;
+}
+
+bool ApplyProjection(const ColumnProjection& projection, std::vector<std::vector<double>>& data)
+{
+	if (!projection.Matches(data.size()))
+		return false;
+
+	std::vector<std::vector<double>> projected(projection.source.size());
+	for (size_t slot = 0; slot < projection.source.size(); ++slot)
+		if (projection.source[slot] >= 0)
+			projected[slot] = data[projection.source[slot]];
+	data = std::move(projected);
+	return true;
+}
+
+void ResampleToReplayFrames(std::vector<std::vector<double>>& data, double rowRate, double replayFps, int numFrames)
+{
+	if (SameFrameRate(rowRate, replayFps) || rowRate <= 0.0 || replayFps <= 0.0 || numFrames <= 0)
+		return;
+
+	for (auto& column : data)
+	{
+		if (column.empty())
+			continue;
+		std::vector<double> resampled((size_t)numFrames);
+		for (int frame = 0; frame < numFrames; ++frame)
+		{
+			size_t row = (size_t)(frame * rowRate / replayFps);
+			resampled[frame] = column[(std::min)(row, column.size() - 1)];
+		}
+		column = std::move(resampled);
+	}
+}
+
+bool SameFrameRate(double a, double b)
+{
+	return std::fabs(a - b) < 0.5;
+}
+
+std::filesystem::path ModelManifestPath(const std::filesystem::path& modelDir)
+{
+	return modelDir / "model.cfg";
+}
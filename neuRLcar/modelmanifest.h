@@ -0,0 +1,79 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// What a model's applet produces and how it can be run, from models/<model>/model.cfg. Same
+// key=value format as launch.cfg; unknown keys are ignored so newer manifests still load:
+//   version=2024.06-3f2a9c1d       required; identifies the model build (see AnalysisCache)
+//   applet=foo_applet.exe          default <model>_applet.exe
+//   runtime=_internal              folder the applet needs next to it, "none" if self-contained
+//   frame_rate=30                  output rows per second of replay, default 30
+//   column=eval probability        one per output column, in output order;
+//                                  types: float, probability, int, bool
+//   transports=csv,stream,shm      output modes the applet supports: csv, stream (--rows),
+//                                  shm (--shm), serve (--serve) and frames (--frames b e);
+//                                  serve and frames write CSVs, so they need csv too
+enum class ColumnType
+{
+	Float,
+	Probability,
+	Int,
+	Bool,
+};
+
+struct ManifestColumn
+{
+	std::string name;
+	ColumnType type = ColumnType::Float;
+};
+
+struct ModelManifest
+{
+	std::string version;
+	std::string applet;
+	std::string runtime = "_internal";    // empty: no runtime folder needed
+	double frameRate = 30.0;
+	std::vector<ManifestColumn> columns;
+
+	bool csv = true;
+	bool stream = false;
+	bool shm = false;
+	bool serve = false;
+	bool frames = false;
+
+	int ColumnIndex(const std::string& name) const;
+};
+
+// Folder-name conventions for a model without model.cfg. Columns are unknown and every
+// transport is allowed; the neurlcar_applet_* cvars pick one as before.
+ModelManifest DefaultModelManifest(const std::string& model);
+
+// False with `error` (and manifest untouched) if the file can't be read or doesn't validate
+bool LoadModelManifest(const std::filesystem::path& file, const std::string& model, ModelManifest& manifest, std::string& error);
+
+// Maps the columns the plugin reads onto a model's output
+struct ColumnProjection
+{
+	size_t sourceColumns = 0;    // output width the manifest declares
+	std::vector<int> source;     // per plugin slot, the output column; -1 if the model has none
+
+	bool Empty() const { return source.empty(); }
+	// Output of any other width is used positionally rather than guessed at
+	bool Matches(size_t width) const { return !Empty() && width == sourceColumns; }
+};
+
+// Empty (positional) unless the manifest names every non-empty wanted column
+ColumnProjection ProjectionFor(const ModelManifest& manifest, const std::vector<std::string>& wanted);
+
+// data[column][row] -> data[slot][row], dropping unread columns; false and untouched on a width mismatch
+bool ApplyProjection(const ColumnProjection& projection, std::vector<std::vector<double>>& data);
+
+// Repeats or skips rows so a model running at rowRate has one row per replay frame
+void ResampleToReplayFrames(std::vector<std::vector<double>>& data, double rowRate, double replayFps, int numFrames);
+
+// Rates this close are the same for indexing purposes
+bool SameFrameRate(double a, double b);
+
+std::filesystem::path ModelManifestPath(const std::filesystem::path& modelDir);
@@ -0,0 +1,194 @@
+#include "pch.h"
+#include "modelregistry.h"
+
+#include <algorithm>
+
+const ModelInstall* ModelRegistrySnapshot::Find(const std::string& name) const
+{
+	auto it = std::lower_bound(models.begin(), models.end(), name,
+		[](const ModelInstall& model, const std::string& n) { return model.name < n; });
+	return it != models.end() && it->name == name ? &*it : nullptr;
+}
+
+std::string ModelInstallProblem(const std::filesystem::path& modelsDir, const std::string& model, const ModelInstall* install)
+{
+	const auto modelDir = modelsDir / model;
+	if (!install)
+		return "Model folder missing: " + modelDir.string();
+	if (!install->manifestError.empty())
+		return "Invalid " + ModelManifestPath(modelDir).string() + ": " + install->manifestError;
+	if (!install->hasExe)
+		return "Missing applet exe: " + (modelDir / install->manifest.applet).string();
+	if (!install->hasRuntime)
+		return "Missing " + install->manifest.runtime + " folder: " + (modelDir / install->manifest.runtime).string();
+	return {};
+}
+
+void ModelRegistry::Start(std::filesystem::path modelsDir, ThreadPool& pool, FileWatchService* watch, ScannedFn onScanned)
+{
+	modelsDir_ = std::move(modelsDir);
+	pool_ = &pool;
+	watch_ = watch;
+	onScanned_ = std::move(onScanned);
+	stopped_ = false;
+
+	if (watch_)
+		watch_->WatchChanges(modelsDir_, std::chrono::milliseconds(500), [this]() { Refresh(); });
+	Refresh();
+}
+
+void ModelRegistry::Stop()
+{
+	// the watches go with the FileWatchService; a scan still running finishes harmlessly
+	stopped_ = true;
+}
+
+void ModelRegistry::Refresh()
+{
+	if (stopped_)
+		return;
+	// one scan at a time; a request during a scan runs one more afterwards. Both flags are
+	// under mutex_, so a request can't land between the scan's last check and its end.
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (scanQueued_)
+		{
+			rescan_ = true;
+			return;
+		}
+		scanQueued_ = true;
+	}
+	pool_->Post("scan models", [this]() { Scan(); }, TaskPriority::Low);
+}
+
+std::shared_ptr<const ModelRegistrySnapshot> ModelRegistry::Snapshot()
+{
+	std::shared_ptr<const ModelRegistrySnapshot> snapshot;
+	bool poll = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		snapshot = snapshot_;
+		poll = !watch_ && std::chrono::steady_clock::now() - scannedAt_ > kPollInterval;
+	}
+	if (poll)
+		Refresh();
+	return snapshot;
+}
+
+ModelInstall ModelRegistry::Describe(const std::string& model)
+{
+	auto snapshot = Snapshot();
+	if (snapshot->scanned)
+	{
+		if (const ModelInstall* install = snapshot->Find(model))
+			return *install;
+		ModelInstall install;
+		install.name = model;
+		install.manifest = DefaultModelManifest(model);
+		return install;
+	}
+	return Inspect(modelsDir_ / model, nullptr);
+}
+
+// cached is this folder's entry from the last scan, reused when nothing it was read from changed
+ModelInstall ModelRegistry::Inspect(const std::filesystem::path& modelDir, const ModelInstall* cached)
+{
+	ModelInstall install;
+	install.name = modelDir.filename().string();
+
+	// adding or removing the exe or runtime folder changes the folder's mtime; editing model.cfg doesn't
+	std::error_code folderEc, manifestEc;
+	install.folderWrite = std::filesystem::last_write_time(modelDir, folderEc);
+	const auto manifestPath = ModelManifestPath(modelDir);
+	install.manifestWrite = std::filesystem::last_write_time(manifestPath, manifestEc);
+	if (cached && !folderEc && cached->folderWrite == install.folderWrite && cached->manifestWrite == install.manifestWrite)
+		return *cached;
+
+	install.manifest = DefaultModelManifest(install.name);
+	if (!manifestEc)
+	{
+		install.hasManifest = true;
+		if (!LoadModelManifest(manifestPath, install.name, install.manifest, install.manifestError))
+			LOG("neuRLcar: {}: {}", manifestPath.string(), install.manifestError);
+	}
+
+	std::error_code ec;
+	install.hasExe = std::filesystem::is_regular_file(modelDir / install.manifest.applet, ec);
+	install.hasRuntime = install.manifest.runtime.empty() || std::filesystem::is_directory(modelDir / install.manifest.runtime, ec);
+	return install;
+}
+
+void ModelRegistry::Scan()
+{
+	std::shared_ptr<const ModelRegistrySnapshot> previous;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		previous = snapshot_;
+	}
+
+	auto next = std::make_shared<ModelRegistrySnapshot>();
+	next->scanned = true;
+
+	std::error_code ec;
+	for (auto it = std::filesystem::directory_iterator(modelsDir_, ec);
+		!ec && it != std::filesystem::directory_iterator();
+		it.increment(ec))
+	{
+		std::error_code entryEc;
+		if (!it->is_directory(entryEc))
+			continue;
+		next->models.push_back(Inspect(it->path(), previous->Find(it->path().filename().string())));
+	}
+	std::sort(next->models.begin(), next->models.end(),
+		[](const ModelInstall& a, const ModelInstall& b) { return a.name < b.name; });
+
+	auto same = [](const ModelInstall& a, const ModelInstall& b) {
+		return a.name == b.name && a.hasExe == b.hasExe && a.hasRuntime == b.hasRuntime &&
+			a.manifestWrite == b.manifestWrite && a.manifestError == b.manifestError;
+	};
+	bool changed = !previous->scanned || !std::equal(next->models.begin(), next->models.end(),
+		previous->models.begin(), previous->models.end(), same);
+	next->version = previous->version + (changed ? 1 : 0);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		snapshot_ = next;
+		scannedAt_ = std::chrono::steady_clock::now();
+	}
+
+	if (!stopped_)
+	{
+		UpdateWatches(*next);
+		if (onScanned_)
+			onScanned_(*next);
+	}
+
+	bool again = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		scanQueued_ = false;
+		again = rescan_;
+		rescan_ = false;
+	}
+	if (again)
+		Refresh();
+}
+
+// Each model folder is watched too: the exe or _internal appearing there isn't an event in models/
+void ModelRegistry::UpdateWatches(const ModelRegistrySnapshot& snapshot)
+{
+	if (!watch_)
+		return;
+
+	std::set<std::filesystem::path> dirs;
+	for (const auto& model : snapshot.models)
+		dirs.insert(modelsDir_ / model.name);
+
+	for (const auto& dir : watchedDirs_)
+		if (!dirs.count(dir))
+			watch_->Unwatch(dir);
+	for (const auto& dir : dirs)
+		if (!watchedDirs_.count(dir))
+			watch_->WatchChanges(dir, std::chrono::milliseconds(500), [this]() { Refresh(); });
+	watchedDirs_ = std::move(dirs);
+}
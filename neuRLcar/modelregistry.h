@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+#include "filewatcher.h"
+#include "modelmanifest.h"
+
+// Install status of one folder under data/neurlcar/models
+struct ModelInstall
+{
+	std::string name;
+	ModelManifest manifest;                            // DefaultModelManifest without a model.cfg
+	bool hasManifest = false;
+	std::string manifestError;                         // model.cfg exists but didn't validate
+	bool hasExe = false;                               // <name>/<manifest.applet>
+	bool hasRuntime = false;                           // <name>/<manifest.runtime>/, or none needed
+	std::filesystem::file_time_type folderWrite{};     // the status is reused while these are unchanged
+	std::filesystem::file_time_type manifestWrite{};
+
+	bool Ready() const { return manifestError.empty() && hasExe && hasRuntime; }
+};
+
+struct ModelRegistrySnapshot
+{
+	bool scanned = false;                // false until the first scan has finished
+	uint64_t version = 0;                // bumped by every scan that changed something
+	std::vector<ModelInstall> models;    // sorted by name
+
+	const ModelInstall* Find(const std::string& name) const;
+};
+
+// Why a model can't run ("" when it can); also what the setup page shows
+std::string ModelInstallProblem(const std::filesystem::path& modelsDir, const std::string& model, const ModelInstall* install);
+
+// Install status and manifest of every model folder, scanned on the thread pool. The models
+// folder and each model's folder are change-watched, so adding or deleting an applet or editing
+// model.cfg triggers a rescan; a folder whose own and whose model.cfg's mtimes haven't moved
+// keeps its cached status and parsed manifest. Readers only ever see an immutable snapshot,
+// so the settings page can ask every frame without touching the filesystem.
+class ModelRegistry
+{
+public:
+	// Called on a pool thread after every scan
+	using ScannedFn = std::function<void(const ModelRegistrySnapshot& snapshot)>;
+
+	ModelRegistry() = default;
+	~ModelRegistry() = default;
+
+	ModelRegistry(const ModelRegistry&) = delete;
+	ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+	// watch may be null (file watching unavailable); snapshots then go stale after kPollInterval
+	void Start(std::filesystem::path modelsDir, ThreadPool& pool, FileWatchService* watch, ScannedFn onScanned);
+	void Stop();
+
+	// Queues a rescan; coalesced with one already queued or running
+	void Refresh();
+
+	std::shared_ptr<const ModelRegistrySnapshot> Snapshot();
+	const std::filesystem::path& ModelsDir() const { return modelsDir_; }
+
+	// From the snapshot, or read directly while the first scan hasn't finished
+	ModelInstall Describe(const std::string& model);
+
+	static constexpr std::chrono::seconds kPollInterval{ 30 };
+
+private:
+	static ModelInstall Inspect(const std::filesystem::path& modelDir, const ModelInstall* cached);
+	void Scan();
+	void UpdateWatches(const ModelRegistrySnapshot& snapshot);
+
+	std::filesystem::path modelsDir_;
+	ThreadPool* pool_ = nullptr;
+	FileWatchService* watch_ = nullptr;
+	ScannedFn onScanned_;
+
+	mutable std::mutex mutex_;
+	std::shared_ptr<const ModelRegistrySnapshot> snapshot_ = std::make_shared<ModelRegistrySnapshot>();
+	std::chrono::steady_clock::time_point scannedAt_{};
+
+	bool scanQueued_ = false;                        // mutex_
+	bool rescan_ = false;                            // mutex_
+	std::atomic<bool> stopped_{ true };
+
+	std::set<std::filesystem::path> watchedDirs_;    // scan only; scans never overlap
+};
@@ -0,0 +1,49 @@
+#include "pch.h"
+#include "netsocket.h"
+
+TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		handle_ = other.handle_;
+		closed_ = other.closed_;
+		error_ = std::move(other.error_);
+		other.handle_ = kInvalidSocket;
+	}
+	return *this;
+}
+
+bool WaitSocket(const TcpSocket& socket, short events, std::chrono::milliseconds timeout)
+{
+	std::vector<SocketPoll> polls = { SocketPoll{ socket.Handle(), events } };
+	// a failed socket counts as ready: the next Send/Recv reports the error
+	return PollSockets(polls, timeout) > 0 && polls[0].ready != 0;
+}
+
+bool MakeSocketPair(TcpSocket& first, TcpSocket& second, std::string& error)
+{
+	TcpSocket listener = TcpSocket::Listen("127.0.0.1", 0, error);
+	if (!listener.Valid())
+		return false;
+
+	std::vector<SocketAddress> addresses;
+	if (!ResolveHost("127.0.0.1", std::to_string(listener.LocalPort()), addresses, error))
+		return false;
+	TcpSocket connecting = TcpSocket::Connect(addresses[0], error);
+	if (!connecting.Valid())
+		return false;
+
+	const auto timeout = std::chrono::milliseconds(2000);
+	TcpSocket accepted = WaitSocket(listener, kSocketReadable, timeout) ? listener.Accept() : TcpSocket();
+	if (!accepted.Valid() || !WaitSocket(connecting, kSocketWritable, timeout) || !connecting.ConnectResult(error))
+	{
+		if (error.empty())
+			error = "loopback socket pair did not connect";
+		return false;
+	}
+
+	first = std::move(accepted);
+	second = std::move(connecting);
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal non-blocking TCP for the remote-analysis client and the local stand-in server
+// (netsocket_win32.cpp / netsocket_posix.cpp). Nothing here blocks except PollSockets.
+
+#ifdef _WIN32
+using SocketHandle = uintptr_t;       // SOCKET
+#else
+using SocketHandle = int;
+#endif
+constexpr SocketHandle kInvalidSocket = (SocketHandle)-1;
+
+// Resolved address, copied so it can be cached and reused
+struct SocketAddress
+{
+	unsigned char bytes[128] = {};    // sockaddr_storage
+	int length = 0;
+	int family = 0;
+
+	std::string ToString() const;
+};
+
+// Starts Winsock once per process; a no-op on POSIX. Every other call assumes it succeeded.
+bool NetInit(std::string& error);
+
+// Blocks until the lookup ends or cancel is set; a lookup the resolver won't stop is left to
+// finish on its own, so a cancelled call returns within about 50 ms either way
+bool ResolveHost(const std::string& host, const std::string& port, std::vector<SocketAddress>& addresses, std::string& error,
+	const std::atomic<bool>* cancel = nullptr);
+
+class TcpSocket
+{
+public:
+	TcpSocket() = default;
+	explicit TcpSocket(SocketHandle handle) : handle_(handle) {}
+	~TcpSocket() { Close(); }
+
+	TcpSocket(TcpSocket&& other) noexcept : handle_(other.handle_), closed_(other.closed_) { other.handle_ = kInvalidSocket; }
+	TcpSocket& operator=(TcpSocket&& other) noexcept;
+	TcpSocket(const TcpSocket&) = delete;
+	TcpSocket& operator=(const TcpSocket&) = delete;
+
+	// Bound and listening; port 0 picks a free one (see LocalPort)
+	static TcpSocket Listen(const std::string& host, uint16_t port, std::string& error);
+	// Connection in progress; it is writable once connected, then ConnectResult tells how it went
+	static TcpSocket Connect(const SocketAddress& address, std::string& error);
+
+	bool ConnectResult(std::string& error) const;
+	// Invalid socket if none is pending
+	TcpSocket Accept() const;
+
+	// Bytes moved, 0 if the call would block, -1 on error (or, for Recv, when the peer closed: see Closed)
+	long long Send(const void* data, size_t size);
+	long long Recv(void* data, size_t size);
+	bool Closed() const { return closed_; }
+
+	uint16_t LocalPort() const;
+	SocketHandle Handle() const { return handle_; }
+	bool Valid() const { return handle_ != kInvalidSocket; }
+	void Close();
+
+	const std::string& LastError() const { return error_; }
+
+private:
+	SocketHandle handle_ = kInvalidSocket;
+	bool closed_ = false;
+	std::string error_;
+};
+
+enum SocketEvents : short
+{
+	kSocketReadable = 1,
+	kSocketWritable = 2,
+	kSocketFailed = 4,     // error or hangup; only ever reported
+};
+
+struct SocketPoll
+{
+	SocketHandle handle = kInvalidSocket;
+	short events = 0;      // SocketEvents to wait for
+	short ready = 0;       // set by PollSockets
+};
+
+// Waits until one of the sockets is ready or timeout passes (negative: forever); returns how
+// many are ready, -1 on error
+int PollSockets(std::vector<SocketPoll>& polls, std::chrono::milliseconds timeout);
+
+// One-socket PollSockets; false on timeout or error
+bool WaitSocket(const TcpSocket& socket, short events, std::chrono::milliseconds timeout);
+
+// Two connected loopback sockets; writing a byte to one wakes a PollSockets waiting on the other
+bool MakeSocketPair(TcpSocket& first, TcpSocket& second, std::string& error);
@@ -0,0 +1,307 @@
+#include "pch.h"
+#include "netsocket.h"
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string ErrnoText(const char* what, int error)
+{
+	return std::string(what) + " failed: " + std::strerror(error);
+}
+
+static bool MakeNonBlocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+bool NetInit(std::string& /*error*/)
+{
+	return true;
+}
+
+static void CopyAddresses(const addrinfo* info, std::vector<SocketAddress>& addresses)
+{
+	addresses.clear();
+	for (const addrinfo* entry = info; entry; entry = entry->ai_next)
+	{
+		if (entry->ai_addrlen > sizeof(SocketAddress::bytes))
+			continue;
+		SocketAddress address;
+		std::memcpy(address.bytes, entry->ai_addr, entry->ai_addrlen);
+		address.length = (int)entry->ai_addrlen;
+		address.family = entry->ai_family;
+		addresses.push_back(address);
+	}
+}
+
+#ifdef __GLIBC__
+
+// getaddrinfo_a's request; it points into the strings, so it is leaked along with them when
+// glibc can't cancel a lookup that already started
+struct AsyncLookup
+{
+	std::string host;
+	std::string port;
+	addrinfo hints = {};
+	gaicb request = {};
+};
+
+bool ResolveHost(const std::string& host, const std::string& port, std::vector<SocketAddress>& addresses, std::string& error,
+	const std::atomic<bool>* cancel)
+{
+	auto lookup = std::make_unique<AsyncLookup>();
+	lookup->host = host;
+	lookup->port = port;
+	lookup->hints.ai_family = AF_UNSPEC;
+	lookup->hints.ai_socktype = SOCK_STREAM;
+	lookup->request.ar_name = lookup->host.c_str();
+	lookup->request.ar_service = lookup->port.c_str();
+	lookup->request.ar_request = &lookup->hints;
+
+	gaicb* list[] = { &lookup->request };
+	int result = getaddrinfo_a(GAI_NOWAIT, list, 1, nullptr);
+	if (result == 0)
+	{
+		const timespec slice = { 0, 50 * 1000 * 1000 };
+		while ((result = gai_error(&lookup->request)) == EAI_INPROGRESS)
+		{
+			if (cancel && cancel->load())
+			{
+				if (gai_cancel(&lookup->request) == EAI_NOTCANCELED)
+					lookup.release();
+				else if (gai_error(&lookup->request) == 0)
+					freeaddrinfo(lookup->request.ar_result);
+				error = "lookup of " + host + " cancelled";
+				return false;
+			}
+			gai_suspend(list, 1, &slice);
+		}
+	}
+	if (result != 0)
+	{
+		error = "cannot resolve " + host + ": " + gai_strerror(result);
+		return false;
+	}
+
+	CopyAddresses(lookup->request.ar_result, addresses);
+	freeaddrinfo(lookup->request.ar_result);
+
+	if (addresses.empty())
+		error = "no addresses for " + host;
+	return !addresses.empty();
+}
+
+#else
+
+// no asynchronous resolver: cancel is only seen before the lookup starts
+bool ResolveHost(const std::string& host, const std::string& port, std::vector<SocketAddress>& addresses, std::string& error,
+	const std::atomic<bool>* cancel)
+{
+	if (cancel && cancel->load())
+	{
+		error = "lookup of " + host + " cancelled";
+		return false;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* info = nullptr;
+	int result = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+	if (result != 0)
+	{
+		error = "cannot resolve " + host + ": " + gai_strerror(result);
+		return false;
+	}
+
+	CopyAddresses(info, addresses);
+	freeaddrinfo(info);
+
+	if (addresses.empty())
+		error = "no addresses for " + host;
+	return !addresses.empty();
+}
+
+#endif
+
+std::string SocketAddress::ToString() const
+{
+	char text[INET6_ADDRSTRLEN] = "?";
+	const sockaddr* address = reinterpret_cast<const sockaddr*>(bytes);
+	if (family == AF_INET)
+		inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(address)->sin_addr, text, sizeof(text));
+	else if (family == AF_INET6)
+		inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr, text, sizeof(text));
+	return text;
+}
+
+TcpSocket TcpSocket::Listen(const std::string& host, uint16_t port, std::string& error)
+{
+	std::vector<SocketAddress> addresses;
+	if (!ResolveHost(host, std::to_string(port), addresses, error))
+		return {};
+
+	TcpSocket socket(::socket(addresses[0].family, SOCK_STREAM, 0));
+	if (!socket.Valid())
+	{
+		error = ErrnoText("socket", errno);
+		return {};
+	}
+
+	int reuse = 1;
+	setsockopt(socket.handle_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	if (!MakeNonBlocking(socket.handle_) ||
+		bind(socket.handle_, reinterpret_cast<const sockaddr*>(addresses[0].bytes), (socklen_t)addresses[0].length) != 0 ||
+		listen(socket.handle_, SOMAXCONN) != 0)
+	{
+		error = ErrnoText(("listen on " + host + ":" + std::to_string(port)).c_str(), errno);
+		return {};
+	}
+	return socket;
+}
+
+TcpSocket TcpSocket::Connect(const SocketAddress& address, std::string& error)
+{
+	TcpSocket socket(::socket(address.family, SOCK_STREAM, 0));
+	if (!socket.Valid() || !MakeNonBlocking(socket.handle_))
+	{
+		error = ErrnoText("socket", errno);
+		return {};
+	}
+
+	// requests are written whole; don't hold small ones back
+	int noDelay = 1;
+	setsockopt(socket.handle_, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+	// an interrupted connect carries on in the background like a non-blocking one
+	int result = ::connect(socket.handle_, reinterpret_cast<const sockaddr*>(address.bytes), (socklen_t)address.length);
+	if (result != 0 && errno != EINPROGRESS && errno != EINTR)
+	{
+		error = ErrnoText(("connect to " + address.ToString()).c_str(), errno);
+		return {};
+	}
+	return socket;
+}
+
+bool TcpSocket::ConnectResult(std::string& error) const
+{
+	int socketError = 0;
+	socklen_t length = sizeof(socketError);
+	if (getsockopt(handle_, SOL_SOCKET, SO_ERROR, &socketError, &length) != 0)
+		socketError = errno;
+	if (socketError != 0)
+		error = ErrnoText("connect", socketError);
+	return socketError == 0;
+}
+
+TcpSocket TcpSocket::Accept() const
+{
+	int fd;
+	do
+		fd = ::accept(handle_, nullptr, nullptr);
+	while (fd == -1 && errno == EINTR);
+	if (fd == -1)
+		return {};
+
+	TcpSocket socket(fd);
+	if (!MakeNonBlocking(fd))
+		return {};
+	int noDelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	return socket;
+}
+
+long long TcpSocket::Send(const void* data, size_t size)
+{
+	ssize_t result;
+	do
+		result = ::send(handle_, data, size, MSG_NOSIGNAL);
+	while (result == -1 && errno == EINTR);
+	if (result >= 0)
+		return result;
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	error_ = ErrnoText("send", errno);
+	return -1;
+}
+
+long long TcpSocket::Recv(void* data, size_t size)
+{
+	ssize_t result;
+	do
+		result = ::recv(handle_, data, size, 0);
+	while (result == -1 && errno == EINTR);
+	if (result > 0)
+		return result;
+	if (result == 0)
+	{
+		closed_ = true;
+		return -1;
+	}
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	error_ = ErrnoText("recv", errno);
+	return -1;
+}
+
+uint16_t TcpSocket::LocalPort() const
+{
+	sockaddr_storage address = {};
+	socklen_t length = sizeof(address);
+	if (getsockname(handle_, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return 0;
+	if (address.ss_family == AF_INET)
+		return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+	if (address.ss_family == AF_INET6)
+		return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+	return 0;
+}
+
+void TcpSocket::Close()
+{
+	if (handle_ != kInvalidSocket)
+		::close(handle_);
+	handle_ = kInvalidSocket;
+}
+
+int PollSockets(std::vector<SocketPoll>& polls, std::chrono::milliseconds timeout)
+{
+	std::vector<pollfd> fds(polls.size());
+	for (size_t i = 0; i < polls.size(); ++i)
+	{
+		fds[i].fd = polls[i].handle;
+		fds[i].events = (short)(((polls[i].events & kSocketReadable) ? POLLIN : 0) | ((polls[i].events & kSocketWritable) ? POLLOUT : 0));
+	}
+
+	int result;
+	do
+		result = ::poll(fds.data(), (nfds_t)fds.size(), timeout.count() < 0 ? -1 : (int)timeout.count());
+	while (result == -1 && errno == EINTR);
+	if (result < 0)
+		return -1;
+
+	for (size_t i = 0; i < polls.size(); ++i)
+	{
+		short ready = 0;
+		if (fds[i].revents & POLLIN) ready |= kSocketReadable;
+		if (fds[i].revents & POLLOUT) ready |= kSocketWritable;
+		if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) ready |= kSocketFailed;
+		polls[i].ready = ready;
+	}
+	return result;
+}
+
+#endif
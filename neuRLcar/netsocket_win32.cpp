@@ -0,0 +1,277 @@
+#include "pch.h"
+#include "netsocket.h"
+
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+static std::string WsaText(const std::string& what, int error)
+{
+	return what + " failed with WSA error " + std::to_string(error);
+}
+
+static bool MakeNonBlocking(SOCKET s)
+{
+	u_long mode = 1;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+}
+
+// WSAStartup is reference counted; the plugin keeps one reference for its lifetime, which
+// FreeLibrary on unload doesn't need to undo
+bool NetInit(std::string& error)
+{
+	static std::once_flag once;
+	static int startupError = 0;
+	std::call_once(once, []() {
+		WSADATA data;
+		startupError = WSAStartup(MAKEWORD(2, 2), &data);
+		});
+	if (startupError != 0)
+		error = WsaText("WSAStartup", startupError);
+	return startupError == 0;
+}
+
+static std::wstring Widen(const std::string& text)
+{
+	std::wstring wide(text.size(), L'\0');
+	int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), wide.data(), (int)wide.size());
+	wide.resize(length > 0 ? length : 0);
+	return wide;
+}
+
+// GetAddrInfoExW writes into these when it completes, so a lookup that doesn't end once it
+// was cancelled leaks them instead of freeing memory the resolver still owns
+struct AsyncLookup
+{
+	OVERLAPPED overlapped = {};
+	ADDRINFOEXW* result = nullptr;
+	HANDLE cancelHandle = nullptr;
+
+	~AsyncLookup()
+	{
+		if (result)
+			FreeAddrInfoExW(result);
+		if (overlapped.hEvent)
+			CloseHandle(overlapped.hEvent);
+	}
+};
+
+bool ResolveHost(const std::string& host, const std::string& port, std::vector<SocketAddress>& addresses, std::string& error,
+	const std::atomic<bool>* cancel)
+{
+	ADDRINFOEXW hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	auto lookup = std::make_unique<AsyncLookup>();
+	lookup->overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	if (!lookup->overlapped.hEvent)
+	{
+		error = WsaText("resolving " + host, (int)GetLastError());
+		return false;
+	}
+
+	int result = GetAddrInfoExW(Widen(host).c_str(), Widen(port).c_str(), NS_ALL, nullptr, &hints, &lookup->result,
+		nullptr, &lookup->overlapped, nullptr, &lookup->cancelHandle);
+	if (result == WSA_IO_PENDING)
+	{
+		while (WaitForSingleObject(lookup->overlapped.hEvent, 50) == WAIT_TIMEOUT)
+		{
+			if (!cancel || !cancel->load())
+				continue;
+			GetAddrInfoExCancel(&lookup->cancelHandle);
+			if (WaitForSingleObject(lookup->overlapped.hEvent, 50) == WAIT_TIMEOUT)
+				lookup.release();
+			error = "lookup of " + host + " cancelled";
+			return false;
+		}
+		result = GetAddrInfoExOverlappedResult(&lookup->overlapped);
+	}
+	if (result != 0)
+	{
+		error = WsaText("resolving " + host, result);
+		return false;
+	}
+
+	addresses.clear();
+	for (ADDRINFOEXW* entry = lookup->result; entry; entry = entry->ai_next)
+	{
+		if (entry->ai_addrlen > sizeof(SocketAddress::bytes))
+			continue;
+		SocketAddress address;
+		std::memcpy(address.bytes, entry->ai_addr, entry->ai_addrlen);
+		address.length = (int)entry->ai_addrlen;
+		address.family = entry->ai_family;
+		addresses.push_back(address);
+	}
+
+	if (addresses.empty())
+		error = "no addresses for " + host;
+	return !addresses.empty();
+}
+
+std::string SocketAddress::ToString() const
+{
+	char text[INET6_ADDRSTRLEN] = "?";
+	const sockaddr* address = reinterpret_cast<const sockaddr*>(bytes);
+	if (family == AF_INET)
+		inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(address)->sin_addr, text, sizeof(text));
+	else if (family == AF_INET6)
+		inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(address)->sin6_addr, text, sizeof(text));
+	return text;
+}
+
+TcpSocket TcpSocket::Listen(const std::string& host, uint16_t port, std::string& error)
+{
+	std::vector<SocketAddress> addresses;
+	if (!ResolveHost(host, std::to_string(port), addresses, error))
+		return {};
+
+	TcpSocket socket((SocketHandle)::socket(addresses[0].family, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.Valid())
+	{
+		error = WsaText("socket", WSAGetLastError());
+		return {};
+	}
+
+	// the Windows default lets another process steal the port; ask for exclusive use instead
+	BOOL exclusive = TRUE;
+	setsockopt((SOCKET)socket.handle_, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, reinterpret_cast<const char*>(&exclusive), sizeof(exclusive));
+	if (!MakeNonBlocking((SOCKET)socket.handle_) ||
+		bind((SOCKET)socket.handle_, reinterpret_cast<const sockaddr*>(addresses[0].bytes), addresses[0].length) != 0 ||
+		listen((SOCKET)socket.handle_, SOMAXCONN) != 0)
+	{
+		error = WsaText("listen on " + host + ":" + std::to_string(port), WSAGetLastError());
+		return {};
+	}
+	return socket;
+}
+
+TcpSocket TcpSocket::Connect(const SocketAddress& address, std::string& error)
+{
+	TcpSocket socket((SocketHandle)::socket(address.family, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.Valid() || !MakeNonBlocking((SOCKET)socket.handle_))
+	{
+		error = WsaText("socket", WSAGetLastError());
+		return {};
+	}
+
+	// requests are written whole; don't hold small ones back
+	BOOL noDelay = TRUE;
+	setsockopt((SOCKET)socket.handle_, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+	if (::connect((SOCKET)socket.handle_, reinterpret_cast<const sockaddr*>(address.bytes), address.length) != 0 &&
+		WSAGetLastError() != WSAEWOULDBLOCK)
+	{
+		error = WsaText("connect to " + address.ToString(), WSAGetLastError());
+		return {};
+	}
+	return socket;
+}
+
+bool TcpSocket::ConnectResult(std::string& error) const
+{
+	int socketError = 0;
+	int length = sizeof(socketError);
+	if (getsockopt((SOCKET)handle_, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError), &length) != 0)
+		socketError = WSAGetLastError();
+	if (socketError != 0)
+		error = WsaText("connect", socketError);
+	return socketError == 0;
+}
+
+TcpSocket TcpSocket::Accept() const
+{
+	SOCKET s = ::accept((SOCKET)handle_, nullptr, nullptr);
+	if (s == INVALID_SOCKET)
+		return {};
+
+	// accepted sockets inherit non-blocking mode from the listener
+	TcpSocket socket((SocketHandle)s);
+	BOOL noDelay = TRUE;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	return socket;
+}
+
+long long TcpSocket::Send(const void* data, size_t size)
+{
+	int chunk = (int)(std::min)(size, (size_t)INT_MAX);
+	int result = ::send((SOCKET)handle_, static_cast<const char*>(data), chunk, 0);
+	if (result != SOCKET_ERROR)
+		return result;
+	if (WSAGetLastError() == WSAEWOULDBLOCK)
+		return 0;
+	error_ = WsaText("send", WSAGetLastError());
+	return -1;
+}
+
+long long TcpSocket::Recv(void* data, size_t size)
+{
+	int chunk = (int)(std::min)(size, (size_t)INT_MAX);
+	int result = ::recv((SOCKET)handle_, static_cast<char*>(data), chunk, 0);
+	if (result > 0)
+		return result;
+	if (result == 0)
+	{
+		closed_ = true;
+		return -1;
+	}
+	if (WSAGetLastError() == WSAEWOULDBLOCK)
+		return 0;
+	error_ = WsaText("recv", WSAGetLastError());
+	return -1;
+}
+
+uint16_t TcpSocket::LocalPort() const
+{
+	sockaddr_storage address = {};
+	int length = sizeof(address);
+	if (getsockname((SOCKET)handle_, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return 0;
+	if (address.ss_family == AF_INET)
+		return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+	if (address.ss_family == AF_INET6)
+		return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+	return 0;
+}
+
+void TcpSocket::Close()
+{
+	if (handle_ != kInvalidSocket)
+		closesocket((SOCKET)handle_);
+	handle_ = kInvalidSocket;
+}
+
+int PollSockets(std::vector<SocketPoll>& polls, std::chrono::milliseconds timeout)
+{
+	std::vector<WSAPOLLFD> fds(polls.size());
+	for (size_t i = 0; i < polls.size(); ++i)
+	{
+		fds[i].fd = (SOCKET)polls[i].handle;
+		fds[i].events = (SHORT)(((polls[i].events & kSocketReadable) ? POLLRDNORM : 0) | ((polls[i].events & kSocketWritable) ? POLLWRNORM : 0));
+	}
+
+	// a connect that fails is reported as POLLERR/POLLHUP, not as writable
+	int result = WSAPoll(fds.data(), (ULONG)fds.size(), timeout.count() < 0 ? -1 : (INT)timeout.count());
+	if (result == SOCKET_ERROR)
+		return -1;
+
+	for (size_t i = 0; i < polls.size(); ++i)
+	{
+		short ready = 0;
+		if (fds[i].revents & POLLRDNORM) ready |= kSocketReadable;
+		if (fds[i].revents & POLLWRNORM) ready |= kSocketWritable;
+		if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) ready |= kSocketFailed;
+		polls[i].ready = ready;
+	}
+	return result;
+}
+
+#endif
@@ -1,6 +1,15 @@
 #include "pch.h"
 #include "neuRLcar.h"
 #include "csvparser.h"
+#include "processrunner.h"
+#include "analysisqueue.h"
+#include "analysisprogress.h"
+#include "appletserver.h"
+#include "rowstream.h"
+#include "sharedresults.h"
+#include "segmentedanalysis.h"
+#include "remoteanalysis.h"
+#include "standinserver.h"
 #include "bakkesmod/core/http_structs.h"
 
 #include <windows.h>
@@ -9,6 +18,9 @@
 #include <vector>
 #include <filesystem>
 #include <string>
+#include <set>
+#include <algorithm>
+#include <cmath>
 
 
 
@@ -27,135 +39,470 @@ std::string testreplayname = "mockypreds.csv";
 char apiKeyInput[256] = "";
 std::string savedApiKey = "";
 
-std::vector<std::vector<double>>& getloadedData() //vector won't work as a global variable without doing this
+static std::atomic<std::shared_ptr<const LoadedDataset>>& loadedDataSlot()
 {
-	static std::vector<std::vector<double>> loadedData;
-	return loadedData;
+	static std::atomic<std::shared_ptr<const LoadedDataset>> slot{ std::make_shared<const LoadedDataset>() };
+	return slot;
 }
 
-bool& replaydataloaded()
+static std::atomic<unsigned>& loadedDataGenerationSlot()
 {
-	static bool replaydataloaded = false;
-	return replaydataloaded;
+	static std::atomic<unsigned> generation{ 0 };
+	return generation;
 }
 
-bool& loadingtoggle() //use this boolean so I don't have to call updateloadeddataset every frame to detect if there's a corresponding replay analysis
+std::shared_ptr<const LoadedDataset> loadedData()
 {
-	static bool loadingtoggle = true;
-	return loadingtoggle;
+	return loadedDataSlot().load();
 }
 
-bool& isinreplay() //use this boolean so I don't have to call updateloadeddataset every frame to detect if there's a corresponding replay analysis
+void publishLoadedData(std::shared_ptr<const LoadedDataset> data)
 {
-	static bool isinreplay = false;
-	return isinreplay;
+	loadedDataSlot().store(data ? std::move(data) : std::make_shared<const LoadedDataset>());
+	++loadedDataGenerationSlot();
 }
 
-bool& wasInReplay_()
+unsigned loadedDataGeneration()
 {
-	static bool wasInReplay = false;
-	return wasInReplay;
+	return loadedDataGenerationSlot().load();
 }
 
-bool runPythonApplet(const std::string& exePath,
+// replays record at 30 fps unless they say otherwise
+static constexpr double kDefaultReplayFps = 30.0;
+// shared results capacity when the replay length isn't known: 30 minutes of replay
+static constexpr double kDefaultSharedResultsSeconds = 30 * 60;
+// rows past the replay's length the shared results segment leaves room for
+static constexpr uint32_t kSharedResultsSlackRows = 64;
+// segments shorter than this (a minute at 30 fps) spend too much of their time warming up
+static constexpr int kMinSegmentFrames = 60 * 30;
+// mean seam disagreement allowed, as a fraction of the column's range
+static constexpr double kSeamTolerance = 0.1;
+// model.cfg column names behind loadedData()'s slots; slot 1 isn't read by the overlay
+static const std::vector<std::string> kOverlayColumns = { "eval", "", "goal_within_3s" };
+
+// Runs an applet to completion, feeding its stdout to onStdout on the reader thread
+static AnalysisOutcome runApplet(const std::string& exePath,
+	std::vector<std::string> args,
+	std::function<void(std::string_view)> onStdout,
+	std::chrono::milliseconds timeout,
+	const std::atomic<bool>* cancel,
+	const LaunchPolicy& policy)
+{
+	// waits while the model is at its cap on concurrent applets
+	AppletSlot slot(policy, cancel);
+	if (!slot.Acquired())
+		return AnalysisOutcome::Cancelled;
+
+	ProcessLaunch launch;
+	launch.exePath = exePath;
+	launch.args = std::move(args);
+	launch.onStdout = std::move(onStdout);
+	launch.limits = policy.limits;
+
+	// stderr is drained while the applet runs, so long warning output can't fill the pipe
+	std::string stderrText;
+	launch.onStderr = [&stderrText](std::string_view chunk) { stderrText.append(chunk); };
+
+	// cancellation and the timeout kill the applet; RunProcess reaps it before returning
+	const auto startedAt = std::chrono::steady_clock::now();
+	ProcessResult result = RunProcess(launch, timeout, cancel);
+
+	if (!result.started)
+	{
+		LOG("RunPythonApplet: " + result.error);
+		return AnalysisOutcome::Failed;
+	}
+
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+	appletUsageStats().Record(policy.model, result.usage, wallSeconds);
+	LOG("RunPythonApplet: applet used {:.1f} s CPU in {:.1f} s, peak RSS {} MB",
+		result.usage.cpuSeconds, wallSeconds, result.usage.peakRssBytes >> 20);
+	if (result.cancelled)
+		return AnalysisOutcome::Cancelled;
+	if (result.timedOut)
+	{
+		LOG("RunPythonApplet: Python applet killed after {} s", std::chrono::duration_cast<std::chrono::seconds>(timeout).count());
+		return AnalysisOutcome::TimedOut;
+	}
+
+	// If there was stderr output, log it
+	if (!stderrText.empty()) { std::ofstream(exePath.substr(0, exePath.find_last_of("\\/")) + "\\applet_stderr.log", std::ios::binary) << stderrText; }
+
+	if (result.exitCode != 0)
+	{
+		LOG("RunPythonApplet: Python applet exited with code " + std::to_string(result.exitCode));
+		LOG("wrote an applet_stderr.log file next to the exe");
+		return AnalysisOutcome::Failed;
+	}
+
+	return AnalysisOutcome::Succeeded;
+}
+
+AnalysisOutcome runPythonApplet(const std::string& exePath,
 	const std::string& replayPath,
-	const std::string& analysisPath)
-{
-	// Build command line
-	std::string cmdLineStr = "\"" + exePath + "\" \"" + replayPath + "\" \"" + analysisPath + "\"";
-
-	// Create pipes for stderr capture
-	SECURITY_ATTRIBUTES sa{};
-	sa.nLength = sizeof(sa);
-	sa.bInheritHandle = TRUE;
-	sa.lpSecurityDescriptor = NULL;
-
-	HANDLE hStdErrRead = NULL;
-	HANDLE hStdErrWrite = NULL;
-
-	if (!CreatePipe(&hStdErrRead, &hStdErrWrite, &sa, 0)) {
-		LOG("RunPythonApplet: Failed CreatePipe() for stderr");
-		return false;
-	}
-
-	// Ensure the read handle is not inherited
-	SetHandleInformation(hStdErrRead, HANDLE_FLAG_INHERIT, 0);
-
-	STARTUPINFOA si{};
-	PROCESS_INFORMATION pi{};
-	si.cb = sizeof(si);
-
-	si.dwFlags = STARTF_USESTDHANDLES;
-	si.hStdError = hStdErrWrite;
-	si.hStdOutput = NULL;
-	si.hStdInput = NULL;
-
-	// Convert command line to modifiable buffer
-	std::vector<char> cmdBuf(cmdLineStr.begin(), cmdLineStr.end());
-	cmdBuf.push_back('\0');
-
-	BOOL ok = CreateProcessA(
-		NULL,
-		cmdBuf.data(),
-		NULL,
-		NULL,
-		TRUE, // IMPORTANT: allow handle inheritance
-		CREATE_NO_WINDOW,
-		NULL,
-		NULL,
-		&si,
-		&pi
-	);
+	const std::string& analysisPath,
+	const AnalysisProgressFn& onProgress = {},
+	std::chrono::milliseconds timeout = kWaitForever,
+	const std::atomic<bool>* cancel = nullptr,
+	const LaunchPolicy& policy = {},
+	std::vector<std::string> extraArgs = {})
+{
+	// progress lines are parsed on the reader thread as they arrive; other stdout is ignored
+	LineSplitter stdoutLines;
+	std::function<void(std::string_view)> onStdout;
+	if (onProgress)
+	{
+		onStdout = [&stdoutLines, &onProgress](std::string_view chunk) {
+			stdoutLines.Feed(chunk, [&onProgress](std::string_view line) {
+				int done = 0, total = 0;
+				if (ParseProgressLine(line, done, total))
+					onProgress(done, total);
+				});
+		};
+	}
+
+	std::vector<std::string> args = { replayPath, analysisPath };
+	args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+	return runApplet(exePath, std::move(args), std::move(onStdout), timeout, cancel, policy);
+}
+
+// `<applet> <replay> <nrlb> --rows`: the applet writes binary rows to stdout (see rowstream.h)
+// instead of a CSV. Rows go to `rows` as they are decoded; the stream itself is saved as the
+// .nrlb file once it ends cleanly.
+AnalysisOutcome runStreamingApplet(const std::string& exePath,
+	const std::string& replayPath,
+	const std::filesystem::path& rowStreamPath,
+	RowStreamBuffer& rows,
+	const std::function<void()>& onRows,
+	const AnalysisProgressFn& onProgress,
+	std::chrono::milliseconds timeout,
+	const std::atomic<bool>* cancel,
+	const LaunchPolicy& policy)
+{
+	std::string captured;
+	int columns = 0, totalRows = 0;
+	long long received = 0;
+	RowStreamDecoder decoder(
+		[&](int cols, int total) { columns = cols; totalRows = total; },
+		[&](const float* data, int rowCount) {
+			rows.Push(data, rowCount, columns);
+			received += rowCount;
+			if (onRows) onRows();
+			if (onProgress && totalRows > 0)
+				onProgress((int)received, totalRows);
+		});
 
-	if (!ok)
+	auto onStdout = [&](std::string_view chunk) {
+		if (decoder.Failed())
+			return;
+		captured.append(chunk.data(), chunk.size());
+		decoder.Feed(chunk);
+	};
+
+	AnalysisOutcome outcome = runApplet(exePath, { replayPath, rowStreamPath.string(), "--rows" }, onStdout, timeout, cancel, policy);
+	if (outcome != AnalysisOutcome::Succeeded)
+		return outcome;
+
+	if (decoder.Failed() || !decoder.Finished())
 	{
-		DWORD err = GetLastError();
-		LOG("RunPythonApplet: CreateProcess failed with error " + std::to_string(err));
-		CloseHandle(hStdErrWrite);
-		CloseHandle(hStdErrRead);
-		return false;
+		LOG("RunPythonApplet: bad row stream ({})", decoder.Failed() ? decoder.Error() : "ended early");
+		return AnalysisOutcome::Failed;
 	}
-	CloseHandle(hStdErrWrite);
 
-	// Wait for the python applet to finish
-	WaitForSingleObject(pi.hProcess, INFINITE);
+	std::string error;
+	if (!SaveRowStreamFile(rowStreamPath, captured, error))
+	{
+		LOG("RunPythonApplet: could not save {} ({})", rowStreamPath.string(), error);
+		return AnalysisOutcome::Failed;
+	}
+	return AnalysisOutcome::Succeeded;
+}
 
-	// Read all stderr output
-	std::string stderrText;
-	char buffer[512];
-	DWORD bytesRead;
+// Rows the applet writes for the job's replay: one per frame, unless model.cfg declares another rate
+static uint32_t SharedResultsCapacity(const AnalysisJob& job)
+{
+	const double fps = job.replayFps > 0.0 ? job.replayFps : kDefaultReplayFps;
+	const double rowRate = job.rowRate > 0.0 ? job.rowRate : fps;
+	const double rows = job.numFrames > 0 ? std::ceil(job.numFrames * rowRate / fps) : kDefaultSharedResultsSeconds * rowRate;
+	return (uint32_t)rows + kSharedResultsSlackRows;
+}
 
-	while (true)
+// `<applet> <replay> <nrlb> --shm <name>`: the applet fills a shared segment (see sharedresults.h)
+// that is polled while it runs. Columns are read in place and handed to `rows` like streamed rows;
+// the result is saved as a .nrlb file so later loads need neither the applet nor the segment.
+AnalysisOutcome runSharedMemoryApplet(const std::string& exePath,
+	const std::string& replayPath,
+	const std::filesystem::path& rowStreamPath,
+	uint32_t capacityRows,
+	RowStreamBuffer& rows,
+	const std::function<void()>& onRows,
+	const AnalysisProgressFn& onProgress,
+	std::chrono::milliseconds timeout,
+	const std::atomic<bool>* cancel,
+	const LaunchPolicy& policy)
+{
+	std::string error;
+	auto segment = SharedResultsReader::Create(capacityRows, error);
+	if (!segment)
 	{
-		BOOL success = ReadFile(hStdErrRead, buffer, sizeof(buffer) - 1, &bytesRead, NULL);
-		if (!success || bytesRead == 0)
-			break;
-		buffer[bytesRead] = '\0';
-		stderrText += buffer;
+		LOG("RunPythonApplet: could not create shared results: {}", error);
+		return AnalysisOutcome::Failed;
 	}
 
-	CloseHandle(hStdErrRead);
+	std::vector<float> all;   // row-major, for the .nrlb
+	SharedResultsReader::Status status;
+	uint32_t copied = 0;
+	bool layoutOk = true;
 
-	// Get exit code
-	DWORD exitCode = 0;
-	GetExitCodeProcess(pi.hProcess, &exitCode);
+	auto poll = [&]() {
+		if (!layoutOk || !segment->ReadStatus(status, error))
+		{
+			layoutOk = false;
+			return;
+		}
+		if (status.rows <= copied)
+			return;
 
-	CloseHandle(pi.hThread);
-	CloseHandle(pi.hProcess);
+		size_t start = all.size();
+		segment->CopyRows(status, copied, all);
+		rows.Push(all.data() + start, (int)(status.rows - copied), (int)status.columns);
+		copied = status.rows;
+		if (onRows) onRows();
+		if (onProgress && status.totalRows > 0)
+			onProgress((int)copied, (int)status.totalRows);
+	};
+
+	std::atomic<bool> stopPolling{ false };
+	std::thread poller([&]() {
+		while (!stopPolling)
+		{
+			poll();
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	});
 
-	// If there was stderr output, log it
-	if (!stderrText.empty()) { std::ofstream(exePath.substr(0, exePath.find_last_of("\\/")) + "\\applet_stderr.log", std::ios::binary) << stderrText; }
+	AnalysisOutcome outcome = runApplet(exePath, { replayPath, rowStreamPath.string(), "--shm", segment->Name() }, nullptr, timeout, cancel, policy);
+	stopPolling = true;
+	poller.join();
+	poll();
 
-	if (exitCode != 0)
+	if (outcome != AnalysisOutcome::Succeeded)
+		return outcome;
+	if (!layoutOk)
 	{
-		LOG("RunPythonApplet: Python applet exited with code " + std::to_string(exitCode));
-		LOG("wrote an applet_stderr.log file next to the exe");
-		return false;
+		LOG("RunPythonApplet: bad shared results ({})", error);
+		return AnalysisOutcome::Failed;
+	}
+	if (status.state != SharedResultsState::Complete || status.columns == 0)
+	{
+		LOG("RunPythonApplet: applet did not complete its shared results{}", status.message.empty() ? "" : ": " + status.message);
+		return AnalysisOutcome::Failed;
 	}
 
-	return true;
+	std::string stream;
+	AppendRowStreamHeader(stream, (int)status.columns, (int)copied);
+	AppendRowStreamRows(stream, all.data(), (int)copied, (int)status.columns);
+	AppendRowStreamEnd(stream, copied);
+	if (!SaveRowStreamFile(rowStreamPath, stream, error))
+	{
+		LOG("RunPythonApplet: could not save {} ({})", rowStreamPath.string(), error);
+		return AnalysisOutcome::Failed;
+	}
+	return AnalysisOutcome::Succeeded;
 }
 
+// An analysis for the local stand-in server (standinserver.h): this machine's applet for the
+// model, streaming rows if its model.cfg allows, otherwise through a CSV read back once complete.
+// Work files go next to the uploaded replay and are removed afterwards.
+static AnalysisOutcome runStandInAnalysis(const std::filesystem::path& modelsDir,
+	const ModelInstall& install,
+	const std::filesystem::path& replayPath,
+	RowStreamBuffer& rows,
+	const std::function<void()>& onRows,
+	const AnalysisProgressFn& onProgress,
+	std::chrono::milliseconds timeout,
+	const std::atomic<bool>& cancel,
+	std::string& error)
+{
+	if (!install.Ready())
+	{
+		error = ModelInstallProblem(modelsDir, install.name, &install);
+		return AnalysisOutcome::Failed;
+	}
+
+	const auto exePath = modelsDir / install.name / install.manifest.applet;
+	LaunchPolicy launch;
+	launch.model = install.name;
+	launch.limits.affinityMask = DefaultAppletAffinity();
+	ApplyLaunchConfig(exePath.parent_path() / "launch.cfg", launch);
+
+	std::filesystem::path work = replayPath;
+	AnalysisOutcome outcome;
+	if (install.hasManifest && install.manifest.stream)
+	{
+		work.replace_extension(".nrlb");
+		outcome = runStreamingApplet(exePath.string(), replayPath.string(), work, rows, onRows, onProgress, timeout, &cancel, launch);
+	}
+	else
+	{
+		work.replace_extension(".csv");
+		outcome = runPythonApplet(exePath.string(), replayPath.string(), work.string(), onProgress, timeout, &cancel, launch);
+		if (outcome == AnalysisOutcome::Succeeded)
+		{
+			auto columns = csvparser(work);
+			size_t rowCount = columns.empty() ? 0 : columns[0].size();
+			for (const auto& column : columns)
+				rowCount = (std::min)(rowCount, column.size());
+
+			std::vector<float> rowMajor(rowCount * columns.size());
+			for (size_t r = 0; r < rowCount; ++r)
+				for (size_t c = 0; c < columns.size(); ++c)
+					rowMajor[r * columns.size() + c] = (float)columns[c][r];
+			if (rowCount > 0)
+			{
+				rows.Push(rowMajor.data(), (int)rowCount, (int)columns.size());
+				onRows();
+			}
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::remove(work, ec);
+	if (outcome != AnalysisOutcome::Succeeded && error.empty())
+		error = std::string("applet ") + ToString(outcome);
+	return outcome;
+}
+
+
+// `<applet> <replay> <csv> --frames <begin> <end>` once per segment, all started at once as
+// blocking pool tasks (still subject to the model's applet cap). The outputs are stitched
+// (segmentedanalysis.h) and saved as a .nrlb. If they can't be stitched, `unstitchable` is set
+// so the caller can rerun the replay in one process.
+static AnalysisOutcome runSegmentedApplet(ThreadPool& pool,
+	const AnalysisJob& job,
+	const std::vector<AnalysisSegment>& segments,
+	const AnalysisProgressFn& onProgress,
+	const std::atomic<bool>& cancel,
+	bool& unstitchable)
+{
+	// one failed segment stops the rest
+	std::atomic<bool> stop{ false };
+	std::vector<std::atomic<int>> done(segments.size());
+	int totalFrames = 0;
+	for (const auto& segment : segments)
+		totalFrames += segment.Rows();
+
+	std::vector<PoolFuture<AnalysisOutcome>> runs;
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		runs.push_back(pool.SubmitBlocking("analysis segment", [&, k]() {
+			AnalysisProgressFn segmentProgress;
+			if (onProgress)
+			{
+				segmentProgress = [&, k](int segmentDone, int) {
+					done[k] = segmentDone;
+					int sum = 0;
+					for (const auto& d : done)
+						sum += d;
+					onProgress(sum, totalFrames);
+				};
+			}
+			const AnalysisSegment& segment = segments[k];
+			return runPythonApplet(job.exePath.string(), job.replayPath.string(), SegmentAnalysisPathFor(job.analysisPath, (int)k).string(),
+				segmentProgress, job.timeout, &stop, job.launch,
+				{ "--frames", std::to_string(segment.begin), std::to_string(segment.end) });
+			}));
+	}
+
+	// the tasks reference this frame, so every one of them is waited for
+	std::vector<AnalysisOutcome> outcomes(runs.size(), AnalysisOutcome::Cancelled);
+	for (bool waiting = true; waiting; )
+	{
+		waiting = false;
+		for (size_t k = 0; k < runs.size(); ++k)
+		{
+			if (!runs[k].Ready())
+			{
+				waiting = true;
+				continue;
+			}
+			try
+			{
+				outcomes[k] = runs[k].Get();
+			}
+			catch (const std::exception&)
+			{
+				outcomes[k] = AnalysisOutcome::Cancelled;   // dropped by the pool's shutdown
+			}
+			if (outcomes[k] != AnalysisOutcome::Succeeded)
+				stop = true;
+		}
+		if (cancel)
+			stop = true;
+		if (waiting)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	std::vector<std::vector<std::vector<double>>> outputs;
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		auto path = SegmentAnalysisPathFor(job.analysisPath, (int)k);
+		if (outcomes[k] == AnalysisOutcome::Succeeded)
+		{
+			try
+			{
+				outputs.push_back(csvparser(path));
+			}
+			catch (const std::exception& e)
+			{
+				LOG("RunPythonApplet: could not read segment {} of {} ({})", k, job.replayId, e.what());
+				outcomes[k] = AnalysisOutcome::Failed;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+	}
+
+	if (cancel)
+		return AnalysisOutcome::Cancelled;
+	for (AnalysisOutcome outcome : { AnalysisOutcome::TimedOut, AnalysisOutcome::Failed, AnalysisOutcome::Cancelled })
+		if (std::find(outcomes.begin(), outcomes.end(), outcome) != outcomes.end())
+			return outcome;
+
+	std::vector<std::vector<double>> stitched;
+	std::vector<SeamCheck> seams;
+	std::string error;
+	const bool stitchedOk = StitchAnalysisSegments(segments, outputs, kSeamTolerance, stitched, seams, error);
+	for (const auto& seam : seams)
+	{
+		if (!seam.ok)
+			LOG("RunPythonApplet: seam at frame {} deviates by {:.1f}% of the column range", seam.frame, seam.deviation * 100.0);
+	}
+	if (!stitchedOk)
+	{
+		LOG("RunPythonApplet: could not stitch {} segments of {} ({})", segments.size(), job.replayId, error);
+		unstitchable = true;
+		return AnalysisOutcome::Failed;
+	}
+
+	const int columns = (int)stitched.size();
+	const int rows = (int)stitched[0].size();
+	std::vector<float> rowMajor((size_t)rows * columns);
+	for (int r = 0; r < rows; ++r)
+		for (int c = 0; c < columns; ++c)
+			rowMajor[(size_t)r * columns + c] = (float)stitched[c][r];
+
+	std::string stream;
+	AppendRowStreamHeader(stream, columns, rows);
+	AppendRowStreamRows(stream, rowMajor.data(), rows, columns);
+	AppendRowStreamEnd(stream, rows);
+	if (!SaveRowStreamFile(RowStreamPathFor(job.analysisPath), stream, error))
+	{
+		LOG("RunPythonApplet: could not save {} ({})", RowStreamPathFor(job.analysisPath).string(), error);
+		return AnalysisOutcome::Failed;
+	}
+	return AnalysisOutcome::Succeeded;
+}
 
 
 
@@ -163,6 +510,21 @@ bool runPythonApplet(const std::string& exePath,
 void neuRLcar::onLoad()
 {
 	_globalCvarManager = cvarManager;
+	analysisProgress_.LoadHistory(gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "analysis_timing.tsv");
+	analysisCache_.Load(gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "replay_hashes.tsv");
+	pool_ = std::make_unique<ThreadPool>([this](const char* name, std::function<void()> fn) {
+		scheduler_.Post(name, std::move(fn));
+		});
+	http_ = std::make_unique<HttpClient>([this](const char* name, std::function<void()> fn, bool blocking) {
+		pool_->Post(name, std::move(fn), TaskPriority::Normal, blocking);
+		});
+	std::string httpError;
+	if (!http_->Start(httpError))
+		LOG("neuRLcar: no networking, remote analyses will fail: {}", httpError);
+	analysisQueue_ = std::make_unique<AnalysisQueue>(
+		[this](const AnalysisJob& job, const std::atomic<bool>& cancel) { return runAnalysisJob(job, cancel); },
+		[this](const AnalysisJob& job, AnalysisOutcome outcome) { onAnalysisJobDone(job, outcome); },
+		[this](std::function<void()> loop) { pool_->Post("analysis worker", std::move(loop), TaskPriority::Normal, true); });
 	gameWrapper->RegisterDrawable(
 		std::bind(&neuRLcar::RenderCanvas, this, std::placeholders::_1)
 	);
@@ -176,12 +538,150 @@ void neuRLcar::onLoad()
 	cvarManager->registerNotifier("updateLoadedDataset", [this](std::vector<std::string> args) { 
 		updateLoadedDataset();
 		}, "", PERMISSION_REPLAY);
+	cvarManager->registerNotifier("neurlcar_analyze_all", [this](std::vector<std::string> args) {
+		enqueueAllReplays();
+		}, "Queue every un-analyzed replay in the Demos folders for background analysis", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_queue_status", [this](std::vector<std::string> args) {
+		LOG("neuRLcar analysis queue: {} queued, {} running, {} workers",
+			analysisQueue_->Queued(), analysisQueue_->Running(), analysisQueue_->Concurrency());
+		}, "Print the neuRLcar analysis queue state", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_applet_stats", [this](std::vector<std::string> args) {
+		auto stats = appletUsageStats().Snapshot();
+		if (stats.empty())
+			LOG("neuRLcar: no applet has finished yet");
+		for (const auto& [model, totals] : stats)
+			LOG("neuRLcar applet '{}': {} runs, {:.1f} s CPU in {:.1f} s, peak RSS {} MB (last run {:.1f} s CPU, {} MB)",
+				model, totals.runs, totals.cpuSeconds, totals.wallSeconds, totals.peakRssBytes >> 20,
+				totals.last.cpuSeconds, totals.last.peakRssBytes >> 20);
+		}, "Print CPU time and peak memory of the analysis applets run so far", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_pool_stats", [this](std::vector<std::string> args) {
+		auto stats = pool_->Stats();
+		LOG("neuRLcar pool: {} threads ({} configured), {} busy, {} blocking; queued {} high / {} normal / {} low, max {}",
+			stats.threads, stats.configured, stats.busy, stats.blocking,
+			stats.queued[0], stats.queued[1], stats.queued[2], stats.maxQueued);
+		LOG("neuRLcar pool: {} tasks run, {} stolen, {} dropped, {:.1f}% utilization",
+			stats.executed, stats.stolen, stats.dropped, stats.utilization * 100.0);
+		if (args.size() > 1 && args[1] == "reset")
+			pool_->ResetStats();
+		}, "Print background pool utilization and queue depth: neurlcar_pool_stats [reset]", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_cancel_analysis", [this](std::vector<std::string> args) {
+		cancelAnalysis();
+		}, "Cancel the running or queued analysis of the replay being viewed", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_cancel_all", [this](std::vector<std::string> args) {
+		analysisQueue_->CancelAll();
+		}, "Cancel every queued and running neuRLcar analysis", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_bench_applet", [this](std::vector<std::string> args) {
+		int runs = 3;
+		if (args.size() > 1)
+		{
+			try { runs = std::stoi(args[1]); }
+			catch (...) {}
+		}
+		RunAppletBenchmark(runs < 1 ? 1 : runs);
+		}, "Compare cold vs resident applet latency on the current replay: neurlcar_bench_applet [runs]", PERMISSION_REPLAY);
+	cvarManager->registerNotifier("neurlcar_sched_stats", [this](std::vector<std::string> args) {
+		auto tick = scheduler_.GetTickStats();
+		LOG("neuRLcar scheduler: budget {}us, {} pending, {} ticks, {} over budget, {} slices deferred",
+			scheduler_.BudgetNs() / 1000, scheduler_.Pending(), tick.ticks, tick.overBudgetTicks, tick.deferredSlices);
+		for (auto& t : scheduler_.Stats())
+			LOG("  {}: {} slices, avg {:.1f}us, max {:.1f}us", t.name, t.slices, t.avgNs / 1000.0, t.maxNs / 1000.0);
+		}, "Print neuRLcar game-thread task scheduler statistics", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_config_stats", [this](std::vector<std::string> args) {
+		auto stats = configSaver_.GetStats();
+		LOG("neuRLcar config: {} save requests, {} writes, {} avoided{}",
+			stats.requests, stats.writes, stats.Avoided(), configSaver_.Dirty() ? ", a save is pending" : "");
+		}, "Print how many config writes settings changes were coalesced into", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_http_stats", [this](std::vector<std::string> args) {
+		auto stats = http_->GetStats();
+		LOG("neuRLcar http: {} requests, {} failed, {} in flight; {} connections opened, {} requests reused one, {} open",
+			stats.requests, stats.failed, stats.inFlight, stats.connectionsOpened, stats.connectionsReused, stats.openConnections);
+		LOG("neuRLcar http: {} dns lookups, {} served from cache", stats.dnsLookups, stats.dnsCacheHits);
+		}, "Print remote analysis connection reuse and dns cache statistics", PERMISSION_ALL);
+	cvarManager->registerNotifier("neurlcar_remote_standin", [this](std::vector<std::string> args) {
+		if (args.size() > 1 && args[1] == "stop")
+		{
+			stopStandIn();
+			return;
+		}
+		int port = 0;
+		if (args.size() > 2)
+		{
+			try { port = std::stoi(args[2]); }
+			catch (...) {}
+		}
+		startStandIn(port < 0 || port > 65535 ? 0 : port);
+		}, "Serve remote analyses from this machine and point neurlcar_remote_url at it: neurlcar_remote_standin [start [port]|stop]", PERMISSION_ALL);
 
 	cvarManager->registerCvar("currentframe", "0", "current replay frame");
 	cvarManager->registerCvar("numframes", "0", "number of frames in this replay");
 	cvarManager->registerCvar("neurlcar_analysis_busy", "0", "1 while neuRLcar analysis is running");
+	cvarManager->getCvar("neurlcar_analysis_busy").setValue(0); // a stale flag from a previous load would block analysis
+	cvarManager->registerCvar("neurlcar_analysis_timeout_s", "900", "Kill an analysis applet after this many seconds (0 = no limit)",
+		true, true, 0.0f, true, 86400.0f);
+	cvarManager->registerCvar("neurlcar_batch_concurrency", "1", "Number of replays analyzed at the same time",
+		true, true, 1.0f, true, 16.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			analysisQueue_->SetConcurrency(cvar.getIntValue());
+		});
+	analysisQueue_->SetConcurrency(cvarManager->getCvar("neurlcar_batch_concurrency").getIntValue());
+	cvarManager->registerCvar("neurlcar_applet_resident", "0", "Keep one applet per model running (--serve) instead of starting it per replay",
+		true, true, 0.0f, true, 1.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			residentApplets_ = cvar.getBoolValue();
+		});
+	residentApplets_ = cvarManager->getCvar("neurlcar_applet_resident").getBoolValue();
+	cvarManager->registerCvar("neurlcar_applet_idle_minutes", "5", "Minutes before an idle resident applet is shut down",
+		true, true, 1.0f, true, 240.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			appletServers_.SetIdleLimit(std::chrono::minutes(cvar.getIntValue()));
+		});
+	appletServers_.SetIdleLimit(std::chrono::minutes(cvarManager->getCvar("neurlcar_applet_idle_minutes").getIntValue()));
+	cvarManager->registerCvar("neurlcar_applet_stream", "0", "Applet streams binary rows over stdout (--rows) instead of writing a CSV (models without model.cfg)",
+		true, true, 0.0f, true, 1.0f);
+	cvarManager->registerCvar("neurlcar_applet_shm", "0", "Applet writes results into shared memory (--shm); takes precedence over neurlcar_applet_stream (models without model.cfg)",
+		true, true, 0.0f, true, 1.0f);
+	cvarManager->registerCvar("neurlcar_applet_priority", "1", "Applet CPU priority: 0 normal, 1 below normal, 2 idle (models/<model>/launch.cfg overrides)",
+		true, true, 0.0f, true, 2.0f);
+	cvarManager->registerCvar("neurlcar_applet_affinity", "auto", "Cores applets may use: auto (all but the first two), all, or a mask like 0xfc");
+	cvarManager->registerCvar("neurlcar_applet_max_concurrent", "0", "Applets of one model running at once (0 = only limited by neurlcar_batch_concurrency)",
+		true, true, 0.0f, true, 16.0f);
+	cvarManager->registerCvar("neurlcar_applet_memory_mb", "0", "Memory cap per applet in MB (0 = none)",
+		true, true, 0.0f, true, 262144.0f);
+	cvarManager->registerCvar("neurlcar_analysis_segments", "1", "Applet processes one long replay is split across (1 = off; the applet must accept --frames <begin> <end>)",
+		true, true, 1.0f, true, 16.0f);
+	cvarManager->registerCvar("neurlcar_segment_overlap_frames", "300", "Frames each later segment starts early so the model warms up before its seam",
+		true, true, 30.0f, true, 3600.0f);
+	cvarManager->registerCvar("neurlcar_pool_threads", "0", "Background worker threads for parsing, indexing and applet supervision (0 = one per core, minus two)",
+		true, true, 0.0f, true, (float)ThreadPool::kMaxThreads)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			pool_->SetThreadCount(cvar.getIntValue());
+		});
+	pool_->SetThreadCount(cvarManager->getCvar("neurlcar_pool_threads").getIntValue());
+	cvarManager->registerCvar("neurlcar_tick_budget_us", "500", "Time budget per game tick for queued neuRLcar work (microseconds)",
+		true, true, 50.0f, true, 20000.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			scheduler_.SetBudget(std::chrono::microseconds(cvar.getIntValue()));
+		});
+	scheduler_.SetBudget(std::chrono::microseconds(cvarManager->getCvar("neurlcar_tick_budget_us").getIntValue()));
+	cvarManager->registerCvar("neurlcar_config_save_delay_ms", "2000", "Settings are saved once they have been left alone this long (writeconfig)",
+		true, true, 0.0f, true, 60000.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			configSaver_.SetQuietPeriod(std::chrono::milliseconds(cvar.getIntValue()));
+		});
+	configSaver_.SetQuietPeriod(std::chrono::milliseconds(cvarManager->getCvar("neurlcar_config_save_delay_ms").getIntValue()));
 
-	cvarManager->registerCvar("neurlcar_model_ready", "0", "1 if the current model has required applet exe and _internal folder");
+	cvarManager->registerCvar("neurlcar_remote_url", "", "Analyze replays on this server (http://host:port) instead of with the local applet; empty = here");
+	cvarManager->registerCvar("neurlcar_remote_api_key", "", "API key for the remote analysis server", false)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) { applyRemoteSettings(); });
+	cvarManager->registerCvar("neurlcar_remote_upload_kbps", "0", "Upload cap for replays sent to the remote server, in KB/s (0 = none)",
+		true, true, 0.0f, true, 1000000.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) { applyRemoteSettings(); });
+	cvarManager->registerCvar("neurlcar_remote_retries", "5", "Times a failed request to the remote server is retried, with growing delays",
+		true, true, 0.0f, true, 20.0f)
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) { applyRemoteSettings(); });
+	applyRemoteSettings();
+
+	cvarManager->registerCvar("neurlcar_model_ready", "0", "1 if the current model has its applet exe and runtime folder and a valid model.cfg, if any");
 
 	cvarManager->registerCvar("neurlcar_ui_show_topbars", "0", "");
 	cvarManager->registerCvar("neurlcar_ui_show_maineval", "1", "");
@@ -197,7 +697,37 @@ void neuRLcar::onLoad()
 	cvarManager->registerCvar("neurlcar_ui_maineval_alpha","165","Alpha transparency for main eval background (0-255)",true, true, 0.0f, true, 255.0f);
 	cvarManager->registerCvar(
 		"neurlcar_ui_open_window_on_replay", "1", "Open neuRLcar window automatically when entering a replay");
-	cvarManager->registerCvar("neurlcar_current_model","neurlcar","Model folder name under bakkesmod/data/neurlcar/models/<model>/");
+	cvarManager->registerCvar("neurlcar_current_model","neurlcar","Model folder name under bakkesmod/data/neurlcar/models/<model>/")
+		.addOnValueChanged([this](std::string oldValue, CVarWrapper cvar) {
+			refreshViewedAnalysisKey();
+			watchAnalysisFolder();
+		});
+	cvarManager->registerCvar("neurlcar_auto_analyze", "1", "Queue replays for background analysis as soon as the game saves them",
+		true, true, 0.0f, true, 1.0f);
+
+	std::string watchError;
+	const bool watching = fileWatch_.Start(watchError);
+	if (watching)
+	{
+		for (const auto& folder : { replayFolderEpic, replayFolder })
+		{
+			std::error_code ec;
+			if (!std::filesystem::is_directory(folder, ec))
+				continue;
+			fileWatch_.Watch(folder, { ".replay" }, std::chrono::seconds(2), [this](const std::filesystem::path& path) {
+				scheduler_.Post("replay saved", [this, path]() { onReplayFileSettled(path); }, TaskPriority::Low);
+				});
+		}
+		watchAnalysisFolder();
+	}
+	else
+	{
+		LOG("neuRLcar: file watching unavailable: {}", watchError);
+	}
+	modelRegistry_.Start(gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "models", *pool_, watching ? &fileWatch_ : nullptr,
+		[this](const ModelRegistrySnapshot&) {
+			scheduler_.Post("models scanned", [this]() { onModelsScanned(); });
+		});
 
 
 
@@ -226,11 +756,158 @@ void neuRLcar::onLoad()
 	}
 
 
-	//call onTick() on every tick
+	//call onTick() on every tick; it returns immediately unless a replay session is active.
+	//Queued game-thread work runs afterwards within the tick budget, then a due config save.
 	gameWrapper->HookEvent("Function Engine.GameViewportClient.Tick",
 		[this](std::string eventName) {
 			onTick();
+			scheduler_.RunTick();
+			configSaver_.Poll();
+		});
+
+	// replay session lifecycle
+	gameWrapper->HookEventPost("Function TAGame.GameInfo_Replay_TA.InitGame",
+		[this](std::string eventName) {
+			onReplayEntered();
+		});
+	gameWrapper->HookEvent("Function TAGame.GameInfo_Replay_TA.Destroyed",
+		[this](std::string eventName) {
+			onReplayLeft();
+		});
+	gameWrapper->HookEvent("Function TAGame.GameEvent_Soccar_TA.Destroyed",
+		[this](std::string eventName) {
+			onReplayLeft();
 		});
+
+	resumeJournaledJobs();
+
+	// plugin (re)loaded while a replay is already open
+	if (gameWrapper->IsInReplay())
+		onReplayEntered();
+}
+
+void neuRLcar::onUnload()
+{
+	// before the flush, so a url pointing at it isn't saved; remote analyses still running fail
+	// over to their retries until the queue shutdown below cancels them
+	stopStandIn();
+
+	// a settings change still inside its quiet period
+	configSaver_.Flush();
+
+	// first, so no more callbacks post into the scheduler
+	modelRegistry_.Stop();
+	fileWatch_.Stop();
+
+	// jobs dropped or killed by the shutdown below stay unfinished in the journal
+	journal_.Close();
+
+	// Queued jobs are dropped and running ones cancelled. Every blocking step of an analysis
+	// (replay hashing, applet process and its output readers, server request, dns lookup and
+	// remote call, slot wait) ends within a fraction of a second of its cancel flag, so the
+	// workers exit well within the caps below. The reload never waits past them: a worker
+	// still running after that is abandoned and its queue, client and pool leaked, as a last
+	// resort that leaves it running plugin code.
+	benchCancel_ = true;
+	bool abandoned = false;
+	if (analysisQueue_ && !analysisQueue_->Shutdown(std::chrono::seconds(3)))
+	{
+		LOG("neuRLcar: analysis workers did not stop in time, abandoning them");
+		analysisQueue_->Abandon();
+		analysisQueue_.release();
+		abandoned = true;
+	}
+
+	// fails any request still in flight; an abandoned worker may still be inside one
+	if (http_ && (!http_->Stop(std::chrono::seconds(1)) || abandoned))
+	{
+		LOG("neuRLcar: http client still in use, abandoning it");
+		http_.release();
+	}
+
+	// whatever is left is short; an abandoned analysis worker still holds one of its threads
+	if (pool_ && !pool_->Shutdown(abandoned ? std::chrono::milliseconds(500) : std::chrono::seconds(3)))
+	{
+		LOG("neuRLcar: pool threads did not stop in time, abandoning them");
+		pool_.release();
+	}
+	analysisCache_.SaveIfDirty();
+
+	appletServers_.StopAll(std::chrono::milliseconds(500));
+}
+
+// neurlcar_bench_applet [runs]: cold (one process per analysis) vs warm (resident server)
+// latency for the replay being viewed. Runs off the game thread; results go to the console.
+void neuRLcar::RunAppletBenchmark(int runs)
+{
+	if (benchRunning_)
+	{
+		LOG("neuRLcar: applet benchmark already running");
+		return;
+	}
+
+	auto& session = replaySession();
+	if (!session.InReplay())
+	{
+		LOG("neuRLcar: open a replay to run the applet benchmark");
+		return;
+	}
+
+	const std::string replayId = session.Context().replayId;
+	std::filesystem::path replayPath = replayFolderEpic / (replayId + ".replay");
+	if (!std::filesystem::exists(replayPath))
+		replayPath = replayFolder / (replayId + ".replay");
+
+	AnalysisJob job = makeAnalysisJob(replayId, replayPath);
+	job.analysisPath.replace_filename(replayId + ".bench.csv");
+
+	benchRunning_ = true;
+	benchCancel_ = false;
+	pool_->Post("applet benchmark", [this, job, runs]() {
+		using ms = std::chrono::duration<double, std::milli>;
+		auto timeIt = [](auto&& fn) {
+			auto t0 = std::chrono::steady_clock::now();
+			bool ok = fn();
+			return std::make_pair(ok, ms(std::chrono::steady_clock::now() - t0).count());
+		};
+
+		double coldTotal = 0.0, warmTotal = 0.0, firstWarm = 0.0;
+		int coldOk = 0, warmOk = 0;
+
+		for (int i = 0; i < runs; ++i)
+		{
+			auto [ok, t] = timeIt([&] {
+				return runPythonApplet(job.exePath.string(), job.replayPath.string(), job.analysisPath.string(),
+					{}, job.timeout, &benchCancel_, job.launch) == AnalysisOutcome::Succeeded;
+				});
+			if (ok) { ++coldOk; coldTotal += t; }
+		}
+
+		AppletServerClient server(job.exePath, job.model, job.launch.limits);
+		std::string error;
+		for (int i = 0; i <= runs; ++i)
+		{
+			auto [ok, t] = timeIt([&] {
+				return server.Analyze(job.replayPath.string(), job.analysisPath.string(), job.timeout, error,
+					{}, &benchCancel_) == AnalysisOutcome::Succeeded;
+				});
+			if (!ok) continue;
+			if (i == 0) firstWarm = t; // includes the server's own startup
+			else { ++warmOk; warmTotal += t; }
+		}
+		server.Stop(benchCancel_ ? std::chrono::milliseconds(0) : std::chrono::seconds(2));
+
+		std::error_code ec;
+		std::filesystem::remove(job.analysisPath, ec);
+
+		LOG("neuRLcar applet benchmark ({}): cold {:.1f} ms avg over {} runs, server start + first {:.1f} ms, warm {:.1f} ms avg over {} runs{}",
+			job.replayId,
+			coldOk ? coldTotal / coldOk : 0.0, coldOk,
+			firstWarm,
+			warmOk ? warmTotal / warmOk : 0.0, warmOk,
+			error.empty() ? "" : " (last error: " + error + ")");
+		benchRunning_ = false;
+		}, TaskPriority::Low, true);
 }
 
 void neuRLcar::saveKeybinds()
@@ -254,109 +931,340 @@ void neuRLcar::saveKeybinds()
 
 
 
+void neuRLcar::onReplayEntered()
+{
+	if (replaySession().Active())
+		return;
+
+	replaySession().Begin();
+}
+
+void neuRLcar::onReplayLeft()
+{
+	auto& session = replaySession();
+	if (!session.Active())
+		return;
+
+	session.Transition(ReplaySessionState::Leaving);
+	analysisProgress_.SetViewed("");
+
+	publishLoadedData(nullptr);
+
+	lastPublishedPosition_ = ReplayPosition{};
+	replayPositionState().Publish(lastPublishedPosition_);
+
+	if (isWindowOpen_)
+		_globalCvarManager->executeCommand("closemenu " + GetMenuName());
+
+	session.End();
+}
+
 void neuRLcar::onTick()
 {
-	const bool inReplayNow = gameWrapper->IsInReplay();
-	const bool justEnteredReplay = (inReplayNow && !wasInReplay_());
-	wasInReplay_() = inReplayNow;
+	auto& session = replaySession();
+	const ReplaySessionState state = session.State();
+	if (state == ReplaySessionState::Idle || state == ReplaySessionState::Leaving)
+		return;
 
-	if (inReplayNow)
+	ReplayServerWrapper serverReplay = gameWrapper->GetGameEventAsReplay();
+	if (serverReplay.IsNull() || serverReplay.GetReplay().IsNull())
 	{
-		isinreplay() = true;
+		// Normally the unload event ends the session; this only covers a missed one
+		auto waited = std::chrono::steady_clock::now() - session.Context().enteredAt;
+		if (session.InReplay() || (!gameWrapper->IsInReplay() && waited > std::chrono::seconds(10)))
+			onReplayLeft();
+		return;
+	}
 
-		if (!replaydataloaded() && loadingtoggle())
-		{
-			updateLoadedDataset();
-			loadingtoggle() = false;
-		}
+	ReplayWrapper replay = serverReplay.GetReplay();
+
+	if (state == ReplaySessionState::Entering)
+		loadReplaySession(replay);
+
+	publishReplayPosition(serverReplay, replay);
+}
+
+// Entering/Loading/Ready -> Loading for the replay currently in the viewer
+void neuRLcar::loadReplaySession(ReplayWrapper& replay)
+{
+	auto& session = replaySession();
+	const bool entering = session.State() == ReplaySessionState::Entering;
+
+	session.Transition(ReplaySessionState::Loading);
+
+	auto& ctx = session.Context();
+	ctx.replayId = replay.GetId().ToString();
+	ctx.replayIdHash = HashReplayId(ctx.replayId);
+	ctx.numFrames = replay.GetNumFrames();
+	hashedReplayObject_ = 0; // the next publish re-hashes the id
 
-		// Auto-open window ONCE when entering replay (if enabled)
-		if (justEnteredReplay)
+	updateLoadedDataset();
+
+	// batch-queued analysis for the replay being viewed jumps the line
+	analysisQueue_->Promote(cvarManager->getCvar("neurlcar_current_model").getStringValue() + "/" + ctx.replayId);
+
+	// Ready once the lookup started above has finished (finishSessionLoad)
+	refreshViewedAnalysisKey();
+
+	// Auto-open window ONCE when entering replay (if enabled)
+	if (entering)
+	{
+		bool openOnReplay = cvarManager->getCvar("neurlcar_ui_open_window_on_replay").getBoolValue();
+		if (openOnReplay && !isWindowOpen_)
 		{
-			bool openOnReplay = cvarManager->getCvar("neurlcar_ui_open_window_on_replay").getBoolValue();
-			if (openOnReplay && !isWindowOpen_)
-			{
-				_globalCvarManager->executeCommand("openmenu " + GetMenuName());
-			}
+			_globalCvarManager->executeCommand("openmenu " + GetMenuName());
 		}
 	}
-	else
+}
+
+// Game thread, from the analysis load's continuation: Loading -> Ready, unless another replay
+// was opened since the load started
+void neuRLcar::finishSessionLoad(const std::string& replayId)
+{
+	auto& session = replaySession();
+	if (session.State() == ReplaySessionState::Loading && session.Context().replayId == replayId)
+		session.Transition(ReplaySessionState::Ready);
+}
+
+void neuRLcar::publishReplayPosition(ReplayServerWrapper& serverReplay, ReplayWrapper& replay)
+{
+	int currentframe = serverReplay.GetCurrentReplayFrame();
+	int numframes = replay.GetNumFrames();
+
+	// Publish the position for RenderCanvas/RenderWindow; they read it lock-free instead of via cvars
+	auto now = std::chrono::steady_clock::now();
+	float replayTime = replay.GetCurrentTime();
+	float fps = replay.GetRecordFPS();
+
+	ReplayPosition& pos = lastPublishedPosition_;
+	ReplayPosition next = pos;
+	next.inReplay = true;
+	next.frame = currentframe;
+	next.numFrames = numframes;
+	next.recordFps = fps > 0.0f ? fps : 30.0f;
+
+	// the id only needs a string conversion when the replay may have changed: another replay
+	// object (or length) than the id was hashed from, or a session (re)load since
+	if (pos.replayId == 0 || replay.memory_address != hashedReplayObject_ || numframes != pos.numFrames)
 	{
-		isinreplay() = false;
-		replaydataloaded() = false;
-		loadingtoggle() = true;
+		next.replayId = HashReplayId(replay.GetId().ToString());
+		hashedReplayObject_ = replay.memory_address;
+	}
 
-		if (isWindowOpen_)
-			_globalCvarManager->executeCommand("closemenu " + GetMenuName());
+	float wallDt = std::chrono::duration<float>(now - pos.tickTime).count();
+	float replayDt = replayTime - pos.replayTime;
+	bool contiguous = (currentframe == pos.frame || currentframe == pos.frame + 1) && replayDt >= 0.0f;
+	float measuredOffset = (float)currentframe - replayTime * next.recordFps;
 
-		return;
+	if (!contiguous || wallDt <= 0.0f || wallDt > 0.5f || next.replayId != pos.replayId)
+	{
+		// scrub, skip or first tick: snap instead of extrapolating across the jump
+		next.playRate = 0.0f;
+		next.frameOffset = measuredOffset;
+	}
+	else
+	{
+		float rate = replayDt / wallDt;
+		next.playRate = rate < 0.0f ? 0.0f : (rate > 16.0f ? 16.0f : rate);
+		if (currentframe != pos.frame)
+			next.frameOffset += 0.2f * (measuredOffset - next.frameOffset);
 	}
 
-	ReplayServerWrapper serverReplay = gameWrapper->GetGameEventAsReplay();
-	if (serverReplay.IsNull()) return;
+	next.playing = next.playRate > 0.0f;
+	next.replayTime = replayTime;
+	next.tickTime = now;
 
-	ReplayWrapper replay = serverReplay.GetReplay();
-	if (replay.IsNull()) return;
+	replayPositionState().Publish(next);
+	pos = next;
 
-	int currentframe = serverReplay.GetCurrentReplayFrame();
-	int numframes = replay.GetNumFrames();
+	// console mirror is low priority; one queued sync picks up whatever position is latest
+	if (!cvarMirrorQueued_ && (next.frame != mirroredFrame_ || next.numFrames != mirroredNumFrames_))
+	{
+		cvarMirrorQueued_ = true;
+		scheduler_.Post("cvar sync", [this]() {
+			cvarMirrorQueued_ = false;
+			MirrorPositionCvars(lastPublishedPosition_);
+			}, TaskPriority::Low);
+	}
+
+	// a different replay was opened without leaving the viewer
+	auto& session = replaySession();
+	if (session.InReplay() && next.replayId != session.Context().replayIdHash)
+		loadReplaySession(replay);
+}
 
-	auto currentframecvar = cvarManager->getCvar("currentframe");
-	if (currentframecvar.IsNull()) return;
-	auto numframescvar = cvarManager->getCvar("numframes");
-	if (numframescvar.IsNull()) return;
+// The currentframe/numframes cvars are kept only for console users, so they are written
+// when the value changes rather than every tick.
+void neuRLcar::MirrorPositionCvars(const ReplayPosition& pos)
+{
+	if (pos.frame != mirroredFrame_)
+	{
+		auto currentframecvar = cvarManager->getCvar("currentframe");
+		if (!currentframecvar.IsNull())
+			currentframecvar.setValue(pos.frame);
+		mirroredFrame_ = pos.frame;
+	}
 
-	currentframecvar.setValue(currentframe);
-	numframescvar.setValue(numframes);
+	if (pos.numFrames != mirroredNumFrames_)
+	{
+		auto numframescvar = cvarManager->getCvar("numframes");
+		if (!numframescvar.IsNull())
+			numframescvar.setValue(pos.numFrames);
+		mirroredNumFrames_ = pos.numFrames;
+	}
 }
 
 
 
+// Parsing, smoothing and the staleness check run on the pool; the result is swapped in on the
+// game thread unless another load, a clear or a streamed row landed in the meantime
 void neuRLcar::updateLoadedDataset()
 {
-	getloadedData().clear();
+	publishLoadedData(nullptr);
+	replaySession().SetAnalysisLoaded(false);
+	replaySession().SetAnalysisFailed(false);
+	loadedAnalysisFile_.clear();
 
 	if (!gameWrapper->IsInReplay()) return;
 	ReplayServerWrapper serverReplay = gameWrapper->GetGameEventAsReplay();
 	if (serverReplay.IsNull()) return;
 	ReplayWrapper replay = serverReplay.GetReplay();
 	if (replay.IsNull()) return;
-	//if (replaydataloaded()) return;
 	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
 	auto replayid = replay.GetId().ToString();
 	auto bakkespath = gameWrapper->GetBakkesModPath();
-	auto analysispath = (bakkespath / "data" / "neurlcar" / "models" / current_model / "demoanalysis" / (replayid + ".csv"));
-	//check if analysis exists
-	std::ifstream infile(analysispath.c_str());
-	bool analysisExists = infile.good();
-	infile.close();
-	if (!analysisExists) 
-	{ 
-		LOG("no analysis file for this replay exists");
-		return;
-	}
+	auto modelDir = bakkespath / "data" / "neurlcar" / "models" / current_model;
+	auto analysispath = modelDir / "demoanalysis" / (replayid + ".csv");
+	const int numFrames = replay.GetNumFrames();
+	const double replayFps = replay.GetRecordFPS();
+	const int smoothingWindow = std::clamp(cvarManager->getCvar("neurlcar_ui_smoothing_window").getIntValue(), 0, 5000);
+	const unsigned generation = loadedDataGeneration();
+
+	// a model.cfg lets the loader keep only the overlay's columns, wherever the model puts them
+	const ModelInstall install = modelRegistry_.Describe(current_model);
+	const bool declared = install.hasManifest && install.manifestError.empty();
+	const ColumnProjection projection = declared ? ProjectionFor(install.manifest, kOverlayColumns) : ColumnProjection{};
+	const double rowRate = declared ? install.manifest.frameRate : 0.0;
+
+	struct LoadedAnalysis
+	{
+		bool found = false;
+		std::vector<std::vector<double>> data;
+		std::vector<float> smoothed;
+		std::filesystem::path file;
+		std::filesystem::file_time_type written{};
+		bool stale = false;
+	};
+
+	pool_->Submit("load analysis", [this, analysispath, modelDir, smoothingWindow, projection, rowRate, replayFps, numFrames]() {
+		LoadedAnalysis loaded;
+
+		// a streamed (binary) analysis is preferred over the CSV
+		auto rowstreampath = RowStreamPathFor(analysispath);
+		std::error_code ec;
+		std::string rowstreamError;
+		if (std::filesystem::exists(rowstreampath, ec) && LoadRowStreamFile(rowstreampath, loaded.data, rowstreamError))
+		{
+			LOG("Analysis found (binary)");
+		}
+		else
+		{
+			if (!rowstreamError.empty())
+				LOG("could not load {}: {}", rowstreampath.string(), rowstreamError);
 
-	LOG("Analysis found");
+			//check if analysis exists
+			std::ifstream infile(analysispath.c_str());
+			bool analysisExists = infile.good();
+			infile.close();
+			if (!analysisExists)
+				return loaded;
 
-	auto datatoload = csvparser(analysispath);
+			LOG("Analysis found");
 
-	LOG("This is the demoanalysis path {}", (analysispath).string());
-	LOG("datatoloadsize is {}", (std::to_string(datatoload.size())));
+			loaded.data = csvparser(analysispath);
+		}
+
+		if (!projection.Empty() && !ApplyProjection(projection, loaded.data))
+			LOG("{} has {} columns, model.cfg declares {}; using them in file order",
+				analysispath.filename().string(), loaded.data.size(), projection.sourceColumns);
+		ResampleToReplayFrames(loaded.data, rowRate, replayFps, numFrames);
+
+		loaded.found = true;
+		loaded.file = ExistingAnalysisFile(analysispath);
+		loaded.written = std::filesystem::last_write_time(loaded.file, ec);
+		if (!loaded.data.empty())
+			loaded.smoothed = ComputeSmoothedSeries(loaded.data[0], smoothingWindow);
+
+		// shown until the refresh lands; only the model half of the key is checked here,
+		// the worker compares the replay contents before running anything
+		uint64_t fingerprint = analysisCache_.ModelFingerprint(modelDir);
+		loaded.stale = fingerprint != 0 && analysisCache_.CheckModel(analysispath, fingerprint) == AnalysisFreshness::Stale;
+		return loaded;
+		}).Then("dataset swap", [this, generation, current_model, replayid, numFrames, replayFps, smoothingWindow](LoadedAnalysis& loaded) {
+			finishSessionLoad(replayid);
+			if (loadedDataGeneration() != generation)
+				return; // superseded
+
+			if (!loaded.found)
+			{
+				LOG("no analysis file for this replay exists");
+				return;
+			}
+
+			LOG("This is the demoanalysis path {}", loaded.file.string());
+			LOG("datatoloadsize is {}", (std::to_string(loaded.data.size())));
 
-	
-	getloadedData() = datatoload;
+			auto data = std::make_shared<const LoadedDataset>(std::move(loaded.data));
+			publishLoadedData(data);
+			if (!data->empty())
+				PrimeSmoothedSeries((*data)[0], smoothingWindow, std::move(loaded.smoothed));
 
-	LOG("loadeddata size is {}", (std::to_string(getloadedData().size())));
+			LOG("loadeddata size is {}", (std::to_string(data->size())));
 
-	replaydataloaded() = true;
+			replaySession().SetAnalysisLoaded(true);
 
-	return;
+			loadedAnalysisFile_ = loaded.file;
+			loadedAnalysisWrite_ = loaded.written;
+
+			// (once per session, so a refresh that keeps failing isn't retried on every reload)
+			if (loaded.stale && staleRefreshes_.insert(current_model + "/" + replayid).second)
+			{
+				LOG("analysis of {} is stale for {}, queueing a refresh", replayid, current_model);
+				AnalysisJob job = makeAnalysisJob(replayid, findReplayFile(replayid));
+				job.numFrames = numFrames;
+				job.replayFps = replayFps;
+				enqueueAnalysis(std::move(job), true);
+			}
+		},
+		[this, generation, replayid, analysispath](std::exception_ptr error) {
+			finishSessionLoad(replayid);
+			if (loadedDataGeneration() != generation)
+				return; // superseded
+
+			try
+			{
+				std::rethrow_exception(error);
+			}
+			catch (const PoolShutdownError&)
+			{
+				return; // unloading
+			}
+			catch (const std::exception& e)
+			{
+				LOG("could not load the analysis {}: {}", analysispath.string(), e.what());
+			}
+			catch (...)
+			{
+				LOG("could not load the analysis {}", analysispath.string());
+			}
+			replaySession().SetAnalysisFailed(true);
+		});
 }
 
 void neuRLcar::deleteLoadedDatasetFile()
 {
-	getloadedData().clear();
-	replaydataloaded() = false;
+	publishLoadedData(nullptr);
+	replaySession().SetAnalysisLoaded(false);
 
 	if (!gameWrapper || !gameWrapper->IsInReplay())
 		return;
@@ -377,6 +1285,10 @@ void neuRLcar::deleteLoadedDatasetFile()
 
 	std::error_code ec;
 	bool removed = std::filesystem::remove(analysispath, ec);
+	if (!ec && std::filesystem::remove(RowStreamPathFor(analysispath), ec))
+		removed = true;
+	if (!ec)
+		analysisCache_.Forget(analysispath);
 
 	if (ec)
 	{
@@ -399,8 +1311,6 @@ void neuRLcar::generateAnalysis()
 	if (cvarManager->getCvar("neurlcar_analysis_busy").getBoolValue())
 		return;
 
-	cvarManager->getCvar("neurlcar_analysis_busy").setValue(1);
-
 	ReplayServerWrapper serverReplay = gameWrapper->GetGameEventAsReplay();
 	if (serverReplay.IsNull()) return;
 
@@ -408,52 +1318,604 @@ void neuRLcar::generateAnalysis()
 	if (replay.IsNull()) return;
 
 	auto replayname = replay.GetId().ToString();
-	std::filesystem::path candidateSteam = replayFolder / (replayname + ".replay");
-	std::filesystem::path candidateEpic = replayFolderEpic / (replayname + ".replay");
+	std::filesystem::path replayPathFs = findReplayFile(replayname);
+
+	LOG("replay path chosen as: " + replayPathFs.string());
+
+	AnalysisJob job = makeAnalysisJob(replayname, replayPathFs);
+	job.numFrames = replay.GetNumFrames();
+	job.replayFps = replay.GetRecordFPS();
+	const std::string key = job.Key();
+
+	LOG("ReplayFrames: async analysis requested for " + replayname);
+
+	// the replay being viewed goes ahead of any batch work
+	if (!enqueueAnalysis(std::move(job), true))
+	{
+		if (!analysisQueue_->Contains(key))
+		{
+			LOG("ReplayFrames: analysis queue is shut down");
+			return;
+		}
+		LOG("ReplayFrames: {} is already being analyzed", replayname);
+	}
+
+	// the queue reports every accepted job exactly once, so onAnalysisJobDone always clears this
+	busyJobKey_ = key;
+	cvarManager->getCvar("neurlcar_analysis_busy").setValue(1);
+}
 
-	std::filesystem::path replayPathFs =
+// The replay in the Epic or Steam demos folder; copies in both have the same contents
+std::filesystem::path neuRLcar::findReplayFile(const std::string& replayId)
+{
+	std::filesystem::path candidateSteam = replayFolder / (replayId + ".replay");
+	std::filesystem::path candidateEpic = replayFolderEpic / (replayId + ".replay");
+
+	return
 		std::filesystem::exists(candidateEpic) ? candidateEpic :
 		std::filesystem::exists(candidateSteam) ? candidateSteam :
 		candidateEpic; // default
+}
 
-	auto replaypath = replayPathFs.string();
-	LOG("replay path chosen as: " + replaypath);
+// Cancels the analysis started from the window/hotkey, or the viewed replay's queued job
+void neuRLcar::cancelAnalysis()
+{
+	std::string key = busyJobKey_;
+	auto& session = replaySession();
+	if (key.empty() && session.InReplay())
+		key = cvarManager->getCvar("neurlcar_current_model").getStringValue() + "/" + session.Context().replayId;
+
+	if (key.empty() || !analysisQueue_->Cancel(key))
+		LOG("neuRLcar: no analysis to cancel");
+	else
+		LOG("neuRLcar: cancelling analysis {}", key);
+}
+
+// model defaults to neurlcar_current_model
+AnalysisJob neuRLcar::makeAnalysisJob(const std::string& replayId, const std::filesystem::path& replayPath, const std::string& model)
+{
 	auto bakkespath = gameWrapper->GetBakkesModPath();
-	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
-	auto analysispath = (bakkespath / "data" / "neurlcar" / "models" / current_model / "demoanalysis" / (replayname + ".csv")).string();
-	auto exePath = (bakkespath / "data" / "neurlcar" / "models" / current_model / (current_model + "_applet.exe")).string();
+	auto current_model = model.empty() ? cvarManager->getCvar("neurlcar_current_model").getStringValue() : model;
 
-	LOG("ReplayFrames: async analysis requested for " + replayname);
+	AnalysisJob job;
+	job.replayId = replayId;
+	job.model = current_model;
+	job.replayPath = replayPath;
+	job.analysisPath = bakkespath / "data" / "neurlcar" / "models" / current_model / "demoanalysis" / (replayId + ".csv");
 
-	std::thread([=]() {
+	const ModelInstall install = modelRegistry_.Describe(current_model);
+	const ModelManifest& manifest = install.manifest;
+	job.exePath = bakkespath / "data" / "neurlcar" / "models" / current_model / manifest.applet;
 
-		LOG("ReplayFrames: (thread) starting Python...");
-		bool ok = runPythonApplet(exePath, replaypath, analysispath);
+	int timeoutSeconds = cvarManager->getCvar("neurlcar_analysis_timeout_s").getIntValue();
+	job.timeout = timeoutSeconds > 0 ? std::chrono::milliseconds(timeoutSeconds * 1000LL) : kWaitForever;
+	if (install.hasManifest && install.manifestError.empty())
+	{
+		// the fastest transport the model declares
+		job.transport = manifest.shm ? AnalysisTransport::SharedMemory :
+			manifest.stream ? AnalysisTransport::RowStream : AnalysisTransport::Csv;
+		job.canServe = manifest.serve;
+		job.columns = ProjectionFor(manifest, kOverlayColumns);
+		job.rowRate = manifest.frameRate;
+	}
+	else if (cvarManager->getCvar("neurlcar_applet_shm").getBoolValue())
+		job.transport = AnalysisTransport::SharedMemory;
+	else if (cvarManager->getCvar("neurlcar_applet_stream").getBoolValue())
+		job.transport = AnalysisTransport::RowStream;
+
+	job.launch.model = current_model;
+	ParseProcessPriority(std::to_string(cvarManager->getCvar("neurlcar_applet_priority").getIntValue()), job.launch.limits.priority);
+	if (!ParseAffinity(cvarManager->getCvar("neurlcar_applet_affinity").getStringValue(), job.launch.limits.affinityMask))
+		job.launch.limits.affinityMask = DefaultAppletAffinity();
+	job.launch.maxConcurrent = cvarManager->getCvar("neurlcar_applet_max_concurrent").getIntValue();
+	job.launch.limits.memoryLimitBytes = (uint64_t)cvarManager->getCvar("neurlcar_applet_memory_mb").getIntValue() << 20;
+	ApplyLaunchConfig(job.exePath.parent_path() / "launch.cfg", job.launch);
+	job.segments = manifest.frames ? (std::max)(1, cvarManager->getCvar("neurlcar_analysis_segments").getIntValue()) : 1;
+	job.segmentOverlapFrames = cvarManager->getCvar("neurlcar_segment_overlap_frames").getIntValue();
+	job.remoteUrl = cvarManager->getCvar("neurlcar_remote_url").getStringValue();
+	return job;
+}
 
-		if (!ok) {
-			gameWrapper->Execute([this](GameWrapper*) {
-				cvarManager->getCvar("neurlcar_analysis_busy").setValue(0);
-				});
-			return;
-		}
+// Game thread; every job goes through here so the journal sees it
+bool neuRLcar::enqueueAnalysis(AnalysisJob job, bool front)
+{
+	// recorded first: a worker may pick the job up and journal its result before Enqueue returns
+	AnalysisJob journaled = job;
+	journal_.Queued(journaled);
+	if (analysisQueue_->Enqueue(std::move(job), front))
+		return true;
+
+	// a duplicate of a job that is still queued or running keeps that job's record; a finished
+	// job leaves the queue before its result is journaled, so it never counts as one
+	if (!analysisQueue_->Contains(journaled.Key()))
+		journal_.Finished(journaled, AnalysisOutcome::Cancelled);
+	return false;
+}
+
+// Game thread, from onLoad: queues what the last session left unfinished
+void neuRLcar::resumeJournaledJobs()
+{
+	auto unfinished = journal_.Open(gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "analysis_journal.log");
+	// before anything is enqueued: a resumed job may start (and write its R) right away, and
+	// the history Open already read is all that is dropped
+	journal_.Compact();
+
+	int resumed = 0;
+	for (const auto& entry : unfinished)
+	{
+		std::error_code ec;
+		if (!std::filesystem::exists(entry.replayPath, ec))
+			continue;
+
+		AnalysisJob job = makeAnalysisJob(entry.replayId, entry.replayPath, entry.model);
+		job.numFrames = entry.numFrames;
+
+		// whatever a killed applet left behind is never loaded, but shouldn't pile up either
+		std::filesystem::remove(PartialAnalysisPathFor(job.analysisPath), ec);
 
+		if (enqueueAnalysis(std::move(job)))
+			++resumed;
+	}
+
+	if (resumed)
+		LOG("neuRLcar: resumed {} unfinished analyses from the last session", resumed);
+}
+
+// Worker thread
+AnalysisOutcome neuRLcar::runAnalysisJob(const AnalysisJob& job, const std::atomic<bool>& cancel)
+{
+	// an analysis of identical replay contents with this model install is reused, not recomputed
+	AnalysisCacheKey cacheKey;
+	std::string cacheError;
+	if (!analysisCache_.KeyFor(job.replayPath, job.exePath.parent_path(), cacheKey, cacheError, &cancel))
+	{
+		LOG("ReplayFrames: analysis of {} won't be cached ({})", job.replayId, cacheError);
+	}
+	else if (analysisCache_.Check(job.analysisPath, cacheKey) == AnalysisFreshness::Fresh)
+	{
+		LOG("ReplayFrames: analysis of {} is up to date", job.replayId);
+		return AnalysisOutcome::Succeeded;
+	}
+	else
+	{
+		std::filesystem::path duplicate;
+		if (analysisCache_.FindByKey(job.analysisPath.parent_path(), cacheKey, duplicate) && duplicate != job.analysisPath)
 		{
-			std::ifstream infile(analysispath);
-			if (!infile.good()) {
-				gameWrapper->Execute([this](GameWrapper*) {
-					cvarManager->getCvar("neurlcar_analysis_busy").setValue(0);
-					});
-				return;
+			if (CopyAnalysisFiles(duplicate, job.analysisPath, cacheError))
+			{
+				LOG("ReplayFrames: {} has the same contents as {}, reusing its analysis", job.replayId, duplicate.stem().string());
+				analysisCache_.Record(job.analysisPath, cacheKey);
+				return AnalysisOutcome::Succeeded;
 			}
+			LOG("ReplayFrames: could not reuse {} ({})", duplicate.string(), cacheError);
 		}
+	}
 
+	if (cancel)
+		return AnalysisOutcome::Cancelled;
+
+	LOG("ReplayFrames: (thread) starting Python for {}", job.replayId);
+	journal_.Running(job);
+	const std::string key = job.Key();
+	analysisProgress_.Begin(key, job.model, job.numFrames);
+	AnalysisProgressFn onProgress = [this, key](int done, int total) { analysisProgress_.Update(key, done, total); };
+
+	// CSVs are written under a temporary name and renamed into place once complete, so a killed
+	// applet or a crash never leaves a truncated CSV that would load as an analysis
+	// (streamed results are saved the same way by SaveRowStreamFile)
+	const auto partialPath = PartialAnalysisPathFor(job.analysisPath);
+
+	// a long replay split across several applet processes, when the applet can take frame ranges
+	AnalysisOutcome outcome = AnalysisOutcome::Failed;
+	const bool remote = !job.remoteUrl.empty();
+	bool segmented = false;
+	if (job.segments > 1 && !remote)
+	{
+		int numFrames = job.numFrames > 0 ? job.numFrames : ReadReplayFrameCount(job.replayPath);
+		auto segments = PlanAnalysisSegments(numFrames, job.segments, job.segmentOverlapFrames, kMinSegmentFrames);
+		if (segments.size() > 1)
+		{
+			LOG("ReplayFrames: analyzing {} in {} segments", job.replayId, segments.size());
+			bool unstitchable = false;
+			outcome = runSegmentedApplet(*pool_, job, segments, onProgress, cancel, unstitchable);
+			segmented = !unstitchable;
+			if (unstitchable)
+				LOG("ReplayFrames: falling back to one applet process for {}", job.replayId);
+		}
+	}
+	const bool resident = !remote && residentApplets_ && job.canServe;
+	const bool writesCsv = !segmented && !remote && (resident || job.transport == AnalysisTransport::Csv);
+
+	// rows reach the overlay as they arrive; drains are coalesced onto the game thread
+	auto rows = std::make_shared<RowStreamBuffer>();
+	auto onRows = [this, job, rows]() {
+		if (rows->MarkDrainQueued())
+			scheduler_.Post("stream rows", [this, job, rows]() { drainStreamedRows(job, *rows); });
+	};
+
+	if (segmented)
+	{
+		// an older CSV would be left behind the new binary analysis
+		std::error_code ec;
+		if (outcome == AnalysisOutcome::Succeeded)
+			std::filesystem::remove(job.analysisPath, ec);
+	}
+	else if (remote)
+	{
+		RemoteSettings settings;
+		{
+			std::lock_guard<std::mutex> lock(remoteMutex_);
+			settings = remoteSettings_;
+		}
+		settings.url = job.remoteUrl;
+
+		std::string error;
+		outcome = RunRemoteAnalysis(*http_, settings, job, RowStreamPathFor(job.analysisPath), *rows, onRows, onProgress, cancel, error);
+		rows->Close();
+		if (outcome != AnalysisOutcome::Succeeded)
+			LOG("ReplayFrames: remote analysis {} on {}: {}", ToString(outcome), job.replayId, error);
+	}
+	else if (resident)
+	{
+		std::string error;
+		auto server = appletServers_.Get(job.model, job.exePath, job.launch.limits);
+		outcome = server->Analyze(job.replayPath.string(), partialPath.string(), job.timeout, error, onProgress, &cancel);
+		if (outcome != AnalysisOutcome::Succeeded)
+			LOG("ReplayFrames: resident applet {} on {}: {}", ToString(outcome), job.replayId, error);
+	}
+	else if (job.transport != AnalysisTransport::Csv)
+	{
+		if (job.transport == AnalysisTransport::SharedMemory)
+		{
+			// sized for the replay when its length is known; the applet fails cleanly past capacity
+			uint32_t capacity = SharedResultsCapacity(job);
+			outcome = runSharedMemoryApplet(job.exePath.string(), job.replayPath.string(), RowStreamPathFor(job.analysisPath),
+				capacity, *rows, onRows, onProgress, job.timeout, &cancel, job.launch);
+		}
+		else
+		{
+			outcome = runStreamingApplet(job.exePath.string(), job.replayPath.string(), RowStreamPathFor(job.analysisPath),
+				*rows, onRows, onProgress, job.timeout, &cancel, job.launch);
+		}
+		rows->Close();
+	}
+	else
+	{
+		outcome = runPythonApplet(job.exePath.string(), job.replayPath.string(), partialPath.string(),
+			onProgress, job.timeout, &cancel, job.launch);
+	}
+
+	if (writesCsv)
+	{
+		std::error_code ec;
+		if (outcome == AnalysisOutcome::Succeeded && std::filesystem::exists(partialPath, ec))
+		{
+			// an older binary analysis would shadow the new CSV
+			std::filesystem::remove(RowStreamPathFor(job.analysisPath), ec);
+			std::filesystem::rename(partialPath, job.analysisPath, ec);
+			if (ec)
+				LOG("ReplayFrames: could not move {} into place ({})", partialPath.string(), ec.message());
+		}
+		else if (outcome == AnalysisOutcome::Succeeded)
+		{
+			ec = std::make_error_code(std::errc::no_such_file_or_directory);
+		}
+		if (ec)
+			outcome = AnalysisOutcome::Failed;
+		std::filesystem::remove(partialPath, ec);
+	}
+	else if (outcome == AnalysisOutcome::Succeeded && !std::ifstream(RowStreamPathFor(job.analysisPath)).good())
+	{
+		outcome = AnalysisOutcome::Failed;
+	}
+
+	analysisProgress_.End(key, outcome == AnalysisOutcome::Succeeded);
+
+	if (outcome == AnalysisOutcome::Succeeded && cacheKey.Valid())
+	{
+		analysisCache_.Record(job.analysisPath, cacheKey);
+		analysisCache_.SaveIfDirty();
+	}
+
+	if (outcome == AnalysisOutcome::Succeeded)
 		LOG("ReplayFrames: (thread) CSV generated successfully");
+	else
+		LOG("ReplayFrames: (thread) analysis of {} {}", job.replayId, ToString(outcome));
+	return outcome;
+}
+
+// Game thread; true if job is for the replay being viewed with the current model
+bool neuRLcar::isViewing(const AnalysisJob& job)
+{
+	auto& session = replaySession();
+	return session.InReplay() &&
+		session.Context().replayId == job.replayId &&
+		cvarManager->getCvar("neurlcar_current_model").getStringValue() == job.model;
+}
+
+// Game thread; appends streamed rows to the loaded dataset while the viewed replay is analyzed.
+// The first drain replaces whatever was loaded, so the overlay fills in from frame 0.
+void neuRLcar::drainStreamedRows(const AnalysisJob& job, RowStreamBuffer& rows)
+{
+	// the finished file is loaded by onAnalysisJobDone instead
+	if (rows.Closed())
+		return;
+
+	std::vector<std::vector<double>> discarded;
+	if (rows.discarded || !isViewing(job) || (job.rowRate > 0.0 && !SameFrameRate(job.rowRate, lastPublishedPosition_.recordFps)))
+	{
+		// started (or left) while looking at another replay: partial data would be misaligned.
+		// Rows at another rate than the replay's are resampled when the finished file loads.
+		rows.discarded = true;
+		rows.Drain(discarded);
+		return;
+	}
+
+	if (!rows.attached)
+	{
+		// also drops a load of the old file still running on the pool
+		publishLoadedData(nullptr);
+		rows.attached = true;
+	}
+
+	// the rows go into a copy; drains are coalesced, so this is a few copies a second at most
+	auto data = std::make_shared<LoadedDataset>(*loadedData());
+	if (rows.Drain(*data, &job.columns) > 0)
+	{
+		publishLoadedData(std::move(data));
+		replaySession().SetAnalysisLoaded(true);
+	}
+}
+
+// Game thread; points the progress bars at the current model's job for the replay being viewed
+void neuRLcar::refreshViewedAnalysisKey()
+{
+	auto& session = replaySession();
+	if (!session.InReplay())
+	{
+		analysisProgress_.SetViewed("");
+		return;
+	}
+	auto model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	analysisProgress_.SetViewed(model + "/" + session.Context().replayId);
+}
+
+// Game thread; the remote settings analysis workers read (the url goes with each job instead)
+void neuRLcar::applyRemoteSettings()
+{
+	savedApiKey = cvarManager->getCvar("neurlcar_remote_api_key").getStringValue();
+
+	std::lock_guard<std::mutex> lock(remoteMutex_);
+	remoteSettings_.apiKey = savedApiKey;
+	remoteSettings_.uploadBytesPerSec = (long long)cvarManager->getCvar("neurlcar_remote_upload_kbps").getIntValue() * 1024;
+	remoteSettings_.retries = cvarManager->getCvar("neurlcar_remote_retries").getIntValue();
+}
+
+// Game thread; analyses queued from now on go through the stand-in, which runs them with this
+// machine's applets, so offloading can be tried without a server
+void neuRLcar::startStandIn(int port)
+{
+	if (standIn_)
+	{
+		LOG("neuRLcar stand-in: already listening at {}", standIn_->Url());
+		return;
+	}
+
+	const auto modelsDir = modelRegistry_.ModelsDir();
+	int timeoutSeconds = cvarManager->getCvar("neurlcar_analysis_timeout_s").getIntValue();
+	const auto timeout = timeoutSeconds > 0 ? std::chrono::milliseconds(timeoutSeconds * 1000LL) : kWaitForever;
+
+	standIn_ = std::make_unique<RemoteStandInServer>(gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "standin",
+		[this, modelsDir, timeout](const std::string& model, const std::filesystem::path& replayPath, RowStreamBuffer& rows,
+			const std::function<void()>& onRows, const AnalysisProgressFn& onProgress, const std::atomic<bool>& cancel, std::string& error) {
+			return runStandInAnalysis(modelsDir, modelRegistry_.Describe(model), replayPath, rows, onRows, onProgress, timeout, cancel, error);
+		},
+		[this](std::function<void()> task) { pool_->Post("stand-in", std::move(task), TaskPriority::Normal, true); });
+
+	std::string error;
+	if (!standIn_->Start((uint16_t)port, error))
+	{
+		LOG("neuRLcar stand-in: could not start ({})", error);
+		standIn_.reset();
+		return;
+	}
+	standInPort_ = standIn_->Port();
+	cvarManager->getCvar("neurlcar_remote_url").setValue(standIn_->Url());
+	LOG("neuRLcar stand-in: listening at {}", standIn_->Url());
+}
+
+// Game thread; analyses go back to running here unless neurlcar_remote_url was pointed elsewhere
+void neuRLcar::stopStandIn()
+{
+	if (!standIn_)
+		return;
+
+	const std::string url = standIn_->Url();
+	standInPort_ = 0;
+	// its connections and analyses poll their stop and cancel flags, so this is a cap, not a wait
+	if (standIn_->Stop(std::chrono::seconds(1)))
+		standIn_.reset();
+	else
+	{
+		LOG("neuRLcar stand-in: connections did not end in time, abandoning them");
+		standIn_.release();
+	}
+
+	CVarWrapper remoteUrl = cvarManager->getCvar("neurlcar_remote_url");
+	if (!remoteUrl.IsNull() && remoteUrl.getStringValue() == url)
+	{
+		remoteUrl.setValue("");
+		configSaver_.MarkDirty();
+	}
+}
+
+// Worker thread; the dataset swap and busy flag are handled on the game thread
+void neuRLcar::onAnalysisJobDone(const AnalysisJob& job, AnalysisOutcome outcome)
+{
+	journal_.Finished(job, outcome);
 
-		gameWrapper->Execute([this](GameWrapper*) {
+	const bool ok = outcome == AnalysisOutcome::Succeeded;
+	scheduler_.Post(ok ? "dataset swap" : "analysis failed", [this, job, ok]() {
+		// a failed stream may have left partial rows in the loaded dataset
+		if (isViewing(job) && (ok || job.transport != AnalysisTransport::Csv || !job.remoteUrl.empty()))
 			updateLoadedDataset();
+
+		if (job.Key() == busyJobKey_)
+		{
+			busyJobKey_.clear();
 			cvarManager->getCvar("neurlcar_analysis_busy").setValue(0);
-			});
+		}
+		}, ok ? TaskPriority::Normal : TaskPriority::High);
+}
+
+// Queues every replay in the Steam and Epic demo folders without an up-to-date analysis for the
+// current model. The folders are indexed on the pool; copies of one replay under different
+// names are only analyzed once, by the worker.
+void neuRLcar::enqueueAllReplays()
+{
+	struct Candidate
+	{
+		std::string replayId;
+		std::filesystem::path path;
+		AnalysisFreshness freshness;
+	};
+	struct ReplayIndex
+	{
+		std::vector<Candidate> candidates;
+		int skipped = 0;
+	};
+
+	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	auto modelDir = gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "models" / current_model;
 
-		}).detach();
+	pool_->Submit("index replays", [this, modelDir]() {
+		ReplayIndex index;
+		std::set<std::string> seen;
+		uint64_t fingerprint = analysisCache_.ModelFingerprint(modelDir);
+
+		for (const auto& folder : { replayFolderEpic, replayFolder })
+		{
+			std::error_code ec;
+			for (auto it = std::filesystem::directory_iterator(folder, ec);
+				!ec && it != std::filesystem::directory_iterator();
+				it.increment(ec))
+			{
+				const auto& path = it->path();
+				if (path.extension() != ".replay")
+					continue;
+
+				std::string replayId = path.stem().string();
+				if (!seen.insert(replayId).second)
+					continue; // same replay saved in both folders
+
+				AnalysisFreshness freshness = analysisCache_.CheckModel(modelDir / "demoanalysis" / (replayId + ".csv"), fingerprint);
+				if (freshness == AnalysisFreshness::Fresh)
+					++index.skipped;
+				else
+					index.candidates.push_back({ replayId, path, freshness });
+			}
+		}
+		return index;
+		}, TaskPriority::Low).Then("queue replays", [this, current_model](ReplayIndex& index) {
+			int queued = 0;
+			int stale = 0;
+			for (const auto& candidate : index.candidates)
+			{
+				if (enqueueAnalysis(makeAnalysisJob(candidate.replayId, candidate.path, current_model)))
+				{
+					++queued;
+					if (candidate.freshness == AnalysisFreshness::Stale)
+						++stale;
+				}
+			}
+
+			LOG("neuRLcar: queued {} replays for analysis ({} stale, {} up to date, {} workers)",
+				queued, stale, index.skipped, analysisQueue_->Concurrency());
+		});
 }
 
+// Game thread; follows neurlcar_current_model so analyses rewritten on disk are reloaded
+void neuRLcar::watchAnalysisFolder()
+{
+	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	auto dir = gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "models" / current_model / "demoanalysis";
+	if (dir == watchedAnalysisDir_)
+		return;
+
+	if (!watchedAnalysisDir_.empty())
+		fileWatch_.Unwatch(watchedAnalysisDir_);
+	watchedAnalysisDir_ = dir;
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	fileWatch_.Watch(dir, { ".csv", ".nrlb" }, std::chrono::milliseconds(500), [this](const std::filesystem::path& path) {
+		scheduler_.Post("analysis changed", [this, path]() { onAnalysisFileSettled(path); });
+		});
+}
+
+// Game thread; a replay the game finished writing goes to the back of the queue, behind
+// anything asked for explicitly
+void neuRLcar::onReplayFileSettled(const std::filesystem::path& replayPath)
+{
+	if (!cvarManager->getCvar("neurlcar_auto_analyze").getBoolValue())
+		return;
+
+	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	auto modelDir = gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "models" / current_model;
+	auto analysisPath = modelDir / "demoanalysis" / (replayPath.stem().string() + ".csv");
+
+	pool_->Submit("check new replay", [this, modelDir, analysisPath]() {
+		uint64_t fingerprint = analysisCache_.ModelFingerprint(modelDir);
+		// no model installed, or already analyzed
+		return fingerprint != 0 && analysisCache_.CheckModel(analysisPath, fingerprint) != AnalysisFreshness::Fresh;
+		}, TaskPriority::Low).Then("queue new replay", [this, replayPath, current_model](bool needed) {
+			if (needed && enqueueAnalysis(makeAnalysisJob(replayPath.stem().string(), replayPath, current_model)))
+				LOG("neuRLcar: new replay {} queued for analysis", replayPath.filename().string());
+		});
+}
+
+// Game thread; reloads the viewed replay's analysis when something else rewrote it
+void neuRLcar::onAnalysisFileSettled(const std::filesystem::path& analysisPath)
+{
+	auto& session = replaySession();
+	if (!session.InReplay() || analysisPath.parent_path() != watchedAnalysisDir_ ||
+		analysisPath.stem().string() != session.Context().replayId)
+		return;
+
+	// our own jobs reload through onAnalysisJobDone
+	auto current_model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	if (analysisQueue_->Contains(current_model + "/" + session.Context().replayId))
+		return;
+
+	std::filesystem::path csvPath = analysisPath;
+	csvPath.replace_extension(".csv");
+	std::error_code ec;
+	std::filesystem::path current = ExistingAnalysisFile(csvPath);
+	if (current == loadedAnalysisFile_ && std::filesystem::last_write_time(current, ec) == loadedAnalysisWrite_)
+		return;
+
+	LOG("neuRLcar: {} changed on disk, reloading", analysisPath.filename().string());
+	updateLoadedDataset();
+}
+
+// Game thread; applies a requested "Verify model install" once the registry has rescanned
+void neuRLcar::onModelsScanned()
+{
+	if (!modelVerifyRequested_.exchange(false))
+		return;
+
+	auto model = cvarManager->getCvar("neurlcar_current_model").getStringValue();
+	auto snapshot = modelRegistry_.Snapshot();
+	std::string reason = ModelInstallProblem(modelRegistry_.ModelsDir(), model, snapshot->Find(model));
+
+	CVarWrapper ready = cvarManager->getCvar("neurlcar_model_ready");
+	if (!ready.IsNull())
+		ready.setValue(reason.empty() ? 1 : 0);
+
+	configSaver_.MarkDirty();
+
+	if (reason.empty())
+		LOG("Model verify OK for '{}'", model);
+	else
+		LOG("Model verify FAILED for '{}': {}", model, reason);
+}
@@ -8,13 +8,33 @@
 
 
 #include "version.h"
+#include "replaystate.h"
+#include "replaysession.h"
+#include "tickscheduler.h"
+#include "analysisqueue.h"
+#include "analysisprogress.h"
+#include "appletserver.h"
+#include "rowstream.h"
+#include "analysiscache.h"
+#include "filewatcher.h"
+#include "jobjournal.h"
+#include "threadpool.h"
+#include "modelregistry.h"
+#include "configsaver.h"
+#include "remoteanalysis.h"
+#include "standinserver.h"
+#include "overlayrender.h"
 
 #include <windows.h>
 #include <fstream>
 #include <vector>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <set>
 
 constexpr auto plugin_version = stringify(VERSION_MAJOR) "." stringify(VERSION_MINOR) "." stringify(VERSION_PATCH) "." stringify(VERSION_BUILD);
-std::vector<std::vector<double>> &getloadedData();
 
 extern std::shared_ptr<CVarManagerWrapper> _globalCvarManager;
 extern WCHAR* myDocuments;
@@ -27,12 +47,17 @@ extern char usernameInput[128];
 extern char passwordInput[128];
 extern char retypePasswordInput[128];
 
+// The analysis being shown, one vector per overlay column. It is never changed in place: the
+// game thread publishes a new snapshot and the render thread keeps the one it read for its frame.
+using LoadedDataset = std::vector<std::vector<double>>;
+
 // Function declarations for globals managed with static variables
-std::vector<std::vector<double>>& getloadedData();
-bool& replaydataloaded();
-bool& loadingtoggle();
-bool& isinreplay();
-bool& wasInReplay_();
+std::shared_ptr<const LoadedDataset> loadedData(); // never null
+void publishLoadedData(std::shared_ptr<const LoadedDataset> data); // game thread; null clears
+unsigned loadedDataGeneration(); // bumped by every publishLoadedData()
+
+// Hands the renderer a series smoothed off the game thread for the current generation
+void PrimeSmoothedSeries(const std::vector<double>& evalSeries, int smoothingWindow, std::vector<float> values);
 
 class neuRLcar: public BakkesMod::Plugin::BakkesModPlugin,
 
@@ -40,13 +65,71 @@ class neuRLcar: public BakkesMod::Plugin::BakkesModPlugin,
 	public PluginWindowBase // Uncomment if you want to render your own plugin window
 {
 	void onLoad() override;
+	void onUnload() override;
 	std::string GetCurrentModelName() const;
 	void saveKeybinds();
 	void onTick();
-	void renderEvalGraph(const char* id, const std::vector<double>& evaluation, int currentframe, ImU32 lowFillColor = IM_COL32(255, 165, 0, 255),   ImU32 highFillColor = IM_COL32(0, 0, 255, 255));
+	void onReplayEntered();
+	void onReplayLeft();
+	void loadReplaySession(ReplayWrapper& replay);
+	void finishSessionLoad(const std::string& replayId);
+	void publishReplayPosition(ReplayServerWrapper& serverReplay, ReplayWrapper& replay);
 	void updateLoadedDataset();
 	void deleteLoadedDatasetFile();
 	void generateAnalysis();
+	std::filesystem::path findReplayFile(const std::string& replayId);
+	void cancelAnalysis();
+	AnalysisJob makeAnalysisJob(const std::string& replayId, const std::filesystem::path& replayPath, const std::string& model = {});
+	bool enqueueAnalysis(AnalysisJob job, bool front = false);
+	void resumeJournaledJobs();
+	AnalysisOutcome runAnalysisJob(const AnalysisJob& job, const std::atomic<bool>& cancel);
+	void onAnalysisJobDone(const AnalysisJob& job, AnalysisOutcome outcome);
+	bool isViewing(const AnalysisJob& job);
+	void drainStreamedRows(const AnalysisJob& job, RowStreamBuffer& rows);
+	void enqueueAllReplays();
+	void watchAnalysisFolder();
+	void onReplayFileSettled(const std::filesystem::path& replayPath);
+	void onAnalysisFileSettled(const std::filesystem::path& analysisPath);
+	void onModelsScanned();
+	void RunAppletBenchmark(int runs);
+	void refreshViewedAnalysisKey();
+	void applyRemoteSettings();
+	void startStandIn(int port);
+	void stopStandIn();
+
+	void MirrorPositionCvars(const ReplayPosition& pos);
+
+	ReplayPosition lastPublishedPosition_{};         // game thread only
+	uintptr_t hashedReplayObject_ = 0;               // replay object lastPublishedPosition_.replayId was hashed from
+	int mirroredFrame_ = -1;
+	int mirroredNumFrames_ = -1;
+	bool cvarMirrorQueued_ = false;
+
+	TickScheduler scheduler_;                        // game-thread work queue, drained on every tick
+	ConfigSaver configSaver_{ [this]() { cvarManager->executeCommand("writeconfig"); } };   // polled on every tick
+	std::unique_ptr<ThreadPool> pool_;               // background work; continuations post to scheduler_
+	std::unique_ptr<HttpClient> http_;               // remote analysis requests; callbacks and lookups run on pool_
+	std::unique_ptr<AnalysisQueue> analysisQueue_;   // declared after pool_: its workers are pool tasks
+	std::string busyJobKey_;                         // job that set neurlcar_analysis_busy, game thread only
+	std::set<std::string> staleRefreshes_;           // stale analyses already re-queued, game thread only
+
+	AnalysisProgressTracker analysisProgress_;
+	AnalysisCache analysisCache_;                    // replay hashes, model fingerprints, analysis keys
+	JobJournal journal_;                             // queued/running jobs, resumed on the next load
+	FileWatchService fileWatch_;                     // new replays and changed analyses; posts to scheduler_
+	ModelRegistry modelRegistry_;                    // install status of every model, scanned on pool_
+	std::atomic<bool> modelVerifyRequested_{ false }; // "Verify model install", applied after the next scan
+	std::filesystem::path watchedAnalysisDir_;       // game thread only
+	std::filesystem::path loadedAnalysisFile_;       // what updateLoadedDataset loaded, game thread only
+	std::filesystem::file_time_type loadedAnalysisWrite_{};
+	AppletServerPool appletServers_;                 // resident applets, one per model
+	std::atomic<bool> residentApplets_{ false };     // neurlcar_applet_resident
+	std::mutex remoteMutex_;
+	RemoteSettings remoteSettings_;                  // neurlcar_remote_* cvars; each job carries its own url
+	std::unique_ptr<RemoteStandInServer> standIn_;   // neurlcar_remote_standin, game thread only
+	std::atomic<uint16_t> standInPort_{ 0 };         // 0 while the stand-in isn't running
+	std::atomic<bool> benchRunning_{ false };        // applet benchmark task on pool_
+	std::atomic<bool> benchCancel_{ false };
 
 public:
 	void RenderSettingsContents();
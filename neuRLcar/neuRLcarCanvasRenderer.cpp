@@ -1,5 +1,6 @@
 ﻿#include "pch.h"
 #include "neuRLcar.h"
+#include "overlayrender.h"
 #include "bakkesmod/wrappers/canvaswrapper.h"
 #include "bakkesmod/wrappers/ImageWrapper.h"
 #include <filesystem>
@@ -8,83 +9,26 @@
 #include <vector>
 #include <memory>
 #include <string>
-
-std::vector<std::vector<double>>& getloadedData();
-bool& replaydataloaded();
-bool& isinreplay();
-
-// Subtle grey used for outlines + separators + grid
-static constexpr int UI_GREY_R = 150;
-static constexpr int UI_GREY_G = 150;
-static constexpr int UI_GREY_B = 150;
-static constexpr int UI_GREY_A = 220;
-
-static constexpr int GRID_A = 120;
+#include <cmath>
 
 // ====================
-// Layout
+// Canvas target
 // ====================
-struct NeuRLcarLayout
+// Forwards the overlay elements' drawing (overlayrender.h) to the game's canvas
+class GameCanvasTarget : public ICanvasTarget
 {
-    float screenW = 0.0f;
-    float screenH = 0.0f;
+public:
+    explicit GameCanvasTarget(CanvasWrapper& canvas) : canvas_(canvas) {}
 
-    // Top advantage bars
-    Vector2 barSize{};
-    Vector2 leftBarPos{};
-    Vector2 rightBarPos{};
+    void SetColor(int r, int g, int b, int a) override { canvas_.SetColor(r, g, b, a); }
+    void SetPosition(CanvasPoint pos) override { canvas_.SetPosition(Vector2(pos.X, pos.Y)); }
+    void FillBox(CanvasPoint size) override { canvas_.FillBox(Vector2(size.X, size.Y)); }
+    void DrawBox(CanvasPoint size) override { canvas_.DrawBox(Vector2(size.X, size.Y)); }
 
-    // Main eval display box
-    Vector2 mainPos{};
-    Vector2 mainSize{};
+private:
+    CanvasWrapper& canvas_;
 };
 
-static constexpr float BAR_HEIGHT_FRAC = 0.07f;
-static constexpr float BAR_WIDTH_FRAC = 0.40f;
-
-static constexpr float MAIN_TOP_FRAC = 0.098f;
-static constexpr float MAIN_HEIGHT_FRAC = 0.14f;
-static constexpr float MAIN_WIDTH_FRAC = 0.20f;
-
-static float Clamp01(float v)
-{
-    if (v < 0.0f) return 0.0f;
-    if (v > 1.0f) return 1.0f;
-    return v;
-}
-
-static int ClampInt(int v, int lo, int hi)
-{
-    if (v < lo) return lo;
-    if (v > hi) return hi;
-    return v;
-}
-
-static NeuRLcarLayout ComputeLayout(const Vector2& screenSize)
-{
-    NeuRLcarLayout lay;
-    lay.screenW = screenSize.X;
-    lay.screenH = screenSize.Y;
-
-    // Top bars
-    float barW = lay.screenW * BAR_WIDTH_FRAC;
-    float barH = lay.screenH * BAR_HEIGHT_FRAC;
-    lay.barSize = Vector2(barW, barH);
-    lay.leftBarPos = Vector2(0.0f, 0.0f);
-    lay.rightBarPos = Vector2(lay.screenW - barW, 0.0f);
-
-    // Main eval box (aligned to scoreboard)
-    float mainW = lay.screenW * MAIN_WIDTH_FRAC;
-    float mainH = lay.screenH * MAIN_HEIGHT_FRAC;
-    float mainX = (lay.screenW - mainW) * 0.5f;
-    float mainY = lay.screenH * MAIN_TOP_FRAC;
-
-    lay.mainPos = Vector2(mainX, mainY);
-    lay.mainSize = Vector2(mainW, mainH);
-
-    return lay;
-}
-
 // Debug grid: 1% increments across screen
 static void RenderDebugGrid(CanvasWrapper& canvas)
 {
@@ -130,157 +74,57 @@ static void GetRowPixelSpan(const NeuRLcarLayout& lay, int row, int totalRows, i
     y1 = (int)fy1;
     if (y1 <= y0) y1 = y0 + 1;
 }
-// Smoothing: avg over [frame-half, frame+half], half = smoothingWindow/2
-static float SmoothedEvalAt(const std::vector<double>& evalSeries, int frame, int smoothingWindow)
-{
-    int n = (int)evalSeries.size();
-    if (n <= 0) return 0.5f;
-
-    if (frame < 0) frame = 0;
-    if (frame >= n) frame = n - 1;
 
-    if (smoothingWindow <= 0) return Clamp01((float)evalSeries[frame]);
-
-    int half = smoothingWindow / 2;
-    int lo = frame - half;
-    int hi = frame + half;
-
-    if (lo < 0) lo = 0;
-    if (hi >= n) hi = n - 1;
-
-    double sum = 0.0;
-    int count = 0;
-    for (int i = lo; i <= hi; ++i)
-    {
-        sum += evalSeries[i];
-        ++count;
-    }
+// ====================
+// Precomputed per-frame eval
+// ====================
+// Smoothed eval for every frame of the loaded series, rebuilt only when the dataset or the
+// smoothing window changes. Renders then cost a lookup (plus one lerp) per sample instead
+// of a window average per graph column.
+struct SmoothedSeriesCache
+{
+    unsigned generation = ~0u;
+    const std::vector<double>* source = nullptr;
+    int smoothingWindow = -1;
+    std::vector<float> values;
+};
 
-    if (count <= 0) return Clamp01((float)evalSeries[frame]);
-    return Clamp01((float)(sum / (double)count));
+static SmoothedSeriesCache& smoothedSeriesCache()
+{
+    static SmoothedSeriesCache cache;
+    return cache;
 }
 
-static void DrawHorizontalEvalGraph(CanvasWrapper& canvas,
-    const NeuRLcarLayout& lay,
-    const std::vector<double>& evalSeries,
-    int currentframe,
-    int smoothingWindow,
-    bool showBackground,
-    int bgAlpha)
+void PrimeSmoothedSeries(const std::vector<double>& evalSeries, int smoothingWindow, std::vector<float> values)
 {
-    const int evalDisplayBreadth = 301;
-    const int halfWindow = 150;
-
-    int x0 = (int)lay.mainPos.X;
-    int x1 = (int)(lay.mainPos.X + lay.mainSize.X);
-    if (x1 <= x0) x1 = x0 + 1;
-    int w = x1 - x0;
-
-    int y0 = (int)lay.mainPos.Y;
-    int y1 = (int)(lay.mainPos.Y + lay.mainSize.Y);
-    if (y1 <= y0) y1 = y0 + 1;
-    int h = y1 - y0;
-
-    if (showBackground)
-    {
-        canvas.SetColor(255, 255, 255, bgAlpha);
-        canvas.SetPosition(lay.mainPos);
-        canvas.FillBox(lay.mainSize);
-    }
-
-    int minFrame = currentframe - halfWindow;
-
-    for (int i = 0; i < evalDisplayBreadth; ++i)
-    {
-        int xi0 = x0 + (w * i) / evalDisplayBreadth;
-        int xi1 = x0 + (w * (i + 1)) / evalDisplayBreadth;
-        if (xi1 <= xi0) xi1 = xi0 + 1;
-
-        int frame = minFrame + i;
-
-        float v = -1.0f;
-        if (frame >= 0 && frame < (int)evalSeries.size())
-            v = SmoothedEvalAt(evalSeries, frame, smoothingWindow);
-
-        if (v < 0.0f)
-        {
-            canvas.SetColor(200, 200, 200, bgAlpha);
-            canvas.SetPosition(Vector2((float)xi0, (float)y0));
-            canvas.FillBox(Vector2((float)(xi1 - xi0), (float)h));
-            continue;
-        }
-
-        int ySplit = y0 + (int)((1.0f - v) * (float)h);
-        ySplit = ClampInt(ySplit, y0, y1);
-
-        int topH = ySplit - y0;
-        int botH = y1 - ySplit;
-
-        if (topH > 0)
-        {
-            canvas.SetColor(0, 0, 255, bgAlpha);
-            canvas.SetPosition(Vector2((float)xi0, (float)y0));
-            canvas.FillBox(Vector2((float)(xi1 - xi0), (float)topH));
-        }
-
-        if (botH > 0)
-        {
-            canvas.SetColor(255, 165, 0, bgAlpha);
-            canvas.SetPosition(Vector2((float)xi0, (float)ySplit));
-            canvas.FillBox(Vector2((float)(xi1 - xi0), (float)botH));
-        }
-    }
-
-    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
-    for (int j = 1; j < 10; ++j)
-    {
-        int yi = y0 + (h * j) / 10;
-
-        int thick = (j == 5) ? 3 : 1;
-        int yStart = yi - (thick / 2);
-
-        if (yStart < y0) yStart = y0;
-        if (yStart + thick > y1) yStart = y1 - thick;
+    if (values.size() != evalSeries.size())
+        return;
 
-        canvas.SetPosition(Vector2((float)x0, (float)yStart));
-        canvas.FillBox(Vector2((float)w, (float)thick));
-    }
+    SmoothedSeriesCache& cache = smoothedSeriesCache();
+    cache.values = std::move(values);
+    cache.generation = loadedDataGeneration();
+    cache.source = &evalSeries;
+    cache.smoothingWindow = smoothingWindow;
+}
 
-    int xCenter = x0 + (w / 2);
-    int centerThick = 4;
-    int xStart = xCenter - (centerThick / 2);
-    if (xStart < x0) xStart = x0;
-    if (xStart + centerThick > x1) xStart = x1 - centerThick;
+static const std::vector<float>& GetSmoothedSeries(const std::vector<double>& evalSeries, int smoothingWindow)
+{
+    SmoothedSeriesCache& cache = smoothedSeriesCache();
 
-    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
-    canvas.SetPosition(Vector2((float)xStart, (float)y0));
-    canvas.FillBox(Vector2((float)centerThick, (float)h));
+    if (cache.generation == loadedDataGeneration() &&
+        cache.source == &evalSeries &&
+        cache.smoothingWindow == smoothingWindow &&
+        cache.values.size() == evalSeries.size())
+        return cache.values;
 
-    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
-    canvas.SetPosition(lay.mainPos);
-    canvas.DrawBox(lay.mainSize);
+    PrimeSmoothedSeries(evalSeries, smoothingWindow, ComputeSmoothedSeries(evalSeries, smoothingWindow));
+    return cache.values;
 }
 
 
 // ====================
 // CVar-driven config
 // ====================
-struct NeuRLcarConfig
-{
-    bool showTopBars = true;
-    bool showMainEval = true;
-    bool showMainBackground = false;
-
-    int mainEvalAlpha = 220;
-
-    bool showHotkeyReminders = true;
-
-    int pastRows = 150;          // frames
-    int futureRows = 150;        // frames
-    int smoothingWindow = 0;    // frames (0 = raw)
-    int barBgAlpha = 180;
-};
-
 static NeuRLcarConfig LoadConfig(CVarManagerWrapper* cvarManager)
 {
     NeuRLcarConfig cfg;
@@ -307,144 +151,14 @@ static NeuRLcarConfig LoadConfig(CVarManagerWrapper* cvarManager)
 
 
 // ====================
-// Rendering context + elements
+// Text elements
 // ====================
-struct RenderContext
-{
-    CanvasWrapper* canvas = nullptr;
-    NeuRLcarLayout layout{};
-    const std::vector<double>* evalSeries = nullptr; // may be null if no analysis
-    int currentframe = 0;
-
-    NeuRLcarConfig cfg{};
-    float presentEval01 = 0.5f; // smoothed at current frame (only meaningful if evalSeries != nullptr)
-};
-
-class ICanvasElement
-{
-public:
-    virtual ~ICanvasElement() = default;
-    virtual void Render(const RenderContext& ctx) = 0;
-};
-
-// ====================
-// Top bars element
-// ====================
-class TopBarsElement : public ICanvasElement
-{
-public:
-    void Render(const RenderContext& ctx) override
-    {
-        if (!ctx.cfg.showTopBars || !ctx.evalSeries) return;
-
-        CanvasWrapper& canvas = *ctx.canvas;
-        const NeuRLcarLayout& lay = ctx.layout;
-
-        float barW = lay.barSize.X;
-        float barH = lay.barSize.Y;
-
-        // Backgrounds
-        canvas.SetColor(0, 0, 0, ctx.cfg.barBgAlpha);
-        canvas.SetPosition(lay.leftBarPos);
-        canvas.FillBox(lay.barSize);
-
-        canvas.SetColor(0, 0, 0, ctx.cfg.barBgAlpha);
-        canvas.SetPosition(lay.rightBarPos);
-        canvas.FillBox(lay.barSize);
-
-        // If we have an eval, fill proportional to advantage magnitude
-        if (ctx.evalSeries)
-        {
-            float e = ctx.presentEval01;
-
-            // advantage magnitude: 0 at 0.5, 1 at 0 or 1
-            float adv = e - 0.5f;
-            if (adv < 0.0f) adv = -adv;
-            adv = Clamp01(adv * 2.0f);
-
-            bool orangeWins = (e > 0.5f);
-            bool blueWins = (e < 0.5f);
-
-            if (blueWins && adv > 0.0f)
-            {
-                float fillW = barW * adv;
-                canvas.SetColor(0, 128, 255, 230);
-                float x = lay.leftBarPos.X + (barW - fillW);
-                canvas.SetPosition(Vector2(x, lay.leftBarPos.Y));
-                canvas.FillBox(Vector2(fillW, barH));
-            }
-
-            if (orangeWins && adv > 0.0f)
-            {
-                float fillW = barW * adv;
-                canvas.SetColor(255, 165, 0, 230);
-                canvas.SetPosition(lay.rightBarPos);
-                canvas.FillBox(Vector2(fillW, barH));
-            }
-        }
-
-		// 10% eval lines
-        canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
-        for (int i = 1; i < 5; ++i)
-        {
-            int thick = 1;
-            int xi = (int)(lay.leftBarPos.X + (barW * i) / 5.0f);
-            canvas.SetPosition(Vector2((float)xi, lay.leftBarPos.Y));
-            canvas.FillBox(Vector2((float)thick, barH));
-        }
-
-        canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
-        for (int i = 1; i < 5; ++i)
-        {
-            int thick = 1;
-            int xi = (int)(lay.rightBarPos.X + (barW * i) / 5.0f);
-            canvas.SetPosition(Vector2((float)xi, lay.rightBarPos.Y));
-            canvas.FillBox(Vector2((float)thick, barH));
-        }
-
-
-
-        // Grey outlines
-        canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
-        canvas.SetPosition(lay.leftBarPos);
-        canvas.DrawBox(lay.barSize);
-        canvas.SetPosition(lay.rightBarPos);
-        canvas.DrawBox(lay.barSize);
-    }
-};
-
-// ====================
-// Main eval display element
-// ====================
-class MainEvalDisplayElement : public ICanvasElement
-{
-public:
-    void Render(const RenderContext& ctx) override
-    {
-        if (!ctx.cfg.showMainEval) return;
-        if (!ctx.evalSeries) return;
-
-        CanvasWrapper& canvas = *ctx.canvas;
-        const NeuRLcarLayout& lay = ctx.layout;
-        const std::vector<double>& evalSeries = *ctx.evalSeries;
-
-        DrawHorizontalEvalGraph(canvas,
-            lay,
-            evalSeries,
-            ctx.currentframe,
-            ctx.cfg.smoothingWindow,
-            ctx.cfg.showMainBackground,
-            ctx.cfg.mainEvalAlpha);
-
-    }
-};
-
 class TextOverlayElement : public ICanvasElement
 {
 public:
     void Render(const RenderContext& ctx) override
     {
-        CanvasWrapper& canvas = *ctx.canvas;
+        ICanvasTarget& canvas = *ctx.canvas;
         const NeuRLcarLayout& lay = ctx.layout;
 
         float W = ctx.layout.screenW;
@@ -468,6 +182,40 @@ static void DrawCenteredText(CanvasWrapper& canvas,
     canvas.DrawString(text, xScale, yScale);
 }
 
+// "analyzing... 42% (~1:05 left)"; the percentage is a prediction until the applet reports
+static std::string AnalysisProgressText(const AnalysisProgress& progress)
+{
+    std::string text = "analyzing...";
+    if (!progress.active)
+        return text;
+    if (progress.reported || progress.etaSeconds >= 0.0)
+        text += " " + std::to_string((int)(progress.fraction * 100.0)) + "%";
+    if (progress.etaSeconds >= 0.0)
+        text += " (~" + FormatDuration(progress.etaSeconds) + " left)";
+    return text;
+}
+
+static void DrawAnalysisProgressBar(CanvasWrapper& canvas, const AnalysisProgress& progress,
+    float centerX, float y, float width, float height)
+{
+    if (!progress.active || (!progress.reported && progress.etaSeconds < 0.0))
+        return;
+
+    float x = centerX - width * 0.5f;
+    canvas.SetColor(0, 0, 0, 150);
+    canvas.SetPosition(Vector2(x, y));
+    canvas.FillBox(Vector2(width, height));
+
+    // predicted progress is drawn dimmer than reported progress
+    canvas.SetColor(255, 255, 255, progress.reported ? 220 : 120);
+    canvas.SetPosition(Vector2(x, y));
+    canvas.FillBox(Vector2(width * (float)progress.fraction, height));
+
+    canvas.SetColor(255, 255, 255, 255);
+    canvas.SetPosition(Vector2(x, y));
+    canvas.DrawBox(Vector2(width, height));
+}
+
 static std::shared_ptr<ImageWrapper> GetScoreboardWrapperImage(GameWrapper* gw)
 {
     static std::shared_ptr<ImageWrapper> img;
@@ -543,37 +291,38 @@ void neuRLcar::RenderCanvas(CanvasWrapper canvas)
     if (cvarManager->getCvar("neurlcar_ui_debug_grid").getBoolValue())
         RenderDebugGrid(canvas);
 
-    if (!isinreplay())
+    if (!replaySession().InReplay())
         return;
 
     NeuRLcarConfig cfg = LoadConfig(cvarManager.get());
-    NeuRLcarLayout lay = ComputeLayout(canvas.GetSize());
+    Vector2 screenSize = canvas.GetSize();
+    NeuRLcarLayout lay = ComputeLayout(CanvasPoint((float)screenSize.X, (float)screenSize.Y));
     DrawScoreboardWrapperPng(canvas, gameWrapper.get());
 
     // Live busy flag (RAW cvar, every frame)
     int analysisBusy = cvarManager->getCvar("neurlcar_analysis_busy").getIntValue();
 
-    // Always get current frame
-    int currentframe = cvarManager->getCvar("currentframe").getIntValue();
+    // Sub-frame playback position (replay time + render delta since the last tick)
+    double playbackPosition = GetPlaybackPosition(replayPositionState().Read(), std::chrono::steady_clock::now());
 
     // Determine if we have analysis loaded
-    bool hasAnalysis = replaydataloaded();
-    const std::vector<double>* evalSeriesPtr = nullptr;
+    bool hasAnalysis = replaySession().AnalysisLoaded();
+    const std::vector<float>* evalSeriesPtr = nullptr;
     float presentEval01 = 0.5f;
 
     if (hasAnalysis)
     {
-        auto& loadedData = getloadedData();
-        if (!loadedData.empty() && !loadedData[0].empty())
+        auto data = loadedData();
+        if (!data->empty() && !(*data)[0].empty())
         {
-            evalSeriesPtr = &loadedData[0];
+            evalSeriesPtr = &GetSmoothedSeries((*data)[0], cfg.smoothingWindow);
 
-            // clamp currentframe
-            int n = (int)evalSeriesPtr->size();
-            if (currentframe < 0) currentframe = 0;
-            if (currentframe >= n) currentframe = n - 1;
+            // clamp playback position
+            double last = (double)(evalSeriesPtr->size() - 1);
+            if (playbackPosition < 0.0) playbackPosition = 0.0;
+            if (playbackPosition > last) playbackPosition = last;
 
-            presentEval01 = SmoothedEvalAt(*evalSeriesPtr, currentframe, cfg.smoothingWindow);
+            presentEval01 = InterpolatedEvalAt(*evalSeriesPtr, playbackPosition);
         }
         else
         {
@@ -581,11 +330,13 @@ void neuRLcar::RenderCanvas(CanvasWrapper canvas)
         }
     }
 
+    GameCanvasTarget target(canvas);
+
     RenderContext ctx;
-    ctx.canvas = &canvas;
+    ctx.canvas = &target;
     ctx.layout = lay;
     ctx.evalSeries = evalSeriesPtr;
-    ctx.currentframe = currentframe;
+    ctx.playbackPosition = playbackPosition;
     ctx.cfg = cfg;
     ctx.presentEval01 = presentEval01;
 
@@ -635,12 +386,19 @@ void neuRLcar::RenderCanvas(CanvasWrapper canvas)
         {
             float yTop = lay.screenH * 0.10f;
 
+            AnalysisProgress progress = analysisProgress_.SnapshotViewed();
+            bool analyzing = analysisBusy == 1 || progress.active;
+
             std::string line1 =
-                (analysisBusy == 1)
-                ? "analyzing..."
+                analyzing
+                ? AnalysisProgressText(progress)
+                : replaySession().AnalysisFailed()
+                ? ("could not load the analysis, press " + keyAnalysis + " to analyze again")
                 : ("press " + keyAnalysis + " to analyze replay");
 
             DrawCenteredText(canvas, line1, xCenter, yTop, 255, 255, 255, 255);
+            if (analyzing)
+                DrawAnalysisProgressBar(canvas, progress, xCenter, lay.screenH * 0.125f, lay.screenW * 0.15f, lay.screenH * 0.008f);
 
             float y2 = lay.screenH * 0.09f;
             DrawCenteredText(canvas, "press " + keySettings + " to toggle settings window", xCenter, y2, 255, 255, 255, 255);
@@ -17,16 +17,17 @@ void neuRLcar::RenderSettingsContents()
 
     auto C = [&](const char* name) { return cvarManager->getCvar(name); };
 
+    // changes are only marked; configSaver_ writes the config once they stop coming
     auto SetBoolAndSave = [&](const char* cvarName, bool value)
         {
             C(cvarName).setValue(value);
-            cvarManager->executeCommand("writeconfig");
+            configSaver_.MarkDirty();
         };
 
     auto SetIntAndSave = [&](const char* cvarName, int value)
         {
             C(cvarName).setValue(value);
-            cvarManager->executeCommand("writeconfig");
+            configSaver_.MarkDirty();
         };
 
     auto GetModelsDir = [&]() -> std::filesystem::path
@@ -34,65 +35,20 @@ void neuRLcar::RenderSettingsContents()
             return gameWrapper->GetBakkesModPath() / "data" / "neurlcar" / "models";
         };
 
-    auto GetModelDir = [&](const std::string& model) -> std::filesystem::path
-        {
-            return GetModelsDir() / model;
-        };
-
-    auto GetModelExePath = [&](const std::string& model) -> std::filesystem::path
-        {
-            return GetModelDir(model) / (model + "_applet.exe");
-        };
-
-    auto GetModelInternalDir = [&](const std::string& model) -> std::filesystem::path
-        {
-            return GetModelDir(model) / "_internal";
-        };
+    // install status comes from the model registry's last background scan, never the filesystem
+    auto models = modelRegistry_.Snapshot();
 
     auto CheckModelInstall = [&](const std::string& model, std::string& outReason) -> bool
         {
-            std::error_code ec;
-
-            const auto modelDir = GetModelDir(model);
-            if (!std::filesystem::exists(modelDir, ec) || !std::filesystem::is_directory(modelDir, ec))
-            {
-                outReason = "Model folder missing: " + modelDir.string();
-                return false;
-            }
-
-            const auto exePath = GetModelExePath(model);
-            if (!std::filesystem::exists(exePath, ec) || !std::filesystem::is_regular_file(exePath, ec))
-            {
-                outReason = "Missing applet exe: " + exePath.string();
-                return false;
-            }
-
-            const auto internalDir = GetModelInternalDir(model);
-            if (!std::filesystem::exists(internalDir, ec) || !std::filesystem::is_directory(internalDir, ec))
-            {
-                outReason = "Missing _internal folder: " + internalDir.string();
-                return false;
-            }
-
-            outReason.clear();
-            return true;
+            outReason = ModelInstallProblem(GetModelsDir(), model, models->Find(model));
+            return outReason.empty();
         };
 
-    auto UpdateModelReadyCvar = [&](const std::string& model)
+    // the result is applied (and logged) once the rescan it asks for has finished
+    auto UpdateModelReadyCvar = [&]()
         {
-            std::string reason;
-            bool ok = CheckModelInstall(model, reason);
-
-            CVarWrapper ready = C("neurlcar_model_ready");
-            if (!ready.IsNull())
-                ready.setValue(ok ? 1 : 0);
-
-            cvarManager->executeCommand("writeconfig");
-
-            if (ok)
-                LOG("Model verify OK for '{}'", model);
-            else
-                LOG("Model verify FAILED for '{}': {}", model, reason);
+            modelVerifyRequested_ = true;
+            modelRegistry_.Refresh();
         };
 
     // ---------------------
@@ -101,12 +57,12 @@ void neuRLcar::RenderSettingsContents()
     CVarWrapper modelCvar = C("neurlcar_current_model");
     std::string current_model = modelCvar.IsNull() ? "neurlcar" : modelCvar.getStringValue();
 
-    const std::filesystem::path modelsDir = GetModelsDir();
-
     static std::vector<std::string> modelNames;
     static std::vector<const char*> modelItems;
     static int selectedIndex = -1;
     static bool modelsInit = false;
+    static uint64_t modelsVersion = 0;
+    static std::string modelsCurrent;
 
     auto RefreshModels = [&]()
         {
@@ -114,24 +70,9 @@ void neuRLcar::RenderSettingsContents()
             modelItems.clear();
             selectedIndex = -1;
 
-            std::error_code ec;
-            if (!std::filesystem::exists(modelsDir, ec))
-                return;
-
-            for (auto it = std::filesystem::directory_iterator(modelsDir, ec);
-                !ec && it != std::filesystem::directory_iterator();
-                ++it)
-            {
-                const auto& entry = *it;
-                if (!entry.is_directory(ec))
-                    continue;
-
-                std::string name = entry.path().filename().string();
-                if (!name.empty())
-                    modelNames.push_back(name);
-            }
-
-            std::sort(modelNames.begin(), modelNames.end());
+            for (const auto& model : models->models)
+                if (!model.name.empty())
+                    modelNames.push_back(model.name);
 
             modelItems.reserve(modelNames.size());
             for (auto& s : modelNames)
@@ -148,17 +89,23 @@ void neuRLcar::RenderSettingsContents()
 
             if (selectedIndex < 0 && !modelNames.empty())
                 selectedIndex = 0;
+
+            modelsVersion = models->version;
+            modelsCurrent = current_model;
         };
 
     if (!modelsInit)
     {
-        RefreshModels();
         modelsInit = true;
 
         // On first open, set readiness cvar based on current model
-        UpdateModelReadyCvar(current_model);
+        UpdateModelReadyCvar();
     }
 
+    // the list follows the registry; rebuilding it is cheap, so any change will do
+    if (models->version != modelsVersion || current_model != modelsCurrent)
+        RefreshModels();
+
     bool modelReady = false;
     {
         CVarWrapper ready = C("neurlcar_model_ready");
@@ -167,14 +114,14 @@ void neuRLcar::RenderSettingsContents()
 
     // Always re-check the currently-selected model if the cvar says "ready",
     // because users can delete files while RL is running
-    if (modelReady)
+    if (modelReady && models->scanned)
     {
         std::string reason;
         if (!CheckModelInstall(current_model, reason))
         {
             // Flip back to setup mode
             C("neurlcar_model_ready").setValue(0);
-            cvarManager->executeCommand("writeconfig");
+            configSaver_.MarkDirty();
             modelReady = false;
         }
     }
@@ -204,25 +151,33 @@ void neuRLcar::RenderSettingsContents()
         ImGui::Separator();
         ImGui::TextUnformatted("directory structure status:");
 
+        if (!models->scanned)
         {
-            const auto modelDir = GetModelDir(current_model);
-            const auto exePath = GetModelExePath(current_model);
-            const auto internalDir = GetModelInternalDir(current_model);
-
-            std::error_code ec;
-            bool hasExe = std::filesystem::exists(exePath, ec) && std::filesystem::is_regular_file(exePath, ec);
-            bool hasInternal = std::filesystem::exists(internalDir, ec) && std::filesystem::is_directory(internalDir, ec);
+            ImGui::TextUnformatted("Checking model folders...");
+        }
+        else
+        {
+            const ModelInstall* install = models->Find(current_model);
+            bool hasExe = install && install->hasExe;
+            bool hasRuntime = install && install->hasRuntime;
 
             ImGui::Text("Applet exe: %s", hasExe ? "FOUND" : "MISSING");
-            ImGui::Text("_internal:  %s", hasInternal ? "FOUND" : "MISSING");
+            if (!install || !install->manifest.runtime.empty())
+                ImGui::Text("%s:  %s", install ? install->manifest.runtime.c_str() : "_internal", hasRuntime ? "FOUND" : "MISSING");
+
+            if (!install || !install->hasManifest)
+                ImGui::TextUnformatted("model.cfg:  none (folder defaults)");
+            else if (!install->manifestError.empty())
+                ImGui::Text("model.cfg:  INVALID (%s)", install->manifestError.c_str());
+            else
+                ImGui::Text("model.cfg:  version %s, %d columns", install->manifest.version.c_str(), (int)install->manifest.columns.size());
         }
 
         ImGui::Separator();
 
         if (ImGui::Button("Verify model install"))
         {
-            UpdateModelReadyCvar(current_model);
-
+            UpdateModelReadyCvar();
         }
 
         return;
@@ -241,8 +196,7 @@ void neuRLcar::RenderSettingsContents()
     bool openOnReplay = C("neurlcar_ui_open_window_on_replay").getBoolValue();
     if (ImGui::Checkbox("Open neuRLcar window automatically in replays", &openOnReplay))
     {
-        C("neurlcar_ui_open_window_on_replay").setValue(openOnReplay);
-        cvarManager->executeCommand("writeconfig");
+        SetBoolAndSave("neurlcar_ui_open_window_on_replay", openOnReplay);
     }
 
     b = C("neurlcar_ui_show_topbars").getBoolValue();
@@ -343,6 +297,48 @@ void neuRLcar::RenderSettingsContents()
 
     ImGui::Separator();
 
+    ImGui::Text("Remote analysis");
+    ImGui::Separator();
+
+    // the stand-in is started and stopped on the game thread; the url box follows once it has
+    static char remoteUrlBuf[256];
+    static bool remoteBufInit = false;
+    static bool lastStandInRunning = false;
+    const bool standInRunning = standInPort_ != 0;
+    if (!remoteBufInit || standInRunning != lastStandInRunning)
+    {
+        strncpy_s(remoteUrlBuf, C("neurlcar_remote_url").getStringValue().c_str(), sizeof(remoteUrlBuf) - 1);
+        strncpy_s(apiKeyInput, savedApiKey.c_str(), sizeof(apiKeyInput) - 1);
+        remoteBufInit = true;
+        lastStandInRunning = standInRunning;
+    }
+
+    ImGui::InputText("Server (empty = analyze here)", remoteUrlBuf, IM_ARRAYSIZE(remoteUrlBuf));
+    ImGui::InputText("API key", apiKeyInput, IM_ARRAYSIZE(apiKeyInput), ImGuiInputTextFlags_Password);
+
+    if (ImGui::Button("Apply server"))
+    {
+        C("neurlcar_remote_url").setValue(std::string(remoteUrlBuf));
+        C("neurlcar_remote_api_key").setValue(std::string(apiKeyInput));
+        configSaver_.MarkDirty();
+    }
+
+    ImGui::SameLine();
+
+    if (ImGui::Button(standInRunning ? "Stop local stand-in" : "Start local stand-in"))
+    {
+        scheduler_.Post("stand-in", [this, standInRunning]() {
+            if (standInRunning)
+                stopStandIn();
+            else
+                startStandIn(0);
+            });
+    }
+    if (standInRunning)
+        ImGui::Text("Stand-in listening on 127.0.0.1:%d", (int)standInPort_);
+
+    ImGui::Separator();
+
     ImGui::Text("Change model:");
     if (modelNames.empty())
     {
@@ -362,11 +358,10 @@ void neuRLcar::RenderSettingsContents()
                 if (!modelCvar.IsNull())
                 {
                     modelCvar.setValue(modelNames[selectedIndex]);
-                    cvarManager->executeCommand("writeconfig");
 
                     // When switching models, go back to setup mode until verified
                     C("neurlcar_model_ready").setValue(0);
-                    cvarManager->executeCommand("writeconfig");
+                    configSaver_.MarkDirty();
 
                     updateLoadedDataset();
                 }
@@ -375,8 +370,7 @@ void neuRLcar::RenderSettingsContents()
 
         if (ImGui::Button("Refresh model list"))
         {
-            current_model = modelCvar.IsNull() ? "neurlcar" : modelCvar.getStringValue();
-            RefreshModels();
+            modelRegistry_.Refresh();
         }
         ImGui::Separator();
     }
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "neuRLcar.h"
+#include "evalgraph.h"
 
 
 void neuRLcar::RenderWindow()
@@ -14,6 +15,26 @@ void neuRLcar::RenderWindow()
     {
         if (ImGui::Button("Generate analysis"))
             generateAnalysis();
+
+        AnalysisProgress progress = analysisProgress_.SnapshotViewed();
+        if (progress.active)
+        {
+            char overlay[96];
+            if (progress.reported)
+                snprintf(overlay, sizeof(overlay), "%d / %d frames", progress.framesDone, progress.framesTotal);
+            else
+                snprintf(overlay, sizeof(overlay), "starting...");
+            ImGui::ProgressBar((float)progress.fraction, ImVec2(-1.0f, 0.0f), overlay);
+
+            if (progress.etaSeconds >= 0.0)
+                ImGui::Text("elapsed %s, about %s left%s", FormatDuration(progress.elapsedSeconds).c_str(),
+                    FormatDuration(progress.etaSeconds).c_str(), progress.reported ? "" : " (estimated)");
+            else
+                ImGui::Text("elapsed %s", FormatDuration(progress.elapsedSeconds).c_str());
+
+            if (ImGui::Button("Cancel analysis"))
+                cvarManager->executeCommand("neurlcar_cancel_analysis");
+        }
         ImGui::Separator();
     }
 
@@ -21,86 +42,29 @@ void neuRLcar::RenderWindow()
 
 	ImGui::Separator();
 	
-	if (!replaydataloaded()) return;
+	if (!replaySession().AnalysisLoaded()) return;
 
-    CVarWrapper currentframecvar = cvarManager->getCvar("currentframe");
-    if (currentframecvar.IsNull()) return;
-    CVarWrapper numframescvar = cvarManager->getCvar("numframes");
-    if (numframescvar.IsNull()) return;
+    ReplayPosition pos = replayPositionState().Read();
+    if (!pos.inReplay) return;
 
-    int currentframe = currentframecvar.getIntValue();
-    int numframes = numframescvar.getIntValue();
+    // read once; the game thread may publish a new dataset while this frame is drawn
+    auto data = loadedData();
+    const LoadedDataset& dataset = *data;
+    if (dataset.size() < 3 || dataset[0].empty() || dataset[2].empty()) return;
 
-	auto eval = getloadedData()[0][currentframe];
+    int currentframe = pos.frame;
+    if (currentframe < 0) currentframe = 0;
+    if (currentframe >= (int)dataset[0].size()) currentframe = (int)dataset[0].size() - 1;
+    if (currentframe >= (int)dataset[2].size()) currentframe = (int)dataset[2].size() - 1;
+
+	auto eval = dataset[0][currentframe];
     ImGui::Text("eval of current frame, 0 blue is winning, 1 orange is winning: %.4f", eval);
-    renderEvalGraph("##eval_graph", getloadedData()[0], currentframe);
+    RenderEvalGraph("##eval_graph", dataset[0], currentframe);
     ImGui::Separator();
 
-    auto imm = getloadedData()[2][currentframe];
+    auto imm = dataset[2][currentframe];
     ImGui::Text("probability <3seconds (90 frames) until a goal: %.4f", imm);
-    renderEvalGraph("##imm_graph", getloadedData()[2], currentframe, IM_COL32(255, 255, 255, 255), IM_COL32(0, 0, 0, 255));
+    RenderEvalGraph("##imm_graph", dataset[2], currentframe, IM_COL32(255, 255, 255, 255), IM_COL32(0, 0, 0, 255));
     ImGui::Separator();
 
 }
-
-
-
-
-void neuRLcar::renderEvalGraph(
-    const char* id,
-    const std::vector<double>& evaluation,
-    int currentframe,
-    ImU32 lowFillColor,
-    ImU32 highFillColor
-)
-{
-    const int evalDisplayBreadth = 301;
-    const int halfWindow = 150;
-    const ImVec2 graphSize = ImVec2(1920.0f / 3.0f, 1080.0f / 6.0f);
-    float rectWidth = graphSize.x / evalDisplayBreadth;
-
-    int minFrame = currentframe - halfWindow;
-
-    float values[evalDisplayBreadth] = {};
-
-    for (int i = 0; i < evalDisplayBreadth; i++) {
-        int frame = minFrame + i;
-        if (frame < 0 || frame >= (int)evaluation.size()) {
-            values[i] = -1.0f;
-        }
-        else {
-            values[i] = (float)evaluation[frame];
-        }
-    }
-
-    ImDrawList* drawList = ImGui::GetWindowDrawList();
-    ImVec2 p = ImGui::GetCursorScreenPos();
-
-    drawList->AddRectFilled(p, ImVec2(p.x + graphSize.x, p.y + graphSize.y), IM_COL32(255, 255, 255, 255));
-
-    for (int i = 0; i < evalDisplayBreadth - 1; i++) {
-        float x0 = p.x + i * rectWidth;
-        float x1 = x0 + rectWidth;
-
-        if (values[i] == -1.0f || values[i + 1] == -1.0f) {
-            drawList->AddRectFilled(ImVec2(x0, p.y), ImVec2(x1, p.y + graphSize.y), IM_COL32(200, 200, 200, 255));
-        }
-        else {
-            float y0 = p.y + (1.0f - values[i]) * graphSize.y;
-
-            drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, p.y + graphSize.y), lowFillColor);
-            drawList->AddRectFilled(ImVec2(x0, p.y), ImVec2(x1, y0), highFillColor);
-        }
-    }
-
-    ImU32 col = IM_COL32(80, 80, 80, 255);
-    const float horizontalSpacing = 0.100f * graphSize.y;
-
-    for (float y = p.y; y < p.y + graphSize.y; y += horizontalSpacing) {
-        drawList->AddLine(ImVec2(p.x, y), ImVec2(p.x + graphSize.x, y), col, 0.005f);
-    }
-
-    drawList->AddLine(ImVec2(p.x + graphSize.x / 2.0f, p.y), ImVec2(p.x + graphSize.x / 2.0f, p.y + graphSize.y), col, 4.0f);
-
-    ImGui::InvisibleButton(id, graphSize);
-}
@@ -0,0 +1,311 @@
+#include "pch.h"
+#include "overlayrender.h"
+
+#include <cmath>
+
+// Subtle grey used for outlines + separators + grid
+static constexpr int UI_GREY_R = 150;
+static constexpr int UI_GREY_G = 150;
+static constexpr int UI_GREY_B = 150;
+static constexpr int UI_GREY_A = 220;
+
+static constexpr int GRID_A = 120;
+
+// ====================
+// Layout
+// ====================
+static constexpr float BAR_HEIGHT_FRAC = 0.07f;
+static constexpr float BAR_WIDTH_FRAC = 0.40f;
+
+static constexpr float MAIN_TOP_FRAC = 0.098f;
+static constexpr float MAIN_HEIGHT_FRAC = 0.14f;
+static constexpr float MAIN_WIDTH_FRAC = 0.20f;
+
+NeuRLcarLayout ComputeLayout(const CanvasPoint& screenSize)
+{
+    NeuRLcarLayout lay;
+    lay.screenW = screenSize.X;
+    lay.screenH = screenSize.Y;
+
+    // Top bars
+    float barW = lay.screenW * BAR_WIDTH_FRAC;
+    float barH = lay.screenH * BAR_HEIGHT_FRAC;
+    lay.barSize = CanvasPoint(barW, barH);
+    lay.leftBarPos = CanvasPoint(0.0f, 0.0f);
+    lay.rightBarPos = CanvasPoint(lay.screenW - barW, 0.0f);
+
+    // Main eval box (aligned to scoreboard)
+    float mainW = lay.screenW * MAIN_WIDTH_FRAC;
+    float mainH = lay.screenH * MAIN_HEIGHT_FRAC;
+    float mainX = (lay.screenW - mainW) * 0.5f;
+    float mainY = lay.screenH * MAIN_TOP_FRAC;
+
+    lay.mainPos = CanvasPoint(mainX, mainY);
+    lay.mainSize = CanvasPoint(mainW, mainH);
+
+    return lay;
+}
+
+// ====================
+// Per-frame eval
+// ====================
+std::vector<float> ComputeSmoothedSeries(const std::vector<double>& evalSeries, int smoothingWindow)
+{
+    int n = (int)evalSeries.size();
+    std::vector<float> values(n);
+
+    if (smoothingWindow <= 0)
+    {
+        for (int i = 0; i < n; ++i)
+            values[i] = Clamp01((float)evalSeries[i]);
+    }
+    else
+    {
+        // Smoothing: avg over [frame-half, frame+half], half = smoothingWindow/2, via prefix sums
+        std::vector<double> prefix(n + 1, 0.0);
+        for (int i = 0; i < n; ++i)
+            prefix[i + 1] = prefix[i] + evalSeries[i];
+
+        int half = smoothingWindow / 2;
+        for (int i = 0; i < n; ++i)
+        {
+            int lo = i - half;
+            int hi = i + half;
+            if (lo < 0) lo = 0;
+            if (hi >= n) hi = n - 1;
+            values[i] = Clamp01((float)((prefix[hi + 1] - prefix[lo]) / (double)(hi - lo + 1)));
+        }
+    }
+    return values;
+}
+
+float InterpolatedEvalAt(const std::vector<float>& smoothed, double position)
+{
+    int n = (int)smoothed.size();
+    if (n <= 0) return 0.5f;
+
+    if (position <= 0.0) return smoothed[0];
+    if (position >= (double)(n - 1)) return smoothed[n - 1];
+
+    int i = (int)position;
+    float t = (float)(position - (double)i);
+    return smoothed[i] + (smoothed[i + 1] - smoothed[i]) * t;
+}
+
+std::vector<double> MakeSyntheticEvalSeries(int numFrames)
+{
+    std::vector<double> series(numFrames);
+    unsigned state = 0x9e3779b9u;
+    for (int i = 0; i < numFrames; ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        double noise = ((double)(state >> 8) / (double)(1u << 24) - 0.5) * 0.05;
+        double v = 0.5 + 0.35 * std::sin(i / 240.0) + 0.1 * std::sin(i / 17.0) + noise;
+        series[i] = v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+    }
+    return series;
+}
+
+void DrawHorizontalEvalGraph(ICanvasTarget& canvas,
+    const NeuRLcarLayout& lay,
+    const std::vector<float>& smoothedSeries,
+    double playbackPosition,
+    bool showBackground,
+    int bgAlpha)
+{
+    const int evalDisplayBreadth = 301;
+    const int halfWindow = 150;
+
+    int x0 = (int)lay.mainPos.X;
+    int x1 = (int)(lay.mainPos.X + lay.mainSize.X);
+    if (x1 <= x0) x1 = x0 + 1;
+    int w = x1 - x0;
+
+    int y0 = (int)lay.mainPos.Y;
+    int y1 = (int)(lay.mainPos.Y + lay.mainSize.Y);
+    if (y1 <= y0) y1 = y0 + 1;
+    int h = y1 - y0;
+
+    if (showBackground)
+    {
+        canvas.SetColor(255, 255, 255, bgAlpha);
+        canvas.SetPosition(lay.mainPos);
+        canvas.FillBox(lay.mainSize);
+    }
+
+    int currentframe = (int)playbackPosition;
+    float scroll = (float)(playbackPosition - (double)currentframe); // 0..1 of a column
+    int minFrame = currentframe - halfWindow;
+
+    // One extra column on the right fills the gap left by the sub-frame scroll
+    for (int i = 0; i <= evalDisplayBreadth; ++i)
+    {
+        int xi0 = x0 + (int)std::floor(((float)i - scroll) * (float)w / (float)evalDisplayBreadth);
+        int xi1 = x0 + (int)std::floor(((float)(i + 1) - scroll) * (float)w / (float)evalDisplayBreadth);
+        if (xi0 < x0) xi0 = x0;
+        if (xi1 > x1) xi1 = x1;
+        if (xi1 <= xi0) continue;
+
+        int frame = minFrame + i;
+
+        float v = -1.0f;
+        if (frame >= 0 && frame < (int)smoothedSeries.size())
+            v = smoothedSeries[frame];
+
+        if (v < 0.0f)
+        {
+            canvas.SetColor(200, 200, 200, bgAlpha);
+            canvas.SetPosition(CanvasPoint((float)xi0, (float)y0));
+            canvas.FillBox(CanvasPoint((float)(xi1 - xi0), (float)h));
+            continue;
+        }
+
+        int ySplit = y0 + (int)((1.0f - v) * (float)h);
+        ySplit = ClampInt(ySplit, y0, y1);
+
+        int topH = ySplit - y0;
+        int botH = y1 - ySplit;
+
+        if (topH > 0)
+        {
+            canvas.SetColor(0, 0, 255, bgAlpha);
+            canvas.SetPosition(CanvasPoint((float)xi0, (float)y0));
+            canvas.FillBox(CanvasPoint((float)(xi1 - xi0), (float)topH));
+        }
+
+        if (botH > 0)
+        {
+            canvas.SetColor(255, 165, 0, bgAlpha);
+            canvas.SetPosition(CanvasPoint((float)xi0, (float)ySplit));
+            canvas.FillBox(CanvasPoint((float)(xi1 - xi0), (float)botH));
+        }
+    }
+
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
+    for (int j = 1; j < 10; ++j)
+    {
+        int yi = y0 + (h * j) / 10;
+
+        int thick = (j == 5) ? 3 : 1;
+        int yStart = yi - (thick / 2);
+
+        if (yStart < y0) yStart = y0;
+        if (yStart + thick > y1) yStart = y1 - thick;
+
+        canvas.SetPosition(CanvasPoint((float)x0, (float)yStart));
+        canvas.FillBox(CanvasPoint((float)w, (float)thick));
+    }
+
+    int xCenter = x0 + (w / 2);
+    int centerThick = 4;
+    int xStart = xCenter - (centerThick / 2);
+    if (xStart < x0) xStart = x0;
+    if (xStart + centerThick > x1) xStart = x1 - centerThick;
+
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
+    canvas.SetPosition(CanvasPoint((float)xStart, (float)y0));
+    canvas.FillBox(CanvasPoint((float)centerThick, (float)h));
+
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
+    canvas.SetPosition(lay.mainPos);
+    canvas.DrawBox(lay.mainSize);
+}
+
+// ====================
+// Elements
+// ====================
+void TopBarsElement::Render(const RenderContext& ctx)
+{
+    if (!ctx.cfg.showTopBars || !ctx.evalSeries) return;
+
+    ICanvasTarget& canvas = *ctx.canvas;
+    const NeuRLcarLayout& lay = ctx.layout;
+
+    float barW = lay.barSize.X;
+    float barH = lay.barSize.Y;
+
+    // Backgrounds
+    canvas.SetColor(0, 0, 0, ctx.cfg.barBgAlpha);
+    canvas.SetPosition(lay.leftBarPos);
+    canvas.FillBox(lay.barSize);
+
+    canvas.SetColor(0, 0, 0, ctx.cfg.barBgAlpha);
+    canvas.SetPosition(lay.rightBarPos);
+    canvas.FillBox(lay.barSize);
+
+    // If we have an eval, fill proportional to advantage magnitude
+    if (ctx.evalSeries)
+    {
+        float e = ctx.presentEval01;
+
+        // advantage magnitude: 0 at 0.5, 1 at 0 or 1
+        float adv = e - 0.5f;
+        if (adv < 0.0f) adv = -adv;
+        adv = Clamp01(adv * 2.0f);
+
+        bool orangeWins = (e > 0.5f);
+        bool blueWins = (e < 0.5f);
+
+        if (blueWins && adv > 0.0f)
+        {
+            float fillW = barW * adv;
+            canvas.SetColor(0, 128, 255, 230);
+            float x = lay.leftBarPos.X + (barW - fillW);
+            canvas.SetPosition(CanvasPoint(x, lay.leftBarPos.Y));
+            canvas.FillBox(CanvasPoint(fillW, barH));
+        }
+
+        if (orangeWins && adv > 0.0f)
+        {
+            float fillW = barW * adv;
+            canvas.SetColor(255, 165, 0, 230);
+            canvas.SetPosition(lay.rightBarPos);
+            canvas.FillBox(CanvasPoint(fillW, barH));
+        }
+    }
+
+    // 10% eval lines
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
+    for (int i = 1; i < 5; ++i)
+    {
+        int thick = 1;
+        int xi = (int)(lay.leftBarPos.X + (barW * i) / 5.0f);
+        canvas.SetPosition(CanvasPoint((float)xi, lay.leftBarPos.Y));
+        canvas.FillBox(CanvasPoint((float)thick, barH));
+    }
+
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, GRID_A);
+    for (int i = 1; i < 5; ++i)
+    {
+        int thick = 1;
+        int xi = (int)(lay.rightBarPos.X + (barW * i) / 5.0f);
+        canvas.SetPosition(CanvasPoint((float)xi, lay.rightBarPos.Y));
+        canvas.FillBox(CanvasPoint((float)thick, barH));
+    }
+
+
+
+    // Grey outlines
+    canvas.SetColor(UI_GREY_R, UI_GREY_G, UI_GREY_B, UI_GREY_A);
+    canvas.SetPosition(lay.leftBarPos);
+    canvas.DrawBox(lay.barSize);
+    canvas.SetPosition(lay.rightBarPos);
+    canvas.DrawBox(lay.barSize);
+}
+
+void MainEvalDisplayElement::Render(const RenderContext& ctx)
+{
+    if (!ctx.cfg.showMainEval) return;
+    if (!ctx.evalSeries) return;
+
+    ICanvasTarget& canvas = *ctx.canvas;
+    const NeuRLcarLayout& lay = ctx.layout;
+    const std::vector<float>& evalSeries = *ctx.evalSeries;
+
+    DrawHorizontalEvalGraph(canvas,
+        lay,
+        evalSeries,
+        ctx.playbackPosition,
+        ctx.cfg.showMainBackground,
+        ctx.cfg.mainEvalAlpha);
+}
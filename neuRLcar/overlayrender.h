@@ -0,0 +1,152 @@
+#pragma once
+// The canvas overlay's layout and graph drawing, kept free of the BakkesMod SDK so the canvas
+// benchmark can build it without the game. neuRLcarCanvasRenderer.cpp draws it through
+// GameCanvasTarget; the benchmark draws it through CountingCanvasTarget.
+#include <vector>
+
+// Whole pixels, like the SDK's Vector2 that the game's canvas takes
+struct CanvasPoint
+{
+    int X = 0;
+    int Y = 0;
+
+    CanvasPoint() = default;
+    CanvasPoint(float x, float y) : X((int)x), Y((int)y) {}
+};
+
+// ====================
+// Canvas target
+// ====================
+// The subset of CanvasWrapper the overlay elements draw with
+class ICanvasTarget
+{
+public:
+    virtual ~ICanvasTarget() = default;
+    virtual void SetColor(int r, int g, int b, int a) = 0;
+    virtual void SetPosition(CanvasPoint pos) = 0;
+    virtual void FillBox(CanvasPoint size) = 0;
+    virtual void DrawBox(CanvasPoint size) = 0;
+};
+
+// Counts every call the elements make instead of drawing, so the benchmark measures the
+// plugin's own layout/graph cost independent of the game's canvas.
+class CountingCanvasTarget : public ICanvasTarget
+{
+public:
+    void SetColor(int r, int g, int b, int a) override { ++setColorCalls; checksum += r + g + b + a; }
+    void SetPosition(CanvasPoint pos) override { ++setPositionCalls; checksum += (long long)pos.X + (long long)pos.Y; }
+    void FillBox(CanvasPoint size) override { ++fillBoxCalls; checksum += (long long)size.X + (long long)size.Y; }
+    void DrawBox(CanvasPoint size) override { ++drawBoxCalls; checksum += (long long)size.X + (long long)size.Y; }
+
+    long long DrawCalls() const { return fillBoxCalls + drawBoxCalls; }
+    long long TotalCalls() const { return setColorCalls + setPositionCalls + fillBoxCalls + drawBoxCalls; }
+
+    long long setColorCalls = 0;
+    long long setPositionCalls = 0;
+    long long fillBoxCalls = 0;
+    long long drawBoxCalls = 0;
+    long long checksum = 0; // keeps the optimizer from discarding the work
+};
+
+// ====================
+// Layout
+// ====================
+struct NeuRLcarLayout
+{
+    float screenW = 0.0f;
+    float screenH = 0.0f;
+
+    // Top advantage bars
+    CanvasPoint barSize{};
+    CanvasPoint leftBarPos{};
+    CanvasPoint rightBarPos{};
+
+    // Main eval display box
+    CanvasPoint mainPos{};
+    CanvasPoint mainSize{};
+};
+
+inline float Clamp01(float v)
+{
+    if (v < 0.0f) return 0.0f;
+    if (v > 1.0f) return 1.0f;
+    return v;
+}
+
+inline int ClampInt(int v, int lo, int hi)
+{
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+
+NeuRLcarLayout ComputeLayout(const CanvasPoint& screenSize);
+
+// ====================
+// Per-frame eval
+// ====================
+// Smoothed eval for every frame of a series: avg over [frame-half, frame+half], clamped to [0,1].
+// Pure, so the dataset loader can run it on the thread pool.
+std::vector<float> ComputeSmoothedSeries(const std::vector<double>& evalSeries, int smoothingWindow);
+
+// Linear interpolation between the two frames around a fractional playback position
+float InterpolatedEvalAt(const std::vector<float>& smoothed, double position);
+
+// Deterministic eval-like series: slow swings plus a little high-frequency noise, in [0,1]
+std::vector<double> MakeSyntheticEvalSeries(int numFrames);
+
+void DrawHorizontalEvalGraph(ICanvasTarget& canvas,
+    const NeuRLcarLayout& lay,
+    const std::vector<float>& smoothedSeries,
+    double playbackPosition,
+    bool showBackground,
+    int bgAlpha);
+
+// ====================
+// Config + elements
+// ====================
+struct NeuRLcarConfig
+{
+    bool showTopBars = true;
+    bool showMainEval = true;
+    bool showMainBackground = false;
+
+    int mainEvalAlpha = 220;
+
+    bool showHotkeyReminders = true;
+
+    int pastRows = 150;          // frames
+    int futureRows = 150;        // frames
+    int smoothingWindow = 0;    // frames (0 = raw)
+    int barBgAlpha = 180;
+};
+
+struct RenderContext
+{
+    ICanvasTarget* canvas = nullptr;
+    NeuRLcarLayout layout{};
+    const std::vector<float>* evalSeries = nullptr; // smoothed per-frame eval, null if no analysis
+    double playbackPosition = 0.0;                  // fractional frame
+
+    NeuRLcarConfig cfg{};
+    float presentEval01 = 0.5f; // smoothed at current frame (only meaningful if evalSeries != nullptr)
+};
+
+class ICanvasElement
+{
+public:
+    virtual ~ICanvasElement() = default;
+    virtual void Render(const RenderContext& ctx) = 0;
+};
+
+class TopBarsElement : public ICanvasElement
+{
+public:
+    void Render(const RenderContext& ctx) override;
+};
+
+class MainEvalDisplayElement : public ICanvasElement
+{
+public:
+    void Render(const RenderContext& ctx) override;
+};
@@ -1,8 +1,10 @@
 #pragma once
 
+#ifndef NEURLCAR_HEADLESS
 #define WIN32_LEAN_AND_MEAN
 #define _CRT_SECURE_NO_WARNINGS
 #include "bakkesmod/plugin/bakkesmodplugin.h"
+#endif
 
 #include <string>
 #include <vector>
@@ -14,4 +16,9 @@
 #include "IMGUI/imgui_searchablecombo.h"
 #include "IMGUI/imgui_rangeslider.h"
 
-#include "logging.h"
\ No newline at end of file
+#ifdef NEURLCAR_HEADLESS
+// the CMake benchmarks and tests, built without the BakkesMod SDK
+#include "headlesslog.h"
+#else
+#include "logging.h"
+#endif
@@ -0,0 +1,42 @@
+#include "pch.h"
+#include "processrunner.h"
+
+#include <thread>
+
+ProcessResult RunProcess(const ProcessLaunch& launch, std::chrono::milliseconds timeout, const std::atomic<bool>* cancel)
+{
+	ProcessResult result;
+
+	auto child = SpawnProcess(launch, result.error);
+	if (!child)
+		return result;
+	result.started = true;
+
+	const auto deadline = std::chrono::steady_clock::now() + timeout;
+	const auto poll = std::chrono::milliseconds(50);
+
+	while (!child->Wait(poll))
+	{
+		if (cancel && cancel->load())
+		{
+			result.cancelled = true;
+			child->Kill();
+		}
+		else if (timeout.count() > 0 && std::chrono::steady_clock::now() >= deadline)
+		{
+			result.timedOut = true;
+			child->Kill();
+		}
+		else
+		{
+			continue;
+		}
+
+		child->Wait(kWaitForever);
+		break;
+	}
+
+	result.exitCode = child->ExitCode();
+	result.usage = child->Usage();
+	return result;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Child-process launching with stdout/stderr streamed to callbacks while the child runs.
+// Both pipes are always drained, so a chatty child can never block on a full pipe.
+// Backends: processrunner_win32.cpp (CreateProcess) and processrunner_posix.cpp (posix_spawn).
+
+using ProcessOutputCallback = std::function<void(std::string_view chunk)>;
+
+enum class ProcessPriority
+{
+	Normal,
+	BelowNormal,   // nice 10 on POSIX
+	Idle,          // nice 19
+};
+
+// Applied before the child runs any code on Windows (it starts suspended); right after the
+// spawn on POSIX, where posix_spawn has no hook for them
+struct ProcessLimits
+{
+	ProcessPriority priority = ProcessPriority::Normal;
+	uint64_t affinityMask = 0;          // logical cores the child may run on; 0 = any
+	uint64_t memoryLimitBytes = 0;      // 0 = none. Job object commit limit / RLIMIT_AS: allocations past it fail
+
+	bool operator==(const ProcessLimits&) const = default;
+};
+
+// Resources a child used; complete once it has exited
+struct ProcessUsage
+{
+	double cpuSeconds = 0.0;            // user + kernel
+	uint64_t peakRssBytes = 0;          // peak working set
+};
+
+struct ProcessLaunch
+{
+	std::string exePath;
+	std::vector<std::string> args;      // not including the exe itself
+	std::string workingDir;             // empty = inherit
+
+	// Called on a reader thread with raw chunks (not split into lines)
+	ProcessOutputCallback onStdout;
+	ProcessOutputCallback onStderr;
+
+	bool pipeStdin = false;             // otherwise stdin is empty
+
+	ProcessLimits limits;
+};
+
+inline constexpr std::chrono::milliseconds kWaitForever{ -1 };
+
+class ChildProcess
+{
+public:
+	virtual ~ChildProcess() = default; // kills a still-running child and joins the readers
+
+	virtual bool WriteStdin(std::string_view data) = 0;
+	virtual void CloseStdin() = 0;
+
+	// True once the child has exited and its output has been fully delivered
+	virtual bool Wait(std::chrono::milliseconds timeout) = 0;
+	// Also kills whatever the child started; output not yet delivered is dropped
+	virtual void Kill() = 0;
+	virtual bool Running() = 0;
+	virtual int ExitCode() = 0; // valid after Wait() returned true
+	virtual long long Pid() const = 0;
+	virtual ProcessUsage Usage() = 0;
+};
+
+// Starts the process; returns null and fills `error` on failure
+std::unique_ptr<ChildProcess> SpawnProcess(const ProcessLaunch& launch, std::string& error);
+
+struct ProcessResult
+{
+	bool started = false;
+	bool timedOut = false;
+	bool cancelled = false;
+	int exitCode = -1;
+	ProcessUsage usage;
+	std::string error;                  // launch failure
+};
+
+// Runs to completion. A positive timeout or a set cancel flag kills the child.
+ProcessResult RunProcess(const ProcessLaunch& launch,
+	std::chrono::milliseconds timeout = kWaitForever,
+	const std::atomic<bool>* cancel = nullptr);
+
+// Splits streamed output into lines; the remainder is kept until the next chunk
+class LineSplitter
+{
+public:
+	template <typename F>
+	void Feed(std::string_view chunk, F&& onLine)
+	{
+		size_t start = 0;
+		for (size_t i = 0; i < chunk.size(); ++i)
+		{
+			if (chunk[i] != '\n')
+				continue;
+			pending_.append(chunk.data() + start, i - start);
+			if (!pending_.empty() && pending_.back() == '\r')
+				pending_.pop_back();
+			onLine(std::string_view(pending_));
+			pending_.clear();
+			start = i + 1;
+		}
+		pending_.append(chunk.data() + start, chunk.size() - start);
+	}
+
+private:
+	std::string pending_;
+};
@@ -0,0 +1,301 @@
+#include "pch.h"
+#include "processrunner.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <poll.h>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+extern char** environ;
+
+class PosixChildProcess : public ChildProcess
+{
+public:
+	PosixChildProcess(pid_t pid, int stdinFd, int stdoutFd, int stderrFd, const ProcessLaunch& launch)
+		: pid_(pid), stdinFd_(stdinFd)
+	{
+		if (pipe2(wakeFds_, O_CLOEXEC | O_NONBLOCK) != 0)
+			LOG("neuRLcar: wake pipe failed: {}", std::strerror(errno));
+		reader_ = std::thread(&PosixChildProcess::ReadOutput, stdoutFd, stderrFd, wakeFds_[0], launch.onStdout, launch.onStderr, &readerDone_);
+	}
+
+	~PosixChildProcess() override
+	{
+		if (Running() || !readerDone_)
+			Kill();
+		Wait(kWaitForever);
+		CloseStdin();
+		for (int fd : wakeFds_)
+			if (fd >= 0) close(fd);
+	}
+
+	bool WriteStdin(std::string_view data) override
+	{
+		std::lock_guard<std::mutex> lock(stdinMutex_);
+		if (stdinFd_ < 0)
+			return false;
+
+		while (!data.empty())
+		{
+			// stdin is a socketpair so a dead child gives EPIPE instead of SIGPIPE
+			ssize_t n = send(stdinFd_, data.data(), data.size(), MSG_NOSIGNAL);
+			if (n < 0)
+			{
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data.remove_prefix((size_t)n);
+		}
+		return true;
+	}
+
+	void CloseStdin() override
+	{
+		std::lock_guard<std::mutex> lock(stdinMutex_);
+		if (stdinFd_ >= 0)
+		{
+			close(stdinFd_);
+			stdinFd_ = -1;
+		}
+	}
+
+	// Output is complete once every process holding the pipes has closed them, which can be
+	// after the child itself exited if it left something running; the timeout covers both
+	bool Wait(std::chrono::milliseconds timeout) override
+	{
+		const auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!Reap() || !readerDone_)
+		{
+			if (timeout.count() >= 0 && std::chrono::steady_clock::now() >= deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		if (reader_.joinable()) reader_.join();
+		return true;
+	}
+
+	// Kills the child's whole process group, so nothing it started keeps running (or keeps the
+	// output pipes open), and stops the readers; output still in the pipes is dropped
+	void Kill() override
+	{
+		// once the child is reaped and its output is done, the group id may belong to someone else
+		if (!Reap() || !readerDone_)
+			kill(-pid_, SIGKILL);
+
+		if (wakeFds_[1] >= 0)
+		{
+			char wake = 1;
+			(void)!write(wakeFds_[1], &wake, 1);
+		}
+	}
+
+	bool Running() override { return !Reap(); }
+
+	int ExitCode() override
+	{
+		std::lock_guard<std::mutex> lock(reapMutex_);
+		return exited_ ? exitCode_ : -1;
+	}
+
+	long long Pid() const override { return (long long)pid_; }
+
+	ProcessUsage Usage() override
+	{
+		std::lock_guard<std::mutex> lock(reapMutex_);
+		return usage_;
+	}
+
+private:
+	// Collects the exit status once; true if the child has exited
+	bool Reap()
+	{
+		std::lock_guard<std::mutex> lock(reapMutex_);
+		if (exited_)
+			return true;
+
+		int status = 0;
+		rusage ru{};
+		pid_t r = wait4(pid_, &status, WNOHANG, &ru);
+		if (r == 0)
+			return false;
+
+		exited_ = true;
+		if (r > 0)
+		{
+			usage_.cpuSeconds = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+			usage_.peakRssBytes = (uint64_t)ru.ru_maxrss * 1024;   // kilobytes on Linux
+		}
+		if (r < 0)
+			exitCode_ = -1;
+		else if (WIFEXITED(status))
+			exitCode_ = WEXITSTATUS(status);
+		else if (WIFSIGNALED(status))
+			exitCode_ = 128 + WTERMSIG(status);
+		return true;
+	}
+
+	// Until both pipes close or Kill() writes to wakeFd
+	static void ReadOutput(int outFd, int errFd, int wakeFd, ProcessOutputCallback onStdout, ProcessOutputCallback onStderr,
+		std::atomic<bool>* done)
+	{
+		pollfd fds[3] = { { outFd, POLLIN, 0 }, { errFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+		const ProcessOutputCallback* callbacks[2] = { &onStdout, &onStderr };
+		int open = 2;
+		char buffer[4096];
+
+		while (open > 0)
+		{
+			if (poll(fds, 3, -1) < 0)
+			{
+				if (errno == EINTR) continue;
+				break;
+			}
+			if (fds[2].revents & POLLIN)
+				break;
+
+			for (int i = 0; i < 2; ++i)
+			{
+				if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+					continue;
+
+				ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+				if (n > 0)
+				{
+					if (*callbacks[i])
+						(*callbacks[i])(std::string_view(buffer, (size_t)n));
+				}
+				else if (n == 0 || errno != EINTR)
+				{
+					close(fds[i].fd);
+					fds[i].fd = -1;
+					--open;
+				}
+			}
+		}
+
+		for (int i = 0; i < 2; ++i)
+			if (fds[i].fd >= 0) close(fds[i].fd);
+		*done = true;
+	}
+
+	pid_t pid_;
+	std::mutex stdinMutex_;
+	int stdinFd_ = -1;
+	std::thread reader_;
+	std::atomic<bool> readerDone_{ false };
+	int wakeFds_[2] = { -1, -1 };
+
+	std::mutex reapMutex_;
+	bool exited_ = false;
+	int exitCode_ = -1;
+	ProcessUsage usage_;
+};
+
+// Best effort: the child may already be running, and a failure leaves it unrestricted
+static void ApplyLimits(pid_t pid, const ProcessLimits& limits)
+{
+	if (limits.priority != ProcessPriority::Normal)
+	{
+		int nice = limits.priority == ProcessPriority::Idle ? 19 : 10;
+		if (setpriority(PRIO_PROCESS, (id_t)pid, nice) != 0)
+			LOG("neuRLcar: setpriority failed: {}", std::strerror(errno));
+	}
+
+	if (limits.affinityMask != 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; ++cpu)
+			if (limits.affinityMask & (1ull << cpu))
+				CPU_SET(cpu, &set);
+		if (sched_setaffinity(pid, sizeof(set), &set) != 0)
+			LOG("neuRLcar: sched_setaffinity failed: {}", std::strerror(errno));
+	}
+
+	// RLIMIT_AS rather than a cgroup, which would need privileges the game doesn't have
+	if (limits.memoryLimitBytes != 0)
+	{
+		rlimit limit{ (rlim_t)limits.memoryLimitBytes, (rlim_t)limits.memoryLimitBytes };
+		if (prlimit(pid, RLIMIT_AS, &limit, nullptr) != 0)
+			LOG("neuRLcar: prlimit failed: {}", std::strerror(errno));
+	}
+}
+
+std::unique_ptr<ChildProcess> SpawnProcess(const ProcessLaunch& launch, std::string& error)
+{
+	int outPipe[2] = { -1, -1 };
+	int errPipe[2] = { -1, -1 };
+	int inPair[2] = { -1, -1 };
+
+	auto closeAll = [&]() {
+		for (int fd : { outPipe[0], outPipe[1], errPipe[0], errPipe[1], inPair[0], inPair[1] })
+			if (fd >= 0) close(fd);
+	};
+
+	if (pipe2(outPipe, O_CLOEXEC) != 0 || pipe2(errPipe, O_CLOEXEC) != 0 ||
+		(launch.pipeStdin && socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, inPair) != 0))
+	{
+		error = std::string("pipe failed: ") + std::strerror(errno);
+		closeAll();
+		return nullptr;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+	if (launch.pipeStdin)
+		posix_spawn_file_actions_adddup2(&actions, inPair[1], STDIN_FILENO);
+	else
+		posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	if (!launch.workingDir.empty())
+		posix_spawn_file_actions_addchdir_np(&actions, launch.workingDir.c_str());
+
+	std::vector<char*> argv;
+	argv.push_back(const_cast<char*>(launch.exePath.c_str()));
+	for (auto& arg : launch.args)
+		argv.push_back(const_cast<char*>(arg.c_str()));
+	argv.push_back(nullptr);
+
+	// its own process group, so Kill() reaches whatever the child starts too
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	pid_t pid = 0;
+	int rc = posix_spawn(&pid, launch.exePath.c_str(), &actions, &attr, argv.data(), environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if (rc != 0)
+	{
+		error = std::string("posix_spawn failed: ") + std::strerror(rc);
+		closeAll();
+		return nullptr;
+	}
+
+	ApplyLimits(pid, launch.limits);
+
+	// the child owns its ends now
+	close(outPipe[1]);
+	close(errPipe[1]);
+	if (inPair[1] >= 0)
+		close(inPair[1]);
+
+	return std::make_unique<PosixChildProcess>(pid, inPair[0], outPipe[0], errPipe[0], launch);
+}
+
+#endif // !_WIN32
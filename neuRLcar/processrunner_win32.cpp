@@ -0,0 +1,313 @@
+#include "pch.h"
+#include "processrunner.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <psapi.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// MSVCRT argv quoting: backslashes are literal unless they precede a quote
+static std::string QuoteWindowsArg(const std::string& arg)
+{
+	if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos)
+		return arg;
+
+	std::string out = "\"";
+	size_t backslashes = 0;
+	for (char c : arg)
+	{
+		if (c == '\\')
+		{
+			++backslashes;
+			continue;
+		}
+		if (c == '"')
+			out.append(backslashes * 2 + 1, '\\');
+		else
+			out.append(backslashes, '\\');
+		backslashes = 0;
+		out.push_back(c);
+	}
+	out.append(backslashes * 2, '\\');
+	out.push_back('"');
+	return out;
+}
+
+// Reads until the pipe closes or stop is set; Kill() sets stop and cancels a blocked ReadFile
+static void ReadPipeUntilClosed(HANDLE pipe, const ProcessOutputCallback& callback, const std::atomic<bool>& stop, HANDLE done)
+{
+	char buffer[4096];
+	DWORD bytesRead = 0;
+	while (!stop && ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+	{
+		if (callback && !stop)
+			callback(std::string_view(buffer, bytesRead));
+	}
+	CloseHandle(pipe);
+	SetEvent(done);
+}
+
+class Win32ChildProcess : public ChildProcess
+{
+public:
+	Win32ChildProcess(PROCESS_INFORMATION pi, HANDLE job, HANDLE stdinWrite, HANDLE stdoutRead, HANDLE stderrRead, const ProcessLaunch& launch)
+		: process_(pi.hProcess), job_(job), pid_(pi.dwProcessId), stdinWrite_(stdinWrite)
+	{
+		CloseHandle(pi.hThread);
+		for (HANDLE& done : readersDone_)
+			done = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		stdoutReader_ = std::thread(ReadPipeUntilClosed, stdoutRead, launch.onStdout, std::cref(stopReading_), readersDone_[0]);
+		stderrReader_ = std::thread(ReadPipeUntilClosed, stderrRead, launch.onStderr, std::cref(stopReading_), readersDone_[1]);
+	}
+
+	~Win32ChildProcess() override
+	{
+		// also when the child is gone but something it started still holds the pipes
+		if (Running() || !ReadersDone(0))
+			Kill();
+		Wait(kWaitForever);
+		CloseStdin();
+		CloseHandle(process_);
+		if (job_)
+			CloseHandle(job_);
+		for (HANDLE done : readersDone_)
+			CloseHandle(done);
+	}
+
+	bool WriteStdin(std::string_view data) override
+	{
+		std::lock_guard<std::mutex> lock(stdinMutex_);
+		if (!stdinWrite_)
+			return false;
+
+		while (!data.empty())
+		{
+			DWORD written = 0;
+			if (!WriteFile(stdinWrite_, data.data(), (DWORD)data.size(), &written, NULL))
+				return false;
+			data.remove_prefix(written);
+		}
+		return true;
+	}
+
+	void CloseStdin() override
+	{
+		std::lock_guard<std::mutex> lock(stdinMutex_);
+		if (stdinWrite_)
+		{
+			CloseHandle(stdinWrite_);
+			stdinWrite_ = NULL;
+		}
+	}
+
+	bool Wait(std::chrono::milliseconds timeout) override
+	{
+		const auto start = std::chrono::steady_clock::now();
+		DWORD ms = timeout.count() < 0 ? INFINITE : (DWORD)timeout.count();
+		if (WaitForSingleObject(process_, ms) != WAIT_OBJECT_0)
+			return false;
+
+		// the pipes close once the child (and anything that inherited them) is gone; something
+		// the child started may keep them open, so the readers get the rest of the timeout only
+		if (timeout.count() >= 0)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			ms = (DWORD)(std::max)(timeout - elapsed, std::chrono::milliseconds(0)).count();
+		}
+		if (!ReadersDone(ms))
+			return false;
+
+		if (stdoutReader_.joinable()) stdoutReader_.join();
+		if (stderrReader_.joinable()) stderrReader_.join();
+		return true;
+	}
+
+	void Kill() override
+	{
+		// the job takes anything the applet started down with it
+		if (!job_ || !TerminateJobObject(job_, 1))
+			TerminateProcess(process_, 1);
+		WaitForSingleObject(process_, 1000);
+
+		// Something outside the job may still hold the pipes; don't let the readers wait on it.
+		// CancelSynchronousIo misses a reader between two reads, so repeat it until both are done.
+		stopReading_ = true;
+		while (!ReadersDone(10))
+		{
+			if (stdoutReader_.joinable()) CancelSynchronousIo(stdoutReader_.native_handle());
+			if (stderrReader_.joinable()) CancelSynchronousIo(stderrReader_.native_handle());
+		}
+	}
+
+	bool Running() override
+	{
+		return WaitForSingleObject(process_, 0) == WAIT_TIMEOUT;
+	}
+
+	int ExitCode() override
+	{
+		DWORD code = 0;
+		if (!GetExitCodeProcess(process_, &code) || code == STILL_ACTIVE)
+			return -1;
+		return (int)code;
+	}
+
+	long long Pid() const override { return (long long)pid_; }
+
+	ProcessUsage Usage() override
+	{
+		ProcessUsage usage;
+		FILETIME created, exited, kernel, user;
+		if (GetProcessTimes(process_, &created, &exited, &kernel, &user))
+		{
+			auto ticks = [](const FILETIME& t) { return ((unsigned long long)t.dwHighDateTime << 32) | t.dwLowDateTime; };
+			usage.cpuSeconds = (ticks(kernel) + ticks(user)) / 1e7;   // 100 ns units
+		}
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (GetProcessMemoryInfo(process_, &counters, sizeof(counters)))
+			usage.peakRssBytes = counters.PeakWorkingSetSize;
+		return usage;
+	}
+
+private:
+	bool ReadersDone(DWORD ms)
+	{
+		return WaitForMultipleObjects(2, readersDone_, TRUE, ms) == WAIT_OBJECT_0;
+	}
+
+	HANDLE process_ = NULL;
+	HANDLE job_ = NULL;
+	DWORD pid_ = 0;
+	std::mutex stdinMutex_;
+	HANDLE stdinWrite_ = NULL;
+	std::atomic<bool> stopReading_{ false };
+	HANDLE readersDone_[2] = {};           // manual-reset events set as each reader exits
+	std::thread stdoutReader_;
+	std::thread stderrReader_;
+};
+
+// Affinity goes on the process. The child always goes into a job object, so Kill() takes down
+// whatever it starts and nothing outlives the handle; the memory cap goes on the same job. The
+// job is returned so it lives as long as the child. Failures are logged and leave the child
+// unrestricted.
+static HANDLE ApplyLimits(HANDLE process, const ProcessLimits& limits)
+{
+	if (limits.affinityMask != 0)
+	{
+		DWORD_PTR processMask = 0, systemMask = 0;
+		GetProcessAffinityMask(process, &processMask, &systemMask);
+		DWORD_PTR mask = (DWORD_PTR)limits.affinityMask & systemMask;
+		if (!mask || !SetProcessAffinityMask(process, mask))
+			LOG("neuRLcar: could not set applet affinity {:#x} (error {})", limits.affinityMask, GetLastError());
+	}
+
+	HANDLE job = CreateJobObjectW(nullptr, nullptr);
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION info{};
+	info.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+	if (limits.memoryLimitBytes != 0)
+	{
+		info.BasicLimitInformation.LimitFlags |= JOB_OBJECT_LIMIT_PROCESS_MEMORY;
+		info.ProcessMemoryLimit = (SIZE_T)limits.memoryLimitBytes;
+	}
+	if (!job ||
+		!SetInformationJobObject(job, JobObjectExtendedLimitInformation, &info, sizeof(info)) ||
+		!AssignProcessToJobObject(job, process))
+	{
+		LOG("neuRLcar: could not put the applet in a job object{} (error {})",
+			limits.memoryLimitBytes != 0 ? ", its memory is not capped" : "", GetLastError());
+		if (job)
+			CloseHandle(job);
+		return NULL;
+	}
+	return job;
+}
+
+std::unique_ptr<ChildProcess> SpawnProcess(const ProcessLaunch& launch, std::string& error)
+{
+	std::string cmdLineStr = QuoteWindowsArg(launch.exePath);
+	for (auto& arg : launch.args)
+		cmdLineStr += " " + QuoteWindowsArg(arg);
+
+	SECURITY_ATTRIBUTES sa{};
+	sa.nLength = sizeof(sa);
+	sa.bInheritHandle = TRUE;
+	sa.lpSecurityDescriptor = NULL;
+
+	HANDLE stdoutRead = NULL, stdoutWrite = NULL;
+	HANDLE stderrRead = NULL, stderrWrite = NULL;
+	HANDLE stdinRead = NULL, stdinWrite = NULL;
+
+	auto closeAll = [&]() {
+		for (HANDLE h : { stdoutRead, stdoutWrite, stderrRead, stderrWrite, stdinRead, stdinWrite })
+			if (h) CloseHandle(h);
+	};
+
+	if (!CreatePipe(&stdoutRead, &stdoutWrite, &sa, 0) ||
+		!CreatePipe(&stderrRead, &stderrWrite, &sa, 0) ||
+		(launch.pipeStdin && !CreatePipe(&stdinRead, &stdinWrite, &sa, 0)))
+	{
+		error = "CreatePipe failed with error " + std::to_string(GetLastError());
+		closeAll();
+		return nullptr;
+	}
+
+	// Ensure our ends are not inherited
+	SetHandleInformation(stdoutRead, HANDLE_FLAG_INHERIT, 0);
+	SetHandleInformation(stderrRead, HANDLE_FLAG_INHERIT, 0);
+	if (stdinWrite)
+		SetHandleInformation(stdinWrite, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFOA si{};
+	PROCESS_INFORMATION pi{};
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdOutput = stdoutWrite;
+	si.hStdError = stderrWrite;
+	si.hStdInput = stdinRead;
+
+	// Convert command line to modifiable buffer
+	std::vector<char> cmdBuf(cmdLineStr.begin(), cmdLineStr.end());
+	cmdBuf.push_back('\0');
+
+	// suspended, so the limits are in place before the applet runs
+	DWORD priorityClass =
+		launch.limits.priority == ProcessPriority::Idle ? IDLE_PRIORITY_CLASS :
+		launch.limits.priority == ProcessPriority::BelowNormal ? BELOW_NORMAL_PRIORITY_CLASS : 0;
+
+	BOOL ok = CreateProcessA(
+		NULL,
+		cmdBuf.data(),
+		NULL,
+		NULL,
+		TRUE, // IMPORTANT: allow handle inheritance
+		CREATE_NO_WINDOW | CREATE_SUSPENDED | priorityClass,
+		NULL,
+		launch.workingDir.empty() ? NULL : launch.workingDir.c_str(),
+		&si,
+		&pi
+	);
+
+	if (!ok)
+	{
+		error = "CreateProcess failed with error " + std::to_string(GetLastError());
+		closeAll();
+		return nullptr;
+	}
+
+	HANDLE job = ApplyLimits(pi.hProcess, launch.limits);
+	ResumeThread(pi.hThread);
+
+	// the child owns its ends now
+	CloseHandle(stdoutWrite);
+	CloseHandle(stderrWrite);
+	if (stdinRead)
+		CloseHandle(stdinRead);
+
+	return std::make_unique<Win32ChildProcess>(pi, job, stdinWrite, stdoutRead, stderrRead, launch);
+}
+
+#endif // _WIN32
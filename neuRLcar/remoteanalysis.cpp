@@ -0,0 +1,414 @@
+#include "pch.h"
+#include "remoteanalysis.h"
+#include "httpclient.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using RemoteClock = std::chrono::steady_clock;
+
+std::string PercentEncode(const std::string& text)
+{
+	static const char* hex = "0123456789ABCDEF";
+	std::string out;
+	out.reserve(text.size());
+	for (unsigned char c : text)
+	{
+		if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+		{
+			out += (char)c;
+			continue;
+		}
+		out += '%';
+		out += hex[c >> 4];
+		out += hex[c & 15];
+	}
+	return out;
+}
+
+static int HexDigit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+std::string PercentDecode(const std::string& text)
+{
+	std::string out;
+	out.reserve(text.size());
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		if (text[i] == '%' && i + 2 < text.size() && HexDigit(text[i + 1]) >= 0 && HexDigit(text[i + 2]) >= 0)
+		{
+			out += (char)(HexDigit(text[i + 1]) * 16 + HexDigit(text[i + 2]));
+			i += 2;
+		}
+		else
+			out += text[i] == '+' ? ' ' : text[i];
+	}
+	return out;
+}
+
+std::map<std::string, std::string> ParseFields(const std::string& text, char separator)
+{
+	std::map<std::string, std::string> fields;
+	size_t start = 0;
+	while (start < text.size())
+	{
+		size_t end = text.find(separator, start);
+		if (end == std::string::npos)
+			end = text.size();
+		std::string item = text.substr(start, end - start);
+		if (!item.empty() && item.back() == '\r')
+			item.pop_back();
+		size_t eq = item.find('=');
+		if (eq != std::string::npos)
+			fields[item.substr(0, eq)] = item.substr(eq + 1);
+		start = end + 1;
+	}
+	return fields;
+}
+
+static long long ToNumber(const std::string& text, long long fallback = -1)
+{
+	try { return text.empty() ? fallback : std::stoll(text); }
+	catch (...) { return fallback; }
+}
+
+// Sleeps in short steps so a cancel is noticed; false if cancelled
+static bool SleepUnlessCancelled(RemoteClock::time_point until, const std::atomic<bool>& cancel)
+{
+	while (RemoteClock::now() < until)
+	{
+		if (cancel)
+			return false;
+		auto step = (std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(until - RemoteClock::now()), std::chrono::milliseconds(100));
+		std::this_thread::sleep_for((std::max)(step, std::chrono::milliseconds(1)));
+	}
+	return !cancel;
+}
+
+namespace
+{
+	enum class CallResult
+	{
+		Ok,           // a response that isn't worth retrying; check its status
+		Cancelled,
+		Failed,       // retries used up
+	};
+
+	class RemoteClient
+	{
+	public:
+		// a deadline stops retries like a cancel does
+		RemoteClient(HttpClient& http, const RemoteSettings& settings, const std::atomic<bool>& cancel, RemoteClock::time_point deadline = RemoteClock::time_point::max())
+			: http_(http), settings_(settings), cancel_(cancel), deadline_(deadline), random_(std::random_device{}())
+		{
+			base_ = settings.url;
+			while (!base_.empty() && base_.back() == '/')
+				base_.pop_back();
+		}
+
+		// One request, retried with exponential backoff on network errors, 5xx and 429. The
+		// delay is jittered so clients that failed together don't all come back together.
+		// A 2xx body goes to onBody if given; one cut short comes back Ok with response.error set,
+		// as the sink has already taken part of it.
+		CallResult Call(const std::string& method, const std::string& target, const std::string& body,
+			std::chrono::milliseconds timeout, HttpResponse& response, std::string& error, const HttpBodySink& onBody = nullptr)
+		{
+			HttpRequest request;
+			request.method = method;
+			request.url = base_ + target;
+			request.timeout = timeout;
+			request.onBody = onBody;
+			if (!settings_.apiKey.empty())
+				request.headers.push_back({ "Authorization", "Bearer " + settings_.apiKey });
+			if (!body.empty())
+				request.headers.push_back({ "Content-Type", "application/octet-stream" });
+
+			auto delay = std::chrono::milliseconds(500);
+			for (int attempt = 0;; ++attempt)
+			{
+				if (cancel_ || RemoteClock::now() >= deadline_)
+					return CallResult::Cancelled;
+
+				// the request is copied: a retry sends it again
+				request.body = body;
+				response = http_.Fetch(request, &cancel_);
+				if (cancel_)
+					return CallResult::Cancelled;
+				if (!response.Received())
+					error = method + " " + target + ": " + response.error;
+				else if (response.status >= 500 || response.status == 429)
+					error = method + " " + target + ": " + std::to_string(response.status) + " " + response.reason;
+				else
+					return CallResult::Ok;
+
+				if (attempt >= settings_.retries)
+					return CallResult::Failed;
+
+				std::uniform_int_distribution<long long> jitter(delay.count() / 2, delay.count());
+				auto wait = std::chrono::milliseconds(jitter(random_));
+				LOG("neuRLcar remote: {} (retry {} of {} in {} ms)", error, attempt + 1, settings_.retries, wait.count());
+				if (!SleepUnlessCancelled((std::min)(RemoteClock::now() + wait, deadline_), cancel_))
+					return CallResult::Cancelled;
+				delay = (std::min)(delay * 2, std::chrono::milliseconds(30000));
+			}
+		}
+
+		std::chrono::milliseconds Timeout() const { return settings_.requestTimeout; }
+
+	private:
+		HttpClient& http_;
+		const RemoteSettings& settings_;
+		const std::atomic<bool>& cancel_;
+		RemoteClock::time_point deadline_;
+		std::string base_;
+		std::mt19937 random_;
+	};
+
+	// Spaces upload pieces out so the average rate stays under the cap
+	class UploadPacer
+	{
+	public:
+		explicit UploadPacer(long long bytesPerSec) : bytesPerSec_(bytesPerSec), next_(RemoteClock::now()) {}
+
+		// Waits until `bytes` more may be sent; false if cancelled meanwhile
+		bool Admit(size_t bytes, const std::atomic<bool>& cancel)
+		{
+			if (bytesPerSec_ <= 0)
+				return !cancel;
+			// idle time (retries, a slow server) isn't saved up for a burst later
+			next_ = (std::max)(next_, RemoteClock::now() - std::chrono::seconds(1));
+			if (!SleepUnlessCancelled(next_, cancel))
+				return false;
+			next_ += std::chrono::duration_cast<RemoteClock::duration>(std::chrono::duration<double>((double)bytes / bytesPerSec_));
+			return true;
+		}
+
+	private:
+		long long bytesPerSec_;
+		RemoteClock::time_point next_;
+	};
+}
+
+AnalysisOutcome RunRemoteAnalysis(HttpClient& http,
+	const RemoteSettings& settings,
+	const AnalysisJob& job,
+	const std::filesystem::path& rowStreamPath,
+	RowStreamBuffer& rows,
+	const std::function<void()>& onRows,
+	const AnalysisProgressFn& onProgress,
+	const std::atomic<bool>& cancel,
+	std::string& error)
+{
+	const bool hasDeadline = job.timeout.count() >= 0;
+	const auto deadline = hasDeadline ? RemoteClock::now() + job.timeout : RemoteClock::time_point::max();
+	auto stopped = [&]() { return cancel || RemoteClock::now() >= deadline; };
+	auto stoppedOutcome = [&]() { return cancel ? AnalysisOutcome::Cancelled : AnalysisOutcome::TimedOut; };
+
+	std::ifstream replay(job.replayPath, std::ios::binary | std::ios::ate);
+	if (!replay)
+	{
+		error = "cannot read " + job.replayPath.string();
+		return AnalysisOutcome::Failed;
+	}
+	const long long replaySize = (long long)replay.tellg();
+	if (replaySize <= 0)
+	{
+		error = job.replayPath.string() + " is empty";
+		return AnalysisOutcome::Failed;
+	}
+
+	// a malformed url won't get better with retries
+	std::string host, port, path;
+	if (!ParseHttpUrl(settings.url, host, port, path, error))
+		return AnalysisOutcome::Failed;
+
+	RemoteClient client(http, settings, cancel, deadline);
+	HttpResponse response;
+
+	// start (or pick up) the analysis
+	std::string target = "/v1/analyses?model=" + PercentEncode(job.model) + "&replay=" + PercentEncode(job.replayId) +
+		"&size=" + std::to_string(replaySize);
+	CallResult result = client.Call("POST", target, {}, client.Timeout(), response, error);
+	if (result != CallResult::Ok)
+		return result == CallResult::Cancelled || stopped() ? stoppedOutcome() : AnalysisOutcome::Failed;
+	if (response.status != 200 && response.status != 201)
+	{
+		error = "starting the analysis: " + std::to_string(response.status) + " " + response.body;
+		return AnalysisOutcome::Failed;
+	}
+	auto fields = ParseFields(response.body);
+	const std::string id = fields["id"];
+	long long received = ToNumber(fields["received"], 0);
+	if (id.empty())
+	{
+		error = "starting the analysis: no id in the response";
+		return AnalysisOutcome::Failed;
+	}
+	const std::string analysis = "/v1/analyses/" + PercentEncode(id);
+
+	// the server is told to drop the analysis whenever we give up on it
+	auto abandon = [&](AnalysisOutcome outcome) {
+		HttpResponse ignored;
+		std::string ignoredError;
+		std::atomic<bool> never{ false };
+		RemoteSettings once = settings;
+		once.retries = 0;
+		RemoteClient(http, once, never).Call("DELETE", analysis, {}, std::chrono::milliseconds(2000), ignored, ignoredError);
+		return outcome;
+	};
+
+	// upload in pieces, resuming wherever the server says it is
+	const size_t pieceBytes = settings.uploadBytesPerSec > 0 ?
+		(std::min)(settings.pieceBytes, (size_t)(std::max)(settings.uploadBytesPerSec, 4096LL)) : settings.pieceBytes;
+	UploadPacer pacer(settings.uploadBytesPerSec);
+	std::string piece;
+	int resyncs = 0;
+	while (received < replaySize)
+	{
+		if (stopped())
+			return abandon(stoppedOutcome());
+
+		const size_t size = (size_t)(std::min)((long long)pieceBytes, replaySize - received);
+		piece.resize(size);
+		replay.clear();
+		replay.seekg(received);
+		if (!replay.read(piece.data(), (std::streamsize)size))
+		{
+			error = "cannot read " + job.replayPath.string();
+			return abandon(AnalysisOutcome::Failed);
+		}
+		if (!pacer.Admit(size, cancel))
+			return abandon(stoppedOutcome());
+
+		const bool last = received + (long long)size == replaySize;
+		result = client.Call("PUT", analysis + "/replay?offset=" + std::to_string(received) + (last ? "&last=1" : ""),
+			piece, client.Timeout(), response, error);
+		if (result != CallResult::Ok)
+			return abandon(result == CallResult::Cancelled || stopped() ? stoppedOutcome() : AnalysisOutcome::Failed);
+
+		long long serverReceived = ToNumber(ParseFields(response.body)["received"]);
+		if (response.status == 409 && serverReceived >= 0 && serverReceived <= replaySize && ++resyncs <= 16)
+		{
+			// a retried piece that had arrived after all, or a server that lost some
+			received = serverReceived;
+			continue;
+		}
+		if (response.status != 200 || serverReceived != received + (long long)size)
+		{
+			error = "uploading the replay: " + std::to_string(response.status) + " " + response.body;
+			return abandon(AnalysisOutcome::Failed);
+		}
+		received = serverReceived;
+	}
+
+	// rows as the server produces them; each poll answers with a self-contained stream, decoded
+	// as it comes off the socket
+	std::vector<float> all;   // row-major, for the .nrlb
+	int columns = 0;
+	long long from = 0;
+	int interruptions = 0;
+	bool ended = false;
+	while (!ended)
+	{
+		if (stopped())
+			return abandon(stoppedOutcome());
+
+		// rounded up: a zero wait in the last second would spin on the server until the deadline
+		int wait = settings.pollWaitSeconds;
+		if (hasDeadline)
+			wait = (int)(std::min)((long long)wait, (long long)std::chrono::ceil<std::chrono::seconds>(deadline - RemoteClock::now()).count());
+		wait = (std::max)(wait, 0);
+
+		bool widthChanged = false;
+		RowStreamDecoder decoder(
+			[&](int cols, int /*total*/) {
+				if (columns == 0)
+					columns = cols;
+				widthChanged = cols != columns;
+			},
+			[&](const float* data, int rowCount) {
+				if (widthChanged)
+					return;
+				all.insert(all.end(), data, data + (size_t)rowCount * columns);
+				rows.Push(data, rowCount, columns);
+				from += rowCount;
+				if (onRows) onRows();
+			});
+		result = client.Call("GET", analysis + "/rows?from=" + std::to_string(from) + "&wait=" + std::to_string(wait), {},
+			client.Timeout() + std::chrono::seconds(wait), response, error,
+			[&](const char* data, size_t size) { return decoder.Feed(std::string_view(data, size)) && !widthChanged; });
+		if (result != CallResult::Ok)
+			return abandon(result == CallResult::Cancelled || stopped() ? stoppedOutcome() : AnalysisOutcome::Failed);
+		if (response.status != 200)
+		{
+			error = "fetching rows: " + std::to_string(response.status) + " " + response.body;
+			return abandon(AnalysisOutcome::Failed);
+		}
+
+		const std::string state = response.Header("x-analysis-state");
+		if (state == "failed")
+		{
+			error = "the server could not analyze the replay: " + response.Header("x-analysis-error");
+			return abandon(AnalysisOutcome::Failed);
+		}
+
+		const std::string progress = response.Header("x-analysis-progress");
+		const size_t slash = progress.find('/');
+		if (onProgress && slash != std::string::npos)
+		{
+			long long done = ToNumber(progress.substr(0, slash)), total = ToNumber(progress.substr(slash + 1));
+			if (done >= 0 && total > 0)
+				onProgress((int)done, (int)total);
+		}
+
+		if (decoder.Failed() || widthChanged)
+		{
+			error = decoder.Failed() ? "bad row stream: " + decoder.Error() : "the row stream changed width";
+			return abandon(AnalysisOutcome::Failed);
+		}
+		if (!response.error.empty())
+		{
+			// cut off mid-stream: the rows that made it are kept and the next poll picks up after them
+			if (++interruptions > settings.retries)
+			{
+				error = "fetching rows: " + response.error;
+				return abandon(AnalysisOutcome::Failed);
+			}
+			LOG("neuRLcar remote: rows stream cut off after row {}: {}", from, response.error);
+			continue;
+		}
+		interruptions = 0;
+
+		if (decoder.Columns() == 0)
+		{
+			if (state != "done")
+				continue;
+			error = "the server finished without sending rows";
+			return abandon(AnalysisOutcome::Failed);
+		}
+		ended = decoder.Finished();
+	}
+
+	if (columns == 0)
+	{
+		error = "the server sent no rows";
+		return AnalysisOutcome::Failed;
+	}
+
+	std::string stream;
+	AppendRowStreamHeader(stream, columns, (int)from);
+	AppendRowStreamRows(stream, all.data(), (int)from, columns);
+	AppendRowStreamEnd(stream, from);
+	if (!SaveRowStreamFile(rowStreamPath, stream, error))
+		return AnalysisOutcome::Failed;
+	return AnalysisOutcome::Succeeded;
+}
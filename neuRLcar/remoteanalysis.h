@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "analysisqueue.h"
+#include "analysisprogress.h"
+#include "httpclient.h"
+#include "rowstream.h"
+
+// Analysis offloaded to a remote server, or to the local stand-in (standinserver.h).
+//
+// Every body except the replay and the rows is "key=value" lines. Requests carry
+// "Authorization: Bearer <api key>" when a key is set.
+//   POST   /v1/analyses?model=<m>&replay=<id>&size=<bytes>
+//          -> id, received, state. An unfinished upload of the same replay is handed back,
+//          so a lost response doesn't start a second analysis.
+//   PUT    /v1/analyses/<id>/replay?offset=<n>[&last=1]   one piece of the .replay
+//          -> received. 409 (with received) if offset isn't where the server is; the upload
+//          resumes from there.
+//   GET    /v1/analyses/<id>/rows?from=<row>&wait=<s>
+//          rows from `from` on as a row stream (rowstream.h): H, R..., and E once the last row
+//          has been sent. Held up to `wait` seconds until there is something new. Headers
+//          X-Analysis-State (uploading, queued, running, done, failed), X-Analysis-Progress
+//          (<done>/<total> frames) and X-Analysis-Error.
+//   DELETE /v1/analyses/<id>
+struct RemoteSettings
+{
+	std::string url;                    // http://host[:port][/prefix]
+	std::string apiKey;
+	long long uploadBytesPerSec = 0;    // 0 = no cap
+	int retries = 5;                    // per request, on network errors, 5xx and 429
+	size_t pieceBytes = 256 << 10;      // replay upload piece
+	int pollWaitSeconds = 5;            // rows long poll
+	std::chrono::milliseconds requestTimeout{ 30000 };
+};
+
+// Uploads job.replayPath, streams the rows back into `rows` (calling onRows after each push)
+// and saves them to rowStreamPath once complete. Blocks the calling worker while `http` does the
+// networking; job.timeout bounds the whole exchange.
+AnalysisOutcome RunRemoteAnalysis(HttpClient& http,
+	const RemoteSettings& settings,
+	const AnalysisJob& job,
+	const std::filesystem::path& rowStreamPath,
+	RowStreamBuffer& rows,
+	const std::function<void()>& onRows,
+	const AnalysisProgressFn& onProgress,
+	const std::atomic<bool>& cancel,
+	std::string& error);
+
+// Shared with the stand-in
+std::string PercentEncode(const std::string& text);
+std::string PercentDecode(const std::string& text);
+// "key=value" lines (and "a=1&b=2" queries with separator '&'); later keys win
+std::map<std::string, std::string> ParseFields(const std::string& text, char separator = '\n');
@@ -0,0 +1,48 @@
+#include "pch.h"
+#include "replaysession.h"
+
+const char* ToString(ReplaySessionState state)
+{
+	switch (state)
+	{
+	case ReplaySessionState::Idle: return "Idle";
+	case ReplaySessionState::Entering: return "Entering";
+	case ReplaySessionState::Loading: return "Loading";
+	case ReplaySessionState::Ready: return "Ready";
+	case ReplaySessionState::Leaving: return "Leaving";
+	}
+	return "?";
+}
+
+void ReplaySession::Begin()
+{
+	context_ = ReplaySessionContext{};
+	context_.enteredAt = std::chrono::steady_clock::now();
+	SetAnalysisLoaded(false);
+	SetAnalysisFailed(false);
+	Transition(ReplaySessionState::Entering);
+}
+
+void ReplaySession::Transition(ReplaySessionState next)
+{
+	ReplaySessionState prev = State();
+	if (prev == next)
+		return;
+
+	DEBUGLOG("replay session {} -> {}", ToString(prev), ToString(next));
+	state_.store(next, std::memory_order_release);
+}
+
+void ReplaySession::End()
+{
+	SetAnalysisLoaded(false);
+	SetAnalysisFailed(false);
+	context_ = ReplaySessionContext{};
+	Transition(ReplaySessionState::Idle);
+}
+
+ReplaySession& replaySession()
+{
+	static ReplaySession session;
+	return session;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Replay viewer lifecycle. Transitions are driven by the replay load/unload game events;
+// the game tick only does work while a session is active.
+//
+//   Idle -> Entering   replay game info initialized
+//   Entering -> Loading   replay object available, analysis lookup starts
+//   Loading -> Ready   analysis load finished: loaded, missing, failed or superseded by streamed rows
+//   Ready -> Leaving -> Idle   replay game event destroyed
+enum class ReplaySessionState
+{
+	Idle,
+	Entering,
+	Loading,
+	Ready,
+	Leaving,
+};
+
+const char* ToString(ReplaySessionState state);
+
+// Per-replay data, created when entering a replay and dropped when leaving it
+struct ReplaySessionContext
+{
+	std::string replayId;            // empty until the replay object is available
+	std::uint64_t replayIdHash = 0;
+	int numFrames = 0;
+	std::chrono::steady_clock::time_point enteredAt{};
+};
+
+class ReplaySession
+{
+public:
+	ReplaySessionState State() const { return state_.load(std::memory_order_acquire); }
+	bool Active() const { return State() != ReplaySessionState::Idle; }
+	bool InReplay() const { return State() == ReplaySessionState::Loading || State() == ReplaySessionState::Ready; }
+
+	// readable from the render thread
+	bool AnalysisLoaded() const { return analysisLoaded_.load(std::memory_order_acquire); }
+	void SetAnalysisLoaded(bool loaded) { analysisLoaded_.store(loaded, std::memory_order_release); }
+	// the analysis file exists but could not be loaded
+	bool AnalysisFailed() const { return analysisFailed_.load(std::memory_order_acquire); }
+	void SetAnalysisFailed(bool failed) { analysisFailed_.store(failed, std::memory_order_release); }
+
+	// game thread only
+	ReplaySessionContext& Context() { return context_; }
+
+	void Begin();                                // Idle -> Entering with a fresh context
+	void Transition(ReplaySessionState next);
+	void End();                                  // -> Idle, context dropped
+
+private:
+	std::atomic<ReplaySessionState> state_{ ReplaySessionState::Idle };
+	std::atomic<bool> analysisLoaded_{ false };
+	std::atomic<bool> analysisFailed_{ false };
+	ReplaySessionContext context_;
+};
+
+ReplaySession& replaySession();
@@ -0,0 +1,84 @@
+#include "pch.h"
+#include "replaystate.h"
+
+void ReplayPositionState::Publish(const ReplayPosition& pos)
+{
+	const std::uint32_t s = seq_.load(std::memory_order_relaxed);
+	seq_.store(s + 1, std::memory_order_relaxed); // odd: write in progress
+	std::atomic_thread_fence(std::memory_order_release);
+
+	inReplay_.store(pos.inReplay, std::memory_order_relaxed);
+	playing_.store(pos.playing, std::memory_order_relaxed);
+	frame_.store(pos.frame, std::memory_order_relaxed);
+	numFrames_.store(pos.numFrames, std::memory_order_relaxed);
+	replayId_.store(pos.replayId, std::memory_order_relaxed);
+	replayTime_.store(pos.replayTime, std::memory_order_relaxed);
+	recordFps_.store(pos.recordFps, std::memory_order_relaxed);
+	playRate_.store(pos.playRate, std::memory_order_relaxed);
+	frameOffset_.store(pos.frameOffset, std::memory_order_relaxed);
+	tickTimeNs_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(pos.tickTime.time_since_epoch()).count(),
+		std::memory_order_relaxed);
+
+	seq_.store(s + 2, std::memory_order_release);
+}
+
+ReplayPosition ReplayPositionState::Read() const
+{
+	ReplayPosition pos;
+	while (true)
+	{
+		const std::uint32_t s0 = seq_.load(std::memory_order_acquire);
+		if (s0 & 1u)
+			continue;
+
+		pos.inReplay = inReplay_.load(std::memory_order_relaxed);
+		pos.playing = playing_.load(std::memory_order_relaxed);
+		pos.frame = frame_.load(std::memory_order_relaxed);
+		pos.numFrames = numFrames_.load(std::memory_order_relaxed);
+		pos.replayId = replayId_.load(std::memory_order_relaxed);
+		pos.replayTime = replayTime_.load(std::memory_order_relaxed);
+		pos.recordFps = recordFps_.load(std::memory_order_relaxed);
+		pos.playRate = playRate_.load(std::memory_order_relaxed);
+		pos.frameOffset = frameOffset_.load(std::memory_order_relaxed);
+		pos.tickTime = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::nanoseconds(tickTimeNs_.load(std::memory_order_relaxed))));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seq_.load(std::memory_order_relaxed) == s0)
+			return pos;
+	}
+}
+
+ReplayPositionState& replayPositionState()
+{
+	static ReplayPositionState state;
+	return state;
+}
+
+// FNV-1a, only used to tell replays apart
+std::uint64_t HashReplayId(const std::string& replayId)
+{
+	std::uint64_t h = 14695981039346656037ull;
+	for (unsigned char c : replayId)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h == 0 ? 1 : h;
+}
+
+// Clamped so it never leaves the frame the game is actually showing.
+double GetPlaybackPosition(const ReplayPosition& pos, std::chrono::steady_clock::time_point now)
+{
+	float sinceTick = std::chrono::duration<float>(now - pos.tickTime).count();
+	if (sinceTick < 0.0f) sinceTick = 0.0f;
+
+	double replayTime = (double)pos.replayTime + (double)sinceTick * (double)pos.playRate;
+	double position = replayTime * (double)pos.recordFps + (double)pos.frameOffset;
+
+	double lo = (double)pos.frame;
+	double hi = lo + 0.999;
+	if (position < lo) position = lo;
+	if (position > hi) position = hi;
+	return position;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Snapshot of where the replay is, written once per game tick by onTick()
+struct ReplayPosition
+{
+	bool inReplay = false;
+	bool playing = false;          // replay time advanced on the last tick
+	int frame = 0;
+	int numFrames = 0;
+	std::uint64_t replayId = 0;    // HashReplayId() of the replay's id, 0 if unknown
+
+	float replayTime = 0.0f;       // replay seconds at the last tick
+	float recordFps = 30.0f;
+	float playRate = 0.0f;         // replay seconds per wall second, 0 while paused
+	float frameOffset = 0.0f;      // frame - replayTime * recordFps, smoothed
+	std::chrono::steady_clock::time_point tickTime{};
+};
+
+// Single-writer, multi-reader replay position shared between the game thread (onTick,
+// RenderCanvas) and the render thread (RenderWindow). A sequence counter makes reads
+// lock-free: readers retry if the writer was mid-update, the writer never waits.
+class ReplayPositionState
+{
+public:
+	void Publish(const ReplayPosition& pos);
+	ReplayPosition Read() const;
+
+private:
+	std::atomic<std::uint32_t> seq_{ 0 };
+
+	std::atomic<bool> inReplay_{ false };
+	std::atomic<bool> playing_{ false };
+	std::atomic<int> frame_{ 0 };
+	std::atomic<int> numFrames_{ 0 };
+	std::atomic<std::uint64_t> replayId_{ 0 };
+	std::atomic<float> replayTime_{ 0.0f };
+	std::atomic<float> recordFps_{ 30.0f };
+	std::atomic<float> playRate_{ 0.0f };
+	std::atomic<float> frameOffset_{ 0.0f };
+	std::atomic<std::int64_t> tickTimeNs_{ 0 };
+};
+
+ReplayPositionState& replayPositionState();
+
+std::uint64_t HashReplayId(const std::string& replayId);
+
+// Fractional frame: replay time extrapolated by the wall time since the last tick
+double GetPlaybackPosition(const ReplayPosition& pos, std::chrono::steady_clock::time_point now);
@@ -0,0 +1,278 @@
+#include "pch.h"
+#include "rowstream.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static void PutU16(std::string& out, uint16_t v)
+{
+	char b[2] = { (char)(v & 0xff), (char)(v >> 8) };
+	out.append(b, 2);
+}
+
+static void PutU32(std::string& out, uint32_t v)
+{
+	char b[4] = { (char)(v & 0xff), (char)((v >> 8) & 0xff), (char)((v >> 16) & 0xff), (char)(v >> 24) };
+	out.append(b, 4);
+}
+
+static uint16_t GetU16(const char* p)
+{
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+static uint32_t GetU32(const char* p)
+{
+	const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+	return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+void AppendRowStreamHeader(std::string& out, int columns, int totalRows)
+{
+	PutU32(out, 1 + 12);
+	out.push_back('H');
+	PutU32(out, kRowStreamMagic);
+	PutU16(out, kRowStreamVersion);
+	PutU16(out, (uint16_t)columns);
+	PutU32(out, (uint32_t)totalRows);
+}
+
+// float32 payloads are copied as-is; both plugin targets are little-endian
+void AppendRowStreamRows(std::string& out, const float* rows, int rowCount, int columns)
+{
+	const size_t bytes = (size_t)rowCount * columns * sizeof(float);
+	PutU32(out, (uint32_t)(1 + 4 + bytes));
+	out.push_back('R');
+	PutU32(out, (uint32_t)rowCount);
+	out.append(reinterpret_cast<const char*>(rows), bytes);
+}
+
+void AppendRowStreamEnd(std::string& out, long long rowsSent)
+{
+	PutU32(out, 1 + 4);
+	out.push_back('E');
+	PutU32(out, (uint32_t)rowsSent);
+}
+
+RowStreamDecoder::RowStreamDecoder(HeaderFn onHeader, RowsFn onRows)
+	: onHeader_(std::move(onHeader)), onRows_(std::move(onRows))
+{
+}
+
+bool RowStreamDecoder::Feed(std::string_view chunk)
+{
+	if (Failed())
+		return false;
+
+	// whole frames are decoded straight from the chunk; only a split frame is copied
+	if (pending_.empty())
+	{
+		size_t used = ParseFrames(chunk.data(), chunk.size());
+		if (!Failed())
+			pending_.assign(chunk.data() + used, chunk.size() - used);
+	}
+	else
+	{
+		pending_.append(chunk.data(), chunk.size());
+		size_t used = ParseFrames(pending_.data(), pending_.size());
+		pending_.erase(0, used);
+	}
+	return !Failed();
+}
+
+size_t RowStreamDecoder::ParseFrames(const char* data, size_t size)
+{
+	size_t pos = 0;
+	while (size - pos >= 5)
+	{
+		uint32_t length = GetU32(data + pos);
+		if (length < 1 || length > kRowStreamMaxFrameBytes)
+		{
+			Fail("bad frame length " + std::to_string(length));
+			return pos;
+		}
+		if (size - pos - 4 < length)
+			break;
+
+		if (!ParseFrame(data[pos + 4], data + pos + 5, length - 1))
+			return pos;
+		pos += 4 + length;
+	}
+	return pos;
+}
+
+bool RowStreamDecoder::ParseFrame(char kind, const char* payload, size_t size)
+{
+	if (finished_)
+		return Fail("data after the end frame");
+
+	if (kind == 'H')
+	{
+		if (columns_ != 0)
+			return Fail("duplicate header");
+		if (size < 12 || GetU32(payload) != kRowStreamMagic)
+			return Fail("bad header");
+		if (GetU16(payload + 4) != kRowStreamVersion)
+			return Fail("unsupported version " + std::to_string(GetU16(payload + 4)));
+
+		columns_ = GetU16(payload + 6);
+		totalRows_ = (int)GetU32(payload + 8);
+		if (columns_ == 0)
+			return Fail("header without columns");
+		if (onHeader_)
+			onHeader_(columns_, totalRows_);
+		return true;
+	}
+
+	if (columns_ == 0)
+		return Fail("data before the header");
+
+	if (kind == 'R')
+	{
+		if (size < 4)
+			return Fail("short rows frame");
+		uint32_t rowCount = GetU32(payload);
+		size_t bytes = (size_t)rowCount * columns_ * sizeof(float);
+		if (size - 4 != bytes)
+			return Fail("rows frame size does not match its row count");
+
+		scratch_.resize((size_t)rowCount * columns_);
+		if (bytes)
+			std::memcpy(scratch_.data(), payload + 4, bytes);
+		rows_ += rowCount;
+		if (onRows_ && rowCount)
+			onRows_(scratch_.data(), (int)rowCount);
+		return true;
+	}
+
+	if (kind == 'E')
+	{
+		if (size < 4 || GetU32(payload) != (uint32_t)rows_)
+			return Fail("end frame row count does not match");
+		finished_ = true;
+		return true;
+	}
+
+	return Fail(std::string("unknown frame kind '") + kind + "'");
+}
+
+bool RowStreamDecoder::Fail(std::string error)
+{
+	error_ = std::move(error);
+	pending_.clear();
+	return false;
+}
+
+void RowStreamBuffer::Push(const float* rows, int rowCount, int columns)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	columns_ = columns;
+	pending_.insert(pending_.end(), rows, rows + (size_t)rowCount * columns);
+}
+
+int RowStreamBuffer::Drain(std::vector<std::vector<double>>& columns, const ColumnProjection* projection)
+{
+	std::vector<float> rows;
+	int width = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		rows.swap(pending_);
+		width = columns_;
+		drainQueued_ = false;
+	}
+	if (width == 0 || rows.empty())
+		return 0;
+
+	const bool project = projection && projection->Matches((size_t)width);
+	const int slots = project ? (int)projection->source.size() : width;
+	if ((int)columns.size() < slots)
+		columns.resize(slots);
+
+	const size_t rowCount = rows.size() / width;
+	for (int slot = 0; slot < slots; ++slot)
+	{
+		const int c = project ? projection->source[slot] : slot;
+		if (c < 0)
+			continue;
+		auto& column = columns[slot];
+		column.reserve(column.size() + rowCount);
+		for (size_t r = 0; r < rowCount; ++r)
+			column.push_back(rows[r * width + c]);
+	}
+	return (int)rowCount;
+}
+
+std::filesystem::path RowStreamPathFor(const std::filesystem::path& csvPath)
+{
+	std::filesystem::path path = csvPath;
+	path.replace_extension(".nrlb");
+	return path;
+}
+
+bool SaveRowStreamFile(const std::filesystem::path& path, const std::string& bytes, std::string& error)
+{
+	// a partial file must never look like a finished analysis
+	std::filesystem::path tmpPath = path;
+	tmpPath += ".tmp";
+	{
+		std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+		out.write(bytes.data(), (std::streamsize)bytes.size());
+		if (!out)
+		{
+			error = "cannot write " + tmpPath.string();
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+	if (ec)
+	{
+		error = ec.message();
+		std::filesystem::remove(tmpPath, ec);
+		return false;
+	}
+	return true;
+}
+
+bool LoadRowStreamFile(const std::filesystem::path& path, std::vector<std::vector<double>>& columns, std::string& error)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		error = "cannot open " + path.string();
+		return false;
+	}
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	std::vector<std::vector<double>> result;
+	int width = 0;
+	RowStreamDecoder decoder(
+		[&](int cols, int totalRows) {
+			width = cols;
+			result.resize(cols);
+			if (totalRows > 0)
+				for (auto& column : result) column.reserve(totalRows);
+		},
+		[&](const float* rows, int rowCount) {
+			for (int r = 0; r < rowCount; ++r)
+				for (int c = 0; c < width; ++c)
+					result[c].push_back(rows[(size_t)r * width + c]);
+		});
+
+	if (!decoder.Feed(bytes))
+	{
+		error = decoder.Error();
+		return false;
+	}
+	if (!decoder.Finished())
+	{
+		error = "truncated file";
+		return false;
+	}
+
+	columns = std::move(result);
+	return true;
+}
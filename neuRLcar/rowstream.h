@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "modelmanifest.h"
+
+// Binary row protocol written by an applet started with --rows, and the format of the
+// .nrlb files kept next to (or instead of) the analysis CSVs.
+//
+// The stream is a sequence of frames, all integers little-endian:
+//   u32 length        bytes that follow, kind included
+//   u8  kind
+//   payload
+// kinds:
+//   'H'  u32 magic "NRLR", u16 version, u16 columns, u32 total rows (0 if unknown)   first frame
+//   'R'  u32 rows, then rows * columns float32, row-major
+//   'E'  u32 rows sent                                                             last frame
+constexpr uint32_t kRowStreamMagic = 0x524C524E; // "NRLR"
+constexpr uint16_t kRowStreamVersion = 1;
+constexpr uint32_t kRowStreamMaxFrameBytes = 64u << 20;
+
+// Encoders, used to persist .nrlb files and by the decoder benchmark
+void AppendRowStreamHeader(std::string& out, int columns, int totalRows);
+void AppendRowStreamRows(std::string& out, const float* rows, int rowCount, int columns);
+void AppendRowStreamEnd(std::string& out, long long rowsSent);
+
+// Incremental decoder; chunks may split frames anywhere
+class RowStreamDecoder
+{
+public:
+	using HeaderFn = std::function<void(int columns, int totalRows)>;
+	using RowsFn = std::function<void(const float* rows, int rowCount)>;   // row-major, Columns() per row
+
+	RowStreamDecoder(HeaderFn onHeader, RowsFn onRows);
+
+	// false once the stream is malformed; later chunks are ignored
+	bool Feed(std::string_view chunk);
+
+	bool Finished() const { return finished_; }
+	bool Failed() const { return !error_.empty(); }
+	const std::string& Error() const { return error_; }
+	int Columns() const { return columns_; }
+	int TotalRows() const { return totalRows_; }
+	long long Rows() const { return rows_; }
+
+private:
+	size_t ParseFrames(const char* data, size_t size);   // returns bytes consumed
+	bool ParseFrame(char kind, const char* payload, size_t size);
+	bool Fail(std::string error);
+
+	HeaderFn onHeader_;
+	RowsFn onRows_;
+	std::string pending_;          // partial frame carried between chunks
+	std::vector<float> scratch_;   // aligned copy of a rows payload
+	int columns_ = 0;
+	int totalRows_ = 0;
+	long long rows_ = 0;
+	bool finished_ = false;
+	std::string error_;
+};
+
+// Rows decoded on a reader thread, waiting to be appended to the loaded dataset on the game thread
+class RowStreamBuffer
+{
+public:
+	void Push(const float* rows, int rowCount, int columns);
+
+	// Appends everything pushed since the last drain to columns ([column][row]); returns rows added.
+	// With a projection that matches the stream's width, only its columns are kept, in slot order.
+	int Drain(std::vector<std::vector<double>>& columns, const ColumnProjection* projection = nullptr);
+
+	// true if the caller should post a drain; cleared by Drain
+	bool MarkDrainQueued() { return !drainQueued_.exchange(true); }
+
+	void Close() { closed_ = true; }
+	bool Closed() const { return closed_; }
+
+	// game thread only
+	bool attached = false;    // the loaded dataset was reset for this stream
+	bool discarded = false;   // not for the replay being viewed; rows are dropped
+
+private:
+	std::mutex mutex_;
+	std::vector<float> pending_;
+	int columns_ = 0;
+	std::atomic<bool> drainQueued_{ false };
+	std::atomic<bool> closed_{ false };
+};
+
+// <id>.csv -> <id>.nrlb
+std::filesystem::path RowStreamPathFor(const std::filesystem::path& csvPath);
+
+// Writes a complete stream under a temporary name, then renames it into place
+bool SaveRowStreamFile(const std::filesystem::path& path, const std::string& bytes, std::string& error);
+
+// Reads a complete .nrlb file into [column][row]
+bool LoadRowStreamFile(const std::filesystem::path& path, std::vector<std::vector<double>>& columns, std::string& error);
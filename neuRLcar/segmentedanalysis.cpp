@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "segmentedanalysis.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+
+std::vector<AnalysisSegment> PlanAnalysisSegments(int numFrames, int maxSegments, int overlapFrames, int minSegmentFrames)
+{
+	if (numFrames <= 0)
+		return {};
+
+	int count = (std::min)(maxSegments, numFrames / (std::max)(1, minSegmentFrames));
+	if (count < 2)
+		return { AnalysisSegment{ 0, numFrames, 0 } };
+
+	// the warm-up may not reach back past the start of the previous segment's kept rows
+	const int overlap = std::clamp(overlapFrames, 0, numFrames / count / 2);
+
+	std::vector<AnalysisSegment> segments;
+	for (int k = 0; k < count; ++k)
+	{
+		AnalysisSegment segment;
+		segment.keepFrom = (int)((long long)numFrames * k / count);
+		segment.end = (int)((long long)numFrames * (k + 1) / count);
+		segment.begin = k == 0 ? 0 : segment.keepFrom - overlap;
+		segments.push_back(segment);
+	}
+	return segments;
+}
+
+bool StitchAnalysisSegments(const std::vector<AnalysisSegment>& segments,
+	const std::vector<std::vector<std::vector<double>>>& outputs,
+	double tolerance,
+	std::vector<std::vector<double>>& stitched,
+	std::vector<SeamCheck>& seams,
+	std::string& error)
+{
+	seams.clear();
+	if (segments.empty() || outputs.size() != segments.size())
+	{
+		error = "expected " + std::to_string(segments.size()) + " segment outputs, got " + std::to_string(outputs.size());
+		return false;
+	}
+
+	const size_t columns = outputs[0].size();
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		if (outputs[k].size() != columns || columns == 0)
+		{
+			error = "segment " + std::to_string(k) + " has " + std::to_string(outputs[k].size()) + " columns, expected " + std::to_string(columns);
+			return false;
+		}
+		for (const auto& column : outputs[k])
+		{
+			// an applet without --frames support analyzes the whole replay every time
+			if ((int)column.size() != segments[k].Rows())
+			{
+				error = "segment " + std::to_string(k) + " has " + std::to_string(column.size()) + " rows for frames " +
+					std::to_string(segments[k].begin) + "-" + std::to_string(segments[k].end);
+				return false;
+			}
+		}
+	}
+
+	const int numFrames = segments.back().end;
+	std::vector<std::vector<double>> result(columns, std::vector<double>(numFrames));
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		const AnalysisSegment& segment = segments[k];
+		for (size_t c = 0; c < columns; ++c)
+			std::copy(outputs[k][c].begin() + (segment.keepFrom - segment.begin), outputs[k][c].end(), result[c].begin() + segment.keepFrom);
+	}
+
+	// column ranges, so the seam check means the same for probabilities and raw values
+	std::vector<double> range(columns);
+	for (size_t c = 0; c < columns; ++c)
+	{
+		auto [lo, hi] = std::minmax_element(result[c].begin(), result[c].end());
+		range[c] = (std::max)(*hi - *lo, 1e-9);
+	}
+
+	bool allOk = true;
+	for (size_t k = 1; k < segments.size(); ++k)
+	{
+		const AnalysisSegment& segment = segments[k];
+		const int overlap = segment.keepFrom - segment.begin;
+		const int blend = overlap / 2;   // the first half is pure warm-up
+		const int blendFrom = segment.keepFrom - blend;
+
+		SeamCheck seam;
+		seam.frame = segment.keepFrom;
+		for (size_t c = 0; c < columns && blend > 0; ++c)
+		{
+			double sumDiff = 0.0;
+			for (int f = blendFrom; f < segment.keepFrom; ++f)
+			{
+				double previous = result[c][f];
+				double next = outputs[k][c][f - segment.begin];
+				double w = (double)(f - blendFrom + 1) / (blend + 1);
+				sumDiff += std::fabs(previous - next);
+				result[c][f] = previous + (next - previous) * w;
+			}
+			seam.deviation = (std::max)(seam.deviation, sumDiff / blend / range[c]);
+		}
+		seam.ok = blend > 0 && seam.deviation <= tolerance;
+		allOk = allOk && seam.ok;
+		seams.push_back(seam);
+	}
+
+	if (!allOk)
+	{
+		error = "segments disagree at a seam";
+		return false;
+	}
+	stitched = std::move(result);
+	return true;
+}
+
+// Header properties are serialized as name, type name, 64-bit size, value; NumFrames is an
+// IntProperty: "\x0a\0\0\0NumFrames\0" "\x0c\0\0\0IntProperty\0" size value
+int ReadReplayFrameCount(const std::filesystem::path& replayPath)
+{
+	std::ifstream in(replayPath, std::ios::binary);
+	if (!in)
+		return 0;
+
+	// the header comes first and is a few KB; goals and player stats can push it past that
+	std::string bytes(256 * 1024, '\0');
+	in.read(bytes.data(), (std::streamsize)bytes.size());
+	bytes.resize((size_t)in.gcount());
+
+	static const char kName[] = "\x0a\0\0\0NumFrames\0\x0c\0\0\0IntProperty\0";
+	const std::string_view name(kName, sizeof(kName) - 1);
+	size_t pos = std::string_view(bytes).find(name);
+	if (pos == std::string::npos || pos + name.size() + 12 > bytes.size())
+		return 0;
+
+	const unsigned char* value = reinterpret_cast<const unsigned char*>(bytes.data() + pos + name.size() + 8);
+	int32_t frames = (int32_t)((uint32_t)value[0] | ((uint32_t)value[1] << 8) | ((uint32_t)value[2] << 16) | ((uint32_t)value[3] << 24));
+	return frames > 0 ? frames : 0;
+}
+
+std::filesystem::path SegmentAnalysisPathFor(const std::filesystem::path& csvPath, int segment)
+{
+	std::filesystem::path path = csvPath;
+	path.replace_extension(".seg" + std::to_string(segment) + ".partial.csv");
+	return path;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Splitting one replay across several applet processes (`--frames <begin> <end>`).
+//
+// Segment k analyzes frames [begin, end) and keeps its rows from keepFrom on. Every segment but
+// the first starts `overlap` frames before its keepFrom so the model has warmed up by the seam.
+// The second half of that overlap is cross-faded from the previous segment's rows into this one's,
+// and the two are compared there; a seam where they disagree means the warm-up was too short.
+
+struct AnalysisSegment
+{
+	int begin = 0;
+	int end = 0;
+	int keepFrom = 0;   // rows before this frame are warm-up
+
+	int Rows() const { return end - begin; }
+};
+
+// At most maxSegments, none shorter than minSegmentFrames; a single segment means "don't split"
+std::vector<AnalysisSegment> PlanAnalysisSegments(int numFrames, int maxSegments, int overlapFrames, int minSegmentFrames);
+
+struct SeamCheck
+{
+	int frame = 0;            // keepFrom of the later segment
+	double deviation = 0.0;   // worst column's mean |difference| over the blend, as a fraction of its range
+	bool ok = false;
+};
+
+// outputs[k] is segment k's column-major result. Fills stitched (column-major, one row per frame)
+// and one SeamCheck per seam; false with `error` if the outputs don't fit the plan or a seam
+// deviates by more than tolerance.
+bool StitchAnalysisSegments(const std::vector<AnalysisSegment>& segments,
+	const std::vector<std::vector<std::vector<double>>>& outputs,
+	double tolerance,
+	std::vector<std::vector<double>>& stitched,
+	std::vector<SeamCheck>& seams,
+	std::string& error);
+
+// NumFrames from the replay's header properties; 0 if it can't be read
+int ReadReplayFrameCount(const std::filesystem::path& replayPath);
+
+// demoanalysis/<replayId>.seg<k>.partial.csv
+std::filesystem::path SegmentAnalysisPathFor(const std::filesystem::path& csvPath, int segment);
@@ -0,0 +1,222 @@
+#include "pch.h"
+#include "sharedresults.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+static constexpr size_t kAlign = 64;
+static constexpr int kMaxReadAttempts = 1000;
+
+static size_t AlignUp(size_t n)
+{
+	return (n + kAlign - 1) & ~(kAlign - 1);
+}
+
+static size_t HeaderBytes()
+{
+	return AlignUp(sizeof(SharedResultsHeader));
+}
+
+static size_t ColumnBytes(uint32_t capacityRows)
+{
+	return AlignUp((size_t)capacityRows * sizeof(float));
+}
+
+size_t SharedResultsBytes(uint32_t capacityRows)
+{
+	return HeaderBytes() + kSharedResultsMaxColumns * ColumnBytes(capacityRows);
+}
+
+SharedResultsReader::SharedResultsReader(std::unique_ptr<SharedMemory> memory, uint32_t capacityRows)
+	: memory_(std::move(memory)), capacityRows_(capacityRows)
+{
+}
+
+std::unique_ptr<SharedResultsReader> SharedResultsReader::Create(uint32_t capacityRows, std::string& error)
+{
+	auto memory = CreateSharedMemory(MakeSharedMemoryName("results"), SharedResultsBytes(capacityRows), error);
+	if (!memory)
+		return nullptr;
+
+	// fresh mappings are zero-filled, so only the fixed fields and the column slots need writing
+	auto* header = new (memory->Data()) SharedResultsHeader{};
+	header->magic = kSharedResultsMagic;
+	header->version = kSharedResultsVersion;
+	header->headerBytes = (uint16_t)HeaderBytes();
+	header->capacityRows = capacityRows;
+	for (int c = 0; c < kSharedResultsMaxColumns; ++c)
+		header->column[c].offset = HeaderBytes() + c * ColumnBytes(capacityRows);
+
+	return std::unique_ptr<SharedResultsReader>(new SharedResultsReader(std::move(memory), capacityRows));
+}
+
+const SharedResultsHeader* SharedResultsReader::Header() const
+{
+	return static_cast<const SharedResultsHeader*>(memory_->Data());
+}
+
+bool SharedResultsReader::ReadStatus(Status& status, std::string& error) const
+{
+	const SharedResultsHeader* header = Header();
+
+	for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt)
+	{
+		if (attempt > 0)
+			std::this_thread::yield();
+
+		uint32_t before = header->commit.load(std::memory_order_acquire);
+		if (before & 1u)
+			continue;
+
+		Status read;
+		read.columns = header->columns.load(std::memory_order_relaxed);
+		read.rows = header->rows.load(std::memory_order_relaxed);
+		read.totalRows = header->totalRows.load(std::memory_order_relaxed);
+		read.state = (SharedResultsState)header->state.load(std::memory_order_relaxed);
+		bool failed = read.state == SharedResultsState::Failed;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->commit.load(std::memory_order_relaxed) != before)
+			continue;
+
+		if (read.columns > kSharedResultsMaxColumns || read.rows > capacityRows_)
+		{
+			error = "invalid layout in shared results header";
+			return false;
+		}
+
+		// the message is only written once, before the final commit of a failed run
+		if (failed)
+			read.message.assign(header->message, strnlen(header->message, sizeof(header->message)));
+
+		status = std::move(read);
+		return true;
+	}
+
+	error = "shared results header stayed torn";
+	return false;
+}
+
+void SharedResultsReader::CopyRows(const Status& status, uint32_t fromRow, std::vector<float>& rowMajor) const
+{
+	if (fromRow >= status.rows || status.columns == 0)
+		return;
+
+	const char* base = static_cast<const char*>(memory_->Data());
+	const SharedResultsHeader* header = Header();
+	const uint32_t rowCount = status.rows - fromRow;
+	const uint32_t columns = status.columns;
+
+	size_t start = rowMajor.size();
+	rowMajor.resize(start + (size_t)rowCount * columns);
+	for (uint32_t c = 0; c < columns; ++c)
+	{
+		// the producer can write anywhere in the segment, offsets included
+		uint64_t offset = header->column[c].offset;
+		if (offset < HeaderBytes() || offset + (uint64_t)capacityRows_ * sizeof(float) > memory_->Size())
+			continue;
+
+		const float* column = reinterpret_cast<const float*>(base + offset) + fromRow;
+		for (uint32_t r = 0; r < rowCount; ++r)
+			rowMajor[start + (size_t)r * columns + c] = column[r];
+	}
+}
+
+SharedResultsWriter::SharedResultsWriter(std::unique_ptr<SharedMemory> memory) : memory_(std::move(memory))
+{
+}
+
+std::unique_ptr<SharedResultsWriter> SharedResultsWriter::Open(const std::string& name, std::string& error)
+{
+	auto memory = OpenSharedMemory(name, error);
+	if (!memory)
+		return nullptr;
+
+	auto* header = static_cast<SharedResultsHeader*>(memory->Data());
+	if (memory->Size() < sizeof(SharedResultsHeader) || header->magic != kSharedResultsMagic ||
+		header->version != kSharedResultsVersion || memory->Size() < SharedResultsBytes(header->capacityRows))
+	{
+		error = "not a shared results segment";
+		return nullptr;
+	}
+	return std::unique_ptr<SharedResultsWriter>(new SharedResultsWriter(std::move(memory)));
+}
+
+SharedResultsHeader* SharedResultsWriter::Header() const
+{
+	return static_cast<SharedResultsHeader*>(memory_->Data());
+}
+
+// Writer half of the seqlock: odd commit, update, even commit
+template <typename Fn>
+static void Commit(SharedResultsHeader* header, Fn&& update)
+{
+	uint32_t c = header->commit.load(std::memory_order_relaxed);
+	header->commit.store(c + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	update();
+	header->commit.store(c + 2, std::memory_order_release);
+}
+
+bool SharedResultsWriter::SetColumns(const std::vector<std::string>& names, uint32_t totalRows, std::string& error)
+{
+	SharedResultsHeader* header = Header();
+	if (names.empty() || names.size() > kSharedResultsMaxColumns)
+	{
+		error = "between 1 and " + std::to_string(kSharedResultsMaxColumns) + " columns are supported";
+		return false;
+	}
+
+	Commit(header, [&] {
+		for (size_t c = 0; c < names.size(); ++c)
+		{
+			std::memset(header->column[c].name, 0, sizeof(header->column[c].name));
+			std::memcpy(header->column[c].name, names[c].data(), (std::min)(names[c].size(), sizeof(header->column[c].name) - 1));
+			header->column[c].type = 0;
+		}
+		header->columns.store((uint32_t)names.size(), std::memory_order_relaxed);
+		header->totalRows.store(totalRows, std::memory_order_relaxed);
+		});
+	return true;
+}
+
+bool SharedResultsWriter::AppendRows(const float* rowMajor, uint32_t rowCount, std::string& error)
+{
+	SharedResultsHeader* header = Header();
+	const uint32_t columns = header->columns.load(std::memory_order_relaxed);
+	const uint32_t rows = header->rows.load(std::memory_order_relaxed);
+	if (columns == 0)
+	{
+		error = "columns must be set before rows";
+		return false;
+	}
+	if (rowCount > header->capacityRows - rows)
+	{
+		error = "segment holds " + std::to_string(header->capacityRows) + " rows";
+		return false;
+	}
+
+	// rows past the committed count are invisible to the reader, so they're written outside the lock
+	char* base = static_cast<char*>(memory_->Data());
+	for (uint32_t c = 0; c < columns; ++c)
+	{
+		float* column = reinterpret_cast<float*>(base + header->column[c].offset) + rows;
+		for (uint32_t r = 0; r < rowCount; ++r)
+			column[r] = rowMajor[(size_t)r * columns + c];
+	}
+
+	Commit(header, [&] { header->rows.store(rows + rowCount, std::memory_order_relaxed); });
+	return true;
+}
+
+void SharedResultsWriter::Finish(bool ok, const std::string& message)
+{
+	SharedResultsHeader* header = Header();
+	Commit(header, [&] {
+		std::memset(header->message, 0, sizeof(header->message));
+		std::memcpy(header->message, message.data(), (std::min)(message.size(), sizeof(header->message) - 1));
+		header->state.store((uint32_t)(ok ? SharedResultsState::Complete : SharedResultsState::Failed), std::memory_order_relaxed);
+		});
+}
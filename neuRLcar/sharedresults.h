@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Named shared-memory segment the applet writes results into (`<applet> <replay> <nrlb> --shm <name>`),
+// so large multi-column results skip the file write, read and parse.
+//
+// The plugin creates the segment, lays out one float32 column slot per possible column and
+// passes the name to the applet. The applet names its columns, appends rows and bumps `commit`
+// around every header update like a seqlock: odd while it writes, even once the header and all
+// rows below `rows` are consistent. Rows below a committed `rows` are never rewritten.
+constexpr uint32_t kSharedResultsMagic = 0x534C524E; // "NRLS"
+constexpr uint16_t kSharedResultsVersion = 1;
+constexpr int kSharedResultsMaxColumns = 32;
+
+enum class SharedResultsState : uint32_t
+{
+	Writing = 0,
+	Complete = 1,
+	Failed = 2,    // message says why
+};
+
+struct SharedResultsColumn
+{
+	char name[24];
+	uint32_t type;        // 0 = float32
+	uint32_t reserved;
+	uint64_t offset;      // from the start of the segment; capacityRows floats
+};
+
+struct SharedResultsHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t headerBytes;
+	uint32_t capacityRows;
+	uint32_t reserved;
+	std::atomic<uint32_t> commit;
+	std::atomic<uint32_t> columns;
+	std::atomic<uint32_t> rows;
+	std::atomic<uint32_t> totalRows;   // expected rows, 0 if unknown
+	std::atomic<uint32_t> state;       // SharedResultsState
+	char message[124];
+	SharedResultsColumn column[kSharedResultsMaxColumns];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared header needs address-free atomics");
+
+// Platform mapping (sharedresults_win32.cpp / sharedresults_posix.cpp)
+class SharedMemory
+{
+public:
+	virtual ~SharedMemory() = default;
+
+	virtual const std::string& Name() const = 0;
+	virtual void* Data() const = 0;
+	virtual size_t Size() const = 0;
+};
+
+// Creates a new segment owned by this process; it is removed when the returned object goes away
+std::unique_ptr<SharedMemory> CreateSharedMemory(const std::string& name, size_t size, std::string& error);
+// Maps all of an existing segment, e.g. from a producer
+std::unique_ptr<SharedMemory> OpenSharedMemory(const std::string& name, std::string& error);
+// Process-unique segment name in the platform's namespace
+std::string MakeSharedMemoryName(const std::string& tag);
+
+size_t SharedResultsBytes(uint32_t capacityRows);
+
+// Consumer side, owned by the plugin
+class SharedResultsReader
+{
+public:
+	static std::unique_ptr<SharedResultsReader> Create(uint32_t capacityRows, std::string& error);
+
+	const std::string& Name() const { return memory_->Name(); }
+	uint32_t CapacityRows() const { return capacityRows_; }
+
+	struct Status
+	{
+		uint32_t columns = 0;
+		uint32_t rows = 0;
+		uint32_t totalRows = 0;
+		SharedResultsState state = SharedResultsState::Writing;
+		std::string message;
+	};
+
+	// Consistent header snapshot; false if the producer kept it torn or wrote an invalid layout
+	bool ReadStatus(Status& status, std::string& error) const;
+
+	// Appends rows [fromRow, status.rows) to rowMajor, reading the columns in place
+	void CopyRows(const Status& status, uint32_t fromRow, std::vector<float>& rowMajor) const;
+
+private:
+	explicit SharedResultsReader(std::unique_ptr<SharedMemory> memory, uint32_t capacityRows);
+	const SharedResultsHeader* Header() const;
+
+	std::unique_ptr<SharedMemory> memory_;
+	uint32_t capacityRows_;
+};
+
+// Producer side: the reference for applet authors, and the stand-in producer for testing
+class SharedResultsWriter
+{
+public:
+	static std::unique_ptr<SharedResultsWriter> Open(const std::string& name, std::string& error);
+
+	bool SetColumns(const std::vector<std::string>& names, uint32_t totalRows, std::string& error);
+	bool AppendRows(const float* rowMajor, uint32_t rowCount, std::string& error);
+	void Finish(bool ok, const std::string& message = {});
+
+private:
+	explicit SharedResultsWriter(std::unique_ptr<SharedMemory> memory);
+	SharedResultsHeader* Header() const;
+
+	std::unique_ptr<SharedMemory> memory_;
+};
@@ -0,0 +1,106 @@
+#include "pch.h"
+#include "sharedresults.h"
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class PosixSharedMemory : public SharedMemory
+{
+public:
+	PosixSharedMemory(std::string name, void* data, size_t size, bool owner)
+		: name_(std::move(name)), data_(data), size_(size), owner_(owner)
+	{
+	}
+
+	~PosixSharedMemory() override
+	{
+		munmap(data_, size_);
+		if (owner_)
+			shm_unlink(name_.c_str());
+	}
+
+	const std::string& Name() const override { return name_; }
+	void* Data() const override { return data_; }
+	size_t Size() const override { return size_; }
+
+private:
+	std::string name_;
+	void* data_;
+	size_t size_;
+	bool owner_;
+};
+
+static std::string ErrnoText(const char* what)
+{
+	return std::string(what) + " failed: " + std::strerror(errno);
+}
+
+std::unique_ptr<SharedMemory> CreateSharedMemory(const std::string& name, size_t size, std::string& error)
+{
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		error = ErrnoText("shm_open");
+		return nullptr;
+	}
+
+	if (ftruncate(fd, (off_t)size) != 0)
+	{
+		error = ErrnoText("ftruncate");
+		close(fd);
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		error = ErrnoText("mmap");
+		shm_unlink(name.c_str());
+		return nullptr;
+	}
+	return std::make_unique<PosixSharedMemory>(name, data, size, true);
+}
+
+std::unique_ptr<SharedMemory> OpenSharedMemory(const std::string& name, std::string& error)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd < 0)
+	{
+		error = ErrnoText("shm_open");
+		return nullptr;
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		error = ErrnoText("fstat");
+		close(fd);
+		return nullptr;
+	}
+
+	void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		error = ErrnoText("mmap");
+		return nullptr;
+	}
+	return std::make_unique<PosixSharedMemory>(name, data, (size_t)st.st_size, false);
+}
+
+std::string MakeSharedMemoryName(const std::string& tag)
+{
+	static std::atomic<unsigned> counter{ 0 };
+	return "/neurlcar_" + tag + "_" + std::to_string(getpid()) + "_" + std::to_string(++counter);
+}
+
+#endif // !_WIN32
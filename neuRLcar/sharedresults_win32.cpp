@@ -0,0 +1,96 @@
+#include "pch.h"
+#include "sharedresults.h"
+
+#ifdef _WIN32
+
+#include <atomic>
+#include <windows.h>
+
+class Win32SharedMemory : public SharedMemory
+{
+public:
+	Win32SharedMemory(std::string name, HANDLE mapping, void* data, size_t size)
+		: name_(std::move(name)), mapping_(mapping), data_(data), size_(size)
+	{
+	}
+
+	// the section goes away with its last handle, so the owner needs no separate unlink
+	~Win32SharedMemory() override
+	{
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_);
+	}
+
+	const std::string& Name() const override { return name_; }
+	void* Data() const override { return data_; }
+	size_t Size() const override { return size_; }
+
+private:
+	std::string name_;
+	HANDLE mapping_;
+	void* data_;
+	size_t size_;
+};
+
+static std::string LastErrorText(const char* what)
+{
+	return std::string(what) + " failed with error " + std::to_string(GetLastError());
+}
+
+std::unique_ptr<SharedMemory> CreateSharedMemory(const std::string& name, size_t size, std::string& error)
+{
+	const unsigned long long size64 = size;
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		(DWORD)(size64 >> 32), (DWORD)(size64 & 0xffffffffu), name.c_str());
+	if (!mapping)
+	{
+		error = LastErrorText("CreateFileMapping");
+		return nullptr;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		error = "shared memory " + name + " already exists";
+		return nullptr;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!data)
+	{
+		error = LastErrorText("MapViewOfFile");
+		CloseHandle(mapping);
+		return nullptr;
+	}
+	return std::make_unique<Win32SharedMemory>(name, mapping, data, size);
+}
+
+std::unique_ptr<SharedMemory> OpenSharedMemory(const std::string& name, std::string& error)
+{
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+	if (!mapping)
+	{
+		error = LastErrorText("OpenFileMapping");
+		return nullptr;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!data)
+	{
+		error = LastErrorText("MapViewOfFile");
+		CloseHandle(mapping);
+		return nullptr;
+	}
+
+	// the view covers the whole section, rounded up to pages
+	MEMORY_BASIC_INFORMATION info{};
+	VirtualQuery(data, &info, sizeof(info));
+	return std::make_unique<Win32SharedMemory>(name, mapping, data, (size_t)info.RegionSize);
+}
+
+std::string MakeSharedMemoryName(const std::string& tag)
+{
+	static std::atomic<unsigned> counter{ 0 };
+	return "Local\\neurlcar_" + tag + "_" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(++counter);
+}
+
+#endif // _WIN32
@@ -0,0 +1,485 @@
+#include "pch.h"
+#include "standinserver.h"
+#include "remoteanalysis.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+// largest request head and body the stand-in accepts; replay pieces are far smaller
+static constexpr size_t kMaxHeadBytes = 64 << 10;
+static constexpr size_t kMaxBodyBytes = 64 << 20;
+static constexpr long long kMaxReplayBytes = 1LL << 30;
+static constexpr auto kIdleLimit = std::chrono::seconds(30);
+// finished and abandoned jobs are forgotten this long after they were last touched
+static constexpr auto kIdleJobLifetime = std::chrono::minutes(10);
+
+static long long ToNumber(const std::string& text, long long fallback = -1)
+{
+	try { return text.empty() ? fallback : std::stoll(text); }
+	catch (...) { return fallback; }
+}
+
+static const char* StatusText(int status)
+{
+	switch (status)
+	{
+	case 200: return "OK";
+	case 201: return "Created";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 409: return "Conflict";
+	case 413: return "Payload Too Large";
+	case 501: return "Not Implemented";
+	case 503: return "Service Unavailable";
+	default: return "Error";
+	}
+}
+
+// Appends whatever arrives next; false on close, error, idle timeout or stop
+static bool ReadSome(TcpSocket& socket, std::string& data, const std::atomic<bool>& stopping)
+{
+	const auto giveUpAt = std::chrono::steady_clock::now() + kIdleLimit;
+	char buffer[16384];
+	while (!stopping && std::chrono::steady_clock::now() < giveUpAt)
+	{
+		if (!WaitSocket(socket, kSocketReadable, std::chrono::milliseconds(200)))
+			continue;
+		long long got = socket.Recv(buffer, sizeof(buffer));
+		if (got < 0)
+			return false;
+		if (got > 0)
+		{
+			data.append(buffer, (size_t)got);
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool WriteAll(TcpSocket& socket, const std::string& data, const std::atomic<bool>& stopping)
+{
+	size_t sent = 0;
+	auto giveUpAt = std::chrono::steady_clock::now() + kIdleLimit;
+	while (sent < data.size())
+	{
+		if (stopping || std::chrono::steady_clock::now() >= giveUpAt)
+			return false;
+		long long wrote = socket.Send(data.data() + sent, data.size() - sent);
+		if (wrote < 0)
+			return false;
+		if (wrote == 0)
+		{
+			WaitSocket(socket, kSocketWritable, std::chrono::milliseconds(200));
+			continue;
+		}
+		sent += (size_t)wrote;
+		giveUpAt = std::chrono::steady_clock::now() + kIdleLimit;
+	}
+	return true;
+}
+
+static std::string Lower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return text;
+}
+
+RemoteStandInServer::RemoteStandInServer(std::filesystem::path workDir, AnalyzeFn analyze, SpawnFn spawn)
+	: workDir_(std::move(workDir)), analyze_(std::move(analyze)), spawn_(std::move(spawn))
+{
+}
+
+RemoteStandInServer::~RemoteStandInServer()
+{
+	Stop(std::chrono::milliseconds(-1));
+}
+
+bool RemoteStandInServer::Start(uint16_t port, std::string& error)
+{
+	if (listener_.Valid())
+	{
+		error = "already running on port " + std::to_string(port_);
+		return false;
+	}
+	if (!NetInit(error))
+		return false;
+
+	// replays left behind by a previous session
+	std::error_code ec;
+	std::filesystem::create_directories(workDir_, ec);
+	for (const auto& entry : std::filesystem::directory_iterator(workDir_, ec))
+		if (entry.path().extension() == ".replay")
+			std::filesystem::remove(entry.path(), ec);
+
+	listener_ = TcpSocket::Listen("127.0.0.1", port, error);
+	if (!listener_.Valid())
+		return false;
+	port_ = listener_.LocalPort();
+	stopping_ = false;
+	acceptThread_ = std::thread(&RemoteStandInServer::AcceptLoop, this);
+	return true;
+}
+
+bool RemoteStandInServer::Stop(std::chrono::milliseconds grace)
+{
+	stopping_ = true;
+	if (acceptThread_.joinable())
+		acceptThread_.join();
+	listener_.Close();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (auto& [id, job] : jobs_)
+		job->cancel = true;
+	changed_.notify_all();
+
+	auto idle = [this]() { return active_ == 0; };
+	if (grace.count() < 0)
+		changed_.wait(lock, idle);
+	else if (!changed_.wait_for(lock, grace, idle))
+		return false;
+
+	std::error_code ec;
+	for (auto& [id, job] : jobs_)
+		std::filesystem::remove(job->replayPath, ec);
+	jobs_.clear();
+	return true;
+}
+
+void RemoteStandInServer::Spawn(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++active_;
+	}
+	spawn_([this, task = std::move(task)]() {
+		task();
+		std::lock_guard<std::mutex> lock(mutex_);
+		--active_;
+		changed_.notify_all();
+	});
+}
+
+void RemoteStandInServer::AcceptLoop()
+{
+	// woken every 200 ms to notice Stop
+	while (!stopping_)
+	{
+		if (!WaitSocket(listener_, kSocketReadable, std::chrono::milliseconds(200)))
+			continue;
+		for (TcpSocket socket = listener_.Accept(); socket.Valid(); socket = listener_.Accept())
+		{
+			auto connection = std::make_shared<TcpSocket>(std::move(socket));
+			Spawn([this, connection]() { ServeConnection(std::move(*connection)); });
+		}
+	}
+}
+
+// Requests are served in turn until the client closes the connection, asks to, or goes idle
+void RemoteStandInServer::ServeConnection(TcpSocket socket)
+{
+	std::string data;   // may already hold the start of the next request
+	bool keepAlive = true;
+	while (keepAlive)
+	{
+		size_t headEnd;
+		while ((headEnd = data.find("\r\n\r\n")) == std::string::npos)
+		{
+			if (data.size() > kMaxHeadBytes || !ReadSome(socket, data, stopping_))
+				return;
+		}
+
+		Request request;
+		Response response;
+		long long contentLength = 0;
+		bool chunked = false;
+
+		size_t lineEnd = data.find("\r\n");
+		const std::string requestLine = data.substr(0, lineEnd);
+		const size_t space1 = requestLine.find(' ');
+		const size_t space2 = requestLine.find(' ', space1 == std::string::npos ? 0 : space1 + 1);
+		if (space1 == std::string::npos || space2 == std::string::npos)
+			response.status = 400;
+		else
+		{
+			request.method = requestLine.substr(0, space1);
+			std::string target = requestLine.substr(space1 + 1, space2 - space1 - 1);
+			size_t question = target.find('?');
+			request.path = PercentDecode(target.substr(0, question));
+			if (question != std::string::npos)
+				for (auto& [key, value] : ParseFields(target.substr(question + 1), '&'))
+					request.query[PercentDecode(key)] = PercentDecode(value);
+			keepAlive = requestLine.compare(space2 + 1, std::string::npos, "HTTP/1.0") != 0;
+		}
+
+		for (size_t start = lineEnd + 2; start < headEnd; start = lineEnd + 2)
+		{
+			lineEnd = data.find("\r\n", start);
+			const std::string line = data.substr(start, lineEnd - start);
+			const size_t colon = line.find(':');
+			if (colon == std::string::npos)
+				continue;
+			const std::string name = Lower(line.substr(0, colon));
+			std::string value = line.substr(colon + 1);
+			value.erase(0, value.find_first_not_of(" \t"));
+			if (name == "content-length")
+				contentLength = ToNumber(value);
+			else if (name == "transfer-encoding")
+				chunked = Lower(value) != "identity";
+			else if (name == "connection")
+				keepAlive = Lower(value).find("close") == std::string::npos && (keepAlive || Lower(value).find("keep-alive") != std::string::npos);
+		}
+
+		if (response.status == 200 && chunked)
+			response.status = 501;   // the client always sends a length
+		else if (response.status == 200 && (contentLength < 0 || contentLength > (long long)kMaxBodyBytes))
+			response.status = 413;
+
+		if (response.status == 200)
+		{
+			data.erase(0, headEnd + 4);
+			while (data.size() < (size_t)contentLength)
+			{
+				if (!ReadSome(socket, data, stopping_))
+					return;
+			}
+			request.body = data.substr(0, (size_t)contentLength);
+			data.erase(0, (size_t)contentLength);
+			response = Handle(request);
+		}
+		else
+			keepAlive = false;   // where the next request starts is unknown
+
+		std::string out = "HTTP/1.1 " + std::to_string(response.status) + " " + StatusText(response.status) + "\r\n"
+			"Content-Length: " + std::to_string(response.body.size()) + "\r\n" +
+			(keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+		for (const auto& [name, value] : response.headers)
+			out += name + ": " + value + "\r\n";
+		out += "\r\n";
+		out += response.body;
+		if (!WriteAll(socket, out, stopping_))
+			return;
+	}
+}
+
+RemoteStandInServer::Response RemoteStandInServer::Handle(const Request& request)
+{
+	static const std::string prefix = "/v1/analyses";
+	if (request.path == prefix)
+		return request.method == "POST" ? Create(request) : Response{ 404 };
+	if (request.path.compare(0, prefix.size() + 1, prefix + "/") != 0)
+		return Response{ 404 };
+
+	std::string rest = request.path.substr(prefix.size() + 1);
+	const size_t slash = rest.find('/');
+	const std::string id = rest.substr(0, slash);
+	const std::string action = slash == std::string::npos ? "" : rest.substr(slash + 1);
+
+	std::shared_ptr<Job> job;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto found = jobs_.find(id);
+		if (found != jobs_.end())
+			job = found->second;
+	}
+	if (!job)
+		return Response{ 404, "error=no such analysis\n" };
+
+	if (request.method == "PUT" && action == "replay")
+		return Upload(job, request);
+	if (request.method == "GET" && action == "rows")
+		return Rows(job, request);
+	if (request.method == "DELETE" && action.empty())
+		return Delete(job);
+	return Response{ 404 };
+}
+
+static std::string JobFields(const std::string& id, long long received, const std::string& state)
+{
+	return "id=" + id + "\nreceived=" + std::to_string(received) + "\nstate=" + state + "\n";
+}
+
+RemoteStandInServer::Response RemoteStandInServer::Create(const Request& request)
+{
+	auto field = [&](const char* key) {
+		auto found = request.query.find(key);
+		return found == request.query.end() ? std::string() : found->second;
+	};
+	const std::string model = field("model");
+	const std::string replayId = field("replay");
+	const long long size = ToNumber(field("size"));
+
+	// the model name becomes a folder name on this machine
+	if (model.empty() || replayId.empty() || model.find_first_of("/\\:") != std::string::npos || model.find("..") != std::string::npos)
+		return Response{ 400, "error=model and replay are required\n" };
+	if (size <= 0 || size > kMaxReplayBytes)
+		return Response{ 413, "error=bad replay size\n" };
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	PruneLocked();
+
+	// a client that didn't see our answer to its first POST asks again
+	for (const auto& [id, existing] : jobs_)
+	{
+		if (existing->model == model && existing->replayId == replayId && existing->size == size && existing->state != "failed")
+			return Response{ 200, JobFields(id, existing->received, existing->state) };
+	}
+
+	auto job = std::make_shared<Job>();
+	job->id = std::to_string(nextId_++);
+	job->model = model;
+	job->replayId = replayId;
+	job->size = size;
+	job->replayPath = workDir_ / (job->id + ".replay");
+	job->touchedAt = std::chrono::steady_clock::now();
+	std::ofstream(job->replayPath, std::ios::binary | std::ios::trunc);
+	jobs_[job->id] = job;
+	LOG("neuRLcar stand-in: analysis {} of {} with {} ({} bytes)", job->id, replayId, model, size);
+	return Response{ 201, JobFields(job->id, 0, job->state) };
+}
+
+RemoteStandInServer::Response RemoteStandInServer::Upload(const std::shared_ptr<Job>& job, const Request& request)
+{
+	auto found = request.query.find("offset");
+	const long long offset = found == request.query.end() ? -1 : ToNumber(found->second);
+	const bool last = request.query.count("last") != 0;
+
+	long long received;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (job->state != "uploading" || offset != job->received)
+			return Response{ 409, "received=" + std::to_string(job->received) + "\n" };
+		if (job->received + (long long)request.body.size() > job->size ||
+			(last != (job->received + (long long)request.body.size() == job->size)))
+			return Response{ 400, "error=piece does not fit the declared size\n" };
+
+		std::ofstream out(job->replayPath, std::ios::binary | std::ios::app);
+		if (!out.write(request.body.data(), (std::streamsize)request.body.size()))
+			return Response{ 503, "error=cannot store the replay\n" };
+		job->received += (long long)request.body.size();
+		job->touchedAt = std::chrono::steady_clock::now();
+		received = job->received;
+		if (received == job->size)
+			job->state = "queued";
+	}
+
+	if (received == job->size)
+		Spawn([this, job]() { RunJob(job); });
+	return Response{ 200, "received=" + std::to_string(received) + "\n" };
+}
+
+RemoteStandInServer::Response RemoteStandInServer::Rows(const std::shared_ptr<Job>& job, const Request& request)
+{
+	auto field = [&](const char* key, long long fallback) {
+		auto found = request.query.find(key);
+		return found == request.query.end() ? fallback : ToNumber(found->second, fallback);
+	};
+	const long long from = (std::max)(field("from", 0), 0LL);
+	const long long wait = (std::clamp)(field("wait", 0), 0LL, 30LL);
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto finished = [&]() { return job->state == "done" || job->state == "failed"; };
+	changed_.wait_for(lock, std::chrono::seconds(wait), [&]() {
+		return stopping_ || job->cancel || job->rows > from || finished();
+		});
+
+	Response response;
+	response.headers = {
+		{ "X-Analysis-State", job->state },
+		{ "X-Analysis-Progress", std::to_string(job->framesDone) + "/" + std::to_string(job->framesTotal) },
+	};
+	if (!job->error.empty())
+		response.headers.push_back({ "X-Analysis-Error", job->error });
+
+	const int columns = (int)job->columns.size();
+	if (columns == 0 || from > job->rows)
+		return response;
+
+	const int count = (int)(job->rows - from);
+	std::vector<float> rowMajor((size_t)count * columns);
+	for (int r = 0; r < count; ++r)
+		for (int c = 0; c < columns; ++c)
+			rowMajor[(size_t)r * columns + c] = (float)job->columns[c][(size_t)(from + r)];
+
+	// each response is a stream of its own; E (and a known total) only once nothing more will come
+	const bool done = job->state == "done";
+	AppendRowStreamHeader(response.body, columns, done ? count : 0);
+	if (count > 0)
+		AppendRowStreamRows(response.body, rowMajor.data(), count, columns);
+	if (done)
+		AppendRowStreamEnd(response.body, count);
+	return response;
+}
+
+RemoteStandInServer::Response RemoteStandInServer::Delete(const std::shared_ptr<Job>& job)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	job->cancel = true;
+	jobs_.erase(job->id);
+	changed_.notify_all();
+
+	// a running analysis removes its replay when it ends
+	if (job->state != "queued" && job->state != "running")
+	{
+		std::error_code ec;
+		std::filesystem::remove(job->replayPath, ec);
+	}
+	return Response{ 200 };
+}
+
+void RemoteStandInServer::RunJob(std::shared_ptr<Job> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job->state = "running";
+		changed_.notify_all();
+	}
+
+	RowStreamBuffer rows;
+	auto onRows = [&]() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		job->rows += rows.Drain(job->columns);
+		changed_.notify_all();
+	};
+	AnalysisProgressFn onProgress = [&](int done, int total) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		job->framesDone = done;
+		job->framesTotal = total;
+	};
+
+	std::string error;
+	AnalysisOutcome outcome = job->cancel ? AnalysisOutcome::Cancelled :
+		analyze_(job->model, job->replayPath, rows, onRows, onProgress, job->cancel, error);
+	onRows();
+
+	std::error_code ec;
+	std::filesystem::remove(job->replayPath, ec);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	const bool ok = outcome == AnalysisOutcome::Succeeded && !job->columns.empty();
+	job->state = ok ? "done" : "failed";
+	if (!ok)
+		job->error = !error.empty() ? error : outcome == AnalysisOutcome::Succeeded ? "no rows" : ToString(outcome);
+	job->touchedAt = std::chrono::steady_clock::now();
+	changed_.notify_all();
+	LOG("neuRLcar stand-in: analysis {} {}{}", job->id, job->state, job->error.empty() ? "" : " (" + job->error + ")");
+}
+
+void RemoteStandInServer::PruneLocked()
+{
+	const auto now = std::chrono::steady_clock::now();
+	for (auto it = jobs_.begin(); it != jobs_.end();)
+	{
+		const auto& job = *it->second;
+		const bool idle = job.state == "done" || job.state == "failed" || job.state == "uploading";
+		if (idle && now - job.touchedAt > kIdleJobLifetime)
+		{
+			std::error_code ec;
+			if (job.state == "uploading")
+				std::filesystem::remove(job.replayPath, ec);
+			it = jobs_.erase(it);
+		}
+		else
+			++it;
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analysisqueue.h"
+#include "analysisprogress.h"
+#include "netsocket.h"
+#include "rowstream.h"
+
+// Local stand-in for the remote analysis server (protocol in remoteanalysis.h), so offloading
+// can be tried without one. Listens on 127.0.0.1 only and runs analyses through the plugin's own
+// applets. Uploaded replays are kept in workDir until their analysis ends. The API key isn't checked.
+class RemoteStandInServer
+{
+public:
+	// Analyzes a replay with a model, pushing rows into `rows` and calling onRows after each push
+	using AnalyzeFn = std::function<AnalysisOutcome(const std::string& model,
+		const std::filesystem::path& replayPath,
+		RowStreamBuffer& rows,
+		const std::function<void()>& onRows,
+		const AnalysisProgressFn& onProgress,
+		const std::atomic<bool>& cancel,
+		std::string& error)>;
+	// Runs connections and analyses; they block, so on threads that may (blocking pool tasks)
+	using SpawnFn = std::function<void(std::function<void()> task)>;
+
+	RemoteStandInServer(std::filesystem::path workDir, AnalyzeFn analyze, SpawnFn spawn);
+	~RemoteStandInServer();
+
+	RemoteStandInServer(const RemoteStandInServer&) = delete;
+	RemoteStandInServer& operator=(const RemoteStandInServer&) = delete;
+
+	// Port 0 picks a free one
+	bool Start(uint16_t port, std::string& error);
+	uint16_t Port() const { return port_; }
+	std::string Url() const { return "http://127.0.0.1:" + std::to_string(port_); }
+
+	// Cancels running analyses and waits up to grace for connections and analyses to end; false
+	// if some are still busy. Call it again to keep waiting.
+	bool Stop(std::chrono::milliseconds grace);
+
+private:
+	struct Job
+	{
+		std::string id;
+		std::string model;
+		std::string replayId;
+		std::filesystem::path replayPath;
+		long long size = 0;
+		long long received = 0;
+		std::string state = "uploading";   // uploading, queued, running, done, failed
+		std::string error;
+		std::vector<std::vector<double>> columns;   // rows so far, [column][row]
+		long long rows = 0;
+		int framesDone = 0;
+		int framesTotal = 0;
+		std::atomic<bool> cancel{ false };
+		std::chrono::steady_clock::time_point touchedAt{};   // last upload, or when it ended
+	};
+
+	struct Request
+	{
+		std::string method;
+		std::string path;
+		std::map<std::string, std::string> query;   // decoded
+		std::string body;
+	};
+
+	struct Response
+	{
+		Response() = default;
+		Response(int status, std::string body = {}) : status(status), body(std::move(body)) {}
+
+		int status = 200;
+		std::string body;
+		std::vector<std::pair<std::string, std::string>> headers;
+	};
+
+	void AcceptLoop();
+	void ServeConnection(TcpSocket socket);
+	Response Handle(const Request& request);
+	Response Create(const Request& request);
+	Response Upload(const std::shared_ptr<Job>& job, const Request& request);
+	Response Rows(const std::shared_ptr<Job>& job, const Request& request);
+	Response Delete(const std::shared_ptr<Job>& job);
+	void RunJob(std::shared_ptr<Job> job);
+	void PruneLocked();
+	void Spawn(std::function<void()> task);
+
+	std::filesystem::path workDir_;
+	AnalyzeFn analyze_;
+	SpawnFn spawn_;
+
+	TcpSocket listener_;
+	std::thread acceptThread_;
+	uint16_t port_ = 0;
+	std::atomic<bool> stopping_{ false };
+
+	std::mutex mutex_;
+	std::condition_variable changed_;        // a job moved on, or the server is stopping
+	std::map<std::string, std::shared_ptr<Job>> jobs_;
+	int nextId_ = 1;
+	int active_ = 0;                         // spawned connections and analyses still running
+};
@@ -0,0 +1,329 @@
+#include "pch.h"
+#include "threadpool.h"
+
+#include <algorithm>
+
+// the pool and slot of the worker running on this thread, so nested submissions stay local
+static thread_local const ThreadPool* tlsPool = nullptr;
+static thread_local int tlsIndex = -1;
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadPool::ThreadPool(GameThreadPost post, int threads) : post_(std::move(post))
+{
+	for (auto& worker : workers_)
+		worker = std::make_unique<Worker>();
+	statsSince_ = NowNs();
+	SetThreadCount(threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+	Shutdown();
+}
+
+void ThreadPool::SetThreadCount(int threads)
+{
+	if (threads <= 0)
+		threads = (std::max)(2, (int)std::thread::hardware_concurrency() - 2);
+	configured_ = std::clamp(threads, 1, kMaxThreads);
+
+	// extra workers retire once idle
+	EnsureWorkers();
+	WakeAll();
+}
+
+int ThreadPool::Target() const
+{
+	return (std::min)(kMaxThreads, configured_.load() + blocking_.load());
+}
+
+void ThreadPool::EnsureWorkers()
+{
+	std::lock_guard<std::mutex> lock(threadsMutex_);
+	if (stopping_)
+		return;
+
+	const int target = Target();
+	for (int i = 0; i < target; ++i)
+	{
+		Worker& worker = *workers_[i];
+		if (worker.alive)
+			continue;
+		// a retired worker has already left its loop
+		if (worker.thread.joinable())
+			worker.thread.join();
+		worker.alive = true;
+		++alive_;
+		worker.thread = std::thread(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+void ThreadPool::WakeAll()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+	}
+	sleepCv_.notify_all();
+}
+
+void ThreadPool::Post(const char* name, std::function<void()> fn, TaskPriority priority, bool blocking)
+{
+	Push({ name, [name, fn = std::move(fn)](bool run) {
+		if (!run)
+			return;
+		try
+		{
+			fn();
+		}
+		catch (const std::exception& e)
+		{
+			LOG("neuRLcar: pool task '{}' threw: {}", name, e.what());
+		}
+		catch (...)
+		{
+			LOG("neuRLcar: pool task '{}' threw", name);
+		}
+		}, blocking }, priority);
+}
+
+void ThreadPool::Push(Task task, TaskPriority priority)
+{
+	// Shutdown waits for submitters that got past the check, so nothing lands after the drop
+	++submitting_;
+	if (stopping_)
+	{
+		--submitting_;
+		++dropped_;
+		task.fn(false);
+		return;
+	}
+
+	int slot = tlsPool == this ? tlsIndex : (int)(nextQueue_++ % (unsigned)(std::max)(1, configured_.load()));
+	Worker& worker = *workers_[slot];
+	size_t pending = 0;
+	{
+		// counted under the deque's lock so a pop can never run ahead of its push
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.queue[(int)priority].push_back(std::move(task));
+		++worker.size;
+		pending = ++pending_;
+	}
+
+	size_t seen = maxQueued_.load();
+	while (pending > seen && !maxQueued_.compare_exchange_weak(seen, pending)) {}
+	--submitting_;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+	}
+	sleepCv_.notify_one();
+}
+
+bool ThreadPool::PopFront(Worker& worker, int priority, Task& task)
+{
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	auto& queue = worker.queue[priority];
+	if (queue.empty())
+		return false;
+	task = std::move(queue.front());
+	queue.pop_front();
+	--worker.size;
+	--pending_;
+	return true;
+}
+
+bool ThreadPool::PopBack(Worker& worker, int priority, Task& task)
+{
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	auto& queue = worker.queue[priority];
+	if (queue.empty())
+		return false;
+	task = std::move(queue.back());
+	queue.pop_back();
+	--worker.size;
+	--pending_;
+	return true;
+}
+
+bool ThreadPool::TakeTask(int index, Task& task, bool& stolen)
+{
+	for (int priority = 0; priority < 3; ++priority)
+	{
+		if (workers_[index]->size.load() > 0 && PopFront(*workers_[index], priority, task))
+		{
+			stolen = false;
+			return true;
+		}
+		// retired slots are searched too; their leftovers are anyone's
+		for (int k = 1; k < kMaxThreads; ++k)
+		{
+			Worker& victim = *workers_[(index + k) % kMaxThreads];
+			if (victim.size.load() > 0 && PopBack(victim, priority, task))
+			{
+				stolen = true;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void ThreadPool::RunTask(Task& task, bool stolen)
+{
+	++busy_;
+	if (task.blocking)
+	{
+		++blocking_;
+		EnsureWorkers();
+	}
+
+	int64_t start = NowNs();
+	task.fn(true);
+
+	if (task.blocking)
+	{
+		--blocking_;
+		WakeAll();
+	}
+	else
+	{
+		busyNs_ += NowNs() - start;
+	}
+
+	++executed_;
+	if (stolen)
+		++stolen_;
+	--busy_;
+}
+
+void ThreadPool::WorkerLoop(int index)
+{
+	tlsPool = this;
+	tlsIndex = index;
+
+	while (true)
+	{
+		Task task;
+		bool stolen = false;
+		if (!stopping_ && TakeTask(index, task, stolen))
+		{
+			RunTask(task, stolen);
+			continue;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(sleepMutex_);
+			sleepCv_.wait(lock, [&] { return stopping_ || pending_.load() > 0 || index >= Target(); });
+			if (!stopping_ && (pending_.load() > 0 || index < Target()))
+				continue;
+		}
+
+		// decided under threadsMutex_, so a blocking task raising the target either sees this
+		// worker gone and restarts the slot, or keeps it
+		std::lock_guard<std::mutex> lock(threadsMutex_);
+		if (!stopping_ && index < Target())
+			continue;
+		workers_[index]->alive = false;
+		--alive_;
+		exitedCv_.notify_all();
+		return;
+	}
+}
+
+void ThreadPool::DropQueued()
+{
+	for (auto& worker : workers_)
+	{
+		std::deque<Task> dropped;
+		{
+			std::lock_guard<std::mutex> lock(worker->mutex);
+			for (auto& queue : worker->queue)
+			{
+				for (auto& task : queue)
+					dropped.push_back(std::move(task));
+				queue.clear();
+			}
+			pending_ -= dropped.size();
+			worker->size = 0;
+		}
+		dropped_ += dropped.size();
+		for (auto& task : dropped)
+			task.fn(false);
+	}
+}
+
+bool ThreadPool::Shutdown(std::chrono::milliseconds grace)
+{
+	bool first = false;
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex_);
+		if (!shutdown_)
+		{
+			shutdown_ = true;
+			stopping_ = true;
+			first = true;
+		}
+	}
+
+	if (first)
+	{
+		while (submitting_.load() > 0)
+			std::this_thread::yield();
+		WakeAll();
+		DropQueued();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(threadsMutex_);
+		auto allExited = [this] { return alive_ == 0; };
+		if (grace.count() < 0)
+			exitedCv_.wait(lock, allExited);
+		else if (!exitedCv_.wait_for(lock, grace, allExited))
+			return false;
+	}
+
+	for (auto& worker : workers_)
+		if (worker->thread.joinable())
+			worker->thread.join();
+	return true;
+}
+
+ThreadPoolStats ThreadPool::Stats() const
+{
+	ThreadPoolStats stats;
+	stats.configured = configured_;
+	stats.busy = busy_;
+	stats.blocking = blocking_;
+	stats.maxQueued = maxQueued_;
+	stats.executed = executed_;
+	stats.stolen = stolen_;
+	stats.dropped = dropped_;
+
+	for (auto& worker : workers_)
+	{
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		for (int p = 0; p < 3; ++p)
+			stats.queued[p] += worker->queue[p].size();
+		if (worker->alive)
+			++stats.threads;
+	}
+
+	int64_t wallNs = NowNs() - statsSince_;
+	if (wallNs > 0 && stats.configured > 0)
+		stats.utilization = (double)busyNs_ / ((double)wallNs * stats.configured);
+	return stats;
+}
+
+void ThreadPool::ResetStats()
+{
+	executed_ = 0;
+	stolen_ = 0;
+	dropped_ = 0;
+	maxQueued_ = pending_.load();
+	busyNs_ = 0;
+	statsSince_ = NowNs();
+}
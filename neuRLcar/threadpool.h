@@ -0,0 +1,280 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "tickscheduler.h"
+
+// Hands a continuation to the game thread (TickScheduler::Post in the plugin)
+using GameThreadPost = std::function<void(const char* name, std::function<void()> fn)>;
+
+// What PoolFuture::Get throws for a task the pool dropped on shutdown
+class PoolShutdownError : public std::runtime_error
+{
+public:
+	PoolShutdownError() : std::runtime_error("thread pool shut down before the task ran") {}
+};
+
+namespace pooldetail
+{
+	template <typename T>
+	struct FutureState
+	{
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool ready = false;
+		std::optional<T> value;
+		std::exception_ptr error;
+		std::function<void()> continuation;
+
+		void Complete(std::optional<T> result, std::exception_ptr failure)
+		{
+			std::function<void()> next;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				value = std::move(result);
+				error = failure;
+				ready = true;
+				next.swap(continuation);
+			}
+			cv.notify_all();
+			if (next)
+				next();
+		}
+	};
+}
+
+// Result of ThreadPool::Submit. Void tasks produce std::monostate.
+template <typename T>
+class PoolFuture
+{
+public:
+	PoolFuture() = default;
+
+	bool Valid() const { return state_ != nullptr; }
+
+	bool Ready() const
+	{
+		std::lock_guard<std::mutex> lock(state_->mutex);
+		return state_->ready;
+	}
+
+	// Blocks until the task has run and rethrows whatever it threw. Not for the game thread.
+	T& Get() const
+	{
+		std::unique_lock<std::mutex> lock(state_->mutex);
+		state_->cv.wait(lock, [this] { return state_->ready; });
+		if (state_->error)
+			std::rethrow_exception(state_->error);
+		return *state_->value;
+	}
+
+	// onValue(T&) (or onValue() for void tasks) runs on the game thread once the task has
+	// finished and may move the value out. onError(std::exception_ptr) runs there instead when
+	// the task threw or was dropped by shutdown. One continuation per future.
+	template <typename OnValue>
+	void Then(const char* name, OnValue onValue, std::function<void(std::exception_ptr)> onError = {})
+	{
+		auto state = state_;
+		auto post = post_;
+		std::function<void()> schedule = [state, post, name, onValue = std::move(onValue), onError = std::move(onError)]() {
+			post(name, [state, onValue, onError]() mutable {
+				if (state->error)
+				{
+					if (onError)
+						onError(state->error);
+					return;
+				}
+				if constexpr (std::is_invocable_v<OnValue&, T&>)
+					onValue(*state->value);
+				else
+					onValue();
+				});
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (!state->ready)
+			{
+				state->continuation = std::move(schedule);
+				return;
+			}
+		}
+		schedule();
+	}
+
+private:
+	friend class ThreadPool;
+	PoolFuture(std::shared_ptr<pooldetail::FutureState<T>> state, GameThreadPost post)
+		: state_(std::move(state)), post_(std::move(post)) {}
+
+	std::shared_ptr<pooldetail::FutureState<T>> state_;
+	GameThreadPost post_;
+};
+
+struct ThreadPoolStats
+{
+	int threads = 0;                   // running workers, spares included
+	int configured = 0;
+	int busy = 0;
+	int blocking = 0;                  // workers inside a blocking task
+	size_t queued[3] = {};             // by TaskPriority
+	size_t maxQueued = 0;              // high-water mark since the last reset
+	uint64_t executed = 0;
+	uint64_t stolen = 0;               // run by a worker other than the one they were queued on
+	uint64_t dropped = 0;              // discarded by shutdown
+	double utilization = 0.0;          // short-task busy time / (configured threads * wall time)
+};
+
+// Plugin-wide work-stealing pool for everything that shouldn't run on the game thread.
+//
+// Every worker owns one deque per TaskPriority. Tasks submitted from a worker go to its own
+// deque, others are spread round robin. A worker takes from the front of its own deques and,
+// once those are empty, steals from the back of the others', always highest priority first.
+//
+// Blocking tasks (an applet run, a benchmark) park their worker for minutes. While one runs
+// the pool starts a spare worker so short tasks keep the configured number of threads; the
+// spare retires once it is idle and the blocking task is done.
+class ThreadPool
+{
+public:
+	static constexpr int kMaxThreads = 64;
+
+	explicit ThreadPool(GameThreadPost post, int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// 0 = one per core, minus the game and render threads, at least 2
+	void SetThreadCount(int threads);
+	int ThreadCount() const { return configured_.load(); }
+
+	template <typename Fn>
+	auto Submit(const char* name, Fn fn, TaskPriority priority = TaskPriority::Normal)
+	{
+		return SubmitTask(name, std::move(fn), priority, false);
+	}
+
+	template <typename Fn>
+	auto SubmitBlocking(const char* name, Fn fn, TaskPriority priority = TaskPriority::Normal)
+	{
+		return SubmitTask(name, std::move(fn), priority, true);
+	}
+
+	// Fire and forget; an exception is logged. Dropped silently on shutdown.
+	void Post(const char* name, std::function<void()> fn, TaskPriority priority = TaskPriority::Normal, bool blocking = false);
+
+	bool Stopping() const { return stopping_.load(); }
+
+	// Drops queued tasks (their futures fail with PoolShutdownError) and waits up to grace for
+	// running ones; false if some are still busy. Call it again to keep waiting: the pool must
+	// not be destroyed while a task runs.
+	bool Shutdown(std::chrono::milliseconds grace = std::chrono::milliseconds(-1));
+
+	ThreadPoolStats Stats() const;
+	void ResetStats();
+
+private:
+	struct Task
+	{
+		const char* name = "";
+		std::function<void(bool run)> fn;   // run == false: dropped by shutdown
+		bool blocking = false;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> queue[3];
+		std::atomic<int> size{ 0 };
+		std::thread thread;
+		std::atomic<bool> alive{ false };    // written under threadsMutex_
+	};
+
+	template <typename Fn>
+	auto SubmitTask(const char* name, Fn fn, TaskPriority priority, bool blocking)
+	{
+		using R = std::invoke_result_t<Fn&>;
+		using T = std::conditional_t<std::is_void_v<R>, std::monostate, R>;
+
+		auto state = std::make_shared<pooldetail::FutureState<T>>();
+		Push({ name, [state, fn = std::move(fn)](bool run) mutable {
+			if (!run)
+			{
+				state->Complete(std::nullopt, std::make_exception_ptr(PoolShutdownError()));
+				return;
+			}
+			std::optional<T> result;
+			std::exception_ptr error;
+			try
+			{
+				if constexpr (std::is_void_v<R>)
+				{
+					fn();
+					result.emplace();
+				}
+				else
+				{
+					result.emplace(fn());
+				}
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			state->Complete(std::move(result), error);
+			}, blocking }, priority);
+		return PoolFuture<T>(state, post_);
+	}
+
+	void Push(Task task, TaskPriority priority);
+	bool TakeTask(int index, Task& task, bool& stolen);
+	bool PopFront(Worker& worker, int priority, Task& task);
+	bool PopBack(Worker& worker, int priority, Task& task);
+	void RunTask(Task& task, bool stolen);
+	void WorkerLoop(int index);
+	void EnsureWorkers();
+	void WakeAll();
+	void DropQueued();
+	int Target() const;
+
+	GameThreadPost post_;
+	std::unique_ptr<Worker> workers_[kMaxThreads];
+
+	std::atomic<int> configured_{ 0 };
+	std::atomic<int> blocking_{ 0 };
+	std::atomic<int> busy_{ 0 };
+	std::atomic<size_t> pending_{ 0 };
+	std::atomic<unsigned> nextQueue_{ 0 };
+	std::atomic<int> submitting_{ 0 };
+	std::atomic<bool> stopping_{ false };
+
+	std::mutex sleepMutex_;
+	std::condition_variable sleepCv_;
+
+	std::mutex threadsMutex_;
+	std::condition_variable exitedCv_;
+	int alive_ = 0;                          // threadsMutex_
+	bool shutdown_ = false;
+
+	std::atomic<uint64_t> executed_{ 0 };
+	std::atomic<uint64_t> stolen_{ 0 };
+	std::atomic<uint64_t> dropped_{ 0 };
+	std::atomic<size_t> maxQueued_{ 0 };
+	std::atomic<int64_t> busyNs_{ 0 };
+	std::atomic<int64_t> statsSince_{ 0 };
+};
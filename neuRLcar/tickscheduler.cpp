@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "tickscheduler.h"
+
+TickScheduler::TickScheduler(Clock clock) : clock_(std::move(clock))
+{
+}
+
+std::int64_t TickScheduler::SteadyClockNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TickScheduler::PostSliced(std::string name, Task task, TaskPriority priority)
+{
+	std::lock_guard<std::mutex> lock(inboxMutex_);
+	inbox_.push_back(Entry{ std::move(name), std::move(task), priority });
+}
+
+void TickScheduler::Post(std::string name, std::function<void()> fn, TaskPriority priority)
+{
+	PostSliced(std::move(name), Task([fn = std::move(fn)]() { fn(); return TaskStatus::Done; }), priority);
+}
+
+int TickScheduler::RunTick()
+{
+	{
+		std::lock_guard<std::mutex> lock(inboxMutex_);
+		for (auto& e : inbox_)
+			queues_[(int)e.priority].push_back(std::move(e));
+		inbox_.clear();
+	}
+
+	const std::int64_t start = clock_();
+	int slices = 0;
+
+	// last tick's deferred slices, oldest first; the first of them always runs. They rejoin
+	// their priority after this tick, having had their slice.
+	std::vector<Entry> resumed;
+	size_t overdue = overdue_.size();
+	for (size_t i = 0; i < overdue; ++i)
+	{
+		Entry entry = std::move(overdue_.front());
+		overdue_.pop_front();
+
+		if (!Fits(entry, start, slices))
+		{
+			++tickStats_.deferredSlices;
+			overdue_.push_back(std::move(entry));
+			continue;
+		}
+		if (RunSlice(entry) == TaskStatus::Yield)
+			resumed.push_back(std::move(entry));
+		++slices;
+	}
+
+	for (int p = 0; p < 3; ++p)
+	{
+		auto& queue = queues_[p];
+
+		// each entry is looked at once per tick; yielded work goes to the back for the next tick
+		size_t count = queue.size();
+		for (size_t i = 0; i < count; ++i)
+		{
+			Entry entry = std::move(queue.front());
+			queue.pop_front();
+
+			if (!Fits(entry, start, slices))
+			{
+				++tickStats_.deferredSlices;
+				overdue_.push_back(std::move(entry));
+				continue;
+			}
+			if (RunSlice(entry) == TaskStatus::Yield)
+				queue.push_back(std::move(entry));
+			++slices;
+		}
+	}
+
+	for (auto& entry : resumed)
+		queues_[(int)entry.priority].push_back(std::move(entry));
+
+	++tickStats_.ticks;
+	if (clock_() - start > budgetNs_)
+		++tickStats_.overBudgetTicks;
+
+	return slices;
+}
+
+bool TickScheduler::Fits(const Entry& entry, std::int64_t start, int slices) const
+{
+	const std::int64_t elapsed = clock_() - start;
+	return slices == 0 || (double)elapsed + EstimateNs(entry.name) <= (double)budgetNs_;
+}
+
+TaskStatus TickScheduler::RunSlice(Entry& entry)
+{
+	const std::int64_t t0 = clock_();
+	TaskStatus status = entry.task ? entry.task() : TaskStatus::Done;
+	Record(entry.name, clock_() - t0);
+	return status;
+}
+
+void TickScheduler::Clear()
+{
+	{
+		std::lock_guard<std::mutex> lock(inboxMutex_);
+		inbox_.clear();
+	}
+	overdue_.clear();
+	for (auto& q : queues_)
+		q.clear();
+}
+
+size_t TickScheduler::Pending() const
+{
+	size_t n = 0;
+	{
+		std::lock_guard<std::mutex> lock(inboxMutex_);
+		n += inbox_.size();
+	}
+	n += overdue_.size();
+	for (auto& q : queues_)
+		n += q.size();
+	return n;
+}
+
+std::vector<TickScheduler::TaskStats> TickScheduler::Stats() const
+{
+	std::vector<TaskStats> out;
+	out.reserve(stats_.size());
+	for (auto& [name, s] : stats_)
+		out.push_back(s);
+	return out;
+}
+
+// Unknown tasks are assumed free until their first slice has been measured
+double TickScheduler::EstimateNs(const std::string& name) const
+{
+	auto it = stats_.find(name);
+	return it == stats_.end() ? 0.0 : it->second.avgNs;
+}
+
+void TickScheduler::Record(const std::string& name, std::int64_t ns)
+{
+	TaskStats& s = stats_[name];
+	if (s.slices == 0)
+	{
+		s.name = name;
+		s.avgNs = (double)ns;
+	}
+	else
+	{
+		s.avgNs += 0.25 * ((double)ns - s.avgNs);
+	}
+	if (ns > s.maxNs) s.maxNs = ns;
+	++s.slices;
+}
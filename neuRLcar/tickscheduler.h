@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class TaskPriority
+{
+	High,
+	Normal,
+	Low,
+};
+
+enum class TaskStatus
+{
+	Done,
+	Yield, // more work left, run another slice on a later tick
+};
+
+// Game-thread task queue with a per-tick time budget.
+//
+// Post()/PostSliced() may be called from any thread; tasks only ever run inside RunTick() on the game
+// thread. Each tick gives every queued task at most one slice, in priority order, as long as
+// the task's measured cost still fits the remaining budget. The first slice of a tick always
+// runs, which means a single slice should be cheaper than the budget; long jobs return
+// TaskStatus::Yield and are resumed on later ticks. A slice that didn't fit goes ahead of every
+// priority on the next tick, so cheaper or higher-priority work can't starve it.
+//
+// The clock is injectable so the budgeting logic does not depend on real time.
+class TickScheduler
+{
+public:
+	using Clock = std::function<std::int64_t()>; // monotonic nanoseconds
+	using Task = std::function<TaskStatus()>;
+
+	struct TaskStats
+	{
+		std::string name;
+		long long slices = 0;
+		double avgNs = 0.0;      // exponential moving average of one slice
+		long long maxNs = 0;
+	};
+
+	struct TickStats
+	{
+		long long ticks = 0;
+		long long overBudgetTicks = 0;
+		long long deferredSlices = 0; // slices pushed to a later tick because they would not fit
+	};
+
+	explicit TickScheduler(Clock clock = SteadyClockNs);
+
+	void SetBudget(std::chrono::nanoseconds budget) { budgetNs_ = budget.count(); }
+	std::int64_t BudgetNs() const { return budgetNs_; }
+
+	void Post(std::string name, std::function<void()> fn, TaskPriority priority = TaskPriority::Normal);
+	void PostSliced(std::string name, Task task, TaskPriority priority = TaskPriority::Normal);
+
+	// Runs queued slices within the budget; returns the number of slices run
+	int RunTick();
+
+	void Clear();
+	size_t Pending() const;
+	std::vector<TaskStats> Stats() const;
+	TickStats GetTickStats() const { return tickStats_; }
+
+	static std::int64_t SteadyClockNs();
+
+private:
+	struct Entry
+	{
+		std::string name;
+		Task task;
+		TaskPriority priority = TaskPriority::Normal;
+	};
+
+	bool Fits(const Entry& entry, std::int64_t start, int slices) const;
+	TaskStatus RunSlice(Entry& entry);
+	double EstimateNs(const std::string& name) const;
+	void Record(const std::string& name, std::int64_t ns);
+
+	Clock clock_;
+	std::int64_t budgetNs_ = 500 * 1000;
+
+	mutable std::mutex inboxMutex_;
+	std::vector<Entry> inbox_;
+
+	// game thread only
+	std::deque<Entry> overdue_; // deferred for lack of budget, run first on the next tick
+	std::deque<Entry> queues_[3];
+	std::unordered_map<std::string, TaskStats> stats_;
+	TickStats tickStats_;
+};
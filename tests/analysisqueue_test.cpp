@@ -0,0 +1,225 @@
+// AnalysisQueue with plain threads for workers and run functions standing in for the applets
+#include "pch.h"
+#include "analysisqueue.h"
+#include "check.h"
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Spawns worker loops on threads that are joined once the queue is gone
+struct Workers
+{
+	std::mutex mutex;
+	std::vector<std::thread> threads;
+
+	AnalysisQueue::SpawnFn Fn()
+	{
+		return [this](std::function<void()> loop) {
+			std::lock_guard<std::mutex> lock(mutex);
+			threads.emplace_back(std::move(loop));
+		};
+	}
+
+	~Workers()
+	{
+		for (auto& thread : threads)
+			thread.join();
+	}
+};
+
+// Outcomes passed to the done callback, by job key
+struct Outcomes
+{
+	std::mutex mutex;
+	std::map<std::string, AnalysisOutcome> byKey;
+
+	AnalysisQueue::DoneFn Fn()
+	{
+		return [this](const AnalysisJob& job, AnalysisOutcome outcome) {
+			std::lock_guard<std::mutex> lock(mutex);
+			byKey[job.Key()] = outcome;
+		};
+	}
+
+	size_t Count()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return byKey.size();
+	}
+
+	bool Has(const std::string& key, AnalysisOutcome outcome)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byKey.find(key);
+		return it != byKey.end() && it->second == outcome;
+	}
+};
+
+static AnalysisJob Job(const std::string& replayId)
+{
+	AnalysisJob job;
+	job.model = "stub";
+	job.replayId = replayId;
+	return job;
+}
+
+// Until count jobs have reported, or 5 s
+static void WaitReported(Outcomes& outcomes, size_t count)
+{
+	auto deadline = std::chrono::steady_clock::now() + 5s;
+	while (outcomes.Count() < count && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(5ms);
+}
+
+static void RunsJobsAndReportsOutcomes()
+{
+	Workers workers;
+	Outcomes outcomes;
+	AnalysisQueue queue([](const AnalysisJob& job, const std::atomic<bool>&) {
+		return job.replayId == "bad" ? AnalysisOutcome::Failed : AnalysisOutcome::Succeeded;
+		}, outcomes.Fn(), workers.Fn());
+
+	CHECK(queue.Enqueue(Job("a")));
+	CHECK(queue.Enqueue(Job("bad")));
+	WaitReported(outcomes, 2);
+
+	CHECK(outcomes.Has("stub/a", AnalysisOutcome::Succeeded));
+	CHECK(outcomes.Has("stub/bad", AnalysisOutcome::Failed));
+	CHECK(queue.Shutdown(5s));
+}
+
+// A run that threw used to leave its key running and its worker counted forever
+static void ThrowingRunFailsTheJob()
+{
+	Workers workers;
+	Outcomes outcomes;
+	AnalysisQueue queue([](const AnalysisJob& job, const std::atomic<bool>&) {
+		if (job.replayId == "throws")
+			throw std::runtime_error("bad row");
+		return AnalysisOutcome::Succeeded;
+		}, outcomes.Fn(), workers.Fn());
+
+	CHECK(queue.Enqueue(Job("throws")));
+	CHECK(queue.Enqueue(Job("next")));
+	WaitReported(outcomes, 2);
+
+	CHECK(outcomes.Has("stub/throws", AnalysisOutcome::Failed));
+	CHECK(outcomes.Has("stub/next", AnalysisOutcome::Succeeded));
+	CHECK(!queue.Contains("stub/throws"));
+
+	// the key can be queued again
+	CHECK(queue.Enqueue(Job("throws")));
+	CHECK(queue.Shutdown(5s));
+}
+
+static void ShutdownCancelsRunningJobs()
+{
+	Workers workers;
+	Outcomes outcomes;
+	std::atomic<bool> started{ false };
+	AnalysisQueue queue([&](const AnalysisJob&, const std::atomic<bool>& cancel) {
+		started = true;
+		while (!cancel)
+			std::this_thread::sleep_for(5ms);
+		return AnalysisOutcome::Failed;
+		}, outcomes.Fn(), workers.Fn());
+
+	CHECK(queue.Enqueue(Job("long")));
+	CHECK(queue.Enqueue(Job("queued")));
+	while (!started)
+		std::this_thread::sleep_for(5ms);
+
+	CHECK(queue.Shutdown(5s));
+	CHECK(outcomes.Has("stub/long", AnalysisOutcome::Cancelled));
+	CHECK(outcomes.Has("stub/queued", AnalysisOutcome::Cancelled));
+	CHECK(!queue.Enqueue(Job("late")));
+}
+
+// A worker slower than the grace period is waited for by the next call, not abandoned
+static void ShutdownCanKeepWaiting()
+{
+	Workers workers;
+	Outcomes outcomes;
+	std::atomic<bool> started{ false };
+	AnalysisQueue queue([&](const AnalysisJob&, const std::atomic<bool>& cancel) {
+		started = true;
+		while (!cancel)
+			std::this_thread::sleep_for(5ms);
+		std::this_thread::sleep_for(300ms);   // slow to notice
+		return AnalysisOutcome::Cancelled;
+		}, outcomes.Fn(), workers.Fn());
+
+	CHECK(queue.Enqueue(Job("slow")));
+	while (!started)
+		std::this_thread::sleep_for(5ms);
+
+	CHECK(!queue.Shutdown(20ms));
+	CHECK(queue.Shutdown());
+	CHECK(outcomes.Has("stub/slow", AnalysisOutcome::Cancelled));
+}
+
+// An owner that gives up on a worker leaks the queue; the worker must not report into it
+static void AbandonStopsReporting()
+{
+	Workers workers;
+	Outcomes outcomes;
+	std::atomic<bool> started{ false };
+	AnalysisQueue queue([&](const AnalysisJob&, const std::atomic<bool>& cancel) {
+		started = true;
+		while (!cancel)
+			std::this_thread::sleep_for(5ms);
+		std::this_thread::sleep_for(100ms);
+		return AnalysisOutcome::Cancelled;
+		}, outcomes.Fn(), workers.Fn());
+
+	CHECK(queue.Enqueue(Job("stuck")));
+	while (!started)
+		std::this_thread::sleep_for(5ms);
+
+	CHECK(!queue.Shutdown(10ms));
+	queue.Abandon();
+	CHECK(queue.Shutdown(5s));
+	CHECK(outcomes.Count() == 0);
+}
+
+// The journal relies on a finished job being gone from the queue before done_ runs
+static void DoneRunsAfterTheJobLeftTheQueue()
+{
+	Workers workers;
+	std::atomic<bool> containedInDone{ true };
+	std::atomic<bool> reported{ false };
+	AnalysisQueue* self = nullptr;
+	AnalysisQueue queue([](const AnalysisJob&, const std::atomic<bool>&) {
+		return AnalysisOutcome::Succeeded;
+		},
+		[&](const AnalysisJob& job, AnalysisOutcome) {
+			containedInDone = self->Contains(job.Key());
+			reported = true;
+		}, workers.Fn());
+	self = &queue;
+
+	CHECK(queue.Enqueue(Job("a")));
+	auto deadline = std::chrono::steady_clock::now() + 5s;
+	while (!reported && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(5ms);
+	CHECK(reported);
+	CHECK(!containedInDone);
+	CHECK(queue.Shutdown(5s));
+}
+
+int main()
+{
+	RUN_TEST(RunsJobsAndReportsOutcomes);
+	RUN_TEST(ThrowingRunFailsTheJob);
+	RUN_TEST(ShutdownCancelsRunningJobs);
+	RUN_TEST(ShutdownCanKeepWaiting);
+	RUN_TEST(DoneRunsAfterTheJobLeftTheQueue);
+	RUN_TEST(AbandonStopsReporting);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+// AppletServerClient and AppletServerPool against stub_applet, a scripted `--serve` stand-in
+#include "pch.h"
+#include "appletserver.h"
+#include "check.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+static std::filesystem::path workDir;
+
+static std::filesystem::path LogPath() { return workDir / "launches.log"; }
+
+static int Launches()
+{
+	std::ifstream log(LogPath());
+	int n = 0;
+	std::string line;
+	while (std::getline(log, line))
+		++n;
+	return n;
+}
+
+static void ResetLaunches()
+{
+	std::error_code ec;
+	std::filesystem::remove(LogPath(), ec);
+}
+
+static std::string Replay(const std::string& name) { return (workDir / name).string(); }
+static std::string Output(const std::string& name) { return (workDir / (name + ".csv")).string(); }
+
+static void AnalyzesAndStaysWarm()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	int lastDone = 0, lastTotal = 0;
+	std::string error;
+	AnalysisOutcome outcome = client.Analyze(Replay("a.replay"), Output("a"), 5s, error,
+		[&](int done, int total) { lastDone = done; lastTotal = total; });
+	CHECK(outcome == AnalysisOutcome::Succeeded);
+	CHECK(std::filesystem::exists(Output("a")));
+	CHECK(lastDone == 100 && lastTotal == 100);
+
+	// the second analysis reuses the running server
+	CHECK(client.Analyze(Replay("b.replay"), Output("b"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(Launches() == 1);
+	CHECK(client.Running());
+
+	client.Stop();
+	CHECK(!client.Running());
+}
+
+static void PingsARunningServer()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	// nothing to answer before the first request starts it
+	CHECK(!client.Ping(200ms));
+
+	std::string error;
+	CHECK(client.Analyze(Replay("a.replay"), Output("a"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(client.Ping(2s));
+	CHECK(Launches() == 1);
+}
+
+static void ErrorReplyIsNotRetried()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	std::string error;
+	CHECK(client.Analyze(Replay("error.replay"), Output("error"), 5s, error) == AnalysisOutcome::Failed);
+	CHECK(error == "bad replay");
+	CHECK(client.Running());
+	CHECK(Launches() == 1);
+}
+
+static void RestartsAfterACrash()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	std::string error;
+	CHECK(client.Analyze(Replay("crash-once.replay"), Output("crash-once"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(Launches() == 2);
+}
+
+static void RetriesOnlyOnce()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	std::string error;
+	CHECK(client.Analyze(Replay("crash.replay"), Output("crash"), 5s, error) == AnalysisOutcome::Failed);
+	CHECK(Launches() == 2);
+}
+
+static void TimeoutStopsTheServer()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	std::string error;
+	CHECK(client.Analyze(Replay("hang.replay"), Output("hang"), 300ms, error) == AnalysisOutcome::TimedOut);
+	CHECK(!client.Running());
+	CHECK(Launches() == 1);
+}
+
+static void CancelStopsTheServer()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+
+	std::atomic<bool> cancel{ false };
+	std::thread canceller([&]() {
+		std::this_thread::sleep_for(200ms);
+		cancel = true;
+	});
+
+	std::string error;
+	CHECK(client.Analyze(Replay("hang.replay"), Output("hang"), 10s, error, {}, &cancel) == AnalysisOutcome::Cancelled);
+	canceller.join();
+	CHECK(!client.Running());
+}
+
+static void HealthCheckRestartsAnUnresponsiveServer()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+	client.SetHealthCheck(50ms, 300ms);
+
+	// the server keeps running but stops answering PING
+	std::string error;
+	CHECK(client.Analyze(Replay("mute.replay"), Output("mute"), 5s, error) == AnalysisOutcome::Succeeded);
+	std::this_thread::sleep_for(100ms);
+
+	CHECK(client.Analyze(Replay("a.replay"), Output("a"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(Launches() == 2);
+}
+
+static void HealthyServerIsKeptAfterIdle()
+{
+	ResetLaunches();
+	AppletServerClient client(STUB_APPLET_PATH, "stub");
+	client.SetHealthCheck(50ms, 2s);
+
+	std::string error;
+	CHECK(client.Analyze(Replay("a.replay"), Output("a"), 5s, error) == AnalysisOutcome::Succeeded);
+	std::this_thread::sleep_for(100ms);
+
+	CHECK(client.Analyze(Replay("b.replay"), Output("b"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(Launches() == 1);
+}
+
+static void JanitorStopsIdleServers()
+{
+	ResetLaunches();
+	AppletServerPool pool;
+	pool.SetIdleLimit(100ms);
+
+	auto client = pool.Get("stub", STUB_APPLET_PATH);
+	CHECK(pool.Get("stub", STUB_APPLET_PATH) == client);
+
+	std::string error;
+	CHECK(client->Analyze(Replay("a.replay"), Output("a"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(pool.RunningCount() == 1);
+
+	auto deadline = std::chrono::steady_clock::now() + 3s;
+	while (pool.RunningCount() > 0 && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(20ms);
+	CHECK(pool.RunningCount() == 0);
+
+	// another request starts it again
+	CHECK(client->Analyze(Replay("b.replay"), Output("b"), 5s, error) == AnalysisOutcome::Succeeded);
+	CHECK(Launches() == 2);
+	pool.StopAll();
+}
+
+int main()
+{
+#ifdef _WIN32
+	workDir = std::filesystem::temp_directory_path() / "appletserver_test";
+#else
+	workDir = std::filesystem::temp_directory_path() / ("appletserver_test_" + std::to_string(getpid()));
+#endif
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir);
+#ifdef _WIN32
+	_putenv_s("STUB_APPLET_LOG", LogPath().string().c_str());
+#else
+	setenv("STUB_APPLET_LOG", LogPath().c_str(), 1);
+#endif
+
+	RUN_TEST(AnalyzesAndStaysWarm);
+	RUN_TEST(PingsARunningServer);
+	RUN_TEST(ErrorReplyIsNotRetried);
+	RUN_TEST(RestartsAfterACrash);
+	RUN_TEST(RetriesOnlyOnce);
+	RUN_TEST(TimeoutStopsTheServer);
+	RUN_TEST(CancelStopsTheServer);
+	RUN_TEST(HealthCheckRestartsAnUnresponsiveServer);
+	RUN_TEST(HealthyServerIsKeptAfterIdle);
+	RUN_TEST(JanitorStopsIdleServers);
+
+	std::filesystem::remove_all(workDir);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+// Minimal assertions for the headless tests: a failed CHECK reports and the test exits non-zero
+#include <cstdio>
+
+inline int& CheckFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+			++CheckFailures(); \
+		} \
+	} while (0)
+
+#define RUN_TEST(fn) \
+	do { \
+		int before = CheckFailures(); \
+		fn(); \
+		std::fprintf(stderr, "%s %s\n", CheckFailures() == before ? "ok  " : "FAIL", #fn); \
+	} while (0)
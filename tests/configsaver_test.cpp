@@ -0,0 +1,125 @@
+// ConfigSaver coalescing against a fake clock; the write function only counts
+#include "pch.h"
+#include "configsaver.h"
+#include "check.h"
+
+using namespace std::chrono_literals;
+
+struct FakeClock
+{
+	std::int64_t now = 0;
+	TickScheduler::Clock Fn() { return [this]() { return now; }; }
+	void Advance(std::chrono::nanoseconds by) { now += by.count(); }
+};
+
+static void WritesAfterTheQuietPeriod()
+{
+	FakeClock clock;
+	int writes = 0;
+	ConfigSaver saver([&]() { ++writes; }, clock.Fn());
+	saver.SetQuietPeriod(2s);
+
+	CHECK(!saver.Poll());   // nothing pending
+	saver.MarkDirty();
+	clock.Advance(1s);
+	saver.MarkDirty();
+	clock.Advance(1500ms);   // 2.5 s since the first change, 1.5 s since the last
+	CHECK(!saver.Poll());
+	CHECK(writes == 0);
+
+	clock.Advance(500ms);
+	CHECK(saver.Poll());
+	CHECK(writes == 1);
+	CHECK(!saver.Dirty());
+	CHECK(!saver.Poll());
+	CHECK(writes == 1);
+}
+
+// A slider being dragged never goes quiet; it is saved every maxDelay anyway
+static void WritesAfterTheMaxDelayWhileChangesKeepComing()
+{
+	FakeClock clock;
+	int writes = 0;
+	ConfigSaver saver([&]() { ++writes; }, clock.Fn());
+	saver.SetQuietPeriod(2s);
+	saver.SetMaxDelay(10s);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		saver.MarkDirty();
+		clock.Advance(100ms);
+		saver.Poll();
+	}
+	CHECK(writes == 1);   // at 10 s, not before
+
+	for (int i = 0; i < 100; ++i)
+	{
+		saver.MarkDirty();
+		clock.Advance(100ms);
+		saver.Poll();
+	}
+	CHECK(writes == 2);
+}
+
+static void FlushWritesOnlyWhatIsPending()
+{
+	FakeClock clock;
+	int writes = 0;
+	ConfigSaver saver([&]() { ++writes; }, clock.Fn());
+
+	CHECK(!saver.Flush());
+	saver.MarkDirty();
+	CHECK(saver.Flush());   // inside the quiet period
+	CHECK(writes == 1);
+	CHECK(!saver.Flush());
+	CHECK(writes == 1);
+}
+
+// A change made from inside the write is not lost
+static void ChangeDuringTheWriteIsSavedNext()
+{
+	FakeClock clock;
+	int writes = 0;
+	ConfigSaver* self = nullptr;
+	ConfigSaver saver([&]() {
+		if (++writes == 1)
+			self->MarkDirty();
+		}, clock.Fn());
+	self = &saver;
+
+	saver.MarkDirty();
+	CHECK(saver.Flush());
+	CHECK(saver.Dirty());
+	CHECK(saver.Flush());
+	CHECK(writes == 2);
+}
+
+static void CountsAvoidedWrites()
+{
+	FakeClock clock;
+	ConfigSaver saver([]() {}, clock.Fn());
+	saver.SetQuietPeriod(1s);
+
+	for (int i = 0; i < 25; ++i)
+		saver.MarkDirty();
+	clock.Advance(1s);
+	CHECK(saver.Poll());
+	for (int i = 0; i < 5; ++i)
+		saver.MarkDirty();
+	CHECK(saver.Flush());
+
+	auto stats = saver.GetStats();
+	CHECK(stats.requests == 30);
+	CHECK(stats.writes == 2);
+	CHECK(stats.Avoided() == 28);
+}
+
+int main()
+{
+	RUN_TEST(WritesAfterTheQuietPeriod);
+	RUN_TEST(WritesAfterTheMaxDelayWhileChangesKeepComing);
+	RUN_TEST(FlushWritesOnlyWhatIsPending);
+	RUN_TEST(ChangeDuringTheWriteIsSavedNext);
+	RUN_TEST(CountsAvoidedWrites);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+// FileWatchService on scratch directories: the platform backend for settling, filtering,
+// coalescing and unwatching, and a scripted backend to drop events on demand
+#include "pch.h"
+#include "filewatcher.h"
+#include "check.h"
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+static std::vector<std::filesystem::path> scratchDirs;
+
+static std::filesystem::path ScratchDir(const std::string& name)
+{
+#ifdef _WIN32
+	auto dir = std::filesystem::temp_directory_path() / ("filewatcher_test_" + name);
+#else
+	auto dir = std::filesystem::temp_directory_path() / ("filewatcher_test_" + std::to_string(getpid()) + "_" + name);
+#endif
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+	std::filesystem::create_directories(dir);
+	scratchDirs.push_back(dir);
+	return dir;
+}
+
+static void Append(const std::filesystem::path& file, const std::string& text)
+{
+	std::ofstream(file, std::ios::binary | std::ios::app) << text;
+}
+
+// Callbacks seen on the watching thread
+struct Reports
+{
+	std::mutex mutex;
+	std::vector<std::filesystem::path> settled;
+	std::vector<std::chrono::steady_clock::time_point> at;
+	int changes = 0;
+
+	FileWatchService::SettledFn SettledFn()
+	{
+		return [this](const std::filesystem::path& file) {
+			std::lock_guard<std::mutex> lock(mutex);
+			settled.push_back(file);
+			at.push_back(std::chrono::steady_clock::now());
+		};
+	}
+
+	FileWatchService::ChangedFn ChangedFn()
+	{
+		return [this]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			++changes;
+		};
+	}
+
+	size_t Settled()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return settled.size();
+	}
+
+	int Changes()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return changes;
+	}
+};
+
+// Until done() or 5 s
+template <typename Fn>
+static void WaitFor(Fn&& done)
+{
+	auto deadline = std::chrono::steady_clock::now() + 5s;
+	while (!done() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(10ms);
+}
+
+// Watch requests are applied on the watching thread; this gives it time to
+static void WaitUntilWatching(FileWatchService& service, size_t count)
+{
+	WaitFor([&] { return service.Watching() == count; });
+}
+
+// The game writes a replay over a while; it is picked up once, after it stopped growing
+static void GrowingFileSettlesOnce()
+{
+	auto dir = ScratchDir("growing");
+	Reports reports;
+	FileWatchService service;
+	std::string error;
+	CHECK(service.Start(error));
+	service.Watch(dir, { ".replay" }, 400ms, reports.SettledFn());
+	WaitUntilWatching(service, 1);
+
+	const auto file = dir / "match.replay";
+	std::chrono::steady_clock::time_point lastWrite;
+	for (int i = 0; i < 8; ++i)
+	{
+		Append(file, std::string(4096, 'x'));
+		lastWrite = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(100ms);
+	}
+	CHECK(reports.Settled() == 0);   // still being written
+
+	WaitFor([&] { return reports.Settled() > 0; });
+	std::this_thread::sleep_for(800ms);   // and nothing more comes
+
+	std::lock_guard<std::mutex> lock(reports.mutex);
+	CHECK(reports.settled.size() == 1);
+	CHECK(!reports.settled.empty() && reports.settled[0] == file);
+	CHECK(!reports.at.empty() && reports.at[0] - lastWrite >= 400ms);
+}
+
+static void OnlyWatchedExtensionsAreReported()
+{
+	auto dir = ScratchDir("extensions");
+	Reports reports;
+	FileWatchService service;
+	std::string error;
+	CHECK(service.Start(error));
+	service.Watch(dir, { ".replay", ".csv" }, 100ms, reports.SettledFn());
+	WaitUntilWatching(service, 1);
+
+	Append(dir / "notes.txt", "x");
+	Append(dir / "a.replay", "x");
+	Append(dir / "a.replay.tmp", "x");
+	Append(dir / "a.csv", "x");
+
+	WaitFor([&] { return reports.Settled() >= 2; });
+	std::this_thread::sleep_for(400ms);
+
+	std::lock_guard<std::mutex> lock(reports.mutex);
+	CHECK(reports.settled.size() == 2);
+	for (const auto& file : reports.settled)
+		CHECK(file.extension() == ".replay" || file.extension() == ".csv");
+}
+
+// A burst of changes is one report once the directory has been quiet for the settle time
+static void ChangesAreCoalesced()
+{
+	auto dir = ScratchDir("changes");
+	Reports reports;
+	FileWatchService service;
+	std::string error;
+	CHECK(service.Start(error));
+	service.WatchChanges(dir, 300ms, reports.ChangedFn());
+	WaitUntilWatching(service, 1);
+
+	for (int i = 0; i < 20; ++i)
+	{
+		Append(dir / ("file" + std::to_string(i % 4)), "x");
+		std::this_thread::sleep_for(10ms);
+	}
+	std::filesystem::create_directory(dir / "sub");
+	std::filesystem::remove(dir / "file0");
+
+	WaitFor([&] { return reports.Changes() > 0; });
+	std::this_thread::sleep_for(700ms);
+	CHECK(reports.Changes() == 1);
+
+	// a later change is reported again
+	Append(dir / "file9", "x");
+	WaitFor([&] { return reports.Changes() > 1; });
+	CHECK(reports.Changes() == 2);
+}
+
+static void UnwatchStopsCallbacks()
+{
+	auto dir = ScratchDir("unwatch");
+	Reports reports;
+	FileWatchService service;
+	std::string error;
+	CHECK(service.Start(error));
+	service.Watch(dir, { ".replay" }, 100ms, reports.SettledFn());
+	WaitUntilWatching(service, 1);
+
+	// one still settling when the watch goes is dropped with it
+	Append(dir / "settling.replay", "x");
+	service.Unwatch(dir);
+	WaitUntilWatching(service, 0);
+	Append(dir / "after.replay", "x");
+
+	std::this_thread::sleep_for(800ms);
+	CHECK(reports.Settled() == 0);
+	CHECK(service.Watching() == 0);
+}
+
+// Stands in for a platform backend: the only events are the dropped ones the test asks for
+class ScriptedBackend : public DirectoryWatchBackend
+{
+public:
+	bool Add(const std::filesystem::path&, std::string&) override { return true; }
+	void Remove(const std::filesystem::path&) override {}
+
+	bool Wait(std::chrono::milliseconds timeout, std::vector<std::filesystem::path>&,
+		std::vector<std::filesystem::path>& overflowed, std::string&) override
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait_for(lock, timeout, [this] { return woken_ || !overflowed_.empty(); });
+		woken_ = false;
+		overflowed.insert(overflowed.end(), overflowed_.begin(), overflowed_.end());
+		overflowed_.clear();
+		return true;
+	}
+
+	void Wake() override
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		woken_ = true;
+		cv_.notify_all();
+	}
+
+	void Overflow(const std::filesystem::path& dir)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		overflowed_.push_back(dir);
+		cv_.notify_all();
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::vector<std::filesystem::path> overflowed_;
+	bool woken_ = false;
+};
+
+// Events the platform dropped are made up for by a rescan, which only picks up files written
+// since the watch started; change watches just see a change
+static void OverflowRescansTheDirectory()
+{
+	auto dir = ScratchDir("overflow");
+	auto changesDir = ScratchDir("overflow_changes");
+	Append(dir / "old.replay", "x");
+	std::filesystem::last_write_time(dir / "old.replay", std::filesystem::file_time_type::clock::now() - 1h);
+
+	auto backendOwned = std::make_unique<ScriptedBackend>();
+	ScriptedBackend* backend = backendOwned.get();
+	Reports reports;
+	Reports changes;
+	FileWatchService service;
+	CHECK(service.Start(std::move(backendOwned)));
+	service.Watch(dir, { ".replay" }, 100ms, reports.SettledFn());
+	service.WatchChanges(changesDir, 100ms, changes.ChangedFn());
+	WaitUntilWatching(service, 2);
+
+	// written without any event reaching the service
+	std::this_thread::sleep_for(20ms);
+	Append(dir / "missed.replay", "x");
+	Append(dir / "missed.txt", "x");
+	std::this_thread::sleep_for(300ms);
+	CHECK(reports.Settled() == 0);
+
+	backend->Overflow(dir);
+	backend->Overflow(changesDir);
+	WaitFor([&] { return reports.Settled() > 0 && changes.Changes() > 0; });
+	std::this_thread::sleep_for(400ms);
+
+	std::lock_guard<std::mutex> lock(reports.mutex);
+	CHECK(reports.settled.size() == 1);
+	CHECK(!reports.settled.empty() && reports.settled[0].filename() == "missed.replay");
+	CHECK(changes.Changes() == 1);
+}
+
+int main()
+{
+	RUN_TEST(GrowingFileSettlesOnce);
+	RUN_TEST(OnlyWatchedExtensionsAreReported);
+	RUN_TEST(ChangesAreCoalesced);
+	RUN_TEST(UnwatchStopsCallbacks);
+	RUN_TEST(OverflowRescansTheDirectory);
+
+	std::error_code ec;
+	for (const auto& dir : scratchDirs)
+		std::filesystem::remove_all(dir, ec);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,663 @@
+// HttpClient on loopback: the event loop and the streaming body sink against a scripted server
+// that answers with whatever bytes a test gives it, keep-alive against the stand-in, and
+// RunRemoteAnalysis fed broken and cut-off row streams
+#include "pch.h"
+#include "httpclient.h"
+#include "remoteanalysis.h"
+#include "standinserver.h"
+#include "check.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+// Runs pool tasks and stand-in connections on threads that are joined once their owners are gone
+struct Workers
+{
+	std::mutex mutex;
+	std::vector<std::thread> threads;
+
+	void Spawn(std::function<void()> task)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.emplace_back(std::move(task));
+	}
+
+	HttpClient::PostFn PostFn()
+	{
+		return [this](const char*, std::function<void()> fn, bool) { Spawn(std::move(fn)); };
+	}
+
+	~Workers()
+	{
+		// a task may still be spawning another
+		for (;;)
+		{
+			std::vector<std::thread> joining;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				joining.swap(threads);
+			}
+			if (joining.empty())
+				break;
+			for (auto& thread : joining)
+				thread.join();
+		}
+	}
+};
+
+// Serves each connection on a thread of its own, answering every request with the bytes the
+// handler returns: sent in the pieces given, a little apart, and closing after if asked to
+class ScriptedServer
+{
+public:
+	struct Request
+	{
+		std::string method;
+		std::string target;
+		std::string body;
+	};
+
+	struct Reply
+	{
+		std::vector<std::string> pieces;
+		bool close = false;
+		std::chrono::milliseconds delay{ 0 };   // before the first piece
+	};
+
+	using HandlerFn = std::function<Reply(const Request& request)>;
+
+	explicit ScriptedServer(HandlerFn handler) : handler_(std::move(handler))
+	{
+		std::string error;
+		if (NetInit(error))
+			listener_ = TcpSocket::Listen("127.0.0.1", 0, error);
+		if (listener_.Valid())
+			acceptThread_ = std::thread(&ScriptedServer::AcceptLoop, this);
+	}
+
+	~ScriptedServer()
+	{
+		stopping_ = true;
+		if (acceptThread_.joinable())
+			acceptThread_.join();
+		for (auto& thread : connections_)
+			thread.join();
+	}
+
+	bool Started() const { return listener_.Valid(); }
+	std::string Url() const { return "http://127.0.0.1:" + std::to_string(listener_.LocalPort()); }
+	int Accepted() const { return accepted_; }
+	int MostOpen() const { return mostOpen_; }
+
+private:
+	void AcceptLoop()
+	{
+		while (!stopping_)
+		{
+			if (!WaitSocket(listener_, kSocketReadable, 50ms))
+				continue;
+			for (TcpSocket socket = listener_.Accept(); socket.Valid(); socket = listener_.Accept())
+			{
+				++accepted_;
+				auto connection = std::make_shared<TcpSocket>(std::move(socket));
+				connections_.emplace_back([this, connection]() { Serve(*connection); });
+			}
+		}
+	}
+
+	void Serve(TcpSocket& socket)
+	{
+		const int open = ++open_;
+		for (int most = mostOpen_; open > most && !mostOpen_.compare_exchange_weak(most, open);)
+		{
+		}
+
+		std::string data;
+		while (!stopping_)
+		{
+			size_t headEnd;
+			while ((headEnd = data.find("\r\n\r\n")) == std::string::npos)
+				if (!Read(socket, data))
+					return Closed();
+
+			Request request;
+			const std::string head = data.substr(0, headEnd);
+			const size_t space1 = head.find(' '), space2 = head.find(' ', space1 + 1);
+			request.method = head.substr(0, space1);
+			request.target = head.substr(space1 + 1, space2 - space1 - 1);
+			size_t length = 0;
+			const size_t field = head.find("Content-Length: ");
+			if (field != std::string::npos)
+				length = (size_t)std::stoull(head.substr(field + 16));
+			data.erase(0, headEnd + 4);
+			while (data.size() < length)
+				if (!Read(socket, data))
+					return Closed();
+			request.body = data.substr(0, length);
+			data.erase(0, length);
+
+			const Reply reply = handler_(request);
+			for (auto until = std::chrono::steady_clock::now() + reply.delay; !stopping_ && std::chrono::steady_clock::now() < until;)
+				std::this_thread::sleep_for(5ms);
+			for (const std::string& piece : reply.pieces)
+			{
+				if (!Write(socket, piece))
+					return Closed();
+				std::this_thread::sleep_for(10ms);
+			}
+			if (reply.close)
+				return Closed();
+		}
+		Closed();
+	}
+
+	void Closed()
+	{
+		--open_;
+	}
+
+	bool Read(TcpSocket& socket, std::string& data)
+	{
+		char buffer[4096];
+		while (!stopping_)
+		{
+			if (!WaitSocket(socket, kSocketReadable, 50ms))
+				continue;
+			const long long got = socket.Recv(buffer, sizeof(buffer));
+			if (got < 0)
+				return false;
+			if (got > 0)
+			{
+				data.append(buffer, (size_t)got);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Write(TcpSocket& socket, const std::string& data)
+	{
+		for (size_t sent = 0; sent < data.size();)
+		{
+			const long long wrote = socket.Send(data.data() + sent, data.size() - sent);
+			if (wrote < 0 || stopping_)
+				return false;
+			if (wrote == 0)
+				WaitSocket(socket, kSocketWritable, 50ms);
+			sent += (size_t)(std::max)(wrote, 0LL);
+		}
+		return true;
+	}
+
+	HandlerFn handler_;
+	TcpSocket listener_;
+	std::thread acceptThread_;
+	std::vector<std::thread> connections_;   // accept thread only, until it is joined
+	std::atomic<bool> stopping_{ false };
+	std::atomic<int> accepted_{ 0 };
+	std::atomic<int> open_{ 0 };
+	std::atomic<int> mostOpen_{ 0 };
+};
+
+static std::string HttpReply(int status, const std::string& body, const std::string& headers = {})
+{
+	return "HTTP/1.1 " + std::to_string(status) + " Whatever\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" +
+		headers + "\r\n" + body;
+}
+
+// Until done() or 5 s
+template <typename Fn>
+static void WaitFor(Fn&& done)
+{
+	auto deadline = std::chrono::steady_clock::now() + 5s;
+	while (!done() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(5ms);
+}
+
+// Every request is sent from the one loop thread; past the per-host cap they wait for a
+// connection to come free and go out on it
+static void ManyRequestsShareTheLoop()
+{
+	constexpr int kRequests = 24;
+	ScriptedServer server([](const ScriptedServer::Request& request) {
+		return ScriptedServer::Reply{ { HttpReply(200, request.target) }, false, 30ms };
+		});
+	CHECK(server.Started());
+	Workers workers;
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(http.Start(error));
+
+	std::mutex mutex;
+	std::map<int, std::string> targets, bodies;
+	std::map<int, int> calls;
+	for (int i = 0; i < kRequests; ++i)
+		targets[i] = "/item/" + std::to_string(i);
+	for (int i = 0; i < kRequests; ++i)
+	{
+		HttpRequest request;
+		request.url = server.Url() + targets[i];
+		http.Send(request, [&, i](HttpResponse response) {
+			std::lock_guard<std::mutex> lock(mutex);
+			bodies[i] = response.status == 200 ? response.body : response.error;
+			++calls[i];
+			});
+	}
+	WaitFor([&] { std::lock_guard<std::mutex> lock(mutex); return calls.size() == kRequests; });
+	std::this_thread::sleep_for(50ms);   // and no callback twice
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		CHECK(bodies == targets);
+		for (const auto& [i, count] : calls)
+			CHECK(count == 1);
+	}
+	const HttpClient::Stats stats = http.GetStats();
+	CHECK(stats.requests == kRequests);
+	CHECK(stats.failed == 0);
+	CHECK(stats.dnsLookups == 1);
+	CHECK(server.MostOpen() <= HttpClient::kMaxConnectionsPerHost);
+	CHECK(stats.connectionsOpened == (uint64_t)server.Accepted());
+	CHECK(stats.connectionsReused == kRequests - stats.connectionsOpened);
+	CHECK(http.Stop(5s));
+}
+
+static void CancelFailsARequestOnTheWire()
+{
+	ScriptedServer server([](const ScriptedServer::Request&) {
+		return ScriptedServer::Reply{ { HttpReply(200, "late") }, false, 3000ms };
+		});
+	CHECK(server.Started());
+	Workers workers;
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(http.Start(error));
+
+	HttpRequest request;
+	request.url = server.Url() + "/slow";
+	std::atomic<bool> cancel{ false };
+	std::thread canceller([&]() {
+		std::this_thread::sleep_for(200ms);
+		cancel = true;
+		});
+	const auto startedAt = std::chrono::steady_clock::now();
+	HttpResponse response = http.Fetch(request, &cancel);
+	const auto took = std::chrono::steady_clock::now() - startedAt;
+	canceller.join();
+
+	CHECK(!response.Received());
+	CHECK(response.error == "cancelled");
+	CHECK(took < 1s);
+	CHECK(http.Stop(5s));
+}
+
+// Chunk framing is taken off and the body handed over as it comes, split wherever the socket split it
+static void SinkTakesAChunkedBodyAsItArrives()
+{
+	ScriptedServer server([](const ScriptedServer::Request&) {
+		return ScriptedServer::Reply{ {
+			"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel",
+			"lo\r\n9;ext=1\r\n, chunke",
+			"d\r\n6\r\n world\r\n0\r\n\r\n" } };
+		});
+	CHECK(server.Started());
+	Workers workers;
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(http.Start(error));
+
+	std::string streamed;
+	int pieces = 0;
+	HttpRequest request;
+	request.url = server.Url() + "/chunked";
+	request.onBody = [&](const char* data, size_t size) {
+		streamed.append(data, size);
+		++pieces;
+		return true;
+	};
+	HttpResponse response = http.Fetch(request);
+
+	CHECK(response.status == 200);
+	CHECK(response.error.empty());
+	CHECK(response.body.empty());
+	CHECK(streamed == "hello, chunked world");
+	CHECK(pieces >= 3);
+
+	// error bodies are kept, not streamed
+	ScriptedServer notFound([](const ScriptedServer::Request&) {
+		return ScriptedServer::Reply{ { HttpReply(404, "error=no such analysis\n") } };
+		});
+	request.url = notFound.Url() + "/missing";
+	streamed.clear();
+	response = http.Fetch(request);
+	CHECK(response.status == 404);
+	CHECK(response.body == "error=no such analysis\n");
+	CHECK(streamed.empty());
+	CHECK(http.Stop(5s));
+}
+
+// A sink that says stop ends the transfer; the response keeps its head, and the connection,
+// with the rest of the body still on it, isn't used again
+static void RefusedBodyStopsTheTransfer()
+{
+	const std::string body(200000, 'x');
+	ScriptedServer server([&](const ScriptedServer::Request&) {
+		return ScriptedServer::Reply{ { HttpReply(200, body) } };
+		});
+	CHECK(server.Started());
+	Workers workers;
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(http.Start(error));
+
+	size_t taken = 0;
+	HttpRequest request;
+	request.url = server.Url() + "/big";
+	request.onBody = [&](const char*, size_t size) {
+		taken += size;
+		return false;
+	};
+	HttpResponse response = http.Fetch(request);
+	CHECK(response.status == 200);
+	CHECK(response.error == "the body was refused");
+	CHECK(taken > 0 && taken < body.size());
+
+	request.onBody = nullptr;
+	response = http.Fetch(request);
+	CHECK(response.status == 200 && response.body == body);
+	CHECK(http.GetStats().connectionsOpened == 2);
+	CHECK(http.GetStats().connectionsReused == 0);
+	CHECK(http.Stop(5s));
+}
+
+// A body cut short: streamed, the head and the error both come back, as the sink already has part
+// of it; collected, it is no response at all
+static void CutOffBodyKeepsItsStatusWhenStreamed()
+{
+	ScriptedServer server([](const ScriptedServer::Request&) {
+		std::string head = HttpReply(200, std::string(100, 'x'));
+		return ScriptedServer::Reply{ { head.substr(0, head.size() - 90) }, true };
+		});
+	CHECK(server.Started());
+	Workers workers;
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(http.Start(error));
+
+	std::string streamed;
+	HttpRequest request;
+	request.url = server.Url() + "/short";
+	request.onBody = [&](const char* data, size_t size) {
+		streamed.append(data, size);
+		return true;
+	};
+	HttpResponse response = http.Fetch(request);
+	CHECK(response.status == 200);
+	CHECK(response.error == "connection closed mid-response");
+	CHECK(streamed == std::string(10, 'x'));
+
+	request.onBody = nullptr;
+	response = http.Fetch(request);
+	CHECK(!response.Received());
+	CHECK(response.error == "connection closed mid-response");
+	CHECK(http.GetStats().failed == 2);
+	CHECK(http.Stop(5s));
+}
+
+// A whole analysis against the stand-in goes over one connection
+static void KeepAliveAgainstTheStandIn()
+{
+	Workers workers;
+#ifdef _WIN32
+	const auto dir = std::filesystem::temp_directory_path() / "httpclient_test";
+#else
+	const auto dir = std::filesystem::temp_directory_path() / ("httpclient_test_" + std::to_string(getpid()));
+#endif
+	std::filesystem::create_directories(dir);
+	std::ofstream(dir / "match.replay", std::ios::binary) << std::string(100000, 'r');
+
+	RemoteStandInServer standIn(dir / "standin", [](const std::string&, const std::filesystem::path&, RowStreamBuffer& rows,
+		const std::function<void()>& onRows, const AnalysisProgressFn&, const std::atomic<bool>&, std::string&) {
+			const float values[] = { 1, 2, 3, 4, 5, 6 };
+			for (int i = 0; i < 3; ++i)
+			{
+				rows.Push(values + 2 * i, 1, 2);
+				onRows();
+				std::this_thread::sleep_for(20ms);
+			}
+			return AnalysisOutcome::Succeeded;
+		}, [&](std::function<void()> task) { workers.Spawn(std::move(task)); });
+	HttpClient http(workers.PostFn());
+	std::string error;
+	CHECK(standIn.Start(0, error));
+	CHECK(http.Start(error));
+
+	RemoteSettings settings;
+	settings.url = standIn.Url();
+	settings.pieceBytes = 16 << 10;   // several PUTs
+	AnalysisJob job;
+	job.model = "stub";
+	job.replayId = "match";
+	job.replayPath = dir / "match.replay";
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	CHECK(RunRemoteAnalysis(http, settings, job, dir / "match.nrlb", rows, nullptr, nullptr, cancel, error) == AnalysisOutcome::Succeeded);
+
+	const HttpClient::Stats stats = http.GetStats();
+	CHECK(stats.requests >= 9);   // POST, 7 PUTs and at least one poll
+	CHECK(stats.failed == 0);
+	CHECK(stats.connectionsOpened == 1);
+	CHECK(stats.connectionsReused == stats.requests - 1);
+	CHECK(stats.dnsLookups == 1);
+
+	CHECK(http.Stop(5s));
+	CHECK(standIn.Stop(5s));
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+}
+
+// A frame with a valid length prefix around whatever payload is given
+static std::string Frame(char kind, const std::string& payload)
+{
+	std::string frame;
+	const uint32_t length = (uint32_t)payload.size() + 1;
+	for (int i = 0; i < 4; ++i)
+		frame.push_back((char)((length >> (8 * i)) & 0xff));
+	frame.push_back(kind);
+	return frame + payload;
+}
+
+// rows * columns values counting up from the first row's
+static std::vector<float> Counting(int rows, int columns, int firstRow = 0)
+{
+	std::vector<float> values((size_t)rows * columns);
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = (float)((size_t)firstRow * columns + i);
+	return values;
+}
+
+static std::string RowsBody(int columns, int firstRow, int count, bool end)
+{
+	auto values = Counting(count, columns, firstRow);
+	std::string body;
+	AppendRowStreamHeader(body, columns, end ? count : 0);
+	AppendRowStreamRows(body, values.data(), count, columns);
+	if (end)
+		AppendRowStreamEnd(body, count);
+	return body;
+}
+
+// The remote protocol with the upload taken as it comes and each rows poll answered by rowsReply
+struct FakeRemote
+{
+	using RowsFn = std::function<ScriptedServer::Reply(int poll, long long from)>;
+
+	std::mutex mutex;
+	std::vector<long long> polledFrom;
+	bool deleted = false;
+	RowsFn rowsReply;
+
+	ScriptedServer::HandlerFn Handler()
+	{
+		return [this](const ScriptedServer::Request& request) {
+			const size_t question = request.target.find('?');
+			auto query = ParseFields(question == std::string::npos ? "" : request.target.substr(question + 1), '&');
+			if (request.method == "POST")
+				return ScriptedServer::Reply{ { HttpReply(201, "id=7\nreceived=0\nstate=uploading\n") } };
+			if (request.method == "PUT")
+				return ScriptedServer::Reply{ { HttpReply(200, "received=" + std::to_string(std::stoll(query["offset"]) + (long long)request.body.size()) + "\n") } };
+			std::lock_guard<std::mutex> lock(mutex);
+			if (request.method == "DELETE")
+			{
+				deleted = true;
+				return ScriptedServer::Reply{ { HttpReply(200, "") } };
+			}
+			polledFrom.push_back(std::stoll(query["from"]));
+			return rowsReply((int)polledFrom.size() - 1, polledFrom.back());
+		};
+	}
+
+	bool Deleted()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return deleted;
+	}
+};
+
+// RunRemoteAnalysis against a FakeRemote
+struct RemoteRun
+{
+	Workers workers;
+	FakeRemote remote;
+	ScriptedServer server{ remote.Handler() };
+	HttpClient http{ workers.PostFn() };
+	std::filesystem::path dir;
+	std::vector<std::vector<double>> columns;
+	std::string error;
+
+	explicit RemoteRun(FakeRemote::RowsFn rowsReply)
+	{
+		remote.rowsReply = std::move(rowsReply);
+#ifdef _WIN32
+		dir = std::filesystem::temp_directory_path() / "httpclient_test_remote";
+#else
+		dir = std::filesystem::temp_directory_path() / ("httpclient_test_remote_" + std::to_string(getpid()));
+#endif
+		std::filesystem::create_directories(dir);
+		std::ofstream(dir / "match.replay", std::ios::binary) << std::string(5000, 'r');
+		http.Start(error);
+	}
+
+	~RemoteRun()
+	{
+		http.Stop(5s);
+		std::error_code ec;
+		std::filesystem::remove_all(dir, ec);
+	}
+
+	AnalysisOutcome Run()
+	{
+		RemoteSettings settings;
+		settings.url = server.Url();
+		AnalysisJob job;
+		job.model = "stub";
+		job.replayId = "match";
+		job.replayPath = dir / "match.replay";
+		RowStreamBuffer rows;
+		std::atomic<bool> cancel{ false };
+		AnalysisOutcome outcome = RunRemoteAnalysis(http, settings, job, dir / "match.nrlb", rows, nullptr, nullptr, cancel, error);
+		rows.Drain(columns);
+		return outcome;
+	}
+};
+
+static ScriptedServer::Reply Rows(const std::string& body, const std::string& state)
+{
+	return ScriptedServer::Reply{ { HttpReply(200, body, "X-Analysis-State: " + state + "\r\n") } };
+}
+
+// A poll that comes back wider than the first stops in the sink; the rows already taken stay
+static void WidthChangeStopsTheAnalysis()
+{
+	RemoteRun run([](int poll, long long from) {
+		return poll == 0 ? Rows(RowsBody(2, 0, 3, false), "running") : Rows(RowsBody(3, (int)from, 2, false), "running");
+		});
+	CHECK(run.server.Started());
+
+	CHECK(run.Run() == AnalysisOutcome::Failed);
+	CHECK(run.error == "the row stream changed width");
+	CHECK(run.columns.size() == 2 && run.columns[0].size() == 3);
+	CHECK(run.remote.polledFrom == (std::vector<long long>{ 0, 3 }));
+	WaitFor([&] { return run.remote.Deleted(); });
+	CHECK(run.remote.Deleted());
+}
+
+static void BadFrameStopsTheAnalysis()
+{
+	RemoteRun run([](int, long long) {
+		std::string body;
+		AppendRowStreamHeader(body, 2, 0);
+		return Rows(body + Frame('?', "junk"), "running");
+		});
+	CHECK(run.server.Started());
+
+	CHECK(run.Run() == AnalysisOutcome::Failed);
+	CHECK(run.error.rfind("bad row stream: ", 0) == 0);
+	CHECK(run.columns.empty());
+	CHECK(run.remote.polledFrom.size() == 1);
+	WaitFor([&] { return run.remote.Deleted(); });
+	CHECK(run.remote.Deleted());
+}
+
+// The first poll is cut off partway through its second frame: the rows of the first are kept and
+// the next poll asks from after them, so every row arrives exactly once
+static void CutOffRowsAreFetchedAgain()
+{
+	RemoteRun run([](int poll, long long from) {
+		if (poll > 0)
+			return Rows(RowsBody(2, (int)from, 6 - (int)from, true), "done");
+		auto first = Counting(4, 2), second = Counting(2, 2, 4);
+		std::string body;
+		AppendRowStreamHeader(body, 2, 0);
+		AppendRowStreamRows(body, first.data(), 4, 2);
+		const size_t cut = body.size() + 7;
+		AppendRowStreamRows(body, second.data(), 2, 2);
+		std::string whole = HttpReply(200, body, "X-Analysis-State: running\r\n");
+		return ScriptedServer::Reply{ { whole.substr(0, whole.size() - (body.size() - cut)) }, true };
+		});
+	CHECK(run.server.Started());
+
+	CHECK(run.Run() == AnalysisOutcome::Succeeded);
+	CHECK(run.error.empty());
+	CHECK(run.remote.polledFrom == (std::vector<long long>{ 0, 4 }));
+	CHECK(run.columns.size() == 2 && run.columns[1] == (std::vector<double>{ 1, 3, 5, 7, 9, 11 }));
+	CHECK(!run.remote.Deleted());
+
+	std::vector<std::vector<double>> saved;
+	CHECK(LoadRowStreamFile(run.dir / "match.nrlb", saved, run.error));
+	CHECK(saved == run.columns);
+}
+
+int main()
+{
+	RUN_TEST(ManyRequestsShareTheLoop);
+	RUN_TEST(CancelFailsARequestOnTheWire);
+	RUN_TEST(SinkTakesAChunkedBodyAsItArrives);
+	RUN_TEST(RefusedBodyStopsTheTransfer);
+	RUN_TEST(CutOffBodyKeepsItsStatusWhenStreamed);
+	RUN_TEST(KeepAliveAgainstTheStandIn);
+	RUN_TEST(WidthChangeStopsTheAnalysis);
+	RUN_TEST(BadFrameStopsTheAnalysis);
+	RUN_TEST(CutOffRowsAreFetchedAgain);
+	return CheckFailures() == 0 ? 0 : 1;
+}
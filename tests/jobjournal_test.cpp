@@ -0,0 +1,100 @@
+// JobJournal replayed across simulated sessions in a scratch file
+#include "pch.h"
+#include "jobjournal.h"
+#include "check.h"
+
+#include <filesystem>
+#include <string>
+
+static std::filesystem::path ScratchFile()
+{
+	auto path = std::filesystem::temp_directory_path() / "neurlcar_jobjournal_test.log";
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	return path;
+}
+
+static AnalysisJob Job(const std::string& replayId)
+{
+	AnalysisJob job;
+	job.model = "stub";
+	job.replayId = replayId;
+	job.replayPath = "/replays/" + replayId + ".replay";
+	job.numFrames = 100;
+	return job;
+}
+
+static void UnfinishedJobsAreResumedInOrder()
+{
+	auto file = ScratchFile();
+	{
+		JobJournal journal;
+		CHECK(journal.Open(file).empty());
+		journal.Queued(Job("a"));
+		journal.Queued(Job("b"));
+		journal.Queued(Job("c"));
+		journal.Running(Job("b"));
+		journal.Finished(Job("b"), AnalysisOutcome::Succeeded);
+	}
+
+	JobJournal journal;
+	auto entries = journal.Open(file);
+	CHECK(entries.size() == 2);
+	CHECK(entries.size() == 2 && entries[0].replayId == "a" && entries[1].replayId == "c");
+	CHECK(entries.size() == 2 && entries[0].numFrames == 100 && entries[0].attempts == 0);
+}
+
+// Compaction used to keep only the Q records, so a job that kept crashing the game while
+// running was never counted as interrupted and came back on every load
+static void CompactionKeepsRunningJobs()
+{
+	auto file = ScratchFile();
+	for (int session = 1; session <= 3; ++session)
+	{
+		JobJournal journal;
+		auto entries = journal.Open(file);
+		if (session == 1)
+			CHECK(entries.empty());
+		else if (session == 2)
+			CHECK(entries.size() == 1 && entries[0].attempts == 1);
+		else
+			CHECK(entries.size() == 1 && entries[0].attempts == 2);
+
+		// what the plugin does on load: compact, then requeue what was left, then it starts
+		journal.Compact();
+		journal.Queued(Job("crashes"));
+		journal.Running(Job("crashes"));
+		journal.Compact();
+		journal.Close();   // the game "crashes" with the job running
+	}
+
+	JobJournal journal;
+	CHECK(journal.Open(file).empty());
+}
+
+static void RequeuedJobIsNotRunning()
+{
+	auto file = ScratchFile();
+	{
+		JobJournal journal;
+		journal.Open(file);
+		journal.Queued(Job("a"));
+		journal.Running(Job("a"));
+		journal.Finished(Job("a"), AnalysisOutcome::Cancelled);
+		journal.Queued(Job("a"));
+		journal.Compact();
+	}
+
+	JobJournal journal;
+	auto entries = journal.Open(file);
+	CHECK(entries.size() == 1 && entries[0].attempts == 0);
+}
+
+int main()
+{
+	RUN_TEST(UnfinishedJobsAreResumedInOrder);
+	RUN_TEST(CompactionKeepsRunningJobs);
+	RUN_TEST(RequeuedJobIsNotRunning);
+	std::filesystem::remove(std::filesystem::temp_directory_path() / "neurlcar_jobjournal_test.log");
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+// RunProcess/SpawnProcess with /bin/sh children, including children that leave something
+// running with their output pipes open.
+#include "pch.h"
+#include "processrunner.h"
+#include "check.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static ProcessLaunch Shell(const std::string& script, std::string* out = nullptr)
+{
+	ProcessLaunch launch;
+	launch.exePath = "/bin/sh";
+	launch.args = { "-c", script };
+	if (out)
+		launch.onStdout = [out](std::string_view chunk) { out->append(chunk); };
+	return launch;
+}
+
+// Gone, or a zombie nobody has reaped yet (a container's init may never reap it)
+static bool ProcessGone(long long pid)
+{
+	for (int i = 0; i < 100; ++i)
+	{
+		std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+		std::string line;
+		if (!std::getline(stat, line))
+			return true;
+		size_t paren = line.rfind(')');
+		if (paren != std::string::npos && paren + 2 < line.size() && line[paren + 2] == 'Z')
+			return true;
+		std::this_thread::sleep_for(10ms);
+	}
+	return false;
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void CapturesOutputAndExitCode()
+{
+	std::string out;
+	ProcessResult result = RunProcess(Shell("echo hello; echo oops >&2; exit 3", &out), 5s);
+	CHECK(result.started);
+	CHECK(!result.timedOut);
+	CHECK(result.exitCode == 3);
+	CHECK(out == "hello\n");
+}
+
+static void TimeoutKillsTheChild()
+{
+	auto start = std::chrono::steady_clock::now();
+	ProcessResult result = RunProcess(Shell("exec sleep 10"), 200ms);
+	CHECK(result.timedOut);
+	CHECK(SecondsSince(start) < 2.0);
+}
+
+// A grandchild that inherited stdout used to keep Wait() joining the readers until it exited
+static void TimeoutKillsWhatTheChildStarted()
+{
+	std::string out;
+	auto start = std::chrono::steady_clock::now();
+	ProcessResult result = RunProcess(Shell("sleep 10 & echo $!; wait", &out), 200ms);
+	CHECK(result.timedOut);
+	CHECK(SecondsSince(start) < 2.0);
+
+	long long grandchild = std::atoll(out.c_str());
+	CHECK(grandchild > 0);
+	if (grandchild > 0)
+		CHECK(ProcessGone(grandchild));
+}
+
+// The child exits at once, but what it left behind still holds the pipes
+static void ExitedChildWithLingeringOutputTimesOut()
+{
+	auto start = std::chrono::steady_clock::now();
+	ProcessResult result = RunProcess(Shell("sleep 10 &"), 300ms);
+	CHECK(result.timedOut);
+	CHECK(SecondsSince(start) < 2.0);
+}
+
+static void CancelKillsTheGroup()
+{
+	std::atomic<bool> cancel{ false };
+	std::thread canceller([&]() {
+		std::this_thread::sleep_for(150ms);
+		cancel = true;
+	});
+
+	auto start = std::chrono::steady_clock::now();
+	ProcessResult result = RunProcess(Shell("sleep 10 & sleep 10"), kWaitForever, &cancel);
+	canceller.join();
+	CHECK(result.cancelled);
+	CHECK(SecondsSince(start) < 2.0);
+}
+
+static void DestructorDoesNotHangOnLingeringOutput()
+{
+	std::string error;
+	auto start = std::chrono::steady_clock::now();
+	{
+		auto child = SpawnProcess(Shell("sleep 10 &"), error);
+		CHECK(child != nullptr);
+		if (child)
+			CHECK(!child->Wait(200ms));
+	}
+	CHECK(SecondsSince(start) < 2.0);
+}
+
+int main()
+{
+	signal(SIGPIPE, SIG_IGN);
+	RUN_TEST(CapturesOutputAndExitCode);
+	RUN_TEST(TimeoutKillsTheChild);
+	RUN_TEST(TimeoutKillsWhatTheChildStarted);
+	RUN_TEST(ExitedChildWithLingeringOutputTimesOut);
+	RUN_TEST(CancelKillsTheGroup);
+	RUN_TEST(DestructorDoesNotHangOnLingeringOutput);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,441 @@
+// RunRemoteAnalysis against RemoteStandInServer on loopback, with plain threads for the pool and
+// analyze functions standing in for the applets
+#include "pch.h"
+#include "remoteanalysis.h"
+#include "standinserver.h"
+#include "check.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+// Runs pool tasks and stand-in connections on threads that are joined once their owners are gone
+struct Workers
+{
+	std::mutex mutex;
+	std::vector<std::thread> threads;
+
+	void Spawn(std::function<void()> task)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads.emplace_back(std::move(task));
+	}
+
+	HttpClient::PostFn PostFn()
+	{
+		return [this](const char*, std::function<void()> fn, bool) { Spawn(std::move(fn)); };
+	}
+
+	RemoteStandInServer::SpawnFn SpawnFn()
+	{
+		return [this](std::function<void()> task) { Spawn(std::move(task)); };
+	}
+
+	~Workers()
+	{
+		// a task may still be spawning another
+		for (;;)
+		{
+			std::vector<std::thread> joining;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				joining.swap(threads);
+			}
+			if (joining.empty())
+				break;
+			for (auto& thread : joining)
+				thread.join();
+		}
+	}
+};
+
+static std::filesystem::path ScratchDir()
+{
+#ifdef _WIN32
+	auto dir = std::filesystem::temp_directory_path() / "remoteanalysis_test";
+#else
+	auto dir = std::filesystem::temp_directory_path() / ("remoteanalysis_test_" + std::to_string(getpid()));
+#endif
+	std::filesystem::create_directories(dir);
+	return dir;
+}
+
+// A replay of `size` bytes that differ from piece to piece
+static std::string ReplayBytes(size_t size)
+{
+	std::string bytes(size, '\0');
+	uint32_t state = 12345;
+	for (char& c : bytes)
+	{
+		state = state * 1103515245 + 12345;
+		c = (char)(state >> 16);
+	}
+	return bytes;
+}
+
+static std::string ReadFile(const std::filesystem::path& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// rows * columns values counting up from 0
+static std::vector<float> Counting(int rows, int columns, int firstRow = 0)
+{
+	std::vector<float> values((size_t)rows * columns);
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = (float)((size_t)firstRow * columns + i);
+	return values;
+}
+
+// Until done() or 5 s
+template <typename Fn>
+static void WaitFor(Fn&& done)
+{
+	auto deadline = std::chrono::steady_clock::now() + 5s;
+	while (!done() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(5ms);
+}
+
+// One stand-in and one client on a scratch directory; the replay is written there
+struct Loopback
+{
+	Workers workers;
+	std::filesystem::path dir = ScratchDir();
+	RemoteStandInServer::AnalyzeFn analyze;
+	RemoteStandInServer server{ dir / "standin", [this](const std::string& model, const std::filesystem::path& replayPath,
+		RowStreamBuffer& rows, const std::function<void()>& onRows, const AnalysisProgressFn& onProgress,
+		const std::atomic<bool>& cancel, std::string& error) {
+			return analyze(model, replayPath, rows, onRows, onProgress, cancel, error);
+		}, workers.SpawnFn() };
+	HttpClient http{ workers.PostFn() };
+	RemoteSettings settings;
+	AnalysisJob job;
+	bool started = false;
+
+	explicit Loopback(const std::string& replay)
+	{
+		std::string error;
+		started = server.Start(0, error) && http.Start(error);
+		settings.url = server.Url();
+		settings.retries = 1;
+		job.model = "stub";
+		job.replayId = "match";
+		job.replayPath = dir / "match.replay";
+		std::ofstream(job.replayPath, std::ios::binary | std::ios::trunc) << replay;
+	}
+
+	~Loopback()
+	{
+		http.Stop(5s);
+		server.Stop(5s);
+		std::error_code ec;
+		std::filesystem::remove_all(dir, ec);
+	}
+
+	AnalysisOutcome Run(RowStreamBuffer& rows, const std::atomic<bool>& cancel, std::string& error,
+		const std::function<void()>& onRows = nullptr)
+	{
+		return RunRemoteAnalysis(http, settings, job, dir / "match.nrlb", rows, onRows, nullptr, cancel, error);
+	}
+
+	// What a second client asking for the same analysis is told: {id, received}
+	std::pair<std::string, long long> Lookup(size_t size)
+	{
+		HttpRequest request;
+		request.method = "POST";
+		request.url = server.Url() + "/v1/analyses?model=stub&replay=match&size=" + std::to_string(size);
+		HttpResponse response = http.Fetch(request);
+		auto fields = ParseFields(response.body);
+		return { fields["id"], fields["received"].empty() ? -1 : std::stoll(fields["received"]) };
+	}
+
+	int Put(const std::string& id, long long offset, const std::string& piece, bool last = false)
+	{
+		HttpRequest request;
+		request.method = "PUT";
+		request.url = server.Url() + "/v1/analyses/" + id + "/replay?offset=" + std::to_string(offset) + (last ? "&last=1" : "");
+		request.body = piece;
+		return http.Fetch(request).status;
+	}
+};
+
+// An analysis that returns one batch of rows once the replay is in
+static AnalysisOutcome OneBatch(const std::string&, const std::filesystem::path&, RowStreamBuffer& rows,
+	const std::function<void()>& onRows, const AnalysisProgressFn&, const std::atomic<bool>&, std::string&)
+{
+	auto values = Counting(4, 2);
+	rows.Push(values.data(), 4, 2);
+	onRows();
+	return AnalysisOutcome::Succeeded;
+}
+
+// An analysis that runs until the stand-in cancels it
+struct UntilCancelled
+{
+	std::atomic<bool> running{ false };
+	std::atomic<bool> cancelled{ false };
+
+	RemoteStandInServer::AnalyzeFn Fn()
+	{
+		return [this](const std::string&, const std::filesystem::path&, RowStreamBuffer&, const std::function<void()>&,
+			const AnalysisProgressFn&, const std::atomic<bool>& cancel, std::string&) {
+				running = true;
+				auto giveUpAt = std::chrono::steady_clock::now() + 10s;
+				while (!cancel && std::chrono::steady_clock::now() < giveUpAt)
+					std::this_thread::sleep_for(5ms);
+				cancelled = (bool)cancel;
+				return AnalysisOutcome::Cancelled;
+			};
+	}
+};
+
+// Another client takes a piece out from under the upload: its next PUT gets a 409 with where the
+// server is, and it carries on from there without sending that piece again
+static void UploadResumesAfterAConflict()
+{
+	constexpr size_t kPiece = 4096, kPieces = 16;
+	const std::string replay = ReplayBytes(kPiece * kPieces);
+	Loopback loopback(replay);
+	CHECK(loopback.started);
+	// a piece every 250 ms leaves the test room to step in
+	loopback.settings.pieceBytes = kPiece;
+	loopback.settings.uploadBytesPerSec = kPiece * 4;
+
+	std::string received;
+	loopback.analyze = [&](const std::string& model, const std::filesystem::path& replayPath, RowStreamBuffer& rows,
+		const std::function<void()>& onRows, const AnalysisProgressFn& onProgress, const std::atomic<bool>& cancel, std::string& error) {
+			received = ReadFile(replayPath);
+			return OneBatch(model, replayPath, rows, onRows, onProgress, cancel, error);
+		};
+
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	AnalysisOutcome outcome = AnalysisOutcome::Failed;
+	std::thread client([&]() { outcome = loopback.Run(rows, cancel, error); });
+
+	// once the upload is under way, send the piece it is about to send next
+	bool tookAPiece = false;
+	auto giveUpAt = std::chrono::steady_clock::now() + 5s;
+	while (!tookAPiece && std::chrono::steady_clock::now() < giveUpAt)
+	{
+		auto [id, at] = loopback.Lookup(replay.size());
+		if (at <= 0 || at + 2 * (long long)kPiece > (long long)replay.size())
+		{
+			std::this_thread::sleep_for(20ms);
+			continue;
+		}
+		tookAPiece = loopback.Put(id, at, replay.substr((size_t)at, kPiece)) == 200;
+	}
+	client.join();
+
+	CHECK(tookAPiece);
+	CHECK(outcome == AnalysisOutcome::Succeeded);
+	CHECK(error.empty());
+	CHECK(received == replay);
+}
+
+// The analysis hands over a first batch and holds the second until the client has the first,
+// so the rows can only arrive across two or more polls
+static void RowsStreamAcrossPolls()
+{
+	Loopback loopback(ReplayBytes(10000));
+	CHECK(loopback.started);
+
+	std::atomic<bool> clientHasRows{ false };
+	loopback.analyze = [&](const std::string&, const std::filesystem::path&, RowStreamBuffer& rows,
+		const std::function<void()>& onRows, const AnalysisProgressFn& onProgress, const std::atomic<bool>& cancel, std::string&) {
+			auto first = Counting(5, 3);
+			rows.Push(first.data(), 5, 3);
+			onProgress(50, 100);
+			onRows();
+			WaitFor([&] { return clientHasRows || cancel; });
+			auto second = Counting(7, 3, 5);
+			rows.Push(second.data(), 7, 3);
+			onProgress(100, 100);
+			onRows();
+			return AnalysisOutcome::Succeeded;
+		};
+
+	RowStreamBuffer rows;
+	std::vector<std::vector<double>> columns;
+	std::vector<int> counts;   // rows the client had after each push
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	AnalysisOutcome outcome = loopback.Run(rows, cancel, error, [&]() {
+		rows.Drain(columns);
+		counts.push_back(columns.empty() ? 0 : (int)columns[0].size());
+		clientHasRows = true;
+		});
+
+	CHECK(outcome == AnalysisOutcome::Succeeded);
+	CHECK(error.empty());
+	CHECK(clientHasRows);
+	CHECK(counts.size() >= 2 && counts.front() == 5 && counts.back() == 12);
+	CHECK(columns.size() == 3 && columns[0].size() == 12);
+	CHECK(columns.size() == 3 && columns[2].size() == 12 && columns[2][11] == 35.0);
+
+	// saved in order, once, for the overlay
+	std::vector<std::vector<double>> saved;
+	CHECK(LoadRowStreamFile(loopback.dir / "match.nrlb", saved, error));
+	CHECK(saved == columns);
+}
+
+// A cancelled analysis is dropped on the server too
+static void CancelDeletesTheAnalysis()
+{
+	Loopback loopback(ReplayBytes(10000));
+	CHECK(loopback.started);
+	UntilCancelled analysis;
+	loopback.analyze = analysis.Fn();
+
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	std::thread canceller([&]() {
+		WaitFor([&] { return (bool)analysis.running; });
+		cancel = true;
+		});
+	const auto startedAt = std::chrono::steady_clock::now();
+	AnalysisOutcome outcome = loopback.Run(rows, cancel, error);
+	const auto took = std::chrono::steady_clock::now() - startedAt;
+	canceller.join();
+
+	CHECK(outcome == AnalysisOutcome::Cancelled);
+	CHECK(took < 3s);   // not held for the rest of the poll
+	WaitFor([&] { return (bool)analysis.cancelled; });
+	CHECK(analysis.cancelled);
+}
+
+// job.timeout bounds the whole exchange, long polls included, and the server is told to stop
+static void DeadlineStopsTheAnalysis()
+{
+	Loopback loopback(ReplayBytes(10000));
+	CHECK(loopback.started);
+	UntilCancelled analysis;
+	loopback.analyze = analysis.Fn();
+	loopback.job.timeout = 1500ms;
+
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	const auto startedAt = std::chrono::steady_clock::now();
+	AnalysisOutcome outcome = loopback.Run(rows, cancel, error);
+	const auto took = std::chrono::steady_clock::now() - startedAt;
+
+	CHECK(outcome == AnalysisOutcome::TimedOut);
+	CHECK(analysis.running);
+	CHECK(took >= 1500ms && took < 4s);
+	WaitFor([&] { return (bool)analysis.cancelled; });
+	CHECK(analysis.cancelled);
+}
+
+// 32 KiB at 16 KiB/s in 4 KiB pieces: the first goes at once, the eighth 1.75 s later
+static void UploadIsPacedToTheRate()
+{
+	constexpr size_t kPiece = 4096;
+	const std::string replay = ReplayBytes(kPiece * 8);
+	Loopback loopback(replay);
+	CHECK(loopback.started);
+	loopback.settings.pieceBytes = kPiece;
+	loopback.settings.uploadBytesPerSec = kPiece * 4;
+
+	std::chrono::steady_clock::time_point uploadedAt;
+	std::string received;
+	loopback.analyze = [&](const std::string& model, const std::filesystem::path& replayPath, RowStreamBuffer& rows,
+		const std::function<void()>& onRows, const AnalysisProgressFn& onProgress, const std::atomic<bool>& cancel, std::string& error) {
+			uploadedAt = std::chrono::steady_clock::now();
+			received = ReadFile(replayPath);
+			return OneBatch(model, replayPath, rows, onRows, onProgress, cancel, error);
+		};
+
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	const auto startedAt = std::chrono::steady_clock::now();
+	CHECK(loopback.Run(rows, cancel, error) == AnalysisOutcome::Succeeded);
+	CHECK(received == replay);
+	CHECK(uploadedAt - startedAt >= 1750ms);
+	CHECK(uploadedAt - startedAt < 3500ms);
+
+	// and without a cap it goes as fast as it can (another replay: the server has this one)
+	loopback.settings.uploadBytesPerSec = 0;
+	loopback.job.replayId = "rematch";
+	received.clear();
+	const auto unpacedAt = std::chrono::steady_clock::now();
+	CHECK(loopback.Run(rows, cancel, error) == AnalysisOutcome::Succeeded);
+	CHECK(received == replay);
+	CHECK(uploadedAt > unpacedAt && uploadedAt - unpacedAt < 1s);
+}
+
+// When the server turns out to have more than was sent, the upload skips ahead instead of pacing
+// out pieces it already has: here another client sends the rest after the first piece, and a
+// 4 s upload is over well before that
+static void ResyncSkipsWhatTheServerHas()
+{
+	constexpr size_t kPiece = 4096, kPieces = 16;
+	const std::string replay = ReplayBytes(kPiece * kPieces);
+	Loopback loopback(replay);
+	CHECK(loopback.started);
+	loopback.settings.pieceBytes = kPiece;
+	loopback.settings.uploadBytesPerSec = kPiece * 4;
+
+	std::chrono::steady_clock::time_point uploadedAt;
+	std::string received;
+	loopback.analyze = [&](const std::string& model, const std::filesystem::path& replayPath, RowStreamBuffer& rows,
+		const std::function<void()>& onRows, const AnalysisProgressFn& onProgress, const std::atomic<bool>& cancel, std::string& error) {
+			uploadedAt = std::chrono::steady_clock::now();
+			received = ReadFile(replayPath);
+			return OneBatch(model, replayPath, rows, onRows, onProgress, cancel, error);
+		};
+
+	RowStreamBuffer rows;
+	std::atomic<bool> cancel{ false };
+	std::string error;
+	AnalysisOutcome outcome = AnalysisOutcome::Failed;
+	const auto startedAt = std::chrono::steady_clock::now();
+	std::thread client([&]() { outcome = loopback.Run(rows, cancel, error); });
+
+	// a piece the client is sending at the same time gets a 409; ask again and go on from there
+	auto giveUpAt = std::chrono::steady_clock::now() + 5s;
+	while (std::chrono::steady_clock::now() < giveUpAt)
+	{
+		auto [id, at] = loopback.Lookup(replay.size());
+		if (at == (long long)replay.size())
+			break;
+		if (at <= 0)
+		{
+			std::this_thread::sleep_for(5ms);
+			continue;
+		}
+		const size_t size = (std::min)(kPiece, replay.size() - (size_t)at);
+		loopback.Put(id, at, replay.substr((size_t)at, size), (size_t)at + size == replay.size());
+	}
+	client.join();
+
+	CHECK(outcome == AnalysisOutcome::Succeeded);
+	CHECK(error.empty());
+	CHECK(received == replay);
+	CHECK(uploadedAt - startedAt < 1500ms);
+}
+
+int main()
+{
+	RUN_TEST(UploadResumesAfterAConflict);
+	RUN_TEST(RowsStreamAcrossPolls);
+	RUN_TEST(CancelDeletesTheAnalysis);
+	RUN_TEST(DeadlineStopsTheAnalysis);
+	RUN_TEST(UploadIsPacedToTheRate);
+	RUN_TEST(ResyncSkipsWhatTheServerHas);
+	return CheckFailures() == 0 ? 0 : 1;
+}
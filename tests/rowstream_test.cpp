@@ -0,0 +1,281 @@
+// RowStreamDecoder fed hand-built streams: split frames, damaged headers and frames, and the
+// RowStreamBuffer the reader threads push into
+#include "pch.h"
+#include "rowstream.h"
+#include "check.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Records what the decoder reported
+struct Decoded
+{
+	int headers = 0;
+	int columns = 0;
+	int totalRows = 0;
+	std::vector<float> values;
+	int frames = 0;
+
+	RowStreamDecoder Decoder()
+	{
+		return RowStreamDecoder(
+			[this](int cols, int total) { ++headers; columns = cols; totalRows = total; },
+			[this](const float* rows, int rowCount) {
+				++frames;
+				values.insert(values.end(), rows, rows + (size_t)rowCount * columns);
+			});
+	}
+};
+
+// rows * columns values counting up from 0
+static std::vector<float> Counting(int rows, int columns)
+{
+	std::vector<float> values((size_t)rows * columns);
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = (float)i;
+	return values;
+}
+
+static std::string Stream(int columns, const std::vector<float>& values, int rowsPerFrame)
+{
+	const int rows = (int)(values.size() / columns);
+	std::string stream;
+	AppendRowStreamHeader(stream, columns, rows);
+	for (int r = 0; r < rows; r += rowsPerFrame)
+		AppendRowStreamRows(stream, values.data() + (size_t)r * columns, std::min(rowsPerFrame, rows - r), columns);
+	AppendRowStreamEnd(stream, rows);
+	return stream;
+}
+
+// A frame with a valid length prefix around whatever payload is given
+static std::string Frame(char kind, const std::string& payload)
+{
+	std::string frame;
+	const uint32_t length = (uint32_t)payload.size() + 1;
+	for (int i = 0; i < 4; ++i)
+		frame.push_back((char)((length >> (8 * i)) & 0xff));
+	frame.push_back(kind);
+	return frame + payload;
+}
+
+static void DecodesAWholeStream()
+{
+	auto values = Counting(10, 3);
+	Decoded decoded;
+	auto decoder = decoded.Decoder();
+
+	CHECK(decoder.Feed(Stream(3, values, 4)));
+	CHECK(decoder.Finished());
+	CHECK(decoded.headers == 1 && decoded.columns == 3 && decoded.totalRows == 10);
+	CHECK(decoded.frames == 3);   // 4 + 4 + 2 rows
+	CHECK(decoded.values == values);
+	CHECK(decoder.Rows() == 10);
+}
+
+// Pipes and sockets hand over whatever they have; a frame can end up anywhere
+static void FramesSplitAcrossFeeds()
+{
+	auto values = Counting(50, 4);
+	const std::string stream = Stream(4, values, 7);
+
+	for (size_t chunk : { (size_t)1, (size_t)3, (size_t)5, (size_t)64, (size_t)1000 })
+	{
+		Decoded decoded;
+		auto decoder = decoded.Decoder();
+		bool ok = true;
+		for (size_t pos = 0; pos < stream.size(); pos += chunk)
+			ok = decoder.Feed(std::string_view(stream).substr(pos, chunk)) && ok;
+
+		CHECK(ok);
+		CHECK(decoder.Finished());
+		CHECK(decoded.headers == 1);
+		CHECK(decoded.values == values);
+	}
+}
+
+static void StreamCutOffIsNotFinished()
+{
+	auto values = Counting(20, 2);
+	const std::string stream = Stream(2, values, 8);
+
+	Decoded decoded;
+	auto decoder = decoded.Decoder();
+	CHECK(decoder.Feed(std::string_view(stream).substr(0, stream.size() - 3)));
+	CHECK(!decoder.Finished());
+	CHECK(!decoder.Failed());
+	CHECK(decoder.Rows() == 20);   // the rows all came; the end frame didn't
+}
+
+static void RejectsMalformedHeaders()
+{
+	std::string magic;
+	AppendRowStreamHeader(magic, 3, 0);
+
+	std::string badMagic = magic;
+	badMagic[5] ^= 0x20;
+	std::string badVersion = magic;
+	badVersion[9] = 7;
+	std::string noColumns;
+	AppendRowStreamHeader(noColumns, 0, 0);
+	const std::string shortHeader = Frame('H', magic.substr(5, 6));
+
+	for (const std::string& stream : { badMagic, badVersion, noColumns, shortHeader })
+	{
+		Decoded decoded;
+		auto decoder = decoded.Decoder();
+		CHECK(!decoder.Feed(stream));
+		CHECK(decoder.Failed());
+		CHECK(decoded.headers == 0);
+	}
+}
+
+static void RejectsMalformedFrames()
+{
+	std::string header;
+	AppendRowStreamHeader(header, 2, 0);
+	const float row[2] = { 1.0f, 2.0f };
+	std::string rows;
+	AppendRowStreamRows(rows, row, 1, 2);
+
+	std::string countMismatch = rows;
+	countMismatch[5] = 2;   // claims two rows, carries one
+	std::string tooLong = header;
+	tooLong += std::string("\xff\xff\xff\xff", 4) + "R";
+
+	const std::string cases[] = {
+		rows,                                   // data before the header
+		header + countMismatch,
+		header + Frame('R', "ab"),              // too short for a row count
+		header + Frame('?', ""),
+		header + header,                        // duplicate header
+		tooLong,                                // length past kRowStreamMaxFrameBytes
+		header + std::string(4, '\0') + "R",    // zero length
+	};
+	for (const std::string& stream : cases)
+	{
+		Decoded decoded;
+		auto decoder = decoded.Decoder();
+		CHECK(!decoder.Feed(stream));
+		CHECK(decoder.Failed());
+		CHECK(decoded.values.empty());
+	}
+}
+
+static void RejectsAWrongEndAndDataAfterIt()
+{
+	auto values = Counting(4, 2);
+	std::string stream;
+	AppendRowStreamHeader(stream, 2, 4);
+	AppendRowStreamRows(stream, values.data(), 4, 2);
+
+	{
+		std::string wrongEnd = stream;
+		AppendRowStreamEnd(wrongEnd, 5);
+		Decoded decoded;
+		auto decoder = decoded.Decoder();
+		CHECK(!decoder.Feed(wrongEnd));
+		CHECK(!decoder.Finished());
+	}
+	{
+		std::string afterEnd = stream;
+		AppendRowStreamEnd(afterEnd, 4);
+		Decoded decoded;
+		auto decoder = decoded.Decoder();
+		CHECK(decoder.Feed(afterEnd));
+		CHECK(decoder.Finished());
+		std::string more;
+		AppendRowStreamRows(more, values.data(), 1, 2);
+		CHECK(!decoder.Feed(more));
+		CHECK(decoded.values.size() == 8);
+	}
+}
+
+// A stream can't change width once its header is in: a second header with another column count
+// fails the stream, and nothing after it is delivered
+static void WidthChangeFailsTheStream()
+{
+	auto narrow = Counting(3, 2);
+	auto wide = Counting(3, 5);
+
+	std::string stream;
+	AppendRowStreamHeader(stream, 2, 0);
+	AppendRowStreamRows(stream, narrow.data(), 3, 2);
+	AppendRowStreamHeader(stream, 5, 0);
+	AppendRowStreamRows(stream, wide.data(), 3, 5);
+
+	Decoded decoded;
+	auto decoder = decoded.Decoder();
+	CHECK(!decoder.Feed(stream));
+	CHECK(decoder.Failed());
+	CHECK(decoder.Columns() == 2);
+	CHECK(decoded.values == narrow);
+
+	// and it stays failed
+	CHECK(!decoder.Feed(std::string()));
+}
+
+static void BufferDrainsColumnMajor()
+{
+	auto values = Counting(4, 3);
+	RowStreamBuffer buffer;
+	CHECK(buffer.MarkDrainQueued());
+	CHECK(!buffer.MarkDrainQueued());
+	buffer.Push(values.data(), 2, 3);
+	buffer.Push(values.data() + 6, 2, 3);
+
+	std::vector<std::vector<double>> columns;
+	CHECK(buffer.Drain(columns) == 4);
+	CHECK(columns.size() == 3);
+	CHECK(columns.size() == 3 && columns[1] == (std::vector<double>{ 1, 4, 7, 10 }));
+	CHECK(buffer.MarkDrainQueued());   // cleared by the drain
+	CHECK(buffer.Drain(columns) == 0);
+
+	// a projection matching the stream's width keeps just its columns, in slot order
+	ColumnProjection projection;
+	projection.sourceColumns = 3;
+	projection.source = { 2, 0 };
+	buffer.Push(values.data(), 4, 3);
+	std::vector<std::vector<double>> projected;
+	CHECK(buffer.Drain(projected, &projection) == 4);
+	CHECK(projected.size() == 2);
+	CHECK(projected.size() == 2 && projected[0] == (std::vector<double>{ 2, 5, 8, 11 }));
+}
+
+static void RowStreamFileRoundTrip()
+{
+	auto path = std::filesystem::temp_directory_path() / "neurlcar_rowstream_test.nrlb";
+	auto values = Counting(9, 3);
+	std::string error;
+	CHECK(SaveRowStreamFile(path, Stream(3, values, 4), error));
+
+	std::vector<std::vector<double>> columns;
+	CHECK(LoadRowStreamFile(path, columns, error));
+	CHECK(columns.size() == 3 && columns[2].size() == 9 && columns[2][8] == 26.0);
+
+	// a file missing its end frame is never loaded as an analysis
+	std::string truncated = Stream(3, values, 4);
+	truncated.resize(truncated.size() - 9);
+	CHECK(SaveRowStreamFile(path, truncated, error));
+	CHECK(!LoadRowStreamFile(path, columns, error));
+	CHECK(error == "truncated file");
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+}
+
+int main()
+{
+	RUN_TEST(DecodesAWholeStream);
+	RUN_TEST(FramesSplitAcrossFeeds);
+	RUN_TEST(StreamCutOffIsNotFinished);
+	RUN_TEST(RejectsMalformedHeaders);
+	RUN_TEST(RejectsMalformedFrames);
+	RUN_TEST(RejectsAWrongEndAndDataAfterIt);
+	RUN_TEST(WidthChangeFailsTheStream);
+	RUN_TEST(BufferDrainsColumnMajor);
+	RUN_TEST(RowStreamFileRoundTrip);
+	return CheckFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+// SharedResultsWriter and SharedResultsReader on one real segment, the writer standing in for
+// an applet on another thread
+#include "pch.h"
+#include "sharedresults.h"
+#include "check.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Value of row r, column c in every stream written here; exact in float32 for these sizes
+static float Cell(uint32_t r, uint32_t c)
+{
+	return (float)(r * 100 + c);
+}
+
+static std::vector<float> Rows(uint32_t from, uint32_t count, uint32_t columns)
+{
+	std::vector<float> rows;
+	for (uint32_t r = from; r < from + count; ++r)
+		for (uint32_t c = 0; c < columns; ++c)
+			rows.push_back(Cell(r, c));
+	return rows;
+}
+
+static void WritesAreReadBack()
+{
+	std::string error;
+	auto reader = SharedResultsReader::Create(64, error);
+	CHECK(reader);
+	if (!reader)
+		return;
+	auto writer = SharedResultsWriter::Open(reader->Name(), error);
+	CHECK(writer);
+	if (!writer)
+		return;
+
+	SharedResultsReader::Status status;
+	CHECK(reader->ReadStatus(status, error));
+	CHECK(status.columns == 0 && status.rows == 0 && status.state == SharedResultsState::Writing);
+
+	CHECK(writer->SetColumns({ "eval", "blue", "orange" }, 10, error));
+	auto rows = Rows(0, 10, 3);
+	CHECK(writer->AppendRows(rows.data(), 10, error));
+	writer->Finish(true);
+
+	CHECK(reader->ReadStatus(status, error));
+	CHECK(status.columns == 3 && status.rows == 10 && status.totalRows == 10);
+	CHECK(status.state == SharedResultsState::Complete);
+
+	std::vector<float> copied;
+	reader->CopyRows(status, 4, copied);
+	CHECK(copied == Rows(4, 6, 3));
+}
+
+// The plugin polls while the applet writes: every snapshot it takes is consistent, rows only
+// grow, and each row it copies holds what was written
+static void ReadsWhileRowsAreWritten()
+{
+	constexpr uint32_t kColumns = 4, kRows = 20000, kBatch = 37;
+	std::string error;
+	auto reader = SharedResultsReader::Create(kRows, error);
+	CHECK(reader);
+	if (!reader)
+		return;
+	auto writer = SharedResultsWriter::Open(reader->Name(), error);
+	CHECK(writer);
+	if (!writer)
+		return;
+
+	// halfway through, the producer waits (up to 5 s) for the reader to have seen a partial count
+	std::atomic<bool> writerOk{ true };
+	std::atomic<bool> sawPartial{ false };
+	std::thread producer([&]() {
+		std::string writeError;
+		if (!writer->SetColumns({ "a", "b", "c", "d" }, kRows, writeError))
+			writerOk = false;
+		for (uint32_t r = 0; r < kRows; r += kBatch)
+		{
+			if (r >= kRows / 2 && r < kRows / 2 + kBatch)
+			{
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+				while (!sawPartial && std::chrono::steady_clock::now() < deadline)
+					std::this_thread::yield();
+			}
+			uint32_t count = (std::min)(kBatch, kRows - r);
+			auto rows = Rows(r, count, kColumns);
+			if (!writer->AppendRows(rows.data(), count, writeError))
+				writerOk = false;
+		}
+		writer->Finish(true);
+		});
+
+	std::vector<float> copied;
+	uint32_t seen = 0;
+	bool consistent = true;
+	while (true)
+	{
+		SharedResultsReader::Status status;
+		if (!reader->ReadStatus(status, error))
+		{
+			consistent = false;
+			break;
+		}
+		if (status.rows < seen || (status.rows > 0 && status.columns != kColumns))
+			consistent = false;
+		if (status.rows > seen)
+		{
+			reader->CopyRows(status, seen, copied);
+			seen = status.rows;
+		}
+		if (seen > 0 && seen < kRows)
+			sawPartial = true;
+		if (status.state != SharedResultsState::Writing)
+			break;
+	}
+	producer.join();
+
+	CHECK(writerOk);
+	CHECK(consistent);
+	CHECK(sawPartial);
+	CHECK(seen == kRows);
+	CHECK(copied == Rows(0, kRows, kColumns));
+}
+
+static void RowsPastCapacityAreRefused()
+{
+	std::string error;
+	auto reader = SharedResultsReader::Create(8, error);
+	CHECK(reader);
+	if (!reader)
+		return;
+	auto writer = SharedResultsWriter::Open(reader->Name(), error);
+	CHECK(writer);
+	if (!writer)
+		return;
+
+	auto rows = Rows(0, 9, 2);
+	CHECK(!writer->AppendRows(rows.data(), 1, error));   // no columns yet
+	CHECK(writer->SetColumns({ "x", "y" }, 0, error));
+	CHECK(writer->AppendRows(rows.data(), 6, error));
+	CHECK(!writer->AppendRows(rows.data(), 3, error));   // 9 > 8
+	CHECK(!error.empty());
+	CHECK(writer->AppendRows(rows.data() + 12, 2, error));   // exactly full
+
+	SharedResultsReader::Status status;
+	CHECK(reader->ReadStatus(status, error));
+	CHECK(status.rows == 8);
+	std::vector<float> copied;
+	reader->CopyRows(status, 0, copied);
+	CHECK(copied == Rows(0, 8, 2));
+
+	CHECK(!writer->SetColumns({}, 0, error));
+	CHECK(!writer->SetColumns(std::vector<std::string>(kSharedResultsMaxColumns + 1, "c"), 0, error));
+}
+
+static void FailureCarriesItsMessage()
+{
+	std::string error;
+	auto reader = SharedResultsReader::Create(16, error);
+	CHECK(reader);
+	if (!reader)
+		return;
+	auto writer = SharedResultsWriter::Open(reader->Name(), error);
+	CHECK(writer);
+	if (!writer)
+		return;
+
+	CHECK(writer->SetColumns({ "eval" }, 16, error));
+	auto rows = Rows(0, 3, 1);
+	CHECK(writer->AppendRows(rows.data(), 3, error));
+	// longer than the header's message field, which keeps a terminator
+	writer->Finish(false, "model ran out of memory " + std::string(200, '!'));
+
+	SharedResultsReader::Status status;
+	CHECK(reader->ReadStatus(status, error));
+	CHECK(status.state == SharedResultsState::Failed);
+	CHECK(status.rows == 3);
+	CHECK(status.message.rfind("model ran out of memory", 0) == 0);
+	CHECK(status.message.size() == sizeof(SharedResultsHeader::message) - 1);
+}
+
+// The plugin owns the name: once its reader is gone, no producer can open the segment
+static void ClosingTheReaderUnlinksTheSegment()
+{
+	std::string error;
+	auto reader = SharedResultsReader::Create(4, error);
+	CHECK(reader);
+	if (!reader)
+		return;
+	const std::string name = reader->Name();
+
+	auto writer = SharedResultsWriter::Open(name, error);
+	CHECK(writer);
+	writer.reset();
+	reader.reset();
+
+	error.clear();
+	CHECK(!SharedResultsWriter::Open(name, error));
+	CHECK(!error.empty());
+}
+
+static void OpenRejectsOtherSegments()
+{
+	std::string error;
+	auto memory = CreateSharedMemory(MakeSharedMemoryName("test"), 4096, error);
+	CHECK(memory);
+	if (!memory)
+		return;
+	CHECK(!SharedResultsWriter::Open(memory->Name(), error));
+	CHECK(error == "not a shared results segment");
+}
+
+int main()
+{
+	RUN_TEST(WritesAreReadBack);
+	RUN_TEST(ReadsWhileRowsAreWritten);
+	RUN_TEST(RowsPastCapacityAreRefused);
+	RUN_TEST(FailureCarriesItsMessage);
+	RUN_TEST(ClosingTheReaderUnlinksTheSegment);
+	RUN_TEST(OpenRejectsOtherSegments);
+	return CheckFailures() == 0 ? 0 : 1;
+}
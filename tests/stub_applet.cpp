@@ -0,0 +1,109 @@
+// Scripted stand-in for `<model>_applet.exe --serve`, for appletserver_test. It speaks the
+// resident applet line protocol (appletserver.h); the replay file name picks its behaviour:
+//   crash.replay        exits without answering
+//   crash-once.replay   exits without answering unless <replay>.crashed exists, which it creates
+//   error.replay        answers ERROR
+//   hang.replay         never answers
+//   mute.replay         succeeds, then stops answering PING
+//   anything else       reports progress, writes the analysis file and answers DONE
+// Each start appends a line to the file named by STUB_APPLET_LOG, if set.
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+static std::vector<std::string> SplitTabs(const std::string& line)
+{
+	std::vector<std::string> fields;
+	size_t start = 0;
+	while (start <= line.size())
+	{
+		size_t tab = line.find('\t', start);
+		if (tab == std::string::npos) tab = line.size();
+		fields.push_back(line.substr(start, tab - start));
+		start = tab + 1;
+	}
+	return fields;
+}
+
+static void Reply(const std::string& line)
+{
+	std::cout << line << "\n" << std::flush;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || std::string(argv[1]) != "--serve")
+	{
+		std::cerr << "stub_applet: only --serve is supported\n";
+		return 2;
+	}
+
+	if (const char* log = std::getenv("STUB_APPLET_LOG"))
+		std::ofstream(log, std::ios::app) << "start " << getpid() << "\n";
+
+	bool muted = false;
+	std::string line;
+	while (std::getline(std::cin, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		auto fields = SplitTabs(line);
+		const std::string& verb = fields[0];
+
+		if (verb == "QUIT")
+			return 0;
+		if (fields.size() < 2)
+			continue;
+		const std::string& id = fields[1];
+
+		if (verb == "PING")
+		{
+			if (!muted)
+				Reply("PONG\t" + id);
+			continue;
+		}
+		if (verb != "ANALYZE" || fields.size() < 4)
+			continue;
+
+		const std::filesystem::path replay = fields[2];
+		const std::string name = replay.filename().string();
+		if (name == "crash.replay")
+			return 3;
+		if (name == "crash-once.replay")
+		{
+			std::filesystem::path marker = replay;
+			marker += ".crashed";
+			if (!std::filesystem::exists(marker))
+			{
+				std::ofstream(marker) << "crashed\n";
+				return 3;
+			}
+		}
+		if (name == "error.replay")
+		{
+			Reply("ERROR\t" + id + "\tbad replay");
+			continue;
+		}
+		if (name == "hang.replay")
+			continue;
+		if (name == "mute.replay")
+			muted = true;
+
+		Reply("PROGRESS\t" + id + "\t50\t100");
+		std::ofstream(fields[3]) << "0.5,0.5,0.1\n";
+		Reply("PROGRESS\t" + id + "\t100\t100");
+		Reply("DONE\t" + id);
+	}
+	return 0;
+}
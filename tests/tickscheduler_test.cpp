@@ -0,0 +1,143 @@
+// TickScheduler budgeting against a fake clock: tasks advance the clock by their cost instead of
+// taking real time.
+#include "pch.h"
+#include "tickscheduler.h"
+#include "check.h"
+
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+struct FakeClock
+{
+	std::int64_t now = 0;
+	TickScheduler::Clock Fn() { return [this]() { return now; }; }
+};
+
+// A task that costs costNs every slice and yields until it has run `slices` times
+static TickScheduler::Task CostlyTask(FakeClock& clock, std::int64_t costNs, int slices, int& ran)
+{
+	return [&clock, costNs, slices, &ran]() {
+		clock.now += costNs;
+		return ++ran < slices ? TaskStatus::Yield : TaskStatus::Done;
+	};
+}
+
+static void RunsInPriorityOrder()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	std::vector<std::string> order;
+
+	scheduler.Post("low", [&]() { order.push_back("low"); }, TaskPriority::Low);
+	scheduler.Post("normal", [&]() { order.push_back("normal"); });
+	scheduler.Post("high", [&]() { order.push_back("high"); }, TaskPriority::High);
+
+	CHECK(scheduler.RunTick() == 3);
+	CHECK((order == std::vector<std::string>{ "high", "normal", "low" }));
+	CHECK(scheduler.Pending() == 0);
+}
+
+static void DefersSlicesPastTheBudget()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	scheduler.SetBudget(1000ns);
+
+	int ranA = 0, ranB = 0, ranC = 0;
+	scheduler.PostSliced("a", CostlyTask(clock, 400, 100, ranA));
+	scheduler.PostSliced("b", CostlyTask(clock, 400, 100, ranB));
+	scheduler.PostSliced("c", CostlyTask(clock, 400, 100, ranC));
+
+	// first tick: costs are unknown, so all three run
+	CHECK(scheduler.RunTick() == 3);
+
+	// now measured at 400ns each: two fit in 1000ns, the third is deferred
+	CHECK(scheduler.RunTick() == 2);
+	CHECK(scheduler.GetTickStats().deferredSlices == 1);
+	CHECK(ranA + ranB + ranC == 5);
+}
+
+static void FirstSliceAlwaysRuns()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	scheduler.SetBudget(100ns);
+
+	int ran = 0;
+	scheduler.PostSliced("huge", CostlyTask(clock, 5000, 3, ran));
+
+	for (int tick = 0; tick < 3; ++tick)
+		CHECK(scheduler.RunTick() == 1);
+	CHECK(ran == 3);
+	CHECK(scheduler.Pending() == 0);
+	CHECK(scheduler.GetTickStats().overBudgetTicks == 3);
+}
+
+// A slice that never fits behind cheaper, higher-priority work used to be deferred forever
+static void DeferredSliceIsNotStarved()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	scheduler.SetBudget(500ns);
+
+	int ranHigh = 0, ranBig = 0;
+	scheduler.PostSliced("high", CostlyTask(clock, 200, 1000, ranHigh), TaskPriority::High);
+	scheduler.PostSliced("big", CostlyTask(clock, 400, 1000, ranBig));
+
+	const int ticks = 20;
+	for (int tick = 0; tick < ticks; ++tick)
+		scheduler.RunTick();
+
+	// the big slice runs first on every tick after it was deferred
+	CHECK(ranBig >= ticks / 2);
+	CHECK(ranHigh >= ticks / 2);
+}
+
+static void DeferredSliceRunsOncePerTick()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	scheduler.SetBudget(500ns);
+
+	int ranHigh = 0, ranBig = 0;
+	scheduler.PostSliced("high", CostlyTask(clock, 200, 1000, ranHigh), TaskPriority::High);
+	scheduler.PostSliced("big", CostlyTask(clock, 400, 1000, ranBig));
+	scheduler.RunTick(); // both measured
+	scheduler.RunTick(); // big deferred
+
+	// the overdue slice runs first; after yielding it waits for the next tick
+	int before = ranBig;
+	scheduler.RunTick();
+	CHECK(ranBig == before + 1);
+}
+
+static void ClearDropsDeferredWork()
+{
+	FakeClock clock;
+	TickScheduler scheduler(clock.Fn());
+	scheduler.SetBudget(500ns);
+
+	int ranA = 0, ranB = 0;
+	scheduler.PostSliced("a", CostlyTask(clock, 400, 100, ranA));
+	scheduler.PostSliced("b", CostlyTask(clock, 400, 100, ranB));
+	scheduler.RunTick();
+	scheduler.RunTick();
+	CHECK(scheduler.Pending() == 2);
+
+	scheduler.Clear();
+	CHECK(scheduler.Pending() == 0);
+	CHECK(scheduler.RunTick() == 0);
+}
+
+int main()
+{
+	RUN_TEST(RunsInPriorityOrder);
+	RUN_TEST(DefersSlicesPastTheBudget);
+	RUN_TEST(FirstSliceAlwaysRuns);
+	RUN_TEST(DeferredSliceIsNotStarved);
+	RUN_TEST(DeferredSliceRunsOncePerTick);
+	RUN_TEST(ClearDropsDeferredWork);
+	return CheckFailures() == 0 ? 0 : 1;
+}